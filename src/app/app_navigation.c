@@ -11,6 +11,7 @@
 
 #include "files.h"
 #include "globals.h"
+#include "listing_cache.h"
 #include "main.h"
 #include "search.h"
 #include "ui.h"
@@ -24,6 +25,22 @@ void navigation_clear_stack(VecStack *stack) {
     }
 }
 
+// Moves the listing from `old_path` to `new_path`. The listing being left goes
+// into the listing cache, and a cached listing of `new_path` is reused while it
+// is still valid, cursor and scroll included. Otherwise `new_path` is loaded
+// lazily with the cursor at the top. Returns true on a cache hit.
+static bool switch_listing(AppState *state, Vector *files, const char *old_path, const char *new_path) {
+    CursorAndSlice *cas = &state->dir_window_cas;
+    listing_cache_store(state->listing_cache, old_path, files, &state->lazy_load, cas);
+    if (listing_cache_restore(state->listing_cache, new_path, files, &state->lazy_load, cas)) {
+        return true;
+    }
+    reload_directory_lazy(files, new_path, &state->lazy_load);
+    cas->cursor = 0;
+    cas->start = 0;
+    return false;
+}
+
 void navigate_up(CursorAndSlice *cas,
                  Vector *files,
                  const char **selected_entry,
@@ -34,8 +51,7 @@ void navigate_up(CursorAndSlice *cas,
     if (cas->num_files > 0) {
         if (cas->cursor == 0) {
             if (lazy_load && current_directory) {
-                load_more_files_if_needed(files, current_directory, cas,
-                                          &lazy_load->files_loaded, lazy_load->total_files);
+                load_more_files_if_needed(files, current_directory, cas, lazy_load);
                 cas->num_files = Vector_len(*files);
             }
 
@@ -88,8 +104,7 @@ void navigate_down(CursorAndSlice *cas,
         fix_cursor(cas);
 
         if (lazy_load && current_directory) {
-            load_more_files_if_needed(files, current_directory, cas,
-                                      &lazy_load->files_loaded, lazy_load->total_files);
+            load_more_files_if_needed(files, current_directory, cas, lazy_load);
             cas->num_files = Vector_len(*files);
         }
 
@@ -108,49 +123,52 @@ void navigate_left(char **current_directory,
 
     search_clear(state);
 
-    char *popped_dir = dir_stack ? VecStack_pop(dir_stack) : NULL;
-
-    if (strcmp(*current_directory, "/") != 0) {
-        char *last_slash = strrchr(*current_directory, '/');
-        if (last_slash != NULL) {
-            *last_slash = '\0';
-            if (state->lazy_load.directory_path) {
-                free(state->lazy_load.directory_path);
-            }
-            state->lazy_load.directory_path = strdup(*current_directory);
-            reload_directory_lazy(files, *current_directory,
-                                  &state->lazy_load.files_loaded, &state->lazy_load.total_files);
+    // The history entry names the directory being left, which is also the
+    // last component of the current path; the latter works without history.
+    free(dir_stack ? VecStack_pop(dir_stack) : NULL);
+
+    bool restored = false;
+    char came_from[MAX_PATH_LENGTH] = "";
+    char *last_slash = strrchr(*current_directory, '/');
+    if (strcmp(*current_directory, "/") != 0 && last_slash != NULL) {
+        char old_path[MAX_PATH_LENGTH];
+        strncpy(old_path, *current_directory, sizeof(old_path) - 1);
+        old_path[sizeof(old_path) - 1] = '\0';
+        strncpy(came_from, last_slash + 1, sizeof(came_from) - 1);
+
+        *last_slash = '\0';
+        if ((*current_directory)[0] == '\0') {
+            strcpy(*current_directory, "/");
         }
-    }
-
-    if ((*current_directory)[0] == '\0') {
-        strcpy(*current_directory, "/");
         if (state->lazy_load.directory_path) {
             free(state->lazy_load.directory_path);
         }
         state->lazy_load.directory_path = strdup(*current_directory);
-        reload_directory_lazy(files, *current_directory,
-                              &state->lazy_load.files_loaded, &state->lazy_load.total_files);
+        restored = switch_listing(state, files, old_path, *current_directory);
     }
 
-    if (popped_dir) {
-        SIZE idx = find_index_by_name_lazy(files, *current_directory, dir_window_cas,
-                                           &state->lazy_load, popped_dir);
+    dir_window_cas->num_lines = LINES - 6;
+    dir_window_cas->num_files = Vector_len(*files);
+
+    // Put the cursor back on the directory we came from. A cached listing
+    // normally has it there already; a fresh one may need more batches.
+    if (came_from[0]) {
+        SIZE idx = restored ? find_loaded_index_by_name(files, came_from)
+                            : find_index_by_name_lazy(files, *current_directory, dir_window_cas,
+                                                      &state->lazy_load, came_from);
+        dir_window_cas->num_files = Vector_len(*files);
         if (idx != (SIZE)-1) {
+            if (!restored) dir_window_cas->start = 0;
             dir_window_cas->cursor = idx;
-        } else {
+        } else if (!restored) {
             dir_window_cas->cursor = 0;
+            dir_window_cas->start = 0;
         }
-        free(popped_dir);
     }
-
-    dir_window_cas->cursor = 0;
-    dir_window_cas->start = 0;
-    dir_window_cas->num_lines = LINES - 6;
-    dir_window_cas->num_files = Vector_len(*files);
+    fix_cursor(dir_window_cas);
 
     if (dir_window_cas->num_files > 0) {
-        state->selected_entry = FileAttr_get_name(files->el[0]);
+        state->selected_entry = FileAttr_get_name(files->el[dir_window_cas->cursor]);
     } else {
         state->selected_entry = "";
     }
@@ -186,6 +204,9 @@ void navigate_right(AppState *state,
 
     char new_path[MAX_PATH_LENGTH];
     path_join(new_path, *current_directory, selected_entry);
+    char old_path[MAX_PATH_LENGTH];
+    strncpy(old_path, *current_directory, sizeof(old_path) - 1);
+    old_path[sizeof(old_path) - 1] = '\0';
 
     if (strcmp(new_path, *current_directory) == 0) {
         werase(notifwin);
@@ -224,24 +245,18 @@ void navigate_right(AppState *state,
     state->lazy_load.directory_path = strdup(*current_directory);
     state->lazy_load.last_load_time = (struct timespec){0};
 
-    reload_directory_lazy(&state->files, *current_directory,
-                          &state->lazy_load.files_loaded, &state->lazy_load.total_files);
+    switch_listing(state, &state->files, old_path, *current_directory);
 
-    dir_window_cas->cursor = 0;
-    dir_window_cas->start = 0;
     dir_window_cas->num_lines = LINES - 6;
     dir_window_cas->num_files = Vector_len(state->files);
+    fix_cursor(dir_window_cas);
 
     if (dir_window_cas->num_files > 0) {
-        state->selected_entry = FileAttr_get_name(state->files.el[0]);
+        state->selected_entry = FileAttr_get_name(state->files.el[dir_window_cas->cursor]);
     } else {
         state->selected_entry = "";
     }
 
-    if (dir_window_cas->num_files == 1) {
-        state->selected_entry = FileAttr_get_name(state->files.el[0]);
-    }
-
     werase(notifwin);
     show_notification(notifwin, "Entered directory: %s", state->selected_entry);
     should_clear_notif = false;
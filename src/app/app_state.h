@@ -5,18 +5,27 @@
 #include <time.h>
 
 #include "browser_ui.h" // CursorAndSlice
+#include "files.h"      // DirCursor
 #include "globals.h"    // MAX_PATH_LENGTH
+#include "listing_sort.h" // SortIndex
 #include "undo.h"       // UndoState
 #include "vector.h"
 
 typedef struct PluginManager PluginManager;
 
-typedef struct {
+typedef struct LazyLoadState {
     char *directory_path;
     size_t files_loaded;
     size_t total_files; // (size_t)-1 if unknown
     bool is_loading;
     struct timespec last_load_time;
+    DirCursor cursor;   // readdir position for the next batch
+    struct DirLoader *loader; // background enumeration, NULL when idle
+    Arena arena;        // backs the FileAttr records and names of `files`
+    SortIndex sort;     // listing order; `files` is kept sorted by it
+    struct DirWatch *watch; // inotify on the listed directory, NULL if unavailable
+    struct timespec last_watch_time; // last watcher batch applied
+    size_t dead_entries; // arena entries dropped since the last reload
 } LazyLoadState;
 
 typedef struct {
@@ -29,6 +38,8 @@ typedef struct {
     bool preview_override_active;
     char preview_override_path[MAX_PATH_LENGTH];
     LazyLoadState lazy_load;
+    struct ListingCache *listing_cache; // recently left listings, NULL if disabled
+    struct ListingPrefetch *prefetch;   // idle-time reads into listing_cache
     bool search_active;
     char search_query[MAX_PATH_LENGTH];
     int search_mode;
@@ -11,17 +11,21 @@
 #include <unistd.h>
 
 #include "browser_ui.h"
+#include "frame_sched.h"
 #include "globals.h"
 #include "main.h"
 #include "search.h"
 
-void redraw_all_windows(AppState *state) {
+// Recreates the windows for the current terminal size. Returns false (and
+// leaves everything alone) when they already match it.
+static bool layout_windows(void) {
+    static bool laid_out = false;
     struct winsize w;
     ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
-    resize_term(w.ws_row, w.ws_col);
+    if (laid_out && w.ws_row == LINES && w.ws_col == COLS) return false;
+    laid_out = true;
 
-    endwin();
-    refresh();
+    resize_term(w.ws_row, w.ws_col);
     clear();
 
     int new_cols = MAX(COLS, 40);
@@ -60,11 +64,23 @@ void redraw_all_windows(AppState *state) {
 
     notifwin = newwin(notif_height, new_cols, new_lines - notif_height, 0);
     box(notifwin, 0, 0);
+    return true;
+}
+
+void redraw_all_windows(AppState *state) {
+    // Only a real size change tears the windows down; otherwise they are
+    // redrawn in place and the terminal gets just what differs.
+    if (!layout_windows()) {
+        touchwin(bannerwin);
+        touchwin(mainwin);
+        touchwin(notifwin);
+    }
+    invalidate_directory_window();
 
+    int inner_height = getmaxy(dirwin);
     state->dir_window_cas.num_lines = inner_height;
     sync_selection_from_active(state, &state->dir_window_cas);
 
-    box(dirwin, 0, 0);
     box(previewwin, 0, 0);
 
     draw_directory_window(
@@ -131,4 +147,5 @@ void redraw_frame_after_edit(AppState *state,
 void handle_winch(int sig) {
     (void)sig;
     resized = 1;
+    frame_sched_wake();
 }
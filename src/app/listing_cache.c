@@ -0,0 +1,283 @@
+// File: listing_cache.c
+// LRU of recently visited directory listings
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "listing_cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "arena.h"
+#include "dir_watch.h"
+#include "files.h"
+#include "globals.h"
+#include "listing_sort.h"
+#include "utils.h"
+
+// Directory timestamps are coarse (a clock tick, whole seconds on some
+// filesystems), so a change right after the listing was read may leave the
+// mtime as it was. Without a watcher only an mtime this old is trusted.
+#define MTIME_SETTLE_SEC 2
+
+typedef struct {
+    char *path;
+    Vector files;
+    Arena arena;
+    SortIndex sort;
+    struct DirWatch *watch; // NULL: revalidate by mtime instead
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    bool mtime_settled; // the mtime was old enough when the snapshot was taken
+    size_t dead_entries;
+    SIZE cursor;
+    SIZE start;
+    size_t bytes;
+} ListingSnapshot;
+
+struct ListingCache {
+    ListingSnapshot *entries; // most recently used first
+    size_t count;
+    size_t max_entries;
+    size_t bytes;
+    size_t max_bytes;
+};
+
+static void snapshot_free(ListingSnapshot *snap) {
+    for (size_t i = 0; i < Vector_len(snap->files); i++) {
+        free_attr((FileAttr)snap->files.el[i]);
+    }
+    free(snap->files.el);
+    Arena_bye(&snap->arena);
+    sort_index_free(&snap->sort);
+    dir_watch_close(snap->watch);
+    free(snap->path);
+}
+
+// Removes entry `i` without freeing what it owns.
+static void cache_unlink(ListingCache *cache, size_t i) {
+    cache->bytes -= cache->entries[i].bytes;
+    memmove(&cache->entries[i], &cache->entries[i + 1],
+            (cache->count - i - 1) * sizeof(cache->entries[0]));
+    cache->count--;
+}
+
+static void cache_evict(ListingCache *cache, size_t i) {
+    snapshot_free(&cache->entries[i]);
+    cache_unlink(cache, i);
+}
+
+static size_t cache_find(const ListingCache *cache, const char *path) {
+    for (size_t i = 0; i < cache->count; i++) {
+        if (strcmp(cache->entries[i].path, path) == 0) return i;
+    }
+    return (size_t)-1;
+}
+
+static bool same_mtime(const struct timespec *a, const struct timespec *b) {
+    return a->tv_sec == b->tv_sec && a->tv_nsec == b->tv_nsec;
+}
+
+static bool mtime_settled(const struct timespec *mtime) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec - mtime->tv_sec > MTIME_SETTLE_SEC;
+}
+
+// A snapshot is good while its watcher has kept up, or, without a watcher,
+// while the directory has not been modified since it was listed.
+static bool snapshot_valid(ListingSnapshot *snap) {
+    if (snap->watch) {
+        dir_watch_poll(snap->watch);
+        return !dir_watch_overflowed(snap->watch);
+    }
+    struct stat st;
+    return snap->mtime_settled && stat(snap->path, &st) == 0 && st.st_dev == snap->dev &&
+           st.st_ino == snap->ino && same_mtime(&st.st_mtim, &snap->mtime);
+}
+
+ListingCache *listing_cache_new(size_t max_entries, size_t max_bytes) {
+    ListingCache *cache = calloc(1, sizeof(*cache));
+    if (!cache) return NULL;
+    cache->entries = calloc(max_entries ? max_entries : 1, sizeof(*cache->entries));
+    if (!cache->entries) {
+        free(cache);
+        return NULL;
+    }
+    cache->max_entries = max_entries ? max_entries : 1;
+    cache->max_bytes = max_bytes;
+    return cache;
+}
+
+void listing_cache_free(ListingCache *cache) {
+    if (!cache) return;
+    while (cache->count > 0) {
+        cache_evict(cache, cache->count - 1);
+    }
+    free(cache->entries);
+    free(cache);
+}
+
+static size_t snapshot_bytes(const Vector *files, const Arena *arena, const SortIndex *sort) {
+    return sizeof(ListingSnapshot) + Vector_len(*files) * sizeof(void *) + Arena_size(arena) +
+           2 * sort->cap * sizeof(KeySortRec);
+}
+
+// Makes room for `snap` and puts it in front. Returns false if it can never
+// fit; the caller keeps ownership then.
+static bool cache_insert(ListingCache *cache, ListingSnapshot *snap) {
+    if (snap->bytes > cache->max_bytes) return false;
+
+    size_t old = cache_find(cache, snap->path);
+    if (old != (size_t)-1) cache_evict(cache, old);
+    while (cache->count > 0 &&
+           (cache->count >= cache->max_entries || cache->bytes + snap->bytes > cache->max_bytes)) {
+        cache_evict(cache, cache->count - 1);
+    }
+
+    memmove(&cache->entries[1], &cache->entries[0], cache->count * sizeof(cache->entries[0]));
+    cache->entries[0] = *snap;
+    cache->count++;
+    cache->bytes += snap->bytes;
+    return true;
+}
+
+void listing_cache_store(ListingCache *cache, const char *path, Vector *files,
+                         LazyLoadState *lazy_load, const CursorAndSlice *cas) {
+    bool complete = !lazy_load->loader && lazy_load->files_loaded >= lazy_load->total_files;
+    struct stat st;
+    if (!cache || !path || !complete || Vector_len(*files) == 0 || stat(path, &st) != 0) {
+        release_listing(files, lazy_load);
+        return;
+    }
+
+    Vector fresh = Vector_new(10);
+    ListingSnapshot snap = {
+        .path = strdup(path),
+        .files = *files,
+        .arena = lazy_load->arena,
+        .sort = lazy_load->sort,
+        .watch = lazy_load->watch,
+        .dev = st.st_dev,
+        .ino = st.st_ino,
+        .mtime = st.st_mtim,
+        .mtime_settled = mtime_settled(&st.st_mtim),
+        .dead_entries = lazy_load->dead_entries,
+        .cursor = cas ? cas->cursor : 0,
+        .start = cas ? cas->start : 0,
+        .bytes = snapshot_bytes(files, &lazy_load->arena, &lazy_load->sort),
+    };
+    if (!snap.path || !fresh.el || !cache_insert(cache, &snap)) {
+        free(snap.path);
+        free(fresh.el);
+        release_listing(files, lazy_load);
+        return;
+    }
+
+    // The live side starts over with empty buffers and its own watcher, if
+    // inotify gave it one before.
+    *files = fresh;
+    lazy_load->arena = Arena_new(LISTING_ARENA_CHUNK);
+    sort_index_init(&lazy_load->sort, lazy_load->sort.mode, lazy_load->sort.dirs_first);
+    lazy_load->watch = snap.watch ? dir_watch_open() : NULL;
+    lazy_load->dead_entries = 0;
+    lazy_load->files_loaded = 0;
+    lazy_load->total_files = 0;
+}
+
+bool listing_cache_put(ListingCache *cache, const char *path, Vector *files, Arena *arena,
+                       SortIndex *sort, struct DirWatch *watch) {
+    struct stat st;
+    ListingSnapshot snap = {
+        .path = strdup(path),
+        .files = *files,
+        .arena = *arena,
+        .sort = *sort,
+        .watch = watch,
+        .bytes = snapshot_bytes(files, arena, sort),
+    };
+    if (!snap.path || stat(path, &st) != 0) {
+        free(snap.path);
+        return false;
+    }
+    snap.dev = st.st_dev;
+    snap.ino = st.st_ino;
+    snap.mtime = st.st_mtim;
+    snap.mtime_settled = mtime_settled(&st.st_mtim);
+    if (!cache_insert(cache, &snap)) {
+        free(snap.path);
+        return false;
+    }
+    *files = (Vector){0};
+    *arena = Arena_new(LISTING_ARENA_CHUNK);
+    sort_index_init(sort, sort->mode, sort->dirs_first);
+    return true;
+}
+
+bool listing_cache_contains(const ListingCache *cache, const char *path) {
+    return cache && path && cache_find(cache, path) != (size_t)-1;
+}
+
+bool listing_cache_restore(ListingCache *cache, const char *path, Vector *files,
+                           LazyLoadState *lazy_load, CursorAndSlice *cas) {
+    if (!cache || !path) return false;
+    size_t i = cache_find(cache, path);
+    if (i == (size_t)-1) return false;
+    if (!snapshot_valid(&cache->entries[i])) {
+        cache_evict(cache, i);
+        return false;
+    }
+    ListingSnapshot snap = cache->entries[i];
+    cache_unlink(cache, i);
+
+    // Free the live listing for good; the snapshot brings its own buffers.
+    SortMode mode = lazy_load->sort.mode;
+    bool dirs_first = lazy_load->sort.dirs_first;
+    release_listing(files, lazy_load);
+    free(files->el);
+    Arena_bye(&lazy_load->arena);
+    sort_index_free(&lazy_load->sort);
+    if (snap.watch) {
+        dir_watch_close(lazy_load->watch);
+        lazy_load->watch = snap.watch;
+    } else if (lazy_load->watch) {
+        dir_watch_set(lazy_load->watch, path);
+    }
+
+    *files = snap.files;
+    lazy_load->arena = snap.arena;
+    lazy_load->sort = snap.sort;
+    lazy_load->dead_entries = snap.dead_entries;
+    lazy_load->files_loaded = Vector_len(*files);
+    lazy_load->total_files = lazy_load->files_loaded;
+    free(snap.path);
+
+    // The order may have been changed while the listing was cached.
+    if (sort_index_set_order(&lazy_load->sort, mode, dirs_first)) {
+        sort_index_build(&lazy_load->sort, files, path);
+    }
+
+    if (cas) {
+        cas->num_files = (SIZE)Vector_len(*files);
+        cas->cursor = snap.cursor;
+        cas->start = snap.start;
+        if (cas->cursor >= cas->num_files) cas->cursor = cas->num_files - 1;
+        if (cas->cursor < 0) cas->cursor = 0;
+        if (cas->start > cas->cursor) cas->start = cas->cursor;
+    }
+    return true;
+}
+
+void listing_cache_poll(ListingCache *cache) {
+    if (!cache) return;
+    for (size_t i = cache->count; i-- > 0;) {
+        ListingSnapshot *snap = &cache->entries[i];
+        if (!snap->watch) continue;
+        dir_watch_poll(snap->watch);
+        if (dir_watch_overflowed(snap->watch)) cache_evict(cache, i);
+    }
+}
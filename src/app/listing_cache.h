@@ -0,0 +1,51 @@
+#ifndef LISTING_CACHE_H
+#define LISTING_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "app_state.h" // LazyLoadState, CursorAndSlice
+#include "vector.h"
+
+// Recently visited directory listings, kept whole for instant back/forward.
+//
+// A snapshot owns everything the live listing owned: the entries and their
+// arena, the sort index, and the directory watcher, which keeps collecting
+// changes while the listing sits in the cache. Restoring a snapshot swaps it
+// back in and leaves those changes pending, so the regular watcher path
+// applies them as deltas. Without inotify a snapshot is only reused while the
+// directory's mtime is unchanged, and only if that mtime was already a few
+// seconds old when the listing was cached.
+//
+// Bounded by entry count and by memory; least recently used snapshots go first.
+typedef struct ListingCache ListingCache;
+
+ListingCache *listing_cache_new(size_t max_entries, size_t max_bytes);
+void listing_cache_free(ListingCache *cache);
+
+// Takes the live listing of `path` into the cache when it is fully loaded,
+// along with the cursor and scroll position of `cas`. `files` and
+// `lazy_load` are left empty either way, ready for the next directory.
+void listing_cache_store(ListingCache *cache, const char *path, Vector *files,
+                         LazyLoadState *lazy_load, const CursorAndSlice *cas);
+
+// Adds a listing built elsewhere (e.g. prefetched) with the cursor at the
+// top. On success the cache owns the entries, arena, sort index and watcher
+// (which should have been armed before the directory was read); `files`,
+// `arena` and `sort` are left empty. On failure nothing changes hands.
+bool listing_cache_put(ListingCache *cache, const char *path, Vector *files, Arena *arena,
+                       SortIndex *sort, struct DirWatch *watch);
+
+bool listing_cache_contains(const ListingCache *cache, const char *path);
+
+// Makes the cached listing of `path` the live one if it is still valid,
+// restoring cursor and scroll into `cas`. The current live listing is freed.
+// Returns false (and changes nothing) on a miss.
+bool listing_cache_restore(ListingCache *cache, const char *path, Vector *files,
+                           LazyLoadState *lazy_load, CursorAndSlice *cas);
+
+// Drains the watchers of cached listings so their kernel queues never fill
+// up, and evicts listings that lost track of their directory.
+void listing_cache_poll(ListingCache *cache);
+
+#endif // LISTING_CACHE_H
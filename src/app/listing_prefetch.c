@@ -0,0 +1,177 @@
+// File: listing_prefetch.c
+// Idle-time background enumeration into the listing cache
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "listing_prefetch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "dir_loader.h"
+#include "dir_size.h"
+#include "dir_watch.h"
+#include "files.h"
+#include "globals.h"
+#include "listing_cache.h"
+#include "listing_sort.h"
+#include "search.h"
+#include "utils.h"
+
+// Larger directories are left to the regular lazy loader; prefetching them
+// would mostly churn the listing cache.
+#define PREFETCH_MAX_ENTRIES 50000
+
+struct ListingPrefetch {
+    char path[MAX_PATH_LENGTH]; // directory being read, valid while `loader` is set
+    char last[MAX_PATH_LENGTH]; // last directory a job was started for
+    DirLoader *loader;
+    DirWatch *watch;            // armed before reading; handed to the cache
+    Vector files;
+    Arena arena;
+};
+
+// The highlighted directory (if the cursor is on one) and the parent of the
+// current directory, as absolute paths. Empty strings when there is none.
+static void prefetch_candidates(AppState *state, char cursor_dir[MAX_PATH_LENGTH],
+                                char parent_dir[MAX_PATH_LENGTH]) {
+    cursor_dir[0] = '\0';
+    parent_dir[0] = '\0';
+
+    Vector *view = active_files(state);
+    SIZE cursor = state->dir_window_cas.cursor;
+    if (cursor >= 0 && (size_t)cursor < Vector_len(*view)) {
+        FileAttr fa = (FileAttr)view->el[cursor];
+        if (FileAttr_is_dir(fa)) {
+            path_join(cursor_dir, state->current_directory, FileAttr_get_name(fa));
+        }
+    }
+
+    const char *cwd = state->current_directory;
+    const char *slash = strrchr(cwd, '/');
+    if (slash && strcmp(cwd, "/") != 0) {
+        size_t len = (slash == cwd) ? 1 : (size_t)(slash - cwd);
+        if (len < MAX_PATH_LENGTH) {
+            memcpy(parent_dir, cwd, len);
+            parent_dir[len] = '\0';
+        }
+    }
+}
+
+// Drops the current job and everything it read.
+static void prefetch_cancel(ListingPrefetch *pf) {
+    // Drained entries live in the loader's arena: release them first.
+    for (size_t i = 0; i < Vector_len(pf->files); i++) {
+        free_attr((FileAttr)pf->files.el[i]);
+    }
+    if (pf->files.el) Vector_set_len_no_free(&pf->files, 0);
+    if (pf->loader) {
+        dir_loader_cancel(pf->loader);
+        pf->loader = NULL;
+    }
+    Arena_reset(&pf->arena);
+    dir_watch_close(pf->watch);
+    pf->watch = NULL;
+}
+
+static bool prefetch_start(ListingPrefetch *pf, const char *path) {
+    strncpy(pf->last, path, sizeof(pf->last) - 1);
+    pf->last[sizeof(pf->last) - 1] = '\0';
+    if (!pf->files.el) {
+        pf->files = Vector_new(256);
+        if (!pf->files.el) return false;
+    }
+
+    // Watch first, so that changes made while the directory is being read
+    // are pending by the time the listing is restored.
+    pf->watch = dir_watch_open();
+    if (pf->watch && !dir_watch_set(pf->watch, path)) {
+        dir_watch_close(pf->watch);
+        pf->watch = NULL;
+    }
+
+    DirCursor cursor;
+    dir_cursor_init(&cursor);
+    if (dir_cursor_open(&cursor, path)) {
+        // A background loader posts no frames: the listing is off screen, and
+        // the next tick drains whatever it has read by then.
+        pf->loader = dir_loader_start_background(path, &cursor);
+    }
+    dir_cursor_close(&cursor);
+    if (!pf->loader) {
+        prefetch_cancel(pf);
+        return false;
+    }
+    strncpy(pf->path, path, sizeof(pf->path) - 1);
+    pf->path[sizeof(pf->path) - 1] = '\0';
+    return true;
+}
+
+// Sorts the finished listing in the current order and gives it to the cache.
+static void prefetch_finish(ListingPrefetch *pf, AppState *state) {
+    dir_loader_finish(pf->loader, &pf->arena);
+    pf->loader = NULL;
+
+    SortIndex sort;
+    sort_index_init(&sort, state->lazy_load.sort.mode, state->lazy_load.sort.dirs_first);
+    sort_index_build(&sort, &pf->files, pf->path);
+    if (listing_cache_put(state->listing_cache, pf->path, &pf->files, &pf->arena, &sort, pf->watch)) {
+        pf->watch = NULL;
+    } else {
+        prefetch_cancel(pf);
+    }
+    sort_index_free(&sort);
+}
+
+ListingPrefetch *listing_prefetch_new(void) {
+    ListingPrefetch *pf = calloc(1, sizeof(*pf));
+    if (!pf) return NULL;
+    pf->arena = Arena_new(LISTING_ARENA_CHUNK);
+    return pf;
+}
+
+void listing_prefetch_free(ListingPrefetch *pf) {
+    if (!pf) return;
+    prefetch_cancel(pf);
+    free(pf->files.el);
+    Arena_bye(&pf->arena);
+    free(pf);
+}
+
+void listing_prefetch_tick(ListingPrefetch *pf, AppState *state) {
+    if (!pf || !state || !state->listing_cache || !state->current_directory) return;
+
+    char cursor_dir[MAX_PATH_LENGTH];
+    char parent_dir[MAX_PATH_LENGTH];
+    prefetch_candidates(state, cursor_dir, parent_dir);
+
+    if (pf->loader) {
+        bool done = false;
+        dir_loader_drain(pf->loader, &pf->files, &done);
+        bool wanted = strcmp(pf->path, cursor_dir) == 0 || strcmp(pf->path, parent_dir) == 0;
+        if (!wanted || Vector_len(pf->files) > PREFETCH_MAX_ENTRIES) {
+            prefetch_cancel(pf);
+        } else if (done) {
+            prefetch_finish(pf, state);
+        }
+        return;
+    }
+
+    // Same rule as the directory size jobs: nothing speculative while the
+    // user is moving around, and never next to a foreground enumeration.
+    if (!dir_size_can_enqueue() || state->lazy_load.loader) return;
+
+    const char *next = NULL;
+    if (cursor_dir[0] && !listing_cache_contains(state->listing_cache, cursor_dir)) {
+        next = cursor_dir;
+    } else if (parent_dir[0] && !listing_cache_contains(state->listing_cache, parent_dir)) {
+        next = parent_dir;
+    }
+    // A directory that could not be cached (unreadable, too large) is not
+    // retried until something else was attempted in between.
+    if (next && strcmp(next, pf->last) != 0) {
+        prefetch_start(pf, next);
+    }
+}
@@ -0,0 +1,23 @@
+#ifndef LISTING_PREFETCH_H
+#define LISTING_PREFETCH_H
+
+#include "app_state.h"
+
+// Speculative enumeration of the directories the user is likely to open next.
+//
+// While the user is idle (same heuristic as the directory size jobs) and the
+// cursor rests on a directory, that directory is read in the background at
+// idle I/O priority, sorted, and handed to the listing cache, so entering it
+// restores a complete listing at once. The parent directory is prefetched the
+// same way once the highlighted one is done. One job runs at a time; moving
+// the cursor to another directory cancels it.
+typedef struct ListingPrefetch ListingPrefetch;
+
+ListingPrefetch *listing_prefetch_new(void);
+void listing_prefetch_free(ListingPrefetch *prefetch);
+
+// Advances the current job and starts the next one when the user is idle.
+// Call once per main loop tick.
+void listing_prefetch_tick(ListingPrefetch *prefetch, AppState *state);
+
+#endif // LISTING_PREFETCH_H
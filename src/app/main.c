@@ -16,7 +16,6 @@
 #include <signal.h>    // for signal, SIGWINCH
 #include <stdbool.h>   // for bool, true, false
 #include <ctype.h>     // for isspace, toupper
-#include <magic.h>     // For libmagic
 #include <time.h>      // For strftime, clock_gettime
 #include <sys/ioctl.h> // For ioctl
 #include <termios.h>   // For resize_term
@@ -28,6 +27,14 @@
 #include "utils.h"
 #include "vector.h"
 #include "files.h"
+#include "dir_loader.h"
+#include "dir_size.h"
+#include "dir_watch.h"
+#include "listing_cache.h"
+#include "listing_prefetch.h"
+#include "listing_sort.h"
+#include "mime.h"
+#include "stat_batch.h"
 #include "vecstack.h"
 #include "main.h"
 #include "globals.h"
@@ -36,10 +43,14 @@
 #include "undo.h"
 #include "plugins.h"
 #include "console.h"
+#include "du_view.h"
+#include "file_copy.h"
 #include "banner.h"
+#include "frame_sched.h"
 #include "clipboard.h"
 #include "tempfiles.h"
 #include "browser_ui.h"
+#include "preview_worker.h"
 #include "app_state.h"
 #include "search.h"
 #include "app_input.h"
@@ -99,6 +110,89 @@ static void banner_help_key_to_string(const KeyBindings *kb, char *out, size_t o
     snprintf(out, out_sz, "%s", keycode_to_string(hk));
 }
 
+// Blocks until there is a key or something else to do (background results,
+// the directory watcher, a deadline). Returns ERR for a tick without a key.
+static int next_key(const LazyLoadState *lazy_load) {
+    // Keys ncurses already read off the terminal (whatever followed a lone
+    // ESC, the rest of a burst) are invisible to poll(): take those first.
+    timeout(0);
+    int ch = getch();
+    timeout(KEY_READ_TIMEOUT_MS);
+    if (ch != ERR) return ch;
+
+    frame_sched_watch_fd(dir_watch_fd(lazy_load->watch));
+    return frame_sched_wait() ? getch() : ERR;
+}
+
+// Copies run on the main thread (paste, undo/redo, plugin file ops). Past
+// the first 200 ms, the notification bar shows how far they got, five
+// times a second.
+static void copy_progress_notify(const FileCopyProgress *progress, void *ctx) {
+    (void)ctx;
+    static long shown_ms = 0;
+    if (progress->elapsed_ms < shown_ms) shown_ms = 0; // a new copy
+    if (!notifwin || progress->elapsed_ms < 200 || progress->elapsed_ms - shown_ms < 200) return;
+    shown_ms = progress->elapsed_ms;
+    char size_buf[32];
+    const char *slash = strrchr(progress->path, '/');
+    show_notification(notifwin, "Copying %s (%s, %ld files)", slash ? slash + 1 : progress->path,
+                      format_file_size(size_buf, (size_t)progress->bytes), progress->files);
+}
+
+// True while the preview shows a directory whose size is still being
+// computed (or waits for the user to go idle before it is queued); the
+// preview polls for it, so it has to be repainted until the size is current.
+static bool preview_size_pending(const AppState *state) {
+    char path[MAX_PATH_LENGTH];
+    if (state->preview_override_active) {
+        strncpy(path, state->preview_override_path, sizeof(path) - 1);
+        path[sizeof(path) - 1] = '\0';
+    } else if (state->selected_entry && state->selected_entry[0]) {
+        path_join(path, state->current_directory, state->selected_entry);
+    } else {
+        return false;
+    }
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode) && !dir_size_settled(path);
+}
+
+// Regions a cursor move repaints: the listing if the cursor, the scroll or the
+// entry count changed, the preview if another entry (or line) is shown.
+static unsigned cursor_move_regions(const AppState *state, const CursorAndSlice *before,
+                                    const char *selected_before, int preview_line_before) {
+    const CursorAndSlice *cas = &state->dir_window_cas;
+    unsigned regions = 0;
+    if (cas->cursor != before->cursor || cas->start != before->start ||
+        cas->num_files != before->num_files) {
+        regions |= FRAME_DIRECTORY;
+    }
+    if (state->selected_entry != selected_before || state->preview_start_line != preview_line_before) {
+        regions |= FRAME_PREVIEW;
+    }
+    return regions;
+}
+
+// Reloads the listing after a file operation and puts the cursor back on
+// `keep` (a name in the current directory), or on the same row if it is gone.
+static void reload_after_fileop(AppState *state, const char *keep) {
+    char name[MAX_PATH_LENGTH] = "";
+    if (keep) {
+        strncpy(name, keep, sizeof(name) - 1);
+    }
+    CursorAndSlice *cas = &state->dir_window_cas;
+    char saved_query[MAX_PATH_LENGTH];
+    search_before_reload(state, saved_query);
+    refresh_directory(&state->files, state->current_directory, &state->lazy_load);
+    cas->num_files = Vector_len(state->files);
+    search_after_reload(state, cas, saved_query);
+    Vector *view = active_files(state);
+    SIZE idx = name[0] ? find_loaded_index_by_name(view, name) : -1;
+    if (idx >= 0) {
+        move_cursor_with_entry(cas, idx);
+    }
+    sync_selection_from_active(state, cas);
+}
+
 int main() {
     // Initialize ncurses
     setlocale(LC_ALL, "");
@@ -123,7 +217,8 @@ int main() {
     raw();   // or cbreak() if you prefer
     keypad(stdscr, TRUE);
     curs_set(0);
-    timeout(100);
+    timeout(KEY_READ_TIMEOUT_MS);
+    frame_sched_init();
     
     // Initialize colors for syntax highlighting
     if (has_colors()) {
@@ -274,11 +369,30 @@ int main() {
     state.lazy_load.total_files = 0;
     state.lazy_load.is_loading = false;
     state.lazy_load.last_load_time = (struct timespec){0};
+    dir_cursor_init(&state.lazy_load.cursor);
+    state.lazy_load.loader = NULL;
+    state.lazy_load.arena = Arena_new(LISTING_ARENA_CHUNK);
+    sort_index_init(&state.lazy_load.sort, (SortMode)kb.sort_mode, kb.sort_dirs_first);
+    // Without inotify every change still goes through a full reload.
+    state.lazy_load.watch = dir_watch_open();
+    state.lazy_load.last_watch_time = (struct timespec){0};
+    state.lazy_load.dead_entries = 0;
+    state.listing_cache = listing_cache_new(LISTING_CACHE_MAX_ENTRIES, LISTING_CACHE_MAX_BYTES);
+    state.prefetch = listing_prefetch_new();
     
+    // Load the magic database once up front instead of on the first redraw.
+    mime_init();
+
     // Use lazy loading for initial directory load
-    reload_directory_lazy(&state.files, state.current_directory, 
-                         &state.lazy_load.files_loaded, &state.lazy_load.total_files);
+    reload_directory_lazy(&state.files, state.current_directory, &state.lazy_load);
+    dir_size_set_workers(kb.dir_size_workers);
+    if (kb.dir_size_remember) {
+        char sizes_path[MAX_PATH_LENGTH];
+        snprintf(sizes_path, sizeof(sizes_path), "%s/.cupidfm/dir_sizes", home);
+        dir_size_set_index_file(sizes_path);
+    }
     dir_size_cache_start();
+    file_copy_set_progress(copy_progress_notify, NULL);
 
     state.dir_window_cas = (CursorAndSlice){
             .start = 0,
@@ -325,8 +439,7 @@ int main() {
                         if (state.lazy_load.directory_path) free(state.lazy_load.directory_path);
                         state.lazy_load.directory_path = strdup(state.current_directory);
                         state.lazy_load.last_load_time = (struct timespec){0};
-                        reload_directory_lazy(&state.files, state.current_directory,
-                                              &state.lazy_load.files_loaded, &state.lazy_load.total_files);
+                        reload_directory_lazy(&state.files, state.current_directory, &state.lazy_load);
                         state.dir_window_cas.num_files = Vector_len(state.files);
                         state.dir_window_cas.cursor = 0;
                         state.dir_window_cas.start = 0;
@@ -343,10 +456,8 @@ int main() {
 
 	        // If plugins requested a reload during on_load, apply once on startup.
 	        if (plugins_take_reload_request(state.plugins)) {
-	            reload_directory(&state.files, state.current_directory);
+	            reload_directory_full(&state.files, state.current_directory, &state.lazy_load);
 	            state.dir_window_cas.num_files = Vector_len(state.files);
-	            state.lazy_load.files_loaded = Vector_len(state.files);
-	            state.lazy_load.total_files = state.lazy_load.files_loaded;
 	        }
 
             plugins_update_context(&state, active_window);
@@ -365,7 +476,13 @@ int main() {
                               BANNER_TIME_PREFIX_LEN + BANNER_TIME_LEN + 4;
 
     int ch;
-    while ((ch = getch()) != kb.key_exit) {
+    while ((ch = next_key(&state.lazy_load)) != kb.key_exit) {
+        // A key may change anything (plugins, file operations, dialogs drawn
+        // over the panes); the keys handled below narrow this down.
+        unsigned key_regions = (ch != ERR) ? FRAME_ALL : 0;
+        CursorAndSlice cas_before = state.dir_window_cas;
+        const char *selected_before = state.selected_entry;
+        int preview_line_before = state.preview_start_line;
         if (state.plugins) {
             plugins_update_context(&state, active_window);
             bool handled = plugins_handle_key(state.plugins, ch);
@@ -408,8 +525,7 @@ int main() {
                     if (state.lazy_load.directory_path) free(state.lazy_load.directory_path);
                     state.lazy_load.directory_path = strdup(state.current_directory);
                     state.lazy_load.last_load_time = (struct timespec){0};
-                    reload_directory_lazy(&state.files, state.current_directory,
-                                          &state.lazy_load.files_loaded, &state.lazy_load.total_files);
+                    reload_directory_lazy(&state.files, state.current_directory, &state.lazy_load);
                     state.dir_window_cas.num_files = Vector_len(state.files);
                     state.dir_window_cas.cursor = 0;
                     state.dir_window_cas.start = 0;
@@ -538,8 +654,7 @@ int main() {
                                     if (state.lazy_load.directory_path) free(state.lazy_load.directory_path);
                                     state.lazy_load.directory_path = strdup(state.current_directory);
                                     state.lazy_load.last_load_time = (struct timespec){0};
-                                    reload_directory_lazy(&state.files, state.current_directory,
-                                                          &state.lazy_load.files_loaded, &state.lazy_load.total_files);
+                                    reload_directory_lazy(&state.files, state.current_directory, &state.lazy_load);
                                     state.dir_window_cas.num_files = Vector_len(state.files);
                                     state.dir_window_cas.cursor = 0;
                                     state.dir_window_cas.start = 0;
@@ -626,16 +741,7 @@ int main() {
                                    ? undo_state_do_undo(&state.undo_state, ubuf, sizeof(ubuf))
                                    : undo_state_do_redo(&state.undo_state, ubuf, sizeof(ubuf));
                     if (did) {
-                        char saved_query[MAX_PATH_LENGTH];
-                        search_before_reload(&state, saved_query);
-                        reload_directory(&state.files, state.current_directory);
-                        state.dir_window_cas.num_files = Vector_len(state.files);
-                        state.lazy_load.files_loaded = Vector_len(state.files);
-                        state.lazy_load.total_files = state.lazy_load.files_loaded;
-                        state.dir_window_cas.cursor = 0;
-                        state.dir_window_cas.start = 0;
-                        search_after_reload(&state, &state.dir_window_cas, saved_query);
-                        sync_selection_from_active(&state, &state.dir_window_cas);
+                        reload_after_fileop(&state, state.selected_entry);
                         show_notification(notifwin, "%s", (op.kind == PLUGIN_FILEOP_UNDO) ? "Undone last operation" : "Redone last operation");
                         should_clear_notif = false;
                         ok = true;
@@ -766,7 +872,9 @@ int main() {
                             snprintf(err, sizeof(err), "dst_dir is not a directory");
                         } else {
                             UndoItem *items = (UndoItem *)calloc(op.count, sizeof(UndoItem));
-                            size_t did = 0;
+                            size_t did = 0;    // undo items recorded
+                            size_t done = 0;
+                            size_t failed = 0;
                             for (size_t i = 0; i < op.count; i++) {
                                 char src[MAX_PATH_LENGTH];
                                 resolve_path_under_cwd(src, state.current_directory, op.paths[i]);
@@ -781,12 +889,17 @@ int main() {
 
                                 if (access(dst, F_OK) == 0) continue;
 
-                                char cmd[4096];
                                 if (op.kind == PLUGIN_FILEOP_COPY) {
-                                    snprintf(cmd, sizeof(cmd), "cp %s \"%s\" \"%s\"",
-                                             (S_ISDIR(st.st_mode) && !S_ISLNK(st.st_mode)) ? "-r" : "",
-                                             src, dst);
-                                    if (system(cmd) != -1) {
+                                    // The first failure is the one reported
+                                    bool copied = failed == 0 ? file_copy(src, dst, err, sizeof(err))
+                                                              : file_copy(src, dst, NULL, 0);
+                                    if (copied) {
+                                        done++;
+                                    } else {
+                                        failed++;
+                                    }
+                                    // What a failed copy left behind is recorded too, for undo
+                                    if (copied || access(dst, F_OK) == 0) {
                                         if (items) {
                                             items[did].src = strdup(src);
                                             items[did].dst = strdup(dst);
@@ -796,6 +909,7 @@ int main() {
                                 } else {
                                     // MOVE
                                     if (rename(src, dst) != 0) {
+                                        char cmd[4096];
                                         snprintf(cmd, sizeof(cmd), "mv \"%s\" \"%s\"", src, dst);
                                         if (system(cmd) == -1) continue;
                                     }
@@ -804,6 +918,7 @@ int main() {
                                         items[did].dst = strdup(dst);
                                     }
                                     did++;
+                                    done++;
                                 }
                             }
 
@@ -820,7 +935,12 @@ int main() {
                                 free(items);
                             }
 
-                            show_notification(notifwin, "%s %zu item(s)", (op.kind == PLUGIN_FILEOP_COPY) ? "Copied" : "Moved", did);
+                            if (failed > 0) {
+                                show_notification(notifwin, "Copied %zu item(s), %zu failed: %s",
+                                                  done, failed, err);
+                            } else {
+                                show_notification(notifwin, "%s %zu item(s)", (op.kind == PLUGIN_FILEOP_COPY) ? "Copied" : "Moved", done);
+                            }
                             should_clear_notif = false;
                             ok = true;
                         }
@@ -837,16 +957,7 @@ int main() {
                 }
 
                 if (ok) {
-                    char saved_query[MAX_PATH_LENGTH];
-                    search_before_reload(&state, saved_query);
-                    reload_directory(&state.files, state.current_directory);
-                    state.dir_window_cas.num_files = Vector_len(state.files);
-                    state.lazy_load.files_loaded = Vector_len(state.files);
-                    state.lazy_load.total_files = state.lazy_load.files_loaded;
-                    state.dir_window_cas.cursor = 0;
-                    state.dir_window_cas.start = 0;
-                    search_after_reload(&state, &state.dir_window_cas, saved_query);
-                    sync_selection_from_active(&state, &state.dir_window_cas);
+                    reload_after_fileop(&state, state.selected_entry);
                 }
 
                 plugins_update_context(&state, active_window);
@@ -872,10 +983,8 @@ int main() {
             if (plugins_take_reload_request(state.plugins)) {
                 char saved_query[MAX_PATH_LENGTH];
                 search_before_reload(&state, saved_query);
-                reload_directory(&state.files, state.current_directory);
+                reload_directory_full(&state.files, state.current_directory, &state.lazy_load);
                 state.dir_window_cas.num_files = Vector_len(state.files);
-                state.lazy_load.files_loaded = Vector_len(state.files);
-                state.lazy_load.total_files = state.lazy_load.files_loaded;
                 state.dir_window_cas.cursor = 0;
                 state.dir_window_cas.start = 0;
                 search_after_reload(&state, &state.dir_window_cas, saved_query);
@@ -910,7 +1019,9 @@ int main() {
             pthread_mutex_unlock(&banner_mutex);
             banner_offset = (banner_offset + 1) % total_scroll_length;
             last_update_time = current_time;
+            time_diff = 0;
         }
+        frame_sched_mark_in(0, (BANNER_SCROLL_INTERVAL - time_diff) / 1000);
 
         clock_gettime(CLOCK_MONOTONIC, &current_time);
         long notification_diff = (current_time.tv_sec - last_notification_time.tv_sec) * 1000 +
@@ -930,6 +1041,12 @@ int main() {
             wrefresh(notifwin);
             should_clear_notif = true;
         }
+        if (notification_hold_active) {
+            frame_sched_mark_in(0, (notification_hold_until.tv_sec - current_time.tv_sec) * 1000 +
+                                   (notification_hold_until.tv_nsec - current_time.tv_nsec) / 1000000 + 1);
+        } else if (!should_clear_notif) {
+            frame_sched_mark_in(0, NOTIFICATION_TIMEOUT_MS - notification_diff);
+        }
 
         if (ch != ERR) {
             dir_size_note_user_activity();
@@ -956,6 +1073,7 @@ int main() {
                         should_clear_notif = false;
                     }
                 }
+                key_regions = cursor_move_regions(&state, &cas_before, selected_before, preview_line_before);
             }
 
             // 2) DOWN
@@ -972,7 +1090,7 @@ int main() {
                     wrefresh(notifwin);
                     should_clear_notif = false;
                 } else if (active_window == PREVIEW_WIN_ACTIVE) {
-                    // Determine total lines for scrolling in the preview
+                    // Scroll only while the preview has more below the window
                     char file_path[MAX_PATH_LENGTH];
                     if (state.preview_override_active) {
                         strncpy(file_path, state.preview_override_path, sizeof(file_path) - 1);
@@ -980,26 +1098,8 @@ int main() {
                     } else {
                         path_join(file_path, state.current_directory, state.selected_entry);
                     }
-                    
-                    // Check if it's a directory or a file
-                    struct stat file_stat;
-                    int total_lines = 0;
-                    if (stat(file_path, &file_stat) == 0 && S_ISDIR(file_stat.st_mode)) {
-                        // It's a directory, count directory tree lines
-                        total_lines = get_directory_tree_total_lines(file_path);
-                    } else {
-                        // It's a file, count file lines
-                        total_lines = get_total_lines(file_path);
-                    }
-
-                    int max_x, max_y;
-                    getmaxyx(previewwin, max_y, max_x);
-                    (void) max_x;
-                    int content_height = max_y - 7;
-                    int max_start_line = total_lines - content_height;
-                    if (max_start_line < 0) max_start_line = 0;
 
-                    if (state.preview_start_line < max_start_line) {
+                    if (preview_can_scroll_down(previewwin, file_path, state.preview_start_line)) {
                         state.preview_start_line++;
                         werase(notifwin);
                         show_notification(notifwin, "Scrolled down");
@@ -1007,6 +1107,7 @@ int main() {
                         should_clear_notif = false;
                     }
                 }
+                key_regions = cursor_move_regions(&state, &cas_before, selected_before, preview_line_before);
             }
 
             // 3) LEFT
@@ -1039,6 +1140,8 @@ int main() {
 
             // 5) TAB (switch active window)
             else if (ch == kb.key_tab) {
+                // Only the preview shows which window is active
+                key_regions = FRAME_PREVIEW;
                 active_window = (active_window == DIRECTORY_WIN_ACTIVE)
                                 ? PREVIEW_WIN_ACTIVE
                                 : DIRECTORY_WIN_ACTIVE;
@@ -1074,6 +1177,8 @@ int main() {
 
             // 7) COPY
             else if (ch == kb.key_copy) {
+                // Copying only clears the select-all highlight
+                key_regions = state.select_all_active ? FRAME_DIRECTORY : 0;
                 if (active_window == DIRECTORY_WIN_ACTIVE && state.selected_entry) {
                     if (state.select_all_active) {
                         Vector *files = active_files(&state);
@@ -1169,10 +1274,8 @@ int main() {
 
                     char saved_query[MAX_PATH_LENGTH];
                     search_before_reload(&state, saved_query);
-                    reload_directory(&state.files, state.current_directory);
+                    refresh_directory(&state.files, state.current_directory, &state.lazy_load);
                     state.dir_window_cas.num_files = Vector_len(state.files);
-                    state.lazy_load.files_loaded = Vector_len(state.files);
-                    state.lazy_load.total_files = state.lazy_load.files_loaded;
                     search_after_reload(&state, &state.dir_window_cas, saved_query);
                     werase(notifwin);
                     if (pasted == 1) {
@@ -1294,10 +1397,8 @@ int main() {
                         // Reload directory to reflect the cut items
                         char saved_query[MAX_PATH_LENGTH];
                         search_before_reload(&state, saved_query);
-                        reload_directory(&state.files, state.current_directory);
+                        refresh_directory(&state.files, state.current_directory, &state.lazy_load);
                         state.dir_window_cas.num_files = Vector_len(state.files);
-                        state.lazy_load.files_loaded = Vector_len(state.files);
-                        state.lazy_load.total_files = state.lazy_load.files_loaded;
                         search_after_reload(&state, &state.dir_window_cas, saved_query);
 
                         show_notification(notifwin, "Cut %d items", moved);
@@ -1319,10 +1420,8 @@ int main() {
                     // Reload directory to reflect the cut file
                     char saved_query[MAX_PATH_LENGTH];
                     search_before_reload(&state, saved_query);
-                    reload_directory(&state.files, state.current_directory);
+                    refresh_directory(&state.files, state.current_directory, &state.lazy_load);
                     state.dir_window_cas.num_files = Vector_len(state.files);
-                    state.lazy_load.files_loaded = Vector_len(state.files);
-                    state.lazy_load.total_files = state.lazy_load.files_loaded;
                     search_after_reload(&state, &state.dir_window_cas, saved_query);
 
                     werase(notifwin);
@@ -1338,6 +1437,7 @@ int main() {
                 state.select_all_active = !state.select_all_active;
                 // Sync UI flag used by renderer
                 g_select_all_highlight = state.select_all_active;
+                key_regions = FRAME_DIRECTORY;
                 if (state.select_all_active) {
                     show_notification(notifwin, "Selected all items in view");
                 } else {
@@ -1359,16 +1459,7 @@ int main() {
 
                 // Refresh directory listing after any filesystem change attempt.
                 if (ok) {
-                    char saved_query[MAX_PATH_LENGTH];
-                    search_before_reload(&state, saved_query);
-                    reload_directory(&state.files, state.current_directory);
-                    state.dir_window_cas.num_files = Vector_len(state.files);
-                    state.lazy_load.files_loaded = Vector_len(state.files);
-                    state.lazy_load.total_files = state.lazy_load.files_loaded;
-                    state.dir_window_cas.cursor = 0;
-                    state.dir_window_cas.start = 0;
-                    search_after_reload(&state, &state.dir_window_cas, saved_query);
-                    sync_selection_from_active(&state, &state.dir_window_cas);
+                    reload_after_fileop(&state, state.selected_entry);
                     show_notification(notifwin, "%s", (ch == kb.key_undo) ? "Undone last operation" : "Redone last operation");
                 } else {
                     show_notification(notifwin, "%s", err[0] ? err : "Undo/redo failed");
@@ -1426,10 +1517,8 @@ int main() {
                         // Reload directory after bulk delete
                         char saved_query[MAX_PATH_LENGTH];
                         search_before_reload(&state, saved_query);
-                        reload_directory(&state.files, state.current_directory);
+                        refresh_directory(&state.files, state.current_directory, &state.lazy_load);
                         state.dir_window_cas.num_files = Vector_len(state.files);
-                        state.lazy_load.files_loaded = Vector_len(state.files);
-                        state.lazy_load.total_files = state.lazy_load.files_loaded;
                         search_after_reload(&state, &state.dir_window_cas, saved_query);
                         show_notification(notifwin, "Deleted %d items", deleted_count);
                         should_clear_notif = false;
@@ -1450,10 +1539,8 @@ int main() {
 	                            }
 	                            char saved_query[MAX_PATH_LENGTH];
 	                            search_before_reload(&state, saved_query);
-	                            reload_directory(&state.files, state.current_directory);
+	                            refresh_directory(&state.files, state.current_directory, &state.lazy_load);
                             state.dir_window_cas.num_files = Vector_len(state.files);
-                            state.lazy_load.files_loaded = Vector_len(state.files);
-	                            state.lazy_load.total_files = state.lazy_load.files_loaded;
 	                            search_after_reload(&state, &state.dir_window_cas, saved_query);
 
 	                            if (deleted_ok) {
@@ -1490,23 +1577,7 @@ int main() {
                     }
 
                     // Reload to show changes
-                    char saved_query[MAX_PATH_LENGTH];
-                    search_before_reload(&state, saved_query);
-                    reload_directory(&state.files, state.current_directory);
-                    state.dir_window_cas.num_files = Vector_len(state.files);
-                    state.lazy_load.files_loaded = Vector_len(state.files);
-                    state.lazy_load.total_files = state.lazy_load.files_loaded;
-                    state.dir_window_cas.cursor = 0;
-                    state.dir_window_cas.start = 0;
-                    search_after_reload(&state, &state.dir_window_cas, saved_query);
-
-                    if (!state.search_active) {
-                        if (state.dir_window_cas.num_files > 0) {
-                            state.selected_entry = FileAttr_get_name(state.files.el[0]);
-                        } else {
-                            state.selected_entry = "";
-                        }
-                    }
+                    reload_after_fileop(&state, new_path[0] ? basename_ptr(new_path) : state.selected_entry);
                 }
             }
 
@@ -1530,23 +1601,7 @@ int main() {
                     if (create_new_file(notifwin, state.current_directory, created_path, sizeof(created_path))) {
                         (void)undo_state_set_single(&state.undo_state, UNDO_OP_CREATE_FILE, NULL, created_path);
                     }
-                    char saved_query[MAX_PATH_LENGTH];
-                    search_before_reload(&state, saved_query);
-                    reload_directory(&state.files, state.current_directory);
-                    state.dir_window_cas.num_files = Vector_len(state.files);
-                    state.lazy_load.files_loaded = Vector_len(state.files);
-                    state.lazy_load.total_files = state.lazy_load.files_loaded;
-                    state.dir_window_cas.cursor = 0;
-                    state.dir_window_cas.start = 0;
-                    search_after_reload(&state, &state.dir_window_cas, saved_query);
-
-                    if (!state.search_active) {
-                        if (state.dir_window_cas.num_files > 0) {
-                            state.selected_entry = FileAttr_get_name(state.files.el[0]);
-                        } else {
-                            state.selected_entry = "";
-                        }
-                    }
+                    reload_after_fileop(&state, created_path[0] ? basename_ptr(created_path) : state.selected_entry);
                 }
             }
 
@@ -1559,23 +1614,7 @@ int main() {
                     continue;
                 }
                 (void)undo_state_set_single(&state.undo_state, UNDO_OP_CREATE_DIR, NULL, created_path);
-                char saved_query[MAX_PATH_LENGTH];
-                search_before_reload(&state, saved_query);
-                reload_directory(&state.files, state.current_directory);
-                state.dir_window_cas.num_files = Vector_len(state.files);
-                state.lazy_load.files_loaded = Vector_len(state.files);
-                state.lazy_load.total_files = state.lazy_load.files_loaded;
-                state.dir_window_cas.cursor = 0;
-                state.dir_window_cas.start = 0;
-                search_after_reload(&state, &state.dir_window_cas, saved_query);
-
-                if (!state.search_active) {
-                    if (state.dir_window_cas.num_files > 0) {
-                        state.selected_entry = FileAttr_get_name(state.files.el[0]);
-                    } else {
-                        state.selected_entry = "";
-                    }
-                }
+                reload_after_fileop(&state, basename_ptr(created_path));
             }
 
             // Quick File Info (Ctrl+T by default)
@@ -1639,13 +1678,10 @@ int main() {
 
                     // MIME type (best effort)
                     char mime_buf[128] = "unknown";
-                    magic_t mc = magic_open(MAGIC_MIME_TYPE | MAGIC_SYMLINK | MAGIC_CHECK);
-                    if (mc && magic_load(mc, NULL) == 0) {
-                        const char *m = magic_file(mc, file_path);
-                        if (m && *m) {
-                            strncpy(mime_buf, m, sizeof(mime_buf) - 1);
-                            mime_buf[sizeof(mime_buf) - 1] = '\0';
-                        }
+                    const char *m = mime_detect(file_path, true);
+                    if (m && *m) {
+                        strncpy(mime_buf, m, sizeof(mime_buf) - 1);
+                        mime_buf[sizeof(mime_buf) - 1] = '\0';
                     }
 
                     char link_target[MAX_PATH_LENGTH] = {0};
@@ -1654,8 +1690,6 @@ int main() {
                         if (n > 0) link_target[n] = '\0';
                     }
 
-                    if (mc) magic_close(mc);
-
                     if (S_ISLNK(st.st_mode) && link_target[0]) {
                         show_popup("File Info",
                                    "Name: %s\n"
@@ -1716,6 +1750,42 @@ int main() {
                 goto input_done;
             }
 
+            // Cycle sort order (s by default)
+            else if (ch == kb.key_sort) {
+                SortIndex *order = &state.lazy_load.sort;
+                Vector *shown = active_files(&state);
+                FileAttr at_cursor = (state.dir_window_cas.cursor >= 0 && state.dir_window_cas.cursor < (SIZE)Vector_len(*shown))
+                                         ? (FileAttr)shown->el[state.dir_window_cas.cursor] : NULL;
+
+                sort_index_set_order(order, (SortMode)((order->mode + 1) % SORT_BY_COUNT), order->dirs_first);
+                sort_index_build(order, &state.files, state.current_directory);
+                if (state.search_active) {
+                    // Exact and regex results follow listing order
+                    search_rebuild(&state, state.search_query);
+                }
+
+                size_t idx = listing_index_of(shown, at_cursor);
+                if (idx != (size_t)-1) {
+                    move_cursor_with_entry(&state.dir_window_cas, (SIZE)idx);
+                }
+                sync_selection_from_active(&state, &state.dir_window_cas);
+                // The status line names the order; the selected entry stays
+                key_regions = FRAME_DIRECTORY |
+                              cursor_move_regions(&state, &cas_before, selected_before, preview_line_before);
+                show_notification(notifwin, "Sort: %s%s", sort_mode_name(order->mode),
+                                  order->dirs_first ? " (directories first)" : "");
+                should_clear_notif = false;
+                goto input_done;
+            }
+
+            // Disk usage breakdown (u by default)
+            else if (ch == kb.key_du) {
+                du_view_show(state.current_directory);
+                redraw_all_windows(&state);
+                should_clear_notif = false;
+                goto input_done;
+            }
+
             // Help menu (H by default)
             else if (key_matches_casefold(ch, kb.key_help)) {
                 show_help_menu(&kb);
@@ -1729,6 +1799,11 @@ int main() {
                 // Ignore it here to prevent terminal flow control (XOFF) from freezing the UI
                 continue;
             }
+
+            // Unbound key
+            else {
+                key_regions = 0;
+            }
         }
 
         // Allow console to be opened even when editor is active
@@ -1739,62 +1814,114 @@ int main() {
         }
 
 input_done:
+        frame_sched_mark(key_regions);
+
         // Clear notification window only if no new notification was displayed
         if (should_clear_notif) {
             werase(notifwin);
             wrefresh(notifwin);
         }
 
+        // Take whatever the background directory loader published since the
+        // last tick; the listing grows while the user browses. New entries
+        // are merged into sort order, so keep the cursor on its entry unless
+        // the view is still at the top.
+        if (state.lazy_load.loader) {
+            CursorAndSlice *cas = &state.dir_window_cas;
+            bool follow = !state.search_active && cas->cursor > 0 &&
+                          cas->cursor < (SIZE)Vector_len(state.files);
+            FileAttr at_cursor = follow ? (FileAttr)state.files.el[cas->cursor] : NULL;
+            // The status line changes at least (count, end of loading).
+            frame_sched_mark(FRAME_DIRECTORY);
+            if (poll_lazy_load(&state.files, &state.lazy_load) > 0 && !state.search_active) {
+                cas->num_files = Vector_len(state.files);
+                size_t idx = listing_index_of(&state.files, at_cursor);
+                if (idx != (size_t)-1) {
+                    move_cursor_with_entry(cas, (SIZE)idx);
+                }
+                sync_selection_from_active(&state, cas);
+                frame_sched_mark(FRAME_PREVIEW);
+            }
+        }
+
+        // Apply what the directory watcher saw since the last batch: entries
+        // are added, dropped or re-stat'ed in place and the cursor stays on
+        // its entry (or on the same row if that entry is gone).
+        if (poll_directory_watch(&state.lazy_load)) {
+            CursorAndSlice *cas = &state.dir_window_cas;
+            char at_cursor[MAX_PATH_LENGTH] = "";
+            if (state.selected_entry) {
+                strncpy(at_cursor, state.selected_entry, sizeof(at_cursor) - 1);
+            }
+            state.selected_entry = at_cursor;
+            sync_directory_changes(&state.files, state.current_directory, &state.lazy_load);
+            if (state.search_active) {
+                search_rebuild(&state, state.search_query);
+            }
+            Vector *view = active_files(&state);
+            cas->num_files = Vector_len(*view);
+            SIZE idx = find_loaded_index_by_name(view, at_cursor);
+            if (idx >= 0) {
+                move_cursor_with_entry(cas, idx);
+            }
+            sync_selection_from_active(&state, cas);
+            frame_sched_mark(FRAME_ALL);
+        } else if (dir_watch_poll(state.lazy_load.watch)) {
+            // Changes are pending but coalesced; come back for them.
+            frame_sched_mark_in(0, 100);
+        }
+        listing_cache_poll(state.listing_cache);
+        listing_prefetch_tick(state.prefetch, &state);
+
         // Keep plugin context up-to-date after CupidFM handled input, and fire change hooks.
         if (state.plugins) {
             plugins_update_context(&state, active_window);
         }
 
-        // Redraw windows
-        draw_directory_window(
-                dirwin,
-                state.current_directory,
-                active_files(&state),
-                &state.dir_window_cas
-        );
-
-        if (state.preview_override_active) {
-            draw_preview_window_path(
-                previewwin,
-                state.preview_override_path,
-                NULL,
-                state.preview_start_line
-            );
-        } else {
-            draw_preview_window(
-                previewwin,
-                state.current_directory,
-                state.selected_entry,
-                state.preview_start_line
+        // Repaint what changed, once all queued keys are handled and at
+        // most once per frame interval.
+        unsigned frame = frame_sched_begin();
+        if (frame & FRAME_DIRECTORY) {
+            draw_directory_window(
+                    dirwin,
+                    state.current_directory,
+                    active_files(&state),
+                    &state.dir_window_cas
             );
+            if (!state.search_active) {
+                draw_directory_status(dirwin, Vector_len(state.files), state.lazy_load.loader != NULL,
+                                      sort_mode_name(state.lazy_load.sort.mode));
+            } else {
+                clear_directory_status(dirwin);
+            }
         }
 
-        // Removed: duplicate active-window cursor highlighting. Use render-only highlights in draw_directory_window.
-
-        wrefresh(mainwin);
-        wrefresh(notifwin);
-        // Highlight the active window
-        if (active_window == DIRECTORY_WIN_ACTIVE) {
-            wattron(dirwin, A_REVERSE);
-            Vector *view = active_files(&state);
-            if (view && Vector_len(*view) > 0 && state.dir_window_cas.cursor >= 0 &&
-                (size_t)state.dir_window_cas.cursor < Vector_len(*view)) {
-                mvwprintw(dirwin,
-                          state.dir_window_cas.cursor - state.dir_window_cas.start + 1,
-                          1,
-                          "%s",
-                          FileAttr_get_name((FileAttr)view->el[state.dir_window_cas.cursor]));
+        if (frame & FRAME_PREVIEW) {
+            if (state.preview_override_active) {
+                draw_preview_window_path(
+                    previewwin,
+                    state.preview_override_path,
+                    NULL,
+                    state.preview_start_line
+                );
+            } else {
+                draw_preview_window(
+                    previewwin,
+                    state.current_directory,
+                    state.selected_entry,
+                    state.preview_start_line
+                );
+            }
+            // Highlight the active window (the directory window already
+            // shows its cursor row highlighted)
+            if (active_window != DIRECTORY_WIN_ACTIVE) {
+                wattron(previewwin, A_REVERSE);
+                mvwprintw(previewwin, 1, 1, "Preview Window Active");
+                wattroff(previewwin, A_REVERSE);
+            }
+            if (preview_size_pending(&state)) {
+                frame_sched_mark_in(FRAME_PREVIEW, 100);
             }
-            wattroff(dirwin, A_REVERSE);
-        } else {
-            wattron(previewwin, A_REVERSE);
-            mvwprintw(previewwin, 1, 1, "Preview Window Active");
-            wattroff(previewwin, A_REVERSE);
         }
 
         wrefresh(mainwin);
@@ -1805,11 +1932,10 @@ input_done:
 
     // Clean up
     // Free all FileAttr objects before destroying the vector
-    for (size_t i = 0; i < Vector_len(state.files); i++) {
-        free_attr((FileAttr)state.files.el[i]);
-    }
-    Vector_set_len_no_free(&state.files, 0);
+    free_listing(&state.files, &state.lazy_load);
     Vector_bye(&state.files);
+    listing_prefetch_free(state.prefetch);
+    listing_cache_free(state.listing_cache);
     // `search_files` is a shallow view into `files`, so only free its backing array.
     if (state.search_files.el) {
         free(state.search_files.el);
@@ -1829,8 +1955,12 @@ input_done:
     delwin(notifwin);
     delwin(mainwin);
     delwin(bannerwin);
+    preview_worker_shutdown(); // before the MIME and syntax state it uses
+    mime_cleanup();
+    stat_batch_shutdown();
     syntax_cleanup();  // Restore colors before endwin()
     endwin();
+    frame_sched_shutdown();
     cleanup_temp_files();
     dir_size_cache_stop();
 
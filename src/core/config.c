@@ -1,5 +1,6 @@
 // config.c
 #include "config.h"
+#include "listing_sort.h"
 #include "../lib/cupidconf.h"
 #include <strings.h>
 #include <string.h>
@@ -44,6 +45,8 @@ void load_default_keybindings(KeyBindings *kb) {
     kb->key_permissions = 16; // Ctrl+P (Edit permissions)
     kb->key_console = 15; // Ctrl+O (Open console)
     kb->key_help = 'H';  // Help menu (accepts both 'h' and 'H' in main.c)
+    kb->key_sort = 's';  // Cycle sort order
+    kb->key_du = 'u';    // Disk usage breakdown
 
     // Editing keys
     kb->edit_up = KEY_UP;
@@ -63,6 +66,14 @@ void load_default_keybindings(KeyBindings *kb) {
 
     // Default label width
     kb->info_label_width = 15;
+
+    // Listing order
+    kb->sort_mode = SORT_BY_NATURAL;
+    kb->sort_dirs_first = true;
+
+    // Directory sizes
+    kb->dir_size_workers = 0;
+    kb->dir_size_remember = true;
 }
 
 static void keycode_to_config_string(int keycode, char *buf, size_t buf_size) {
@@ -160,6 +171,8 @@ bool write_default_config_file(const char *filepath, const KeyBindings *kb, char
     write_kv_line(fp, "key_console", kb->key_console, "Open plugin console (log output)");
     write_kv_line(fp, "key_save", kb->key_save, "Save changes");
     write_kv_line(fp, "key_help", kb->key_help, "Show help menu (h/H)");
+    write_kv_line(fp, "key_sort", kb->key_sort, "Cycle sort order (natural/name/size/mtime/extension)");
+    write_kv_line(fp, "key_du", kb->key_du, "Disk usage breakdown of the current directory");
     fputc('\n', fp);
 
     fputs("# Editing Mode Keys\n", fp);
@@ -180,6 +193,17 @@ bool write_default_config_file(const char *filepath, const KeyBindings *kb, char
     fputc('\n', fp);
 
     fprintf(fp, "info_label_width=%d\n", kb->info_label_width);
+    fputc('\n', fp);
+
+    fputs("# Listing order: natural, name, size, mtime or extension\n", fp);
+    fprintf(fp, "sort_mode=%s\n", sort_mode_name((SortMode)kb->sort_mode));
+    fprintf(fp, "sort_dirs_first=%s\n", kb->sort_dirs_first ? "true" : "false");
+    fputc('\n', fp);
+
+    fputs("# Threads computing directory sizes (0 = one per CPU)\n", fp);
+    fprintf(fp, "dir_size_workers=%d\n", kb->dir_size_workers);
+    fputs("# Show the directory sizes of the last run until they are recomputed\n", fp);
+    fprintf(fp, "dir_size_remember=%s\n", kb->dir_size_remember ? "true" : "false");
 
     bool ok = (fclose(fp) == 0);
     if (!ok && error_buffer && buffer_size > 0) {
@@ -248,6 +272,8 @@ int load_config_file(KeyBindings *kb, const char *filepath, char *error_buffer,
         {"key_permissions", &kb->key_permissions},
         {"key_console", &kb->key_console},
         {"key_help", &kb->key_help},
+        {"key_sort", &kb->key_sort},
+        {"key_du", &kb->key_du},
 
         {"edit_up",        &kb->edit_up},
         {"edit_down",      &kb->edit_down},
@@ -314,7 +340,71 @@ int load_config_file(KeyBindings *kb, const char *filepath, char *error_buffer,
         }
     }
 
-    // 5) Free conf
+    // 5) Listing order
+    const char *sort_val = cupidconf_get(conf, "sort_mode");
+    if (sort_val) {
+        SortMode mode;
+        if (sort_mode_parse(sort_val, &mode)) {
+            kb->sort_mode = mode;
+        } else {
+            errors++;
+            if (error_buffer && (strlen(error_buffer) + 128 < buffer_size)) {
+                snprintf(error_buffer + strlen(error_buffer),
+                         buffer_size - strlen(error_buffer),
+                         "Invalid sort_mode: %s\n", sort_val);
+            }
+        }
+    }
+    const char *dirs_val = cupidconf_get(conf, "sort_dirs_first");
+    if (dirs_val) {
+        if (strcasecmp(dirs_val, "true") == 0 || strcmp(dirs_val, "1") == 0) {
+            kb->sort_dirs_first = true;
+        } else if (strcasecmp(dirs_val, "false") == 0 || strcmp(dirs_val, "0") == 0) {
+            kb->sort_dirs_first = false;
+        } else {
+            errors++;
+            if (error_buffer && (strlen(error_buffer) + 128 < buffer_size)) {
+                snprintf(error_buffer + strlen(error_buffer),
+                         buffer_size - strlen(error_buffer),
+                         "Invalid sort_dirs_first: %s\n", dirs_val);
+            }
+        }
+    }
+
+    // 6) Directory sizes
+    const char *workers_val = cupidconf_get(conf, "dir_size_workers");
+    if (workers_val) {
+        char *endptr;
+        long user_val = strtol(workers_val, &endptr, 10);
+        if (*workers_val != '\0' && *endptr == '\0' && user_val >= 0 && user_val <= 1024) {
+            kb->dir_size_workers = (int)user_val;
+        } else {
+            errors++;
+            if (error_buffer && (strlen(error_buffer) + 128 < buffer_size)) {
+                snprintf(error_buffer + strlen(error_buffer),
+                         buffer_size - strlen(error_buffer),
+                         "Invalid dir_size_workers: %s\n", workers_val);
+            }
+        }
+    }
+
+    const char *remember_val = cupidconf_get(conf, "dir_size_remember");
+    if (remember_val) {
+        if (strcasecmp(remember_val, "true") == 0 || strcmp(remember_val, "1") == 0) {
+            kb->dir_size_remember = true;
+        } else if (strcasecmp(remember_val, "false") == 0 || strcmp(remember_val, "0") == 0) {
+            kb->dir_size_remember = false;
+        } else {
+            errors++;
+            if (error_buffer && (strlen(error_buffer) + 128 < buffer_size)) {
+                snprintf(error_buffer + strlen(error_buffer),
+                         buffer_size - strlen(error_buffer),
+                         "Invalid dir_size_remember: %s\n", remember_val);
+            }
+        }
+    }
+
+    // 7) Free conf
     cupidconf_free(conf);
 
     return errors; // 0 means no errors
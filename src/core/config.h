@@ -30,6 +30,8 @@ typedef struct {
     int key_permissions; // e.g., Ctrl+P (Edit permissions)
     int key_console; // e.g., Ctrl+O (Open console)
     int key_help;    // e.g., H (Show help menu)
+    int key_sort;    // e.g., s (Cycle listing sort order)
+    int key_du;      // e.g., u (Disk usage breakdown)
 
     // Dedicated editing keys
     int edit_up;
@@ -49,6 +51,14 @@ typedef struct {
 
     // file 
     int info_label_width;
+
+    // listing order
+    int sort_mode;        // SortMode (listing_sort.h)
+    bool sort_dirs_first; // directories before files in every order
+
+    // directory sizes
+    int dir_size_workers;   // threads walking directory trees; 0 = one per CPU
+    bool dir_size_remember; // keep sizes across runs in ~/.cupidfm/dir_sizes
 } KeyBindings;
 
 
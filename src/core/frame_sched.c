@@ -0,0 +1,167 @@
+// File: frame_sched.c
+// Dirty-region frame pacing and the main loop's blocking wait
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "frame_sched.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "globals.h"
+
+// A key flood (paste, runaway auto-repeat) may postpone a frame only this
+// long; then the frame is painted between keys anyway.
+#define FRAME_MAX_DEFER_NS (100L * 1000 * 1000)
+
+static int wake_fd = -1;
+static int extra_fd = -1;
+static unsigned posted;            // written by any thread (atomic)
+static unsigned dirty;
+static struct timespec dirty_since;
+static unsigned delayed;           // become dirty at `delay_until`
+static bool have_delay;
+static struct timespec delay_until;
+static struct timespec last_frame;
+
+static long ns_between(const struct timespec *from, const struct timespec *to) {
+    return (to->tv_sec - from->tv_sec) * 1000000000L + (to->tv_nsec - from->tv_nsec);
+}
+
+static void add_dirty(unsigned regions, const struct timespec *now) {
+    if (regions && !dirty) dirty_since = *now;
+    dirty |= regions;
+}
+
+// Folds posted regions and expired delays into `dirty`.
+static void collect(const struct timespec *now) {
+    add_dirty(__atomic_exchange_n(&posted, 0, __ATOMIC_ACQ_REL), now);
+    if (have_delay && ns_between(now, &delay_until) <= 0) {
+        have_delay = false;
+        add_dirty(delayed, now);
+        delayed = 0;
+    }
+}
+
+static bool input_pending(void) {
+    struct pollfd pfd = {.fd = STDIN_FILENO, .events = POLLIN};
+    return poll(&pfd, 1, 0) > 0;
+}
+
+bool frame_sched_init(void) {
+    if (wake_fd < 0) {
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    }
+    return wake_fd >= 0;
+}
+
+void frame_sched_shutdown(void) {
+    if (wake_fd >= 0) close(wake_fd);
+    wake_fd = -1;
+}
+
+void frame_sched_mark(unsigned regions) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    add_dirty(regions, &now);
+}
+
+void frame_sched_mark_in(unsigned regions, long ms) {
+    struct timespec at;
+    clock_gettime(CLOCK_MONOTONIC, &at);
+    if (ms < 0) ms = 0;
+    at.tv_sec += ms / 1000;
+    at.tv_nsec += (ms % 1000) * 1000000L;
+    if (at.tv_nsec >= 1000000000L) {
+        at.tv_sec++;
+        at.tv_nsec -= 1000000000L;
+    }
+    if (!have_delay || ns_between(&at, &delay_until) > 0) {
+        delay_until = at;
+        have_delay = true;
+    }
+    delayed |= regions;
+}
+
+void frame_sched_post(unsigned regions) {
+    __atomic_fetch_or(&posted, regions, __ATOMIC_ACQ_REL);
+    frame_sched_wake();
+}
+
+void frame_sched_wake(void) {
+    if (wake_fd < 0) return;
+    uint64_t one = 1;
+    ssize_t rc = write(wake_fd, &one, sizeof(one));
+    (void)rc; // EAGAIN: the counter is saturated, the loop is awake anyway
+}
+
+void frame_sched_watch_fd(int fd) {
+    extra_fd = fd;
+}
+
+// Milliseconds until `at`, rounded up so the wait never ends just short of it.
+static int ms_until(const struct timespec *now, const struct timespec *at) {
+    long ns = ns_between(now, at);
+    if (ns <= 0) return 0;
+    long ms = (ns + 999999L) / 1000000L;
+    return ms > 60000 ? 60000 : (int)ms;
+}
+
+bool frame_sched_wait(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    collect(&now);
+
+    int timeout = -1;
+    if (dirty) {
+        struct timespec due = last_frame;
+        due.tv_nsec += FRAME_INTERVAL_MS * 1000000L;
+        due.tv_sec += due.tv_nsec / 1000000000L;
+        due.tv_nsec %= 1000000000L;
+        timeout = ms_until(&now, &due);
+    }
+    if (have_delay) {
+        int ms = ms_until(&now, &delay_until);
+        if (timeout < 0 || ms < timeout) timeout = ms;
+    }
+
+    struct pollfd fds[3] = {
+        {.fd = STDIN_FILENO, .events = POLLIN},
+        {.fd = wake_fd, .events = POLLIN},
+        {.fd = extra_fd, .events = POLLIN}, // negative descriptors are skipped
+    };
+    int n = poll(fds, 3, timeout);
+    if (n < 0 && errno != EINTR) {
+        // Should not happen; do not spin if it does.
+        struct timespec pause = {0, FRAME_INTERVAL_MS * 1000000L};
+        nanosleep(&pause, NULL);
+    }
+    if (n > 0 && (fds[1].revents & POLLIN)) {
+        uint64_t count;
+        ssize_t rc = read(wake_fd, &count, sizeof(count));
+        (void)rc;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    collect(&now);
+    return n > 0 && (fds[0].revents & (POLLIN | POLLHUP | POLLERR));
+}
+
+unsigned frame_sched_begin(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    collect(&now);
+    if (!dirty) return 0;
+    if (ns_between(&last_frame, &now) < FRAME_INTERVAL_MS * 1000000L) return 0;
+    if (ns_between(&dirty_since, &now) < FRAME_MAX_DEFER_NS && input_pending()) return 0;
+
+    unsigned regions = dirty;
+    dirty = 0;
+    last_frame = now;
+    return regions;
+}
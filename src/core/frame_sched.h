@@ -0,0 +1,53 @@
+#ifndef FRAME_SCHED_H
+#define FRAME_SCHED_H
+
+#include <stdbool.h>
+
+// Pacing of the main loop.
+//
+// Whatever changes what the panes show marks them dirty: the main thread
+// with frame_sched_mark(), background workers (directory loader, size and
+// MIME workers) with frame_sched_post(), which also wakes the loop. The loop
+// blocks in frame_sched_wait() on the terminal, the wakeup eventfd, an
+// optional extra descriptor (the directory watcher) and the earliest
+// deadline. It handles every queued key before frame_sched_begin() grants a
+// frame, at most once per FRAME_INTERVAL_MS, so a held-down arrow key costs
+// one repaint per frame rather than one per key.
+enum {
+    FRAME_DIRECTORY = 1u << 0,
+    FRAME_PREVIEW = 1u << 1,
+    FRAME_ALL = FRAME_DIRECTORY | FRAME_PREVIEW,
+};
+
+// Without eventfd the loop still works, with background changes picked up
+// at the next deadline instead of at once.
+bool frame_sched_init(void);
+void frame_sched_shutdown(void);
+
+// Main thread: `regions` need repainting.
+void frame_sched_mark(unsigned regions);
+
+// Main thread: mark `regions` dirty (and wake up) in `ms` milliseconds.
+// With no regions this only bounds the next wait.
+void frame_sched_mark_in(unsigned regions, long ms);
+
+// Any thread: mark `regions` dirty and wake the main loop.
+void frame_sched_post(unsigned regions);
+
+// Wakes the main loop. Async-signal-safe.
+void frame_sched_wake(void);
+
+// Also wait on `fd` (-1 for none) in the next frame_sched_wait() calls.
+void frame_sched_watch_fd(int fd);
+
+// Blocks until a key is readable, something was posted, `fd` became
+// readable, a deadline passed or a dirty frame became due. Returns true if a
+// key is readable.
+bool frame_sched_wait(void);
+
+// Returns the dirty regions and clears them if a frame may be painted now:
+// no key is queued and the previous frame is at least FRAME_INTERVAL_MS old.
+// Otherwise returns 0 and the regions stay dirty.
+unsigned frame_sched_begin(void);
+
+#endif // FRAME_SCHED_H
@@ -10,6 +10,14 @@
 #define MAX_PATH_LENGTH 1024  // Define it here consistently
 #define NOTIFICATION_TIMEOUT_MS 250  // 1 second timeout for notifications
 #define MAX_DIR_NAME 256
+#define LISTING_ARENA_CHUNK (256 * 1024) // Arena chunk for FileAttr records and names
+#define LISTING_CACHE_MAX_ENTRIES 16      // Directory listings kept for back/forward
+#define LISTING_CACHE_MAX_BYTES (64 * 1024 * 1024) // Memory cap for cached listings
+#define PREVIEW_CACHE_MAX_ENTRIES 64      // Highlighted text preview windows kept
+#define PREVIEW_CACHE_MAX_BYTES (4 * 1024 * 1024) // Memory cap for cached preview windows
+#define PREVIEW_WORKERS 2                 // Threads building preview contents
+#define PREVIEW_RESULTS_MAX_ENTRIES 32    // Finished preview contents kept
+#define PREVIEW_RESULTS_MAX_BYTES (4 * 1024 * 1024) // Memory cap for finished preview contents
 #define MAX_DISPLAY_LENGTH 32
 #define TAB 9
 #define CTRL_E 5
@@ -20,6 +28,8 @@
 #define BANNER_TIME_PREFIX " | "
 #define BANNER_TIME_PREFIX_LEN 3
 #define INPUT_CHECK_INTERVAL 10        // Milliseconds for input checking (10ms)
+#define FRAME_INTERVAL_MS 16           // Shortest time between two repaints (~60 fps)
+#define KEY_READ_TIMEOUT_MS 100        // getch() wait on stdscr for the rest of a key
 #define ERROR_BUFFER_SIZE 2048         // Increased buffer size for error messages
 #define NOTIFICATION_TIMEOUT_MS 250    // 250ms timeout for notifications
 #define PATH_MAX 4096
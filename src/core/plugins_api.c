@@ -10,7 +10,6 @@
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
-#include <magic.h>
 #include <ncurses.h>
 #include <poll.h>
 #include <signal.h>
@@ -24,6 +23,7 @@
 #include <unistd.h>
 
 #include "../fs/files.h"
+#include "../fs/mime.h"
 #include "../ui/ui.h"
 #include "clipboard.h"
 #include "config.h"
@@ -235,6 +235,14 @@ static bool config_key_to_field(const char *key, int **out_field) {
     *out_field = &g_kb.key_console;
     return true;
   }
+  if (strcmp(key, "key_sort") == 0) {
+    *out_field = &g_kb.key_sort;
+    return true;
+  }
+  if (strcmp(key, "key_du") == 0) {
+    *out_field = &g_kb.key_du;
+    return true;
+  }
   if (strcmp(key, "edit_up") == 0) {
     *out_field = &g_kb.edit_up;
     return true;
@@ -1787,16 +1795,11 @@ static int nf_fm_info(cs_vm *vm, void *ud, int argc, const cs_value *argv,
   }
 
   cs_value v_mime = cs_str(vm, "");
-  magic_t mc = magic_open(MAGIC_MIME_TYPE | MAGIC_SYMLINK | MAGIC_CHECK);
-  if (mc && magic_load(mc, NULL) == 0) {
-    const char *mt = magic_file(mc, full);
-    if (mt && *mt) {
-      cs_value_release(v_mime);
-      v_mime = cs_str(vm, mt);
-    }
+  const char *mt = mime_detect(full, true);
+  if (mt && *mt) {
+    cs_value_release(v_mime);
+    v_mime = cs_str(vm, mt);
   }
-  if (mc)
-    magic_close(mc);
 
   if (!map_put_move_local(vm, &mapv, "size", &v_size))
     goto info_oom;
@@ -2381,11 +2384,7 @@ static int nf_fm_entries(cs_vm *vm, void *ud, int argc, const cs_value *argv,
     return 0;
   }
 
-  magic_t mc = magic_open(MAGIC_MIME_TYPE | MAGIC_SYMLINK | MAGIC_CHECK);
-  if (mc && magic_load(mc, NULL) != 0) {
-    magic_close(mc);
-    mc = NULL;
-  }
+  bool have_magic = mime_init();
 
   size_t n = Vector_len(*view);
   for (size_t i = 0; i < n; i++) {
@@ -2403,17 +2402,22 @@ static int nf_fm_entries(cs_vm *vm, void *ud, int argc, const cs_value *argv,
 
     struct stat st;
     memset(&st, 0, sizeof(st));
-    if (full[0]) {
-      (void)lstat(full, &st);
-    }
+    bool have_stat = full[0] && lstat(full, &st) == 0;
 
     const char *mime = "unknown";
+    char mime_buf[128];
     if (is_dir) {
       mime = "inode/directory";
-    } else if (mc && full[0]) {
-      const char *m = magic_file(mc, full);
-      if (m && *m)
-        mime = m;
+    } else if (have_magic && full[0]) {
+      if (have_stat && !S_ISLNK(st.st_mode)) {
+        // Regular entries share the listing's MIME cache.
+        if (mime_cached_type(full, &st, mime_buf, sizeof(mime_buf)) && mime_buf[0])
+          mime = mime_buf;
+      } else {
+        const char *m = mime_detect(full, true);
+        if (m && *m)
+          mime = m;
+      }
     }
 
     cs_value m = cs_map(vm);
@@ -2447,15 +2451,11 @@ static int nf_fm_entries(cs_vm *vm, void *ud, int argc, const cs_value *argv,
   oom:
     cs_value_release(v);
     cs_value_release(m);
-    if (mc)
-      magic_close(mc);
     cs_value_release(list);
     cs_error(vm, "out of memory");
     return 1;
   }
 
-  if (mc)
-    magic_close(mc);
   *out = list;
   return 0;
 }
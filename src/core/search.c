@@ -14,16 +14,13 @@
 #include <time.h>
 
 #include "browser_ui.h"
+#include "dir_loader.h"
 #include "files.h"
 #include "globals.h"
+#include "keysort.h"
 #include "main.h" // banner_mutex, draw_scrolling_banner, bannerwin, BANNER_TEXT, BUILD_INFO
 #include "utils.h"
 
-typedef struct {
-    int score;      // lower is better
-    FileAttr entry; // pointer owned by AppState.files
-} FuzzyHit;
-
 SIZE find_loaded_index_by_name(Vector *files, const char *name) {
     if (!files || !name || !*name) return (SIZE)-1;
     SIZE count = (SIZE)Vector_len(*files);
@@ -54,11 +51,15 @@ SIZE find_index_by_name_lazy(Vector *files,
         if (before == 0) return (SIZE)-1;
 
         cas->cursor = (SIZE)(before - 1);
-        load_more_files_if_needed(files, dir, cas, &lazy_load->files_loaded, lazy_load->total_files);
+        load_more_files_if_needed(files, dir, cas, lazy_load);
 
         size_t after = Vector_len(*files);
         cas->num_files = after;
-        if (after == before) break;
+        if (after == before) {
+            // A background loader may just not have published the next batch.
+            if (!lazy_load->loader) break;
+            dir_loader_wait(lazy_load->loader, 50);
+        }
     }
 
     return (SIZE)-1;
@@ -89,17 +90,28 @@ static int cupidfuzzy_score(const char *pattern, const char *text) {
     return score;
 }
 
-static int fuzzyhit_cmp(const void *a, const void *b) {
-    const FuzzyHit *aa = (const FuzzyHit *)a;
-    const FuzzyHit *bb = (const FuzzyHit *)b;
-    if (aa->score != bb->score) return (aa->score < bb->score) ? -1 : 1;
-
-    const char *an = FileAttr_get_name(aa->entry);
-    const char *bn = FileAttr_get_name(bb->entry);
-    if (!an && !bn) return 0;
-    if (!an) return 1;
-    if (!bn) return -1;
-    return strcasecmp(an, bn);
+// Fuzzy hit key: score (lower is better), then the case-folded name. Entries
+// that do not match get an all-ones score and are dropped before the sort.
+#define FUZZY_NO_MATCH UINT64_MAX
+
+static void fuzzy_key(KeySortRec *rec, void *ctx) {
+    const char *name = FileAttr_get_name((FileAttr)rec->item);
+    int score = name ? cupidfuzzy_score((const char *)ctx, name) : -1;
+    if (score < 0) {
+        rec->key[0] = FUZZY_NO_MATCH;
+        rec->key[1] = rec->key[2] = 0;
+        return;
+    }
+    rec->key[0] = (uint64_t)score;
+    KeySort_casefold_prefix(name, &rec->key[1], 2);
+}
+
+static int fuzzy_tie(const void *a, const void *b, void *ctx) {
+    (void)ctx;
+    const char *an = FileAttr_get_name((FileAttr)a);
+    const char *bn = FileAttr_get_name((FileAttr)b);
+    if (!an || !bn) return 0;
+    return KeySort_casecmp(an, bn);
 }
 
 static bool ci_substr(const char *haystack, const char *needle) {
@@ -173,35 +185,34 @@ size_t search_rebuild(AppState *state, const char *query) {
         return count;
     }
 
-    FuzzyHit *hits = malloc(total * sizeof(*hits));
+    // Scoring and ranking both go through the key sort engine, which spreads
+    // large listings over all cores. Only the hits are ranked.
+    KeySortRec *hits = malloc(total * sizeof(*hits));
     if (!hits) return 0;
 
+    KeySortOpts opts = { .tie = fuzzy_tie };
+    KeySort_extract(hits, state->files.el, total, fuzzy_key, (void *)query, &opts);
+
     size_t count = 0;
     for (size_t i = 0; i < total; i++) {
-        FileAttr fa = (FileAttr)state->files.el[i];
-        const char *name = FileAttr_get_name(fa);
-        if (!name) continue;
-
-        int score = cupidfuzzy_score(query, name);
-        if (score < 0) continue;
-
-        hits[count].score = score;
-        hits[count].entry = fa;
-        count++;
+        if (hits[i].key[0] != FUZZY_NO_MATCH) hits[count++] = hits[i];
     }
 
-    if (count == 0) {
-        free(hits);
-        return 0;
-    }
-
-    qsort(hits, count, sizeof(*hits), fuzzyhit_cmp);
+    if (count > 0) {
+        KeySortRec *scratch = malloc(count * sizeof(*scratch));
+        if (!scratch) {
+            free(hits);
+            return 0;
+        }
+        KeySort_sort(hits, scratch, count, &opts);
+        free(scratch);
 
-    Vector_add(&state->search_files, count);
-    for (size_t i = 0; i < count; i++) {
-        state->search_files.el[i] = hits[i].entry;
+        Vector_add(&state->search_files, count);
+        for (size_t i = 0; i < count; i++) {
+            state->search_files.el[i] = hits[i].item;
+        }
+        Vector_set_len_no_free(&state->search_files, count);
     }
-    Vector_set_len_no_free(&state->search_files, count);
 
     free(hits);
     return count;
@@ -240,6 +251,12 @@ void maybe_load_more_for_search(AppState *state, CursorAndSlice *cas) {
     if (state->lazy_load.total_files == 0) return;
     if (state->lazy_load.files_loaded >= state->lazy_load.total_files) return;
 
+    // Background enumeration is cheap to poll; no need to throttle it.
+    if (state->lazy_load.loader) {
+        poll_lazy_load(&state->files, &state->lazy_load);
+        return;
+    }
+
     struct timespec now;
     clock_gettime(CLOCK_MONOTONIC, &now);
     long dt_ns = (now.tv_sec - state->lazy_load.last_load_time.tv_sec) * 1000000000L +
@@ -257,8 +274,7 @@ void maybe_load_more_for_search(AppState *state, CursorAndSlice *cas) {
     load_more_files_if_needed(&state->files,
                               state->current_directory,
                               &tmp,
-                              &state->lazy_load.files_loaded,
-                              state->lazy_load.total_files);
+                              &state->lazy_load);
 }
 
 void sync_selection_from_active(AppState *state, CursorAndSlice *cas) {
@@ -330,6 +346,7 @@ bool prompt_fuzzy_search(AppState *state,
     cas->cursor = 0;
     cas->start = 0;
     sync_selection_from_active(state, cas);
+    if (dir_window) clear_directory_status(dir_window);
 
     while (true) {
         size_t shown = Vector_len(*active_files(state));
@@ -4,6 +4,7 @@
 #endif
 
 #include "undo.h"
+#include "file_copy.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -125,19 +126,8 @@ static bool copy_path(const char *src, const char *dst, char *err, size_t err_le
         if (err && err_len) snprintf(err, err_len, "Destination already exists");
         return false;
     }
-    struct stat st;
-    if (lstat(src, &st) != 0) {
-        if (err && err_len) snprintf(err, err_len, "Copy source missing");
-        return false;
-    }
     (void)ensure_parent_dir(dst);
-    char cmd[4096];
-    snprintf(cmd, sizeof(cmd), "cp %s \"%s\" \"%s\"", S_ISDIR(st.st_mode) ? "-r" : "", src, dst);
-    if (system(cmd) == -1) {
-        if (err && err_len) snprintf(err, err_len, "Copy failed");
-        return false;
-    }
-    return true;
+    return file_copy(src, dst, err, err_len);
 }
 
 static bool create_empty_file(const char *path, char *err, size_t err_len) {
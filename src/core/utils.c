@@ -4,6 +4,8 @@
 #define _POSIX_C_SOURCE 200809L
 #endif
 #include <errno.h>     // for errno
+#include <fcntl.h>     // for open, O_DIRECTORY, AT_SYMLINK_NOFOLLOW
+#include <stdint.h>    // for uint32_t
 #include <stdarg.h>    // for va_list, va_start, va_end
 #include <stdio.h>     // for fprintf, stderr, vfprintf
 #include <stdlib.h>    // for exit
@@ -25,6 +27,12 @@
 #include "globals.h"
 #include "main.h"
 #include "mime.h"   // For MIME type and emoji functions
+#include "app_state.h" // For LazyLoadState
+#include "dir_loader.h"
+#include "dir_size.h"
+#include "dir_watch.h"
+#include "file_copy.h"
+#include "listing_sort.h"
 #define MAX_DISPLAY_LENGTH 32
 
 // Declare copied_filename as a global variable at the top of the file
@@ -474,7 +482,7 @@ int paste_from_clipboard(const char *target_directory, const char *filename, Pas
             if (!p2) continue;
             *p2++ = '\0';
 
-            int is_directory = atoi(line);
+            // The copy finds out for itself whether it is a directory
             const char *source_path = p1;
             const char *name = p2;
             if (!source_path || !*source_path || !name || !*name) continue;
@@ -498,17 +506,16 @@ int paste_from_clipboard(const char *target_directory, const char *filename, Pas
                     log = NULL;
                 }
             } else {
-                char cp_command[2048];
-                snprintf(cp_command, sizeof(cp_command), "cp %s \"%s\" \"%s/%s\"",
-                         is_directory ? "-r" : "", source_path, target_directory, unique_filename);
-                if (system(cp_command) == -1) {
-                    fprintf(stderr, "Error: Unable to copy file.\n");
-                    continue;
-                }
-                if (!paste_log_append(log, kind, source_path, dst_full)) {
+                char err[PATH_MAX + 64];
+                bool copied = file_copy(source_path, dst_full, err, sizeof(err));
+                if (!copied) fprintf(stderr, "Error: %s\n", err);
+                // What a failed copy left behind is logged too, for undo
+                if ((copied || access(dst_full, F_OK) == 0) &&
+                    !paste_log_append(log, kind, source_path, dst_full)) {
                     paste_log_free(log);
                     log = NULL;
                 }
+                if (!copied) continue;
             }
             pasted++;
         }
@@ -564,14 +571,15 @@ int paste_from_clipboard(const char *target_directory, const char *filename, Pas
         (void)paste_log_append(log, kind, temp_storage, dst_full);
     } else {
         // Handle regular copy operation.
-        char cp_command[2048];
-        snprintf(cp_command, sizeof(cp_command), "cp %s \"%s\" \"%s/%s\"",
-                 is_directory ? "-r" : "", source_path, target_directory, unique_filename);
-        if (system(cp_command) == -1) {
-            fprintf(stderr, "Error: Unable to copy file.\n");
+        char err[PATH_MAX + 64];
+        bool copied = file_copy(source_path, dst_full, err, sizeof(err));
+        if (copied || access(dst_full, F_OK) == 0) {
+            (void)paste_log_append(log, kind, source_path, dst_full);
+        }
+        if (!copied) {
+            fprintf(stderr, "Error: %s\n", err);
             return -1;
         }
-        (void)paste_log_append(log, kind, source_path, dst_full);
     }
 
     return 1;
@@ -1086,48 +1094,318 @@ void reload_directory(Vector *files, const char *current_directory) {
     // Empties the vector
     Vector_set_len_no_free(files, 0);
     // Reads the filenames
-    append_files_to_vec(files, current_directory);
+    append_files_to_vec(files, current_directory, NULL);
     // Makes the vector shorter
     Vector_sane_cap(files);
 }
 
-// Lazy loading version - loads initial batch
-void reload_directory_lazy(Vector *files, const char *current_directory, size_t *files_loaded, size_t *total_files) {
-    // Free all FileAttr objects before clearing the vector
+// Stops the background loader of the previous listing, if any.
+static void lazy_load_stop(LazyLoadState *lazy_load) {
+    if (lazy_load->loader) {
+        dir_loader_cancel(lazy_load->loader);
+        lazy_load->loader = NULL;
+    }
+    lazy_load->is_loading = false;
+}
+
+// Drops the current listing. Entries are released before the loader is
+// cancelled because the ones it published still live in its arena.
+void release_listing(Vector *files, LazyLoadState *lazy_load) {
     for (size_t i = 0; i < Vector_len(*files); i++) {
         free_attr((FileAttr)files->el[i]);
     }
-    // Empties the vector
     Vector_set_len_no_free(files, 0);
-    *files_loaded = 0;
-    
-    // Count total files first (for display purposes)
-    *total_files = count_directory_files(current_directory);
+    sort_index_clear(&lazy_load->sort);
+    lazy_load_stop(lazy_load);
+    // Every record and name of the old listing goes in one shot.
+    Arena_reset(&lazy_load->arena);
+    lazy_load->dead_entries = 0;
+    lazy_load->files_loaded = 0;
+    // Drop any stream left over from the previous listing
+    dir_cursor_close(&lazy_load->cursor);
+}
+
+// Subscribes to changes of the directory about to be read. Done before
+// reading so that nothing changing during enumeration is missed; names that
+// did make it into the listing are simply re-checked.
+static void watch_listing(LazyLoadState *lazy_load, const char *current_directory) {
+    if (lazy_load->watch) dir_watch_set(lazy_load->watch, current_directory);
+}
+
+// Lazy loading version - loads initial batch
+void reload_directory_lazy(Vector *files, const char *current_directory, LazyLoadState *lazy_load) {
+    release_listing(files, lazy_load);
+    watch_listing(lazy_load, current_directory);
     
-    // Load initial batch - larger for better UX (200 files or all if less)
+    // Read the first screenful synchronously; no separate counting pass, the
+    // total becomes known once enumeration reaches the end.
     const size_t INITIAL_BATCH = 200;
-    size_t batch_size = (*total_files > INITIAL_BATCH) ? INITIAL_BATCH : *total_files;
-    
-    if (batch_size > 0) {
-        append_files_to_vec_lazy(files, current_directory, batch_size, files_loaded);
+    append_files_to_vec_lazy(files, current_directory, INITIAL_BATCH,
+                             &lazy_load->files_loaded, &lazy_load->cursor,
+                             &lazy_load->arena);
+
+    if (lazy_load->cursor.exhausted || !lazy_load->cursor.dir) {
+        lazy_load->total_files = lazy_load->files_loaded;
+        dir_cursor_close(&lazy_load->cursor);
+    } else {
+        // Hand the open stream to a background thread. If that fails the
+        // cursor stays with us and load_more_files_if_needed() reads it.
+        lazy_load->total_files = (size_t)-1;
+        lazy_load->loader = dir_loader_start(current_directory, &lazy_load->cursor);
+        lazy_load->is_loading = lazy_load->loader != NULL;
     }
+    sort_index_build(&lazy_load->sort, files, current_directory);
     
     // Makes the vector shorter
     Vector_sane_cap(files);
 }
 
+void reload_directory_full(Vector *files, const char *current_directory, LazyLoadState *lazy_load) {
+    release_listing(files, lazy_load);
+    watch_listing(lazy_load, current_directory);
+    append_files_to_vec(files, current_directory, &lazy_load->arena);
+    sort_index_build(&lazy_load->sort, files, current_directory);
+    Vector_sane_cap(files);
+    lazy_load->files_loaded = Vector_len(*files);
+    lazy_load->total_files = lazy_load->files_loaded;
+}
+
+void free_listing(Vector *files, LazyLoadState *lazy_load) {
+    release_listing(files, lazy_load);
+    sort_index_free(&lazy_load->sort);
+    Arena_bye(&lazy_load->arena);
+    dir_watch_close(lazy_load->watch);
+    lazy_load->watch = NULL;
+}
+
+// Watcher batches are only applied to a complete listing: entries still to
+// come from readdir would otherwise race with the ones the watcher adds.
+static bool listing_complete(const LazyLoadState *lazy_load) {
+    return !lazy_load->loader && lazy_load->files_loaded >= lazy_load->total_files;
+}
+
+static uint32_t name_hash(const char *s) {
+    uint32_t h = 2166136261u; // FNV-1a
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Brings the entries named in `batch` up to date: each name is lstat'ed and
+// the listing entry is added, re-stat'ed or dropped to match. Changed entries
+// are taken out and merged back in, since their sort key may have moved.
+// Returns false if the directory could not be opened.
+static bool apply_watch_batch(Vector *files, const char *current_directory,
+                              LazyLoadState *lazy_load, const DirWatchBatch *batch) {
+    size_t k = batch->count;
+    size_t n = Vector_len(*files);
+    int dir_fd = open(current_directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0) return false;
+
+    // Find every changed name in the listing with one pass over it.
+    size_t slots = 16;
+    while (slots < 2 * k) slots <<= 1;
+    uint32_t *table = calloc(slots, sizeof(*table)); // name index + 1, 0 = free
+    size_t *where = malloc(k * sizeof(*where));
+    FileAttr *changed = malloc(k * sizeof(*changed));
+    if (!table || !where || !changed) {
+        free(table);
+        free(where);
+        free(changed);
+        close(dir_fd);
+        return false;
+    }
+    for (size_t j = 0; j < k; j++) {
+        where[j] = (size_t)-1;
+        size_t s = name_hash(batch->names[j]) & (slots - 1);
+        while (table[s]) s = (s + 1) & (slots - 1);
+        table[s] = (uint32_t)(j + 1);
+    }
+    for (size_t i = 0; i < n; i++) {
+        const char *name = FileAttr_get_name((FileAttr)files->el[i]);
+        for (size_t s = name_hash(name) & (slots - 1); table[s]; s = (s + 1) & (slots - 1)) {
+            if (strcmp(batch->names[table[s] - 1], name) == 0) {
+                where[table[s] - 1] = i;
+                break;
+            }
+        }
+    }
+
+    size_t count = 0;
+    for (size_t j = 0; j < k; j++) {
+        const char *name = batch->names[j];
+        FileAttr fa = (where[j] != (size_t)-1) ? (FileAttr)files->el[where[j]] : NULL;
+        struct stat st;
+        bool exists = fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0;
+
+        if (fa) {
+            files->el[where[j]] = NULL;
+            if (!exists || FileAttr_is_dir(fa) != (bool)S_ISDIR(st.st_mode)) {
+                free_attr(fa);
+                lazy_load->dead_entries++;
+                fa = NULL;
+            }
+        }
+        if (!exists) continue;
+        if (!fa) {
+            fa = mk_attr_in(&lazy_load->arena, name, S_ISDIR(st.st_mode), st.st_ino);
+            if (!fa) continue;
+        }
+        FileAttr_set_stat(fa, &st, dir_fd);
+        changed[count++] = fa;
+    }
+    close(dir_fd);
+
+    sort_index_compact(&lazy_load->sort, files);
+    size_t first_new = Vector_len(*files);
+    if (count > 0) {
+        Vector_add(files, count);
+        memcpy(files->el + first_new, changed, count * sizeof(*changed));
+        Vector_set_len_no_free(files, first_new + count);
+    }
+    sort_index_merge(&lazy_load->sort, files, first_new, current_directory);
+    lazy_load->files_loaded = Vector_len(*files);
+    lazy_load->total_files = lazy_load->files_loaded;
+
+    free(table);
+    free(where);
+    free(changed);
+    return true;
+}
+
+// Entries dropped by watcher batches stay in the listing arena until the next
+// reload. When they outnumber the live ones, move the live ones to a fresh
+// arena so that a directory churning for hours does not grow without bound.
+static void compact_listing_arena(Vector *files, LazyLoadState *lazy_load) {
+    const size_t MIN_DEAD = 4096;
+    size_t n = Vector_len(*files);
+    if (lazy_load->dead_entries < MIN_DEAD || lazy_load->dead_entries < n) return;
+
+    SortIndex *si = &lazy_load->sort;
+    bool keyed = si->len == n;
+    Arena fresh = Arena_new(LISTING_ARENA_CHUNK);
+    for (size_t i = 0; i < n; i++) {
+        FileAttr moved = FileAttr_move_to(&fresh, (FileAttr)files->el[i]);
+        if (!moved) {
+            // Out of memory: keep the old arena alive behind the new one.
+            Arena_adopt(&fresh, &lazy_load->arena);
+            break;
+        }
+        files->el[i] = moved;
+        if (keyed) si->keys[i].item = moved;
+    }
+    Arena_bye(&lazy_load->arena);
+    lazy_load->arena = fresh;
+    lazy_load->dead_entries = 0;
+}
+
+bool poll_directory_watch(LazyLoadState *lazy_load) {
+    if (!dir_watch_active(lazy_load->watch)) return false;
+    if (!dir_watch_poll(lazy_load->watch)) return false;
+    if (!listing_complete(lazy_load)) return false;
+
+    // Coalesce: a directory changing continuously is applied a few times a
+    // second, not once per event.
+    const long APPLY_INTERVAL_NS = 100000000L; // 100ms
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long dt_ns = (now.tv_sec - lazy_load->last_watch_time.tv_sec) * 1000000000L +
+                 (now.tv_nsec - lazy_load->last_watch_time.tv_nsec);
+    return dt_ns >= APPLY_INTERVAL_NS;
+}
+
+// The sizes of the directories above a changed name are out of date.
+static void invalidate_dir_sizes(const char *current_directory, const DirWatchBatch *batch) {
+    if (batch->overflow) {
+        dir_size_invalidate(current_directory);
+        return;
+    }
+    char path[MAX_PATH_LENGTH];
+    for (size_t i = 0; i < batch->count; i++) {
+        path_join(path, current_directory, batch->names[i]);
+        dir_size_invalidate(path);
+    }
+}
+
+void sync_directory_changes(Vector *files, const char *current_directory, LazyLoadState *lazy_load) {
+    DirWatchBatch batch;
+    if (!lazy_load->watch || !dir_watch_take(lazy_load->watch, &batch)) return;
+    clock_gettime(CLOCK_MONOTONIC, &lazy_load->last_watch_time);
+    invalidate_dir_sizes(current_directory, &batch);
+
+    if (batch.overflow || !apply_watch_batch(files, current_directory, lazy_load, &batch)) {
+        reload_directory_full(files, current_directory, lazy_load);
+        return;
+    }
+    compact_listing_arena(files, lazy_load);
+}
+
+void refresh_directory(Vector *files, const char *current_directory, LazyLoadState *lazy_load) {
+    if (!dir_watch_active(lazy_load->watch) || !listing_complete(lazy_load)) {
+        reload_directory_full(files, current_directory, lazy_load);
+        return;
+    }
+    // Events are queued before the syscall that caused them returns, so the
+    // batch already covers the operation that just finished.
+    DirWatchBatch batch;
+    if (!dir_watch_take(lazy_load->watch, &batch)) return;
+    invalidate_dir_sizes(current_directory, &batch);
+    if (batch.overflow || !apply_watch_batch(files, current_directory, lazy_load, &batch)) {
+        reload_directory_full(files, current_directory, lazy_load);
+    }
+}
+
+size_t poll_lazy_load(Vector *files, LazyLoadState *lazy_load) {
+    if (!lazy_load || !lazy_load->loader) return 0;
+
+    bool done = false;
+    size_t first_new = Vector_len(*files);
+    size_t added = dir_loader_drain(lazy_load->loader, files, &done);
+    lazy_load->files_loaded += added;
+    // Loader entries carry their metadata already; no directory needed.
+    sort_index_merge(&lazy_load->sort, files, first_new, NULL);
+    if (done) {
+        // The drained entries now belong to the listing arena.
+        dir_loader_finish(lazy_load->loader, &lazy_load->arena);
+        lazy_load->loader = NULL;
+        lazy_load->is_loading = false;
+        lazy_load->total_files = lazy_load->files_loaded;
+    }
+    return added;
+}
+
+// New entries are merged into sorted position, so the entry under the cursor
+// may move; keep the cursor (and the screen line) on it. A view still at the
+// top stays there.
+static void follow_cursor_entry(Vector *files, CursorAndSlice *cas, FileAttr entry) {
+    cas->num_files = Vector_len(*files);
+    if (cas->cursor == 0 && cas->start == 0) return;
+    size_t idx = listing_index_of(files, entry);
+    if (idx != (size_t)-1 && (SIZE)idx != cas->cursor) {
+        move_cursor_with_entry(cas, (SIZE)idx);
+    }
+}
+
 // Load more files when user scrolls near the end
-// Note: CursorAndSlice is defined in main.c, this function is implemented here but declared in utils.h
-void load_more_files_if_needed(Vector *files, const char *current_directory, void *cas_ptr, size_t *files_loaded, size_t total_files) {
-    // Cast to access CursorAndSlice fields (defined in main.c)
-    typedef struct {
-        SIZE start;
-        SIZE cursor;
-        SIZE num_lines;
-        SIZE num_files;
-    } CursorAndSlice;
+// Note: the CursorAndSlice comes in as void * because utils.h does not see browser_ui.h
+void load_more_files_if_needed(Vector *files, const char *current_directory, void *cas_ptr, LazyLoadState *lazy_load) {
     CursorAndSlice *cas = (CursorAndSlice *)cas_ptr;
+    size_t *files_loaded = &lazy_load->files_loaded;
+    size_t total_files = lazy_load->total_files;
+    FileAttr at_cursor = (cas->cursor >= 0 && (size_t)cas->cursor < Vector_len(*files))
+                             ? (FileAttr)files->el[cas->cursor] : NULL;
     
+    // The background loader publishes on its own; just take what is ready.
+    if (lazy_load->loader) {
+        if (poll_lazy_load(files, lazy_load) > 0) {
+            follow_cursor_entry(files, cas, at_cursor);
+        }
+        cas->num_files = Vector_len(*files);
+        return;
+    }
+
     // Only load more if we haven't loaded all files yet
     if (total_files > 0 && *files_loaded >= total_files) {
         return;  // All files already loaded
@@ -1144,8 +1422,15 @@ void load_more_files_if_needed(Vector *files, const char *current_directory, voi
         size_t remaining = (total_files > *files_loaded) ? (total_files - *files_loaded) : 200;
         size_t batch_size = (remaining > 200) ? 200 : remaining;  // Load 200 at a time for better performance
         
-        append_files_to_vec_lazy(files, current_directory, batch_size, files_loaded);
-        cas->num_files = Vector_len(*files);
+        size_t first_new = Vector_len(*files);
+        append_files_to_vec_lazy(files, current_directory, batch_size, files_loaded,
+                                 &lazy_load->cursor, &lazy_load->arena);
+        sort_index_merge(&lazy_load->sort, files, first_new, current_directory);
+        follow_cursor_entry(files, cas, at_cursor);
+        if (lazy_load->cursor.exhausted) {
+            lazy_load->total_files = *files_loaded;
+            dir_cursor_close(&lazy_load->cursor);
+        }
         
         // Make the vector shorter if needed
         Vector_sane_cap(files);
@@ -20,8 +20,28 @@ void preview_file(const char *filename);
 void change_directory(const char *new_directory, const char ***files, int *num_files, int *selected_entry, int *start_entry, int *end_entry);
 void path_join(char *result, const char *base, const char *extra);
 void reload_directory(Vector *files, const char *current_directory);
-void reload_directory_lazy(Vector *files, const char *current_directory, size_t *files_loaded, size_t *total_files);
-void load_more_files_if_needed(Vector *files, const char *current_directory, void *cas, size_t *files_loaded, size_t total_files);
+struct LazyLoadState;
+void reload_directory_lazy(Vector *files, const char *current_directory, struct LazyLoadState *lazy_load);
+// Synchronous full reload that also stops any background enumeration.
+void reload_directory_full(Vector *files, const char *current_directory, struct LazyLoadState *lazy_load);
+// Drops the entries of the listing but keeps its buffers for the next one.
+void release_listing(Vector *files, struct LazyLoadState *lazy_load);
+// Frees the listing and its arena for good (shutdown).
+void free_listing(Vector *files, struct LazyLoadState *lazy_load);
+// Moves entries published by the background loader into `files`. Returns how
+// many were appended; total_files becomes exact once the loader finishes.
+size_t poll_lazy_load(Vector *files, struct LazyLoadState *lazy_load);
+// Reads what the directory watcher reported and returns true once a batch is
+// due (coalesced, and only for a completely loaded listing).
+bool poll_directory_watch(struct LazyLoadState *lazy_load);
+// Applies the watcher's batch to `files` in place (full reload if events were
+// lost). Entries may be moved to a new arena, so names taken from the listing
+// must be copied before the call.
+void sync_directory_changes(Vector *files, const char *current_directory, struct LazyLoadState *lazy_load);
+// Brings the listing up to date after a file operation of our own: applies
+// the watcher's deltas, or reloads fully when the directory is not watched.
+void refresh_directory(Vector *files, const char *current_directory, struct LazyLoadState *lazy_load);
+void load_more_files_if_needed(Vector *files, const char *current_directory, void *cas, struct LazyLoadState *lazy_load);
 
 // short cut utils
 void copy_to_clipboard(const char *path);
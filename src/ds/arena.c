@@ -0,0 +1,193 @@
+// File: src/ds/arena.c
+// -----------------------
+#include <stddef.h> // for size_t, max_align_t
+#include <stdlib.h> // for malloc, free
+#include <string.h> // for memcpy, strlen
+
+#include "arena.h"
+
+#define ARENA_ALIGN _Alignof(max_align_t)
+// Requests above this share of a chunk get a chunk of their own
+#define ARENA_LARGE_DIVISOR 4
+
+struct ArenaChunk {
+    ArenaChunk *next;
+    size_t cap;
+    size_t used;
+    _Alignas(max_align_t) unsigned char data[];
+};
+
+static size_t align_up(size_t n) {
+    return (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+static ArenaChunk *chunk_new(size_t cap) {
+    ArenaChunk *chunk = malloc(sizeof(ArenaChunk) + cap);
+    if (!chunk) {
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->cap = cap;
+    chunk->used = 0;
+    return chunk;
+}
+/**
+ * Function to create a new Arena
+ *
+ * @param chunk_size the size of the chunks the arena carves allocations from
+ * @return a new, empty Arena
+ */
+Arena Arena_new(size_t chunk_size) {
+    Arena arena = {
+        .head = NULL,
+        .chunk_size = chunk_size > 0 ? align_up(chunk_size) : 64 * 1024,
+    };
+    return arena;
+}
+/**
+ * Function to allocate memory from an Arena
+ *
+ * @param arena the Arena to allocate from
+ * @param size the number of bytes needed
+ * @return a pointer aligned for any type, or NULL if out of memory
+ */
+void *Arena_alloc(Arena *arena, size_t size) {
+    if (!arena) {
+        return NULL;
+    }
+    size = align_up(size > 0 ? size : 1);
+
+    ArenaChunk *head = arena->head;
+    if (head && head->cap - head->used >= size) {
+        void *p = head->data + head->used;
+        head->used += size;
+        return p;
+    }
+
+    if (size > arena->chunk_size / ARENA_LARGE_DIVISOR) {
+        // A dedicated chunk keeps the current one usable for small requests.
+        ArenaChunk *chunk = chunk_new(size);
+        if (!chunk) {
+            return NULL;
+        }
+        chunk->used = size;
+        if (head) {
+            chunk->next = head->next;
+            head->next = chunk;
+        } else {
+            arena->head = chunk;
+        }
+        return chunk->data;
+    }
+
+    ArenaChunk *chunk = chunk_new(arena->chunk_size);
+    if (!chunk) {
+        return NULL;
+    }
+    chunk->next = head;
+    chunk->used = size;
+    arena->head = chunk;
+    return chunk->data;
+}
+/**
+ * Function to copy a string into an Arena
+ *
+ * @param arena the Arena to allocate from
+ * @param s the string to copy
+ * @return the copy, or NULL if out of memory
+ */
+char *Arena_strdup(Arena *arena, const char *s) {
+    if (!s) {
+        return NULL;
+    }
+    size_t len = strlen(s) + 1;
+    char *copy = Arena_alloc(arena, len);
+    if (copy) {
+        memcpy(copy, s, len);
+    }
+    return copy;
+}
+/**
+ * Function to release all allocations of an Arena at once. One regular-sized
+ * chunk is kept so refilling the arena does not go back to malloc.
+ *
+ * @param arena the Arena to reset
+ */
+void Arena_reset(Arena *arena) {
+    if (!arena) {
+        return;
+    }
+    ArenaChunk *keep = NULL;
+    ArenaChunk *chunk = arena->head;
+    while (chunk) {
+        ArenaChunk *next = chunk->next;
+        if (!keep && chunk->cap == arena->chunk_size) {
+            keep = chunk;
+        } else {
+            free(chunk);
+        }
+        chunk = next;
+    }
+    if (keep) {
+        keep->next = NULL;
+        keep->used = 0;
+    }
+    arena->head = keep;
+}
+/**
+ * Function to move the memory of one Arena into another. Pointers handed out
+ * by `src` stay valid and are released together with `dst`.
+ *
+ * @param dst the Arena that takes ownership
+ * @param src the Arena to empty
+ */
+void Arena_adopt(Arena *dst, Arena *src) {
+    if (!dst || !src || dst == src || !src->head) {
+        return;
+    }
+    // Append behind dst's head so dst keeps filling its current chunk.
+    ArenaChunk *tail = src->head;
+    while (tail->next) {
+        tail = tail->next;
+    }
+    if (dst->head) {
+        tail->next = dst->head->next;
+        dst->head->next = src->head;
+    } else {
+        dst->head = src->head;
+    }
+    src->head = NULL;
+}
+/**
+ * Function to get the memory footprint of an Arena
+ *
+ * @param arena the Arena to measure
+ * @return the capacity of all its chunks in bytes
+ */
+size_t Arena_size(const Arena *arena) {
+    if (!arena) {
+        return 0;
+    }
+    size_t size = 0;
+    for (const ArenaChunk *chunk = arena->head; chunk; chunk = chunk->next) {
+        size += chunk->cap;
+    }
+    return size;
+}
+/**
+ * Function to free the memory allocated for an Arena
+ *
+ * @param arena the Arena to free
+ */
+void Arena_bye(Arena *arena) {
+    if (!arena) {
+        return;
+    }
+    ArenaChunk *chunk = arena->head;
+    while (chunk) {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->head = NULL;
+}
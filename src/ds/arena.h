@@ -0,0 +1,37 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct ArenaChunk ArenaChunk;
+
+// Bump allocator for objects that all die together. Memory is carved out of
+// large chunks and only ever released as a whole with Arena_reset() or
+// Arena_bye(); there is no per-object free.
+typedef struct {
+    ArenaChunk *head;  // chunk currently being filled
+    size_t chunk_size;
+} Arena;
+
+// "Constructor"; no memory is allocated until the first Arena_alloc()
+Arena Arena_new(size_t chunk_size);
+
+// Returns `size` bytes aligned for any type, or NULL on allocation failure
+void  *Arena_alloc(Arena *arena, size_t size);
+
+// Copies a NUL-terminated string into the arena
+char  *Arena_strdup(Arena *arena, const char *s);
+
+// Releases everything allocated so far but keeps one chunk for reuse
+void   Arena_reset(Arena *arena);
+
+// Moves all memory of `src` into `dst`; `src` is left empty and reusable
+void   Arena_adopt(Arena *dst, Arena *src);
+
+// Bytes held from malloc (chunk capacities), used or not
+size_t Arena_size(const Arena *arena);
+
+// Frees every chunk
+void   Arena_bye(Arena *arena);
+
+#endif // ARENA_H
@@ -0,0 +1,360 @@
+// File: src/ds/keysort.c
+// -----------------------
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <pthread.h>  // for pthread_create, pthread_join
+#include <stdbool.h>  // for bool
+#include <string.h>   // for memcpy
+#include <unistd.h>   // for sysconf
+
+#include "keysort.h"
+
+#define KEY_BYTES 24              // bytes in KeySortRec.key
+#define SMALL_SORT 48             // insertion sort at or below this many records
+#define MERGE_RUN 16              // initial run length of the tie merge sort
+#define PARALLEL_MIN (1 << 15)    // fewer records than this are sorted on one thread
+#define PER_THREAD_MIN (1 << 14)  // smallest share worth a thread of its own
+#define MAX_THREADS 8
+
+static const KeySortOpts default_opts = {0};
+
+static inline int key_cmp(const KeySortRec *a, const KeySortRec *b) {
+    for (int w = 0; w < 3; w++) {
+        if (a->key[w] != b->key[w]) return a->key[w] < b->key[w] ? -1 : 1;
+    }
+    return 0;
+}
+
+int KeySort_compare(const KeySortRec *a, const KeySortRec *b, const KeySortOpts *opts) {
+    int c = key_cmp(a, b);
+    if (c || !opts || !opts->tie) return c;
+    return opts->tie(a->item, b->item, opts->ctx);
+}
+
+// Byte `byte` (0 = most significant byte of key[0]) of a record's key
+static inline unsigned key_byte(const KeySortRec *r, int byte) {
+    return (unsigned)(r->key[byte >> 3] >> (56 - 8 * (byte & 7))) & 0xffu;
+}
+
+static void insertion_sort(KeySortRec *a, size_t n, const KeySortOpts *o) {
+    for (size_t i = 1; i < n; i++) {
+        KeySortRec r = a[i];
+        size_t j = i;
+        while (j > 0 && KeySort_compare(&r, &a[j - 1], o) < 0) {
+            a[j] = a[j - 1];
+            j--;
+        }
+        a[j] = r;
+    }
+}
+
+static void merge_runs(const KeySortRec *x, size_t nx, const KeySortRec *y, size_t ny,
+                       KeySortRec *out, const KeySortOpts *o) {
+    size_t i = 0, j = 0, k = 0;
+    while (i < nx && j < ny) {
+        // Stable: on equal records the left run wins
+        if (KeySort_compare(&y[j], &x[i], o) < 0) out[k++] = y[j++];
+        else out[k++] = x[i++];
+    }
+    if (i < nx) memcpy(out + k, x + i, (nx - i) * sizeof(*x));
+    if (j < ny) memcpy(out + k, y + j, (ny - j) * sizeof(*y));
+}
+
+// Bottom-up merge sort of `a`, `tmp` as scratch; result ends up in `a`
+static void merge_sort(KeySortRec *a, KeySortRec *tmp, size_t n, const KeySortOpts *o) {
+    for (size_t lo = 0; lo < n; lo += MERGE_RUN) {
+        insertion_sort(a + lo, (n - lo < MERGE_RUN) ? n - lo : MERGE_RUN, o);
+    }
+    KeySortRec *src = a, *dst = tmp;
+    for (size_t width = MERGE_RUN; width < n; width *= 2) {
+        for (size_t lo = 0; lo < n; lo += 2 * width) {
+            size_t mid = (lo + width < n) ? lo + width : n;
+            size_t hi = (lo + 2 * width < n) ? lo + 2 * width : n;
+            merge_runs(src + lo, mid - lo, src + mid, hi - mid, dst + lo, o);
+        }
+        KeySortRec *t = src;
+        src = dst;
+        dst = t;
+    }
+    if (src != a) memcpy(a, src, n * sizeof(*a));
+}
+
+// MSD radix sort of `src` on key bytes from `byte` on, with `dst` as the
+// other buffer of the ping-pong. The result lands in `dst` if `to_dst`.
+static void radix_sort(KeySortRec *src, KeySortRec *dst, size_t n, int byte, bool to_dst,
+                       const KeySortOpts *o) {
+    for (;;) {
+        if (n <= SMALL_SORT) {
+            insertion_sort(src, n, o);
+            break;
+        }
+        if (byte == KEY_BYTES) {
+            // Every key byte is equal; only the tie function can order these
+            if (o->tie) merge_sort(src, dst, n, o);
+            break;
+        }
+
+        size_t count[256] = {0};
+        for (size_t i = 0; i < n; i++) count[key_byte(&src[i], byte)]++;
+        if (count[key_byte(&src[0], byte)] == n) {
+            // Shared byte (common name prefix, group byte): nothing to move
+            byte++;
+            continue;
+        }
+
+        size_t start[256], pos[256];
+        size_t sum = 0;
+        for (int b = 0; b < 256; b++) {
+            start[b] = pos[b] = sum;
+            sum += count[b];
+        }
+        for (size_t i = 0; i < n; i++) {
+            dst[pos[key_byte(&src[i], byte)]++] = src[i];
+        }
+        for (int b = 0; b < 256; b++) {
+            if (count[b]) {
+                radix_sort(dst + start[b], src + start[b], count[b], byte + 1, !to_dst, o);
+            }
+        }
+        return;
+    }
+    if (to_dst) memcpy(dst, src, n * sizeof(*src));
+}
+
+static int thread_count(const KeySortOpts *o, size_t n) {
+    if (o->threads == 1 || n < PARALLEL_MIN) return 1;
+    long t = o->threads > 0 ? o->threads : sysconf(_SC_NPROCESSORS_ONLN);
+    if (t > MAX_THREADS) t = MAX_THREADS;
+    if ((size_t)t > n / PER_THREAD_MIN) t = (long)(n / PER_THREAD_MIN);
+    return t > 1 ? (int)t : 1;
+}
+
+// Runs fn over `count` tasks of `size` bytes each, one thread per task (the
+// calling thread takes the first). A task whose thread cannot be started runs
+// inline.
+static void run_tasks(void *(*fn)(void *), void *tasks, size_t size, int count) {
+    pthread_t tid[MAX_THREADS * 2];
+    bool started[MAX_THREADS * 2] = {false};
+    unsigned char *base = tasks;
+    for (int i = 1; i < count; i++) {
+        started[i] = pthread_create(&tid[i], NULL, fn, base + (size_t)i * size) == 0;
+    }
+    fn(base);
+    for (int i = 1; i < count; i++) {
+        if (started[i]) pthread_join(tid[i], NULL);
+        else fn(base + (size_t)i * size);
+    }
+}
+
+typedef struct {
+    KeySortRec *recs;
+    void *const *items;
+    size_t n;
+    KeySortKeyFn key_fn;
+    void *ctx;
+} ExtractTask;
+
+static void *extract_task(void *arg) {
+    ExtractTask *t = arg;
+    for (size_t i = 0; i < t->n; i++) {
+        t->recs[i].item = t->items[i];
+        t->key_fn(&t->recs[i], t->ctx);
+    }
+    return NULL;
+}
+
+typedef struct {
+    KeySortRec *recs;
+    KeySortRec *scratch;
+    size_t n;
+    const KeySortOpts *opts;
+} SortTask;
+
+static void *sort_task(void *arg) {
+    SortTask *t = arg;
+    radix_sort(t->recs, t->scratch, t->n, 0, false, t->opts);
+    return NULL;
+}
+
+typedef struct {
+    const KeySortRec *x;
+    size_t nx;
+    const KeySortRec *y;
+    size_t ny;
+    KeySortRec *out;
+    const KeySortOpts *opts;
+} MergeTask;
+
+static void *merge_task(void *arg) {
+    MergeTask *t = arg;
+    merge_runs(t->x, t->nx, t->y, t->ny, t->out, t->opts);
+    return NULL;
+}
+
+// How many of the first k merged records come from x (merge path search)
+static size_t merge_split(const KeySortRec *x, size_t nx, const KeySortRec *y, size_t ny,
+                          size_t k, const KeySortOpts *o) {
+    size_t lo = k > ny ? k - ny : 0;
+    size_t hi = k < nx ? k : nx;
+    while (lo < hi) {
+        size_t i = lo + (hi - lo) / 2;
+        if (KeySort_compare(&y[k - i - 1], &x[i], o) < 0) hi = i;
+        else lo = i + 1;
+    }
+    return lo;
+}
+
+// Splits the merge of x and y into `parts` independent pieces of equal output
+// size, appended to `tasks`. Returns the number of tasks added.
+static int plan_merge(const KeySortRec *x, size_t nx, const KeySortRec *y, size_t ny,
+                      KeySortRec *out, int parts, const KeySortOpts *o, MergeTask *tasks) {
+    size_t n = nx + ny;
+    size_t prev_k = 0, prev_i = 0;
+    for (int p = 1; p <= parts; p++) {
+        size_t k = n * (size_t)p / (size_t)parts;
+        size_t i = (p == parts) ? nx : merge_split(x, nx, y, ny, k, o);
+        tasks[p - 1] = (MergeTask){
+            .x = x + prev_i, .nx = i - prev_i,
+            .y = y + (prev_k - prev_i), .ny = (k - i) - (prev_k - prev_i),
+            .out = out + prev_k, .opts = o,
+        };
+        prev_k = k;
+        prev_i = i;
+    }
+    return parts;
+}
+
+/**
+ * Function to build the records of a set of items
+ *
+ * @param recs the destination for n records
+ * @param items the items, one per record
+ * @param n the number of items
+ * @param key_fn fills the key of one record
+ * @param ctx passed to key_fn
+ * @param opts the thread count, or NULL
+ */
+void KeySort_extract(KeySortRec *recs, void *const *items, size_t n,
+                     KeySortKeyFn key_fn, void *ctx, const KeySortOpts *opts) {
+    const KeySortOpts *o = opts ? opts : &default_opts;
+    int threads = thread_count(o, n);
+    ExtractTask tasks[MAX_THREADS];
+    for (int t = 0; t < threads; t++) {
+        size_t lo = n * (size_t)t / (size_t)threads;
+        size_t hi = n * (size_t)(t + 1) / (size_t)threads;
+        tasks[t] = (ExtractTask){ recs + lo, items + lo, hi - lo, key_fn, ctx };
+    }
+    run_tasks(extract_task, tasks, sizeof(tasks[0]), threads);
+}
+
+/**
+ * Function to merge two sorted runs
+ *
+ * @param x the first sorted run; wins ties
+ * @param nx the length of x
+ * @param y the second sorted run
+ * @param ny the length of y
+ * @param out the destination for nx + ny records
+ * @param opts the tie function and thread count, or NULL
+ */
+void KeySort_merge(const KeySortRec *x, size_t nx, const KeySortRec *y, size_t ny,
+                   KeySortRec *out, const KeySortOpts *opts) {
+    const KeySortOpts *o = opts ? opts : &default_opts;
+    int threads = thread_count(o, nx + ny);
+    if (threads <= 1 || nx == 0 || ny == 0) {
+        merge_runs(x, nx, y, ny, out, o);
+        return;
+    }
+    MergeTask tasks[MAX_THREADS];
+    int count = plan_merge(x, nx, y, ny, out, threads, o, tasks);
+    run_tasks(merge_task, tasks, sizeof(tasks[0]), count);
+}
+
+/**
+ * Function to sort records by key
+ *
+ * @param recs the records to sort in place
+ * @param scratch a buffer of at least n records
+ * @param n the number of records
+ * @param opts the tie function and thread count, or NULL
+ */
+void KeySort_sort(KeySortRec *recs, KeySortRec *scratch, size_t n, const KeySortOpts *opts) {
+    const KeySortOpts *o = opts ? opts : &default_opts;
+    int threads = thread_count(o, n);
+    if (threads <= 1) {
+        radix_sort(recs, scratch, n, 0, false, o);
+        return;
+    }
+
+    // Each thread radix-sorts one slice...
+    size_t bounds[MAX_THREADS + 1];
+    SortTask sorts[MAX_THREADS];
+    for (int t = 0; t <= threads; t++) bounds[t] = n * (size_t)t / (size_t)threads;
+    for (int t = 0; t < threads; t++) {
+        sorts[t] = (SortTask){ recs + bounds[t], scratch + bounds[t], bounds[t + 1] - bounds[t], o };
+    }
+    run_tasks(sort_task, sorts, sizeof(sorts[0]), threads);
+
+    // ...then neighbouring slices are merged pairwise, every round spread
+    // over all threads, until one run is left.
+    KeySortRec *src = recs, *dst = scratch;
+    int runs = threads;
+    while (runs > 1) {
+        MergeTask tasks[MAX_THREADS * 2];
+        int count = 0;
+        int pairs = runs / 2;
+        int parts = threads / pairs > 0 ? threads / pairs : 1;
+        int next = 0;
+        for (int r = 0; r < runs; r += 2) {
+            size_t lo = bounds[r];
+            size_t mid = bounds[r + 1];
+            size_t hi = (r + 2 <= runs) ? bounds[r + 2] : mid;
+            if (r + 1 == runs) {
+                // Odd run out: carried over as a merge with nothing
+                tasks[count++] = (MergeTask){ src + lo, mid - lo, src + mid, 0, dst + lo, o };
+            } else {
+                count += plan_merge(src + lo, mid - lo, src + mid, hi - mid, dst + lo,
+                                    parts, o, tasks + count);
+            }
+            bounds[next++] = lo;
+        }
+        bounds[next] = n;
+        run_tasks(merge_task, tasks, sizeof(tasks[0]), count);
+        runs = next;
+
+        KeySortRec *t = src;
+        src = dst;
+        dst = t;
+    }
+    if (src != recs) memcpy(recs, src, n * sizeof(*recs));
+}
+
+static inline unsigned char ascii_lower(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c + ('a' - 'A')) : c;
+}
+
+void KeySort_casefold_prefix(const char *s, uint64_t *out, size_t words) {
+    bool ended = false;
+    for (size_t w = 0; w < words; w++) {
+        uint64_t v = 0;
+        for (int b = 0; b < 8; b++) {
+            unsigned char c = ended ? 0 : ascii_lower((unsigned char)*s);
+            if (c) s++;
+            else ended = true;
+            v = (v << 8) | c;
+        }
+        out[w] = v;
+    }
+}
+
+int KeySort_casecmp(const char *a, const char *b) {
+    const unsigned char *x = (const unsigned char *)a;
+    const unsigned char *y = (const unsigned char *)b;
+    for (;; x++, y++) {
+        unsigned char cx = ascii_lower(*x), cy = ascii_lower(*y);
+        if (cx != cy) return cx < cy ? -1 : 1;
+        if (!cx) return 0;
+    }
+}
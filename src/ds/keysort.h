@@ -0,0 +1,57 @@
+#ifndef KEYSORT_H
+#define KEYSORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Sort engine for large arrays of items ordered by a fixed-width key.
+//
+// Callers extract each item's key prefix once (name bytes, size, mtime, ...)
+// into a flat array of records; the engine then never touches the items
+// except to break ties between records whose 24 key bytes are all equal.
+// Records are sorted with an MSD radix sort on the key bytes; large inputs are
+// split across threads and the sorted runs merged in parallel.
+//
+// Both the sort and the merge are stable.
+typedef struct {
+    uint64_t key[3]; // compared in order as unsigned integers
+    void *item;
+} KeySortRec;
+
+// Orders two items whose keys are equal; 0 keeps their input order.
+typedef int (*KeySortTieFn)(const void *a, const void *b, void *ctx);
+
+// Fills rec->key for the item in rec->item.
+typedef void (*KeySortKeyFn)(KeySortRec *rec, void *ctx);
+
+typedef struct {
+    KeySortTieFn tie; // NULL: equal keys keep their input order
+    void *ctx;
+    int threads;      // 0: one per online CPU (capped); 1: single-threaded
+} KeySortOpts;
+
+// Builds one record per item: rec->item = items[i], then key_fn fills the key.
+// Large inputs are spread over threads, so key_fn must be safe to run
+// concurrently on different items.
+void KeySort_extract(KeySortRec *recs, void *const *items, size_t n,
+                     KeySortKeyFn key_fn, void *ctx, const KeySortOpts *opts);
+
+// Sorts `n` records in place. `scratch` must hold `n` records.
+void KeySort_sort(KeySortRec *recs, KeySortRec *scratch, size_t n, const KeySortOpts *opts);
+
+// Merges the sorted runs `x` and `y` into `out` (nx + ny records, not
+// overlapping either run). On equal records `x` goes first.
+void KeySort_merge(const KeySortRec *x, size_t nx, const KeySortRec *y, size_t ny,
+                   KeySortRec *out, const KeySortOpts *opts);
+
+// Full record order: key words, then the tie function.
+int KeySort_compare(const KeySortRec *a, const KeySortRec *b, const KeySortOpts *opts);
+
+// Packs the first 8 * `words` bytes of `s`, ASCII lower-cased and zero padded,
+// big-endian into `out`, so that key order matches KeySort_casecmp() order.
+void KeySort_casefold_prefix(const char *s, uint64_t *out, size_t words);
+
+// Byte-wise compare with ASCII letters folded to lower case.
+int KeySort_casecmp(const char *a, const char *b);
+
+#endif // KEYSORT_H
@@ -0,0 +1,326 @@
+// File: dir_loader.c
+// Background directory enumeration with incremental publishing
+#define _GNU_SOURCE // syscall()
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "dir_loader.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "frame_sched.h"
+#include "globals.h"
+
+#define DIR_LOADER_BATCH 512
+#define DIR_LOADER_PUBLISH_NS 20000000L // 20ms
+
+// From linux/ioprio.h, which not every libc ships.
+#define DIR_LOADER_IOPRIO_WHO_PROCESS 1
+#define DIR_LOADER_IOPRIO_CLASS_IDLE 3
+#define DIR_LOADER_IOPRIO_CLASS_SHIFT 13
+#define DIR_LOADER_PREFETCH_NICE 10
+
+struct DirLoader {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    char path[MAX_PATH_LENGTH];
+    DirCursor cursor; // owned by the thread until it finishes
+    Vector pending;   // back buffer: published by the thread, not yet drained
+    Vector spare;     // front buffer: swapped with `pending` on drain
+    Arena arena;      // backs every entry the thread creates
+    size_t found;
+    bool finished;
+    bool cancelled;
+    bool background;  // speculative: idle I/O class, lower CPU priority
+};
+
+static void free_attr_vector(Vector *v) {
+    if (!v->el) return;
+    for (size_t i = 0; i < Vector_len(*v); i++) {
+        free_attr((FileAttr)v->el[i]);
+    }
+    Vector_set_len_no_free(v, 0);
+}
+
+static void dir_loader_free(DirLoader *ld) {
+    dir_cursor_close(&ld->cursor);
+    free_attr_vector(&ld->pending);
+    free_attr_vector(&ld->spare);
+    free(ld->pending.el);
+    free(ld->spare.el);
+    Arena_bye(&ld->arena);
+    pthread_cond_destroy(&ld->cond);
+    pthread_mutex_destroy(&ld->mutex);
+    free(ld);
+}
+
+static long elapsed_ns(const struct timespec *since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000000000L + (now.tv_nsec - since->tv_nsec);
+}
+
+// Hands the thread-private batch over to the UI side.
+static void dir_loader_publish(DirLoader *ld, Vector *batch) {
+    size_t n = Vector_len(*batch);
+    if (n == 0) return;
+
+    pthread_mutex_lock(&ld->mutex);
+    if (ld->cancelled) {
+        pthread_mutex_unlock(&ld->mutex);
+        free_attr_vector(batch);
+        return;
+    }
+    size_t len = Vector_len(ld->pending);
+    Vector_add(&ld->pending, n);
+    memcpy(ld->pending.el + len, batch->el, n * sizeof(void *));
+    Vector_set_len_no_free(&ld->pending, len + n);
+    ld->found += n;
+    pthread_cond_broadcast(&ld->cond);
+    pthread_mutex_unlock(&ld->mutex);
+
+    Vector_set_len_no_free(batch, 0);
+    if (!ld->background) frame_sched_post(FRAME_DIRECTORY);
+}
+
+static bool dir_loader_is_cancelled(DirLoader *ld) {
+    pthread_mutex_lock(&ld->mutex);
+    bool cancelled = ld->cancelled;
+    pthread_mutex_unlock(&ld->mutex);
+    return cancelled;
+}
+
+// Same rule as is_directory(): symlinks count as directories if their
+// target is one.
+static bool dir_loader_entry_is_dir(int fd, const char *name, const struct stat *lst) {
+    if (lst && !S_ISLNK(lst->st_mode)) return S_ISDIR(lst->st_mode);
+    struct stat st;
+    return fstatat(fd, name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+}
+
+// Moves the calling thread to the idle I/O class, so speculative reads only
+// use the disk when nothing else wants it. Best effort: on kernels or
+// schedulers without I/O priorities the thread simply runs at normal priority.
+static void dir_loader_lower_priority(void) {
+#ifdef SYS_ioprio_set
+    syscall(SYS_ioprio_set, DIR_LOADER_IOPRIO_WHO_PROCESS, 0,
+            DIR_LOADER_IOPRIO_CLASS_IDLE << DIR_LOADER_IOPRIO_CLASS_SHIFT);
+#endif
+#ifdef SYS_gettid
+    // Linux applies nice values per thread.
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), DIR_LOADER_PREFETCH_NICE);
+#endif
+}
+
+static void *dir_loader_thread(void *arg) {
+    DirLoader *ld = (DirLoader *)arg;
+    if (ld->background) dir_loader_lower_priority();
+    Vector batch = Vector_new(DIR_LOADER_BATCH);
+    int fd = dirfd(ld->cursor.dir);
+
+    struct timespec last_publish;
+    clock_gettime(CLOCK_MONOTONIC, &last_publish);
+
+    while (batch.el) {
+        // Checking once per entry keeps cancellation latency at one readdir().
+        if (dir_loader_is_cancelled(ld)) break;
+
+        struct dirent *entry = readdir(ld->cursor.dir);
+        if (entry == NULL) {
+            ld->cursor.exhausted = true;
+            break;
+        }
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        // Off the UI thread, so metadata is filled here and redraws of these
+        // rows never stat.
+        struct stat st;
+        bool have_stat = fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0;
+
+        bool is_dir = false;
+#ifdef DT_DIR
+        if (entry->d_type == DT_DIR) {
+            is_dir = true;
+        } else if (entry->d_type == DT_UNKNOWN) {
+            is_dir = dir_loader_entry_is_dir(fd, entry->d_name, have_stat ? &st : NULL);
+        }
+#else
+        is_dir = dir_loader_entry_is_dir(fd, entry->d_name, have_stat ? &st : NULL);
+#endif
+
+        FileAttr fa = mk_attr_in(&ld->arena, entry->d_name, is_dir, entry->d_ino);
+        if (!fa) continue;
+        if (have_stat) FileAttr_set_stat(fa, &st, fd);
+
+        size_t len = Vector_len(batch);
+        Vector_add(&batch, 1);
+        batch.el[len] = fa;
+        Vector_set_len_no_free(&batch, len + 1);
+
+        if (Vector_len(batch) >= DIR_LOADER_BATCH ||
+            elapsed_ns(&last_publish) >= DIR_LOADER_PUBLISH_NS) {
+            dir_loader_publish(ld, &batch);
+            clock_gettime(CLOCK_MONOTONIC, &last_publish);
+        }
+    }
+
+    if (batch.el) {
+        dir_loader_publish(ld, &batch);
+        free_attr_vector(&batch);
+        free(batch.el);
+    }
+
+    pthread_mutex_lock(&ld->mutex);
+    ld->finished = true;
+    bool orphaned = ld->cancelled;
+    bool background = ld->background; // `ld` may be freed once unlocked
+    pthread_cond_broadcast(&ld->cond);
+    pthread_mutex_unlock(&ld->mutex);
+    if (!background) frame_sched_post(FRAME_DIRECTORY);
+
+    if (orphaned) {
+        dir_loader_free(ld);
+    }
+    return NULL;
+}
+
+static DirLoader *dir_loader_spawn(const char *path, DirCursor *cursor, bool background) {
+    if (!path || !cursor || !cursor->dir || cursor->exhausted) return NULL;
+
+    DirLoader *ld = calloc(1, sizeof(*ld));
+    if (!ld) return NULL;
+
+    ld->pending = Vector_new(DIR_LOADER_BATCH);
+    ld->spare = Vector_new(DIR_LOADER_BATCH);
+    if (!ld->pending.el || !ld->spare.el) {
+        free(ld->pending.el);
+        free(ld->spare.el);
+        free(ld);
+        return NULL;
+    }
+    ld->arena = Arena_new(LISTING_ARENA_CHUNK);
+    pthread_mutex_init(&ld->mutex, NULL);
+    pthread_cond_init(&ld->cond, NULL);
+    strncpy(ld->path, path, sizeof(ld->path) - 1);
+    ld->path[sizeof(ld->path) - 1] = '\0';
+    ld->cursor = *cursor;
+    ld->background = background;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    int rc = pthread_create(&thread, &attr, dir_loader_thread, ld);
+    pthread_attr_destroy(&attr);
+
+    if (rc != 0) {
+        // The caller keeps its cursor and can fall back to synchronous batches.
+        dir_cursor_init(&ld->cursor);
+        dir_loader_free(ld);
+        return NULL;
+    }
+
+    dir_cursor_init(cursor);
+    return ld;
+}
+
+DirLoader *dir_loader_start(const char *path, DirCursor *cursor) {
+    return dir_loader_spawn(path, cursor, false);
+}
+
+DirLoader *dir_loader_start_background(const char *path, DirCursor *cursor) {
+    return dir_loader_spawn(path, cursor, true);
+}
+
+size_t dir_loader_drain(DirLoader *loader, Vector *files, bool *done) {
+    if (done) *done = false;
+    if (!loader || !files) return 0;
+
+    pthread_mutex_lock(&loader->mutex);
+    Vector tmp = loader->pending;
+    loader->pending = loader->spare;
+    loader->spare = tmp;
+    bool finished = loader->finished;
+    pthread_mutex_unlock(&loader->mutex);
+
+    // `spare` is only touched by the UI thread, so the copy runs unlocked.
+    size_t n = Vector_len(loader->spare);
+    if (n > 0) {
+        size_t len = Vector_len(*files);
+        Vector_add(files, n);
+        memcpy(files->el + len, loader->spare.el, n * sizeof(void *));
+        Vector_set_len_no_free(files, len + n);
+        Vector_set_len_no_free(&loader->spare, 0);
+    }
+
+    if (done) *done = finished;
+    return n;
+}
+
+bool dir_loader_wait(DirLoader *loader, int timeout_ms) {
+    if (!loader) return false;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&loader->mutex);
+    while (Vector_len(loader->pending) == 0 && !loader->finished) {
+        if (pthread_cond_timedwait(&loader->cond, &loader->mutex, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    bool ready = Vector_len(loader->pending) > 0 || loader->finished;
+    pthread_mutex_unlock(&loader->mutex);
+    return ready;
+}
+
+size_t dir_loader_found(DirLoader *loader) {
+    if (!loader) return 0;
+    pthread_mutex_lock(&loader->mutex);
+    size_t found = loader->found;
+    pthread_mutex_unlock(&loader->mutex);
+    return found;
+}
+
+void dir_loader_finish(DirLoader *loader, Arena *arena) {
+    if (!loader) return;
+    if (arena) {
+        // The thread no longer allocates once `finished` is set.
+        pthread_mutex_lock(&loader->mutex);
+        bool finished = loader->finished;
+        pthread_mutex_unlock(&loader->mutex);
+        if (finished) Arena_adopt(arena, &loader->arena);
+    }
+    dir_loader_cancel(loader);
+}
+
+void dir_loader_cancel(DirLoader *loader) {
+    if (!loader) return;
+    pthread_mutex_lock(&loader->mutex);
+    loader->cancelled = true;
+    bool finished = loader->finished;
+    pthread_mutex_unlock(&loader->mutex);
+
+    if (finished) {
+        dir_loader_free(loader);
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef DIR_LOADER_H
+#define DIR_LOADER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "files.h"  // DirCursor, FileAttr
+#include "vector.h"
+
+// Background enumeration of one directory listing.
+//
+// The loader thread keeps reading from the cursor it was handed and publishes
+// FileAttr batches into a back buffer. The UI thread swaps that buffer out with
+// dir_loader_drain() between input ticks, so the listing grows progressively
+// while the user is already browsing the first screen.
+typedef struct DirLoader DirLoader;
+
+// Starts enumerating the rest of `path` from `cursor`. On success the loader
+// takes ownership of the open stream and `cursor` is reset; on failure the
+// cursor is left untouched and NULL is returned.
+DirLoader *dir_loader_start(const char *path, DirCursor *cursor);
+
+// Same, for speculative work: the thread runs in the idle I/O class and at a
+// lower CPU priority so that it never competes with what the user waits on.
+DirLoader *dir_loader_start_background(const char *path, DirCursor *cursor);
+
+// Appends every entry published since the last call to `files` and returns how
+// many were added. Sets *done once the thread has read the whole directory and
+// nothing is left to drain.
+size_t dir_loader_drain(DirLoader *loader, Vector *files, bool *done);
+
+// Blocks for up to timeout_ms until new entries are published or enumeration
+// finishes. Returns true if there is something to drain.
+bool dir_loader_wait(DirLoader *loader, int timeout_ms);
+
+// Number of entries found so far (published or already drained).
+size_t dir_loader_found(DirLoader *loader);
+
+// Stops the loader and releases it. Never blocks on I/O: a thread still inside
+// readdir() frees the job itself when it notices the cancellation.
+//
+// Entries are allocated from the loader's own arena, so anything drained must
+// be dropped before cancelling a loader that has not finished.
+void dir_loader_cancel(DirLoader *loader);
+
+// Releases a loader whose enumeration is done (dir_loader_drain() reported
+// *done), moving the memory behind every drained entry into `arena`.
+void dir_loader_finish(DirLoader *loader, Arena *arena);
+
+#endif // DIR_LOADER_H
@@ -0,0 +1,1077 @@
+// File: dir_size.c
+// Recursive directory sizes on a work-stealing thread pool
+#define _GNU_SOURCE
+
+#include "dir_size.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "frame_sched.h"
+#include "globals.h"
+
+#define DIR_SIZE_MAX_WORKERS 32
+// Subdirectories waiting in the deques keep their directory open. Past this
+// many, a worker walks a subdirectory itself instead of queueing it.
+#define DIR_SIZE_MAX_QUEUED 256
+// Sizes past this are reported as DIR_SIZE_TOO_LARGE
+#define DIR_SIZE_MAX_BYTES (1000L * 1024 * 1024 * 1024 * 1024) // 1000 TiB
+// A worker publishes the byte count of its walk at most this often
+#define DIR_SIZE_PROGRESS_INTERVAL_NS (50L * 1000 * 1000)
+#define DIR_SIZE_PROGRESS_BATCH 128
+// Directories the index holds before walks stop recording the subdirectories
+// they meet (they still add them up)
+#define DIR_SIZE_MAX_NODES (1 << 20)
+// Sizes written to the index file, at most
+#define DIR_SIZE_REMEMBER_MAX 4096
+#define DIR_SIZE_FILE_HEADER "# cupidfm directory sizes v2\n"
+// A walk nobody asked about for this long is dropped, unless it is for the
+// focus; what it finished stays in the index.
+#define DIR_SIZE_WALK_DEADLINE_NS (1000L * 1000 * 1000)
+
+typedef struct DirSizeWalk DirSizeWalk;
+
+// A directory in the size index. Nodes form the directory tree and are found
+// by (parent, name) in one hash table: a walk holding a directory's node
+// finds a subdirectory's with one probe, a path takes one per component.
+// Nodes live until dir_size_cache_stop(), so workers may keep pointers.
+typedef struct DirSizeNode {
+    struct DirSizeNode *parent;
+    struct DirSizeNode *children;
+    struct DirSizeNode *sibling;
+    struct DirSizeNode *hash_next;
+    long size;     // bytes below the directory, or a DIR_SIZE_* code
+    long allocated; // ... of disk blocks they take up (with `size`)
+    long progress; // bytes counted so far by a walk queued for it
+    unsigned long stale_epoch; // index_epoch when last invalidated
+    bool known;     // `size` holds a result
+    bool fresh;     // ... walked this run and not invalidated since
+    DirSizeWalk *walk; // queued or running for it, or NULL
+    bool requested; // asked for by the UI: remembered across runs
+    char name[];    // "" for "/"
+} DirSizeNode;
+
+// (dev, ino) of the files with more than one link met by a walk.
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+} InodeKey;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    InodeKey *slots; // open addressing; ino 0 marks a free slot
+    size_t mask;
+    size_t count;
+} InodeSet;
+
+typedef enum {
+    WALK_RUN = 0,
+    WALK_YIELD, // make way for the focus, then go back to the queue
+    WALK_DROP,  // nobody is looking any more
+} WalkHalt;
+
+// One requested directory, walked by any number of tasks.
+struct DirSizeWalk {
+    char path[MAX_PATH_LENGTH];
+    DirSizeNode *node;     // the requested directory
+    unsigned long epoch;   // index_epoch when the walk started
+    atomic_long total;     // bytes counted so far, for progress
+    atomic_long wanted_ns; // when the UI last asked for it
+    atomic_bool focus;     // the directory the user is looking at
+    atomic_int halt;       // WalkHalt; tasks stop at their next entry
+    InodeSet links;
+    struct DirSizeWalk *next; // in walk_queue or active_walks
+};
+
+// A directory being walked. Its files and its finished subdirectories add
+// up here; once the last of them is in, the total is recorded in the index
+// and handed to the parent.
+typedef struct DirSizeDir {
+    struct DirSizeDir *parent; // NULL for the root of the walk
+    DirSizeWalk *walk;
+    DirSizeNode *node; // NULL once the index is full
+    atomic_long bytes;
+    atomic_long allocated;
+    atomic_int pending; // its own listing plus subdirectories not done
+    atomic_int error;   // first DIR_SIZE_* code met below, or 0
+    atomic_bool partial; // the walk halted before all of it was read
+} DirSizeDir;
+
+// An open subdirectory of a walk, waiting for a worker.
+typedef struct {
+    DirSizeDir *dir;
+    int fd;
+} DirSizeTask;
+
+// Each worker's deque: the owner pushes and pops at the bottom (newest,
+// depth first), thieves take from the top (oldest, closest to the root,
+// usually the biggest subtrees).
+typedef struct {
+    pthread_mutex_t mutex;
+    DirSizeTask *tasks;
+    size_t top;
+    size_t bottom;
+    size_t cap;
+    pthread_t thread;
+    bool started;
+    int index;
+    long last_progress_ns;
+    int items_since_progress;
+} DirSizeWorker;
+
+static pthread_mutex_t dir_size_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dir_size_cond = PTHREAD_COND_INITIALIZER;
+static DirSizeWalk *walk_queue = NULL;   // not started yet, in no order
+static DirSizeWalk *active_walks = NULL; // started and not finished
+static char focus_path[MAX_PATH_LENGTH] = "";
+static DirSizeWorker *workers = NULL;
+static int worker_count = 0;
+static int workers_wanted = 0;
+static atomic_bool workers_stopping = false;
+static atomic_int queued_tasks = 0;
+static atomic_int sleeping_workers = 0;
+static struct timespec dir_size_last_activity = {0};
+static bool dir_size_last_activity_initialized = false;
+
+// The index; all of it is guarded by index_mutex. Taken after
+// dir_size_mutex when both are needed.
+static pthread_mutex_t index_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DirSizeNode *index_root = NULL;
+static DirSizeNode **index_buckets = NULL;
+static size_t index_mask = 0;
+static size_t index_count = 0;
+static unsigned long index_epoch = 0;
+static char index_file[MAX_PATH_LENGTH] = "";
+
+void dir_size_note_user_activity(void) {
+    clock_gettime(CLOCK_MONOTONIC, &dir_size_last_activity);
+    dir_size_last_activity_initialized = true;
+}
+
+static bool dir_size_user_idle(void) {
+    if (!dir_size_last_activity_initialized) {
+        return true;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long elapsed_ns = (now.tv_sec - dir_size_last_activity.tv_sec) * 1000000000L +
+                      (now.tv_nsec - dir_size_last_activity.tv_nsec);
+    return elapsed_ns >= DIR_SIZE_REQUEST_DELAY_NS;
+}
+
+bool dir_size_can_enqueue(void) { return dir_size_user_idle(); }
+
+void dir_size_set_workers(int workers_new) {
+    pthread_mutex_lock(&dir_size_mutex);
+    workers_wanted = workers_new > 0 ? workers_new : 0;
+    pthread_mutex_unlock(&dir_size_mutex);
+}
+
+void dir_size_set_index_file(const char *path) {
+    pthread_mutex_lock(&index_mutex);
+    snprintf(index_file, sizeof(index_file), "%s", path ? path : "");
+    pthread_mutex_unlock(&index_mutex);
+}
+
+static long now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+// ---------------------------------------------------------------------------
+// Hard links
+// ---------------------------------------------------------------------------
+
+static size_t inode_hash(dev_t dev, ino_t ino) {
+    uint64_t h = (uint64_t)ino * 0x9e3779b97f4a7c15ULL ^ (uint64_t)dev;
+    return (size_t)(h ^ (h >> 29));
+}
+
+// True if (dev, ino) was not in the set yet. On allocation failure the file
+// is counted (again), as it was before links were tracked.
+static bool inode_set_add(InodeSet *set, dev_t dev, ino_t ino) {
+    pthread_mutex_lock(&set->mutex);
+    if ((set->count + 1) * 2 > set->mask + 1 || !set->slots) {
+        size_t cap = set->slots ? (set->mask + 1) * 2 : 64;
+        InodeKey *slots = calloc(cap, sizeof(*slots));
+        if (!slots) {
+            pthread_mutex_unlock(&set->mutex);
+            return true;
+        }
+        for (size_t i = 0; set->slots && i <= set->mask; i++) {
+            if (set->slots[i].ino == 0) continue;
+            size_t j = inode_hash(set->slots[i].dev, set->slots[i].ino) & (cap - 1);
+            while (slots[j].ino != 0) j = (j + 1) & (cap - 1);
+            slots[j] = set->slots[i];
+        }
+        free(set->slots);
+        set->slots = slots;
+        set->mask = cap - 1;
+    }
+    size_t i = inode_hash(dev, ino) & set->mask;
+    while (set->slots[i].ino != 0) {
+        if (set->slots[i].ino == ino && set->slots[i].dev == dev) {
+            pthread_mutex_unlock(&set->mutex);
+            return false;
+        }
+        i = (i + 1) & set->mask;
+    }
+    set->slots[i] = (InodeKey){dev, ino};
+    set->count++;
+    pthread_mutex_unlock(&set->mutex);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Index (index_mutex held)
+// ---------------------------------------------------------------------------
+
+static size_t node_hash(const DirSizeNode *parent, const char *name, size_t len) {
+    uint64_t h = (uint64_t)(uintptr_t)parent * 0x9e3779b97f4a7c15ULL;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)name[i]) * 0x100000001b3ULL;
+    }
+    return (size_t)(h ^ (h >> 31));
+}
+
+static bool index_grow(void) {
+    size_t cap = index_buckets ? (index_mask + 1) * 2 : 1024;
+    DirSizeNode **buckets = calloc(cap, sizeof(*buckets));
+    if (!buckets) return false;
+    for (size_t i = 0; index_buckets && i <= index_mask; i++) {
+        DirSizeNode *node = index_buckets[i];
+        while (node) {
+            DirSizeNode *next = node->hash_next;
+            size_t j = node_hash(node->parent, node->name, strlen(node->name)) & (cap - 1);
+            node->hash_next = buckets[j];
+            buckets[j] = node;
+            node = next;
+        }
+    }
+    free(index_buckets);
+    index_buckets = buckets;
+    index_mask = cap - 1;
+    return true;
+}
+
+static DirSizeNode *node_new(DirSizeNode *parent, const char *name, size_t len) {
+    if (index_count >= index_mask && !index_grow()) return NULL;
+    DirSizeNode *node = calloc(1, sizeof(*node) + len + 1);
+    if (!node) return NULL;
+    memcpy(node->name, name, len);
+    node->parent = parent;
+    if (parent) {
+        node->sibling = parent->children;
+        parent->children = node;
+        size_t i = node_hash(parent, name, len) & index_mask;
+        node->hash_next = index_buckets[i];
+        index_buckets[i] = node;
+    }
+    index_count++;
+    return node;
+}
+
+// The subdirectory `name` (its first `len` bytes) of `parent`; created if
+// asked to and there is room.
+static DirSizeNode *node_child(DirSizeNode *parent, const char *name, size_t len,
+                               bool create) {
+    if (!parent) return NULL;
+    if (index_buckets) {
+        size_t i = node_hash(parent, name, len) & index_mask;
+        for (DirSizeNode *node = index_buckets[i]; node; node = node->hash_next) {
+            if (node->parent == parent && strncmp(node->name, name, len) == 0 &&
+                node->name[len] == '\0') {
+                return node;
+            }
+        }
+    }
+    return create ? node_new(parent, name, len) : NULL;
+}
+
+// The node of the absolute `path`, or with `deepest` that of its deepest
+// ancestor in the index; NULL if there is none (or `path` is relative).
+static DirSizeNode *index_lookup(const char *path, bool create, bool deepest) {
+    if (!path || path[0] != '/') return NULL;
+    if (!index_root && create) index_root = node_new(NULL, "", 0);
+    DirSizeNode *node = index_root;
+    const char *p = path;
+    while (node) {
+        while (*p == '/') p++;
+        if (!*p) return node;
+        size_t len = strcspn(p, "/");
+        DirSizeNode *child = node_child(node, p, len, create);
+        if (!child) return deepest ? node : NULL;
+        node = child;
+        p += len;
+    }
+    return NULL;
+}
+
+// Drops the result of `node` and of everything below it.
+static void node_forget_tree(DirSizeNode *node) {
+    node->known = false;
+    node->fresh = false;
+    node->stale_epoch = index_epoch;
+    for (DirSizeNode *child = node->children; child; child = child->sibling) {
+        node_forget_tree(child);
+    }
+}
+
+// Writes the path of `node` into `out`; false if it does not fit.
+static bool node_path(const DirSizeNode *node, char *out, size_t size) {
+    if (!node->parent) {
+        if (size < 2) return false;
+        strcpy(out, "/");
+        return true;
+    }
+    if (!node_path(node->parent, out, size)) return false;
+    size_t used = strlen(out);
+    int n = snprintf(out + used, size - used, "%s%s", used > 1 ? "/" : "", node->name);
+    return n >= 0 && (size_t)n < size - used;
+}
+
+static void index_clear(void) {
+    for (size_t i = 0; index_buckets && i <= index_mask; i++) {
+        DirSizeNode *node = index_buckets[i];
+        while (node) {
+            DirSizeNode *next = node->hash_next;
+            free(node);
+            node = next;
+        }
+    }
+    free(index_root);
+    free(index_buckets);
+    index_root = NULL;
+    index_buckets = NULL;
+    index_mask = 0;
+    index_count = 0;
+}
+
+// Sizes from the last run are shown until a walk of this run replaces them;
+// walks never build on them.
+static void index_load(void) {
+    if (!index_file[0]) return;
+    FILE *fp = fopen(index_file, "r");
+    if (!fp) return;
+    char line[MAX_PATH_LENGTH + 32];
+    if (fgets(line, sizeof(line), fp) && strcmp(line, DIR_SIZE_FILE_HEADER) == 0) {
+        while (fgets(line, sizeof(line), fp)) {
+            line[strcspn(line, "\n")] = '\0';
+            char *alloc_end;
+            char *path;
+            long size = strtol(line, &alloc_end, 10);
+            long allocated = strtol(alloc_end, &path, 10);
+            if (size < 0 || allocated < 0 || *path != ' ') continue;
+            DirSizeNode *node = index_lookup(path + 1, true, false);
+            if (!node) continue;
+            node->size = size;
+            node->allocated = allocated;
+            node->known = true;
+            node->requested = true;
+        }
+    }
+    fclose(fp);
+}
+
+static bool make_parent_dir(const char *path) {
+    char dir[MAX_PATH_LENGTH];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (!slash || slash == dir) return true;
+    *slash = '\0';
+    return mkdir(dir, 0700) == 0 || errno == EEXIST;
+}
+
+// Writes the sizes the UI asked for, replacing the file in one rename.
+static void index_save(void) {
+    if (!index_file[0] || !index_buckets || !make_parent_dir(index_file)) return;
+    char tmp[MAX_PATH_LENGTH + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", index_file);
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) return;
+    fputs(DIR_SIZE_FILE_HEADER, fp);
+    int written = 0;
+    char path[MAX_PATH_LENGTH];
+    for (size_t i = 0; i <= index_mask && written < DIR_SIZE_REMEMBER_MAX; i++) {
+        for (DirSizeNode *node = index_buckets[i]; node; node = node->hash_next) {
+            if (!node->requested || !node->known || node->size < 0) continue;
+            if (!node_path(node, path, sizeof(path)) || strchr(path, '\n')) continue;
+            fprintf(fp, "%ld %ld %s\n", node->size, node->allocated, path);
+            if (++written == DIR_SIZE_REMEMBER_MAX) break;
+        }
+    }
+    if (fclose(fp) != 0 || rename(tmp, index_file) != 0) unlink(tmp);
+}
+
+// ---------------------------------------------------------------------------
+// Results
+// ---------------------------------------------------------------------------
+
+static DirSizeDir *dir_new(DirSizeWalk *walk, DirSizeDir *parent, DirSizeNode *node) {
+    DirSizeDir *dir = malloc(sizeof(*dir));
+    if (!dir) return NULL;
+    dir->parent = parent;
+    dir->walk = walk;
+    dir->node = node;
+    atomic_init(&dir->bytes, 0);
+    atomic_init(&dir->allocated, 0);
+    atomic_init(&dir->pending, 1);
+    atomic_init(&dir->error, 0);
+    atomic_init(&dir->partial, false);
+    return dir;
+}
+
+static void dir_fail(DirSizeDir *dir, int code) {
+    int none = 0;
+    atomic_compare_exchange_strong(&dir->error, &none, code);
+}
+
+static void dir_add(DirSizeDir *dir, long bytes, long allocated) {
+    atomic_fetch_add(&dir->bytes, bytes);
+    atomic_fetch_add(&dir->allocated, allocated);
+    atomic_fetch_add(&dir->walk->total, bytes);
+}
+
+static DirSizeWalk *walk_new(const char *path, DirSizeNode *node) {
+    DirSizeWalk *walk = calloc(1, sizeof(*walk));
+    if (!walk) return NULL;
+    strncpy(walk->path, path, MAX_PATH_LENGTH - 1);
+    walk->path[MAX_PATH_LENGTH - 1] = '\0';
+    walk->node = node;
+    atomic_init(&walk->total, 0);
+    atomic_init(&walk->wanted_ns, now_ns());
+    atomic_init(&walk->focus, false);
+    atomic_init(&walk->halt, WALK_RUN);
+    pthread_mutex_init(&walk->links.mutex, NULL);
+    return walk;
+}
+
+static void walk_free(DirSizeWalk *walk) {
+    pthread_mutex_destroy(&walk->links.mutex);
+    free(walk->links.slots);
+    free(walk);
+}
+
+static bool walk_halted(DirSizeWalk *walk) {
+    return atomic_load(&walk->halt) != WALK_RUN || atomic_load(&workers_stopping);
+}
+
+static void walk_halt(DirSizeWalk *walk, WalkHalt halt) {
+    int run = WALK_RUN;
+    atomic_compare_exchange_strong(&walk->halt, &run, halt);
+}
+
+// Non-focus walks nobody asked about for a while are dropped.
+static bool walk_expired(DirSizeWalk *walk, long now) {
+    return !atomic_load(&walk->focus) &&
+           now - atomic_load(&walk->wanted_ns) > DIR_SIZE_WALK_DEADLINE_NS;
+}
+
+// A walk for the focus is waiting (dir_size_mutex held): the others make way
+// at their next entry and go back to the queue.
+static void walks_yield_locked(void) {
+    for (DirSizeWalk *walk = active_walks; walk; walk = walk->next) {
+        if (!atomic_load(&walk->focus)) walk_halt(walk, WALK_YIELD);
+    }
+}
+
+static void walk_unlink_locked(DirSizeWalk **list, DirSizeWalk *walk) {
+    while (*list && *list != walk) list = &(*list)->next;
+    if (*list) *list = walk->next;
+}
+
+// A walk made way for the focus: it starts over later from the index, which
+// has the size of every subdirectory it finished.
+static void walk_requeue(DirSizeWalk *walk) {
+    pthread_mutex_lock(&walk->links.mutex);
+    free(walk->links.slots);
+    walk->links.slots = NULL;
+    walk->links.mask = 0;
+    walk->links.count = 0;
+    pthread_mutex_unlock(&walk->links.mutex);
+    atomic_store(&walk->total, 0);
+    atomic_store(&walk->halt, WALK_RUN);
+
+    pthread_mutex_lock(&dir_size_mutex);
+    walk_unlink_locked(&active_walks, walk);
+    walk->next = walk_queue;
+    walk_queue = walk;
+    pthread_cond_signal(&dir_size_cond);
+    pthread_mutex_unlock(&dir_size_mutex);
+}
+
+static void walk_finish(DirSizeWalk *walk) {
+    pthread_mutex_lock(&dir_size_mutex);
+    walk_unlink_locked(&active_walks, walk);
+    pthread_mutex_unlock(&dir_size_mutex);
+    walk_free(walk);
+}
+
+// Part of `dir` is done: its listing or one subdirectory. Once all of it is,
+// the directory's size goes to the index and to its parent, and so on up to
+// the root of the walk, which reports to the UI. A directory the walk did not
+// read in full records nothing, but its finished subdirectories did.
+static void dir_done(DirSizeDir *dir) {
+    while (dir && atomic_fetch_sub(&dir->pending, 1) == 1) {
+        DirSizeDir *parent = dir->parent;
+        DirSizeWalk *walk = dir->walk;
+        bool stopping = atomic_load(&workers_stopping);
+        bool partial = atomic_load(&dir->partial);
+        long size = atomic_load(&dir->error);
+        long allocated = size;
+        if (size == 0) {
+            size = atomic_load(&dir->bytes);
+            allocated = atomic_load(&dir->allocated);
+            if (size > DIR_SIZE_MAX_BYTES) size = allocated = DIR_SIZE_TOO_LARGE;
+        }
+
+        bool requeue = false;
+        if (!stopping && dir->node) {
+            pthread_mutex_lock(&index_mutex);
+            // Something below changed since the walk started: stale already
+            if (!partial && dir->node->stale_epoch <= walk->epoch) {
+                dir->node->size = size;
+                dir->node->allocated = allocated;
+                dir->node->known = true;
+                dir->node->fresh = true;
+            }
+            if (!parent) {
+                requeue = partial && atomic_load(&walk->halt) == WALK_YIELD;
+                if (!requeue) dir->node->walk = NULL;
+            }
+            pthread_mutex_unlock(&index_mutex);
+        }
+
+        if (parent) {
+            if (partial) {
+                atomic_store(&parent->partial, true);
+            } else if (size < 0) {
+                dir_fail(parent, (int)size);
+            } else {
+                atomic_fetch_add(&parent->bytes, size);
+                atomic_fetch_add(&parent->allocated, allocated);
+            }
+        } else if (requeue) {
+            walk_requeue(walk);
+        } else {
+            if (!stopping) frame_sched_post(FRAME_PREVIEW);
+            walk_finish(walk);
+        }
+        free(dir);
+        dir = parent;
+    }
+}
+
+static void progress_maybe_publish(DirSizeWorker *self, DirSizeWalk *walk) {
+    // Throttle updates: at most ~20Hz or every N entries per worker to keep
+    // mutex overhead low.
+    if (++self->items_since_progress < DIR_SIZE_PROGRESS_BATCH) {
+        return;
+    }
+    self->items_since_progress = 0;
+    long now = now_ns();
+    if (self->last_progress_ns != 0 &&
+        now - self->last_progress_ns < DIR_SIZE_PROGRESS_INTERVAL_NS) {
+        return;
+    }
+    self->last_progress_ns = now;
+    if (walk_expired(walk, now)) walk_halt(walk, WALK_DROP);
+
+    pthread_mutex_lock(&index_mutex);
+    walk->node->progress = atomic_load(&walk->total);
+    pthread_mutex_unlock(&index_mutex);
+    frame_sched_post(FRAME_PREVIEW);
+}
+
+// ---------------------------------------------------------------------------
+// Deques
+// ---------------------------------------------------------------------------
+
+static void wake_worker(void) {
+    if (atomic_load(&sleeping_workers) == 0) return;
+    pthread_mutex_lock(&dir_size_mutex);
+    pthread_cond_signal(&dir_size_cond);
+    pthread_mutex_unlock(&dir_size_mutex);
+}
+
+// Queues `fd`, the open directory of `dir`, on the worker's own deque. False
+// if the deques are full; the caller then walks it itself.
+static bool task_push(DirSizeWorker *self, DirSizeDir *dir, int fd) {
+    if (atomic_load(&queued_tasks) >= DIR_SIZE_MAX_QUEUED) return false;
+    pthread_mutex_lock(&self->mutex);
+    if (self->bottom == self->cap) {
+        if (self->top > 0) {
+            memmove(self->tasks, self->tasks + self->top,
+                    (self->bottom - self->top) * sizeof(*self->tasks));
+            self->bottom -= self->top;
+            self->top = 0;
+        } else {
+            size_t cap = self->cap ? self->cap * 2 : 64;
+            DirSizeTask *tasks = realloc(self->tasks, cap * sizeof(*tasks));
+            if (!tasks) {
+                pthread_mutex_unlock(&self->mutex);
+                return false;
+            }
+            self->tasks = tasks;
+            self->cap = cap;
+        }
+    }
+    self->tasks[self->bottom++] = (DirSizeTask){dir, fd};
+    pthread_mutex_unlock(&self->mutex);
+    atomic_fetch_add(&queued_tasks, 1);
+    wake_worker();
+    return true;
+}
+
+static bool task_pop(DirSizeWorker *self, DirSizeTask *out) {
+    pthread_mutex_lock(&self->mutex);
+    bool found = self->bottom > self->top;
+    if (found) {
+        *out = self->tasks[--self->bottom];
+        if (self->bottom == self->top) self->top = self->bottom = 0;
+        atomic_fetch_sub(&queued_tasks, 1);
+    }
+    pthread_mutex_unlock(&self->mutex);
+    return found;
+}
+
+static bool task_steal(DirSizeWorker *victim, DirSizeTask *out) {
+    if (pthread_mutex_trylock(&victim->mutex) != 0) return false;
+    bool found = victim->bottom > victim->top;
+    if (found) {
+        *out = victim->tasks[victim->top++];
+        if (victim->bottom == victim->top) victim->top = victim->bottom = 0;
+        atomic_fetch_sub(&queued_tasks, 1);
+    }
+    pthread_mutex_unlock(&victim->mutex);
+    return found;
+}
+
+// Unlinks the walk to start next: the focus, else the one asked for most
+// recently. Walks that expired in the queue are dropped on the way. There is
+// one walk per directory the user paused on, so a scan will do.
+static DirSizeWalk *walk_queue_take(void) {
+    long now = now_ns();
+    pthread_mutex_lock(&dir_size_mutex);
+    DirSizeWalk **best = NULL;
+    DirSizeWalk **link = &walk_queue;
+    while (*link) {
+        DirSizeWalk *walk = *link;
+        if (walk_expired(walk, now)) {
+            *link = walk->next;
+            pthread_mutex_lock(&index_mutex);
+            walk->node->walk = NULL;
+            pthread_mutex_unlock(&index_mutex);
+            walk_free(walk);
+            continue;
+        }
+        if (!best || (atomic_load(&walk->focus) && !atomic_load(&(*best)->focus)) ||
+            (atomic_load(&walk->focus) == atomic_load(&(*best)->focus) &&
+             atomic_load(&walk->wanted_ns) > atomic_load(&(*best)->wanted_ns))) {
+            best = link;
+        }
+        link = &walk->next;
+    }
+    DirSizeWalk *walk = best ? *best : NULL;
+    if (walk) {
+        *best = walk->next;
+        walk->next = active_walks;
+        active_walks = walk;
+    }
+    pthread_mutex_unlock(&dir_size_mutex);
+    return walk;
+}
+
+// Takes the next task: own deque first, then another worker's, then the
+// root of a walk not started yet.
+static bool task_next(DirSizeWorker *self, DirSizeTask *out) {
+    if (task_pop(self, out)) return true;
+    for (int round = 0; round < 2 && atomic_load(&queued_tasks) > 0; round++) {
+        for (int i = 1; i < worker_count; i++) {
+            DirSizeWorker *victim = &workers[(self->index + i) % worker_count];
+            if (task_steal(victim, out)) return true;
+        }
+    }
+
+    DirSizeWalk *walk = walk_queue_take();
+    if (!walk) return false;
+
+    DirSizeDir *root = dir_new(walk, NULL, walk->node);
+    pthread_mutex_lock(&index_mutex);
+    walk->epoch = index_epoch;
+    if (!root) walk->node->walk = NULL;
+    pthread_mutex_unlock(&index_mutex);
+    if (!root) {
+        walk_finish(walk);
+        return false;
+    }
+
+    *out = (DirSizeTask){root, -1};
+    if (strncmp(walk->path, "/proc", 5) == 0 || strncmp(walk->path, "/sys", 4) == 0 ||
+        strncmp(walk->path, "/dev", 4) == 0 || strncmp(walk->path, "/run", 4) == 0) {
+        dir_fail(root, DIR_SIZE_VIRTUAL_FS);
+        return true;
+    }
+    out->fd = open(walk->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (out->fd < 0) dir_fail(root, errno == EACCES ? DIR_SIZE_PERMISSION_DENIED : -1);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Traversal
+// ---------------------------------------------------------------------------
+
+// The subdirectory `name` of `dir`: true with its sizes if the index has
+// fresh ones, otherwise false with its node (NULL if the index is full).
+static bool subdir_lookup(DirSizeDir *dir, const char *name, long *size, long *allocated,
+                          DirSizeNode **node) {
+    pthread_mutex_lock(&index_mutex);
+    *node = node_child(dir->node, name, strlen(name), index_count < DIR_SIZE_MAX_NODES);
+    bool fresh = *node && (*node)->fresh;
+    if (fresh) {
+        *size = (*node)->size;
+        *allocated = (*node)->allocated;
+    }
+    pthread_mutex_unlock(&index_mutex);
+    return fresh;
+}
+
+// Records why the subdirectory `node` of `dir` (NULL if the index is full)
+// has no size.
+static void subdir_fail(DirSizeDir *dir, DirSizeNode *node, int code) {
+    if (!node) return;
+    pthread_mutex_lock(&index_mutex);
+    if (node->stale_epoch <= dir->walk->epoch) {
+        node->size = node->allocated = code;
+        node->known = true;
+        node->fresh = true;
+    }
+    pthread_mutex_unlock(&index_mutex);
+}
+
+// /proc, /sys, /dev and /run hold no files worth counting: walking "/" skips
+// them.
+static bool subdir_virtual(DirSizeDir *dir, const char *name) {
+    if (dir->parent || strcmp(dir->walk->path, "/") != 0) return false;
+    return strcmp(name, "proc") == 0 || strcmp(name, "sys") == 0 || strcmp(name, "dev") == 0 ||
+           strcmp(name, "run") == 0;
+}
+
+// Adds up the entries of the open directory `fd` (closed on return), and the
+// blocks of the directory itself. Subdirectories with a fresh size in the
+// index count that size; the others are queued for any worker, or walked
+// right here while the deques are full.
+static void walk_dir(DirSizeWorker *self, DirSizeDir *dir, int fd) {
+    DirSizeWalk *walk = dir->walk;
+    DIR *handle = fdopendir(fd);
+    if (!handle) {
+        close(fd);
+        return;
+    }
+    int dfd = dirfd(handle);
+    struct stat self_st;
+    if (fstat(dfd, &self_st) == 0) dir_add(dir, 0, (long)self_st.st_blocks * 512);
+    struct dirent *entry;
+    while (!walk_halted(walk) && (entry = readdir(handle)) != NULL) {
+        const char *name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+
+        bool is_dir = entry->d_type == DT_DIR;
+        if (!is_dir) {
+            struct stat st;
+            if (fstatat(dfd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                continue;
+            }
+            is_dir = S_ISDIR(st.st_mode);
+            if (!is_dir) {
+                // A file with several links is counted where it is met first
+                if (st.st_nlink > 1 && !inode_set_add(&walk->links, st.st_dev, st.st_ino)) {
+                    continue;
+                }
+                dir_add(dir, (long)st.st_size, (long)st.st_blocks * 512);
+                progress_maybe_publish(self, walk);
+                continue;
+            }
+        }
+
+        long size;
+        long allocated;
+        DirSizeNode *node;
+        if (subdir_virtual(dir, name)) {
+            if (!subdir_lookup(dir, name, &size, &allocated, &node)) {
+                subdir_fail(dir, node, DIR_SIZE_VIRTUAL_FS);
+            }
+            continue;
+        }
+        if (subdir_lookup(dir, name, &size, &allocated, &node)) {
+            if (size < 0) {
+                dir_fail(dir, (int)size);
+            } else {
+                dir_add(dir, size, allocated);
+            }
+            continue;
+        }
+
+        int fd_sub = openat(dfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd_sub < 0) {
+            if (errno == EACCES) {
+                dir_fail(dir, DIR_SIZE_PERMISSION_DENIED);
+                subdir_fail(dir, node, DIR_SIZE_PERMISSION_DENIED);
+            }
+            // Otherwise unreadable (or replaced meanwhile): skip
+            continue;
+        }
+        DirSizeDir *sub = dir_new(walk, dir, node);
+        if (!sub) {
+            close(fd_sub);
+            continue;
+        }
+        atomic_fetch_add(&dir->pending, 1);
+        if (!task_push(self, sub, fd_sub)) {
+            walk_dir(self, sub, fd_sub);
+            dir_done(sub);
+        }
+    }
+    if (walk_halted(walk)) atomic_store(&dir->partial, true);
+    closedir(handle);
+}
+
+static void *dir_size_worker(void *arg) {
+    DirSizeWorker *self = arg;
+    while (!atomic_load(&workers_stopping)) {
+        DirSizeTask task;
+        if (task_next(self, &task)) {
+            if (task.fd >= 0) {
+                DirSizeWalk *walk = task.dir->walk;
+                if (walk_expired(walk, now_ns())) walk_halt(walk, WALK_DROP);
+                if (walk_halted(walk)) {
+                    close(task.fd);
+                    atomic_store(&task.dir->partial, true);
+                } else {
+                    walk_dir(self, task.dir, task.fd);
+                }
+            }
+            dir_done(task.dir);
+            continue;
+        }
+
+        pthread_mutex_lock(&dir_size_mutex);
+        atomic_fetch_add(&sleeping_workers, 1);
+        while (!atomic_load(&workers_stopping) && atomic_load(&queued_tasks) == 0 &&
+               walk_queue == NULL) {
+            pthread_cond_wait(&dir_size_cond, &dir_size_mutex);
+        }
+        atomic_fetch_sub(&sleeping_workers, 1);
+        pthread_mutex_unlock(&dir_size_mutex);
+    }
+    return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Requests
+// ---------------------------------------------------------------------------
+
+static long dir_size_get_result(const char *dir_path, bool allow_enqueue) {
+    dir_size_cache_start();
+
+    pthread_mutex_lock(&index_mutex);
+    DirSizeNode *node = index_lookup(dir_path, allow_enqueue, false);
+    if (!node) {
+        pthread_mutex_unlock(&index_mutex);
+        return allow_enqueue ? -1 : DIR_SIZE_PENDING;
+    }
+    // A stale size (from the last run, or from before a change below) stays
+    // on show while it is walked again.
+    long result = node->known ? node->size : DIR_SIZE_PENDING;
+    if (node->walk) {
+        atomic_store(&node->walk->wanted_ns, now_ns());
+    }
+    if (node->fresh || node->walk || !allow_enqueue || !dir_size_user_idle()) {
+        pthread_mutex_unlock(&index_mutex);
+        return result;
+    }
+
+    DirSizeWalk *walk = walk_new(dir_path, node);
+    if (!walk) {
+        pthread_mutex_unlock(&index_mutex);
+        return -1;
+    }
+    node->walk = walk;
+    node->requested = true;
+    node->progress = 0;
+    pthread_mutex_unlock(&index_mutex);
+
+    pthread_mutex_lock(&dir_size_mutex);
+    walk->next = walk_queue;
+    walk_queue = walk;
+    if (strcmp(dir_path, focus_path) == 0) {
+        atomic_store(&walk->focus, true);
+        walks_yield_locked();
+    }
+    pthread_cond_signal(&dir_size_cond);
+    pthread_mutex_unlock(&dir_size_mutex);
+    return result;
+}
+
+long get_directory_size(const char *dir_path) { return dir_size_get_result(dir_path, true); }
+
+long get_directory_size_peek(const char *dir_path) { return dir_size_get_result(dir_path, false); }
+
+long dir_size_get_progress(const char *dir_path) {
+    if (!dir_path || !*dir_path) return 0;
+    pthread_mutex_lock(&index_mutex);
+    DirSizeNode *node = index_lookup(dir_path, false, false);
+    long p = 0;
+    if (node && node->walk) {
+        p = node->progress;
+        if (p < 0) p = 0;
+    }
+    pthread_mutex_unlock(&index_mutex);
+    return p;
+}
+
+long dir_size_peek_usage(const char *dir_path, long *allocated) {
+    pthread_mutex_lock(&index_mutex);
+    DirSizeNode *node = index_lookup(dir_path, false, false);
+    long size = node && node->known ? node->size : DIR_SIZE_PENDING;
+    *allocated = node && node->known ? node->allocated : DIR_SIZE_PENDING;
+    pthread_mutex_unlock(&index_mutex);
+    return size;
+}
+
+bool dir_size_settled(const char *dir_path) {
+    pthread_mutex_lock(&index_mutex);
+    DirSizeNode *node = index_lookup(dir_path, false, false);
+    bool settled = node && node->fresh;
+    pthread_mutex_unlock(&index_mutex);
+    return settled;
+}
+
+void dir_size_set_focus(const char *path) {
+    if (!path) path = "";
+    pthread_mutex_lock(&dir_size_mutex);
+    if (strcmp(path, focus_path) == 0) {
+        pthread_mutex_unlock(&dir_size_mutex);
+        return;
+    }
+    snprintf(focus_path, sizeof(focus_path), "%s", path);
+    bool waiting = false;
+    for (DirSizeWalk *walk = walk_queue; walk; walk = walk->next) {
+        bool focus = strcmp(walk->path, focus_path) == 0;
+        atomic_store(&walk->focus, focus);
+        waiting |= focus;
+    }
+    for (DirSizeWalk *walk = active_walks; walk; walk = walk->next) {
+        atomic_store(&walk->focus, strcmp(walk->path, focus_path) == 0);
+    }
+    if (waiting) walks_yield_locked();
+    pthread_mutex_unlock(&dir_size_mutex);
+}
+
+void dir_size_invalidate(const char *path) {
+    pthread_mutex_lock(&index_mutex);
+    DirSizeNode *node = index_lookup(path, false, true);
+    if (node) {
+        index_epoch++;
+        // `path` itself was added, removed or replaced: nothing below holds
+        DirSizeNode *exact = index_lookup(path, false, false);
+        if (exact) {
+            node_forget_tree(exact);
+            node = exact->parent;
+        }
+        for (; node; node = node->parent) {
+            node->fresh = false;
+            node->stale_epoch = index_epoch;
+        }
+    }
+    pthread_mutex_unlock(&index_mutex);
+}
+
+void dir_size_cache_start(void) {
+    pthread_mutex_lock(&dir_size_mutex);
+    if (workers) {
+        pthread_mutex_unlock(&dir_size_mutex);
+        return;
+    }
+    int count = workers_wanted;
+    if (count <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        count = cpus > 0 ? (int)cpus : 1;
+    }
+    if (count > DIR_SIZE_MAX_WORKERS) count = DIR_SIZE_MAX_WORKERS;
+
+    workers = calloc((size_t)count, sizeof(*workers));
+    if (!workers) {
+        pthread_mutex_unlock(&dir_size_mutex);
+        return;
+    }
+    pthread_mutex_lock(&index_mutex);
+    if (!index_root) index_load();
+    pthread_mutex_unlock(&index_mutex);
+
+    atomic_store(&workers_stopping, false);
+    for (int i = 0; i < count; i++) {
+        pthread_mutex_init(&workers[i].mutex, NULL);
+        workers[i].index = i;
+    }
+    // Workers look at worker_count when stealing, so it is final before the
+    // first one starts; a thread that fails to start leaves an idle deque.
+    worker_count = count;
+    for (int i = 0; i < count; i++) {
+        workers[i].started =
+            pthread_create(&workers[i].thread, NULL, dir_size_worker, &workers[i]) == 0;
+    }
+    pthread_mutex_unlock(&dir_size_mutex);
+}
+
+void dir_size_cache_stop(void) {
+    pthread_mutex_lock(&dir_size_mutex);
+    DirSizeWorker *stopping = workers;
+    int count = worker_count;
+    atomic_store(&workers_stopping, true);
+    pthread_cond_broadcast(&dir_size_cond);
+    pthread_mutex_unlock(&dir_size_mutex);
+
+    for (int i = 0; i < count; i++) {
+        if (stopping[i].started) pthread_join(stopping[i].thread, NULL);
+    }
+
+    // Nothing runs any more: drop what is left
+    for (int i = 0; i < count; i++) {
+        DirSizeTask task;
+        while (task_pop(&stopping[i], &task)) {
+            close(task.fd);
+            dir_done(task.dir);
+        }
+        free(stopping[i].tasks);
+        pthread_mutex_destroy(&stopping[i].mutex);
+    }
+    pthread_mutex_lock(&dir_size_mutex);
+    while (walk_queue) {
+        DirSizeWalk *next = walk_queue->next;
+        walk_free(walk_queue);
+        walk_queue = next;
+    }
+    free(workers);
+    workers = NULL;
+    worker_count = 0;
+    pthread_mutex_unlock(&dir_size_mutex);
+
+    pthread_mutex_lock(&index_mutex);
+    index_save();
+    index_clear();
+    pthread_mutex_unlock(&index_mutex);
+}
@@ -0,0 +1,83 @@
+#ifndef DIR_SIZE_H
+#define DIR_SIZE_H
+
+#include <stdbool.h>
+
+// Recursive directory sizes, computed in the background.
+//
+// Asking for the size of a directory queues a walk of its tree on a pool of
+// worker threads. Every subdirectory met on the way becomes a task of its
+// own: a worker pushes the tasks it finds onto its own deque and works from
+// the newest end, idle workers steal the oldest task of another worker, so a
+// wide tree keeps every thread busy. Directories are opened relative to
+// their parent (openat/fstatat), never through a path string, and a file
+// with several hard links is counted once per walk. Walks add up both the
+// apparent size (st_size) and the disk blocks taken (st_blocks), the latter
+// including the directories themselves.
+//
+// Results go into an index shaped like the directory tree: a walk records
+// the size of every subdirectory it adds up, so sizing /a also sizes /a/b,
+// and a walk that meets a subdirectory already sized (since the last change
+// reported for it) takes that size instead of descending. Hard links shared
+// between such a subdirectory and the rest of the walk count twice.
+//
+// dir_size_invalidate() marks a change: the directories above it are walked
+// again when next asked for, which rereads them and reuses all the rest.
+// Their old size stays on show meanwhile, like the sizes the UI asked for in
+// the last run, which are read from the index file (if set) at start.
+//
+// Walks wait in a priority queue: the focus (the directory under the cursor)
+// first, then the one asked for most recently. When a walk for the focus is
+// queued, running walks stop at their next entry and queue up again; a walk
+// nobody asked about for a second is dropped. Either way the subdirectories
+// it finished stay in the index, so starting over resumes more than restarts.
+
+// Results other than a size
+#define DIR_SIZE_TOO_LARGE (-2)
+#define DIR_SIZE_VIRTUAL_FS (-3)
+#define DIR_SIZE_PENDING (-4)
+#define DIR_SIZE_PERMISSION_DENIED (-5)
+// How long the user has to stay on an entry before its size is asked for
+#define DIR_SIZE_REQUEST_DELAY_NS 200000000L
+
+// Number of worker threads; 0 (the default) means one per online CPU. Takes
+// effect at the next dir_size_cache_start().
+void dir_size_set_workers(int workers);
+
+// File the sizes the UI asked for are kept in across runs; NULL or "" (the
+// default) keeps nothing. Read at dir_size_cache_start() and written at
+// dir_size_cache_stop().
+void dir_size_set_index_file(const char *path);
+
+// Size of `dir_path` in bytes, or one of the DIR_SIZE_* codes. Queues a walk
+// unless one ran or is running already (and the user is idle).
+long get_directory_size(const char *dir_path);
+
+// Like get_directory_size(), but never queues a walk.
+long get_directory_size_peek(const char *dir_path);
+
+// Returns the best-known in-progress byte total for a directory size job, or 0
+// if none.
+long dir_size_get_progress(const char *dir_path);
+
+// Like get_directory_size_peek(), and also sets `*allocated` to the bytes of
+// disk blocks (or the same DIR_SIZE_* code).
+long dir_size_peek_usage(const char *dir_path, long *allocated);
+
+// True once `dir_path` has an up-to-date size: nothing left to wait for.
+bool dir_size_settled(const char *dir_path);
+
+// The directory the user is looking at, or NULL.
+void dir_size_set_focus(const char *path);
+
+// `path` (a file or directory) was created, deleted, renamed or changed.
+void dir_size_invalidate(const char *path);
+
+void dir_size_cache_start(void);
+void dir_size_cache_stop(void);
+
+// Walks are only queued once the user paused for DIR_SIZE_REQUEST_DELAY_NS.
+void dir_size_note_user_activity(void);
+bool dir_size_can_enqueue(void);
+
+#endif // DIR_SIZE_H
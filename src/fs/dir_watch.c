@@ -0,0 +1,189 @@
+// File: dir_watch.c
+// inotify watcher for the listed directory with per-name event coalescing
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "dir_watch.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "arena.h"
+
+// A burst touching more names than this is cheaper to reload than to apply.
+#define DIR_WATCH_MAX_PENDING 4096
+#define DIR_WATCH_HASH_SLOTS (DIR_WATCH_MAX_PENDING * 2) // power of two
+#define DIR_WATCH_ARENA_CHUNK 16384
+#define DIR_WATCH_READ_BUF 65536
+
+#define DIR_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                        IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE |                \
+                        IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_EXCL_UNLINK)
+
+// One side of the double buffer: names collected, or names handed out.
+typedef struct {
+    Arena arena;
+    char *names[DIR_WATCH_MAX_PENDING];
+    size_t count;
+    bool overflow;
+} NameSet;
+
+struct DirWatch {
+    int fd;
+    int wd;                               // -1 when nothing is watched
+    NameSet sets[2];
+    int pending;                          // index of the set being filled
+    uint32_t slots[DIR_WATCH_HASH_SLOTS]; // pending names: index + 1, 0 = free
+};
+
+static uint32_t name_hash(const char *s) {
+    uint32_t h = 2166136261u; // FNV-1a
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void name_set_reset(NameSet *set) {
+    Arena_reset(&set->arena);
+    set->count = 0;
+    set->overflow = false;
+}
+
+static void forget_pending(DirWatch *watch) {
+    name_set_reset(&watch->sets[watch->pending]);
+    memset(watch->slots, 0, sizeof(watch->slots));
+}
+
+// Adds `name` to the pending set unless it is already there.
+static void note_name(DirWatch *watch, const char *name) {
+    NameSet *set = &watch->sets[watch->pending];
+    if (set->overflow) return;
+
+    uint32_t mask = DIR_WATCH_HASH_SLOTS - 1;
+    uint32_t i = name_hash(name) & mask;
+    while (watch->slots[i]) {
+        if (strcmp(set->names[watch->slots[i] - 1], name) == 0) return;
+        i = (i + 1) & mask;
+    }
+    if (set->count == DIR_WATCH_MAX_PENDING) {
+        set->overflow = true;
+        return;
+    }
+    char *copy = Arena_strdup(&set->arena, name);
+    if (!copy) {
+        set->overflow = true;
+        return;
+    }
+    set->names[set->count++] = copy;
+    watch->slots[i] = (uint32_t)set->count;
+}
+
+DirWatch *dir_watch_open(void) {
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) return NULL;
+
+    DirWatch *watch = malloc(sizeof(*watch));
+    if (!watch) {
+        close(fd);
+        return NULL;
+    }
+    watch->fd = fd;
+    watch->wd = -1;
+    watch->pending = 0;
+    for (int i = 0; i < 2; i++) {
+        watch->sets[i].arena = Arena_new(DIR_WATCH_ARENA_CHUNK);
+        watch->sets[i].count = 0;
+        watch->sets[i].overflow = false;
+    }
+    memset(watch->slots, 0, sizeof(watch->slots));
+    return watch;
+}
+
+void dir_watch_close(DirWatch *watch) {
+    if (!watch) return;
+    close(watch->fd);
+    Arena_bye(&watch->sets[0].arena);
+    Arena_bye(&watch->sets[1].arena);
+    free(watch);
+}
+
+bool dir_watch_set(DirWatch *watch, const char *path) {
+    if (!watch) return false;
+    if (watch->wd >= 0) {
+        inotify_rm_watch(watch->fd, watch->wd);
+        watch->wd = -1;
+    }
+    // Events already queued belong to the old directory (or predate the
+    // listing about to be read); drop them.
+    char buf[DIR_WATCH_READ_BUF] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (read(watch->fd, buf, sizeof(buf)) > 0) {
+    }
+    forget_pending(watch);
+
+    if (!path) return false;
+    watch->wd = inotify_add_watch(watch->fd, path, DIR_WATCH_MASK);
+    return watch->wd >= 0;
+}
+
+bool dir_watch_active(const DirWatch *watch) {
+    return watch && watch->wd >= 0;
+}
+
+bool dir_watch_poll(DirWatch *watch) {
+    if (!watch) return false;
+    NameSet *set = &watch->sets[watch->pending];
+    char buf[DIR_WATCH_READ_BUF] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    for (;;) {
+        ssize_t len = read(watch->fd, buf, sizeof(buf));
+        if (len <= 0) {
+            if (len < 0 && errno == EINTR) continue;
+            break;
+        }
+        for (char *p = buf; p < buf + len;) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            p += sizeof(*ev) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                set->overflow = true;
+                continue;
+            }
+            if (ev->wd != watch->wd) continue; // left over from a previous watch
+            if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED | IN_UNMOUNT)) {
+                set->overflow = true;
+                continue;
+            }
+            if (ev->len > 0 && ev->name[0]) note_name(watch, ev->name);
+        }
+    }
+    return set->count > 0 || set->overflow;
+}
+
+bool dir_watch_overflowed(const DirWatch *watch) {
+    return watch && watch->sets[watch->pending].overflow;
+}
+
+bool dir_watch_take(DirWatch *watch, DirWatchBatch *out) {
+    if (!dir_watch_poll(watch)) return false;
+
+    NameSet *full = &watch->sets[watch->pending];
+    out->names = full->names;
+    out->count = full->count;
+    out->overflow = full->overflow;
+
+    // The other set was handed out last time; it is free again.
+    watch->pending ^= 1;
+    forget_pending(watch);
+    return true;
+}
+
+int dir_watch_fd(const DirWatch *watch) {
+    return watch ? watch->fd : -1;
+}
@@ -0,0 +1,52 @@
+#ifndef DIR_WATCH_H
+#define DIR_WATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// inotify subscription for the directory being listed.
+//
+// The watcher only records *which* names changed; it never trusts the event
+// kind. Bursts of create/delete/rename/modify events for the same name collapse
+// into one pending entry, and whoever applies the batch lstat()s each name to
+// learn its final state. That keeps the listing correct no matter how events
+// for one name interleave within a burst.
+typedef struct DirWatch DirWatch;
+
+// Names touched since the last dir_watch_take(). `names` stays valid until
+// the next call on the watcher.
+typedef struct {
+    char **names;
+    size_t count;
+    // Events were lost (queue overflow, too many names) or the directory
+    // itself was deleted or moved: only a full reload is trustworthy.
+    bool overflow;
+} DirWatchBatch;
+
+// Returns NULL if inotify is unavailable; callers then keep reloading.
+DirWatch *dir_watch_open(void);
+void dir_watch_close(DirWatch *watch);
+
+// Watches `path` instead of the previous directory and forgets everything
+// pending. Returns false (and watches nothing) if the watch cannot be added.
+bool dir_watch_set(DirWatch *watch, const char *path);
+
+// True while a directory is being watched.
+bool dir_watch_active(const DirWatch *watch);
+
+// Non-blocking: moves queued kernel events into the pending set. Returns true
+// if anything is pending.
+bool dir_watch_poll(DirWatch *watch);
+
+// True once the pending batch can no longer be applied as deltas (see
+// DirWatchBatch.overflow); only a full reload will do.
+bool dir_watch_overflowed(const DirWatch *watch);
+
+// Polls, then hands over everything pending and starts a new batch. Returns
+// false if nothing changed.
+bool dir_watch_take(DirWatch *watch, DirWatchBatch *out);
+
+// inotify descriptor, readable when events are queued (-1 if closed).
+int dir_watch_fd(const DirWatch *watch);
+
+#endif // DIR_WATCH_H
@@ -0,0 +1,341 @@
+// File: file_copy.c
+// In-process copies of files and directory trees
+#define _GNU_SOURCE
+
+#include "file_copy.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#if __has_include(<linux/fs.h>)
+#include <linux/fs.h>
+#endif
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
+#include "globals.h"
+
+// Bytes handed to the kernel per call; progress is reported in between
+#define FILE_COPY_CHUNK (8L * 1024 * 1024)
+// Buffer of the read()/write() fallback
+#define FILE_COPY_BUFFER (128 * 1024)
+
+static FileCopyProgressFn progress_fn = NULL;
+static void *progress_ctx = NULL;
+
+// One file_copy() call.
+typedef struct {
+    char path[MAX_PATH_LENGTH]; // source entry being copied
+    size_t path_len;
+    FileCopyProgress progress;
+    struct timespec start;
+    // The top directory created, so a copy into its own source skips it
+    dev_t dst_dev;
+    ino_t dst_ino;
+    bool no_clone; // the destination cannot share extents; stop asking
+    int error; // first errno met, or 0
+    char error_path[MAX_PATH_LENGTH];
+} CopyJob;
+
+void file_copy_set_progress(FileCopyProgressFn fn, void *ctx) {
+    progress_fn = fn;
+    progress_ctx = ctx;
+}
+
+static void job_report(CopyJob *job) {
+    if (!progress_fn) return;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    job->progress.elapsed_ms = (now.tv_sec - job->start.tv_sec) * 1000L +
+                               (now.tv_nsec - job->start.tv_nsec) / 1000000L;
+    progress_fn(&job->progress, progress_ctx);
+}
+
+// Records errno against the entry being copied, unless an earlier one is.
+static bool job_fail(CopyJob *job) {
+    if (!job->error) {
+        job->error = errno ? errno : EIO;
+        snprintf(job->error_path, sizeof(job->error_path), "%s", job->path);
+    }
+    return false;
+}
+
+// Appends "/name" to the path being copied; false if it does not fit.
+static bool job_enter(CopyJob *job, const char *name) {
+    size_t len = strlen(name);
+    if (job->path_len + 1 + len >= sizeof(job->path)) return false;
+    job->path[job->path_len] = '/';
+    memcpy(job->path + job->path_len + 1, name, len + 1);
+    job->path_len += 1 + len;
+    return true;
+}
+
+static void job_leave(CopyJob *job, size_t len) {
+    job->path_len = len;
+    job->path[len] = '\0';
+}
+
+// Copies the rest of `in` to `out` with the cheapest means available. The
+// kernel calls advance both file offsets, so each fallback carries on where
+// the previous one stopped.
+static bool copy_data(CopyJob *job, int in, int out) {
+    if (!job->no_clone) {
+        if (ioctl(out, FICLONE, in) == 0) {
+            struct stat st;
+            if (fstat(in, &st) == 0) job->progress.bytes += st.st_size;
+            return true;
+        }
+        job->no_clone = errno == EOPNOTSUPP || errno == ENOTTY || errno == EXDEV ||
+                        errno == EINVAL;
+    }
+
+    bool any = false;
+    for (;;) {
+        ssize_t n = copy_file_range(in, NULL, out, NULL, FILE_COPY_CHUNK, 0);
+        if (n < 0 && errno == EINTR) continue;
+        // Other filesystem, or one that cannot: fall back
+        if (n < 0 &&
+            (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP)) {
+            break;
+        }
+        if (n < 0) return job_fail(job);
+        if (n == 0) {
+            // Nothing at all may be a file that only claims to be empty
+            // (procfs and the like): read() tells
+            if (any) return true;
+            break;
+        }
+        any = true;
+        job->progress.bytes += n;
+        job_report(job);
+    }
+
+    for (;;) {
+        ssize_t n = sendfile(out, in, NULL, FILE_COPY_CHUNK);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EINVAL || errno == ENOSYS)) break;
+        if (n < 0) return job_fail(job);
+        if (n == 0) {
+            if (any) return true;
+            break;
+        }
+        any = true;
+        job->progress.bytes += n;
+        job_report(job);
+    }
+
+    char *buffer = malloc(FILE_COPY_BUFFER);
+    if (!buffer) return job_fail(job);
+    long long since_report = 0;
+    for (;;) {
+        ssize_t n = read(in, buffer, FILE_COPY_BUFFER);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            free(buffer);
+            return n == 0 ? true : job_fail(job);
+        }
+        for (ssize_t off = 0; off < n;) {
+            ssize_t w = write(out, buffer + off, (size_t)(n - off));
+            if (w < 0 && errno == EINTR) continue;
+            if (w < 0) {
+                free(buffer);
+                return job_fail(job);
+            }
+            off += w;
+        }
+        job->progress.bytes += n;
+        since_report += n;
+        if (since_report >= FILE_COPY_CHUNK) {
+            since_report = 0;
+            job_report(job);
+        }
+    }
+}
+
+// Owner first: chown clears set-id bits that the mode then puts back.
+// Without the privilege to give the file away it stays the copier's, and
+// then must not become set-id to the copier.
+static void copy_metadata(int fd, const struct stat *st) {
+    mode_t mode = st->st_mode & 07777;
+    if (fchown(fd, st->st_uid, st->st_gid) != 0) {
+        // Keep the group at least, where we belong to it
+        (void)!fchown(fd, (uid_t)-1, st->st_gid);
+        mode &= ~(mode_t)(S_ISUID | S_ISGID);
+    }
+    (void)fchmod(fd, mode);
+    struct timespec times[2] = {st->st_atim, st->st_mtim};
+    (void)futimens(fd, times);
+}
+
+static void copy_metadata_at(int dir, const char *name, const struct stat *st, bool link) {
+    int flags = link ? AT_SYMLINK_NOFOLLOW : 0;
+    mode_t mode = st->st_mode & 07777;
+    if (fchownat(dir, name, st->st_uid, st->st_gid, flags) != 0) {
+        (void)!fchownat(dir, name, (uid_t)-1, st->st_gid, flags);
+        mode &= ~(mode_t)(S_ISUID | S_ISGID);
+    }
+    if (!link) (void)fchmodat(dir, name, mode, 0);
+    struct timespec times[2] = {st->st_atim, st->st_mtim};
+    (void)utimensat(dir, name, times, flags);
+}
+
+static bool copy_file_at(CopyJob *job, int src_dir, const char *src, int dst_dir,
+                         const char *dst, const struct stat *st) {
+    int in = openat(src_dir, src, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (in < 0) return job_fail(job);
+    // Private until the data is in; the mode is set last
+    int out = openat(dst_dir, dst, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (out < 0) {
+        job_fail(job);
+        close(in);
+        return false;
+    }
+    bool ok = copy_data(job, in, out);
+    if (ok) copy_metadata(out, st);
+    close(in);
+    if (close(out) != 0 && ok) ok = job_fail(job);
+    return ok;
+}
+
+static bool copy_symlink_at(CopyJob *job, int src_dir, const char *src, int dst_dir,
+                            const char *dst, const struct stat *st) {
+    char target[MAX_PATH_LENGTH];
+    ssize_t len = readlinkat(src_dir, src, target, sizeof(target) - 1);
+    if (len < 0) return job_fail(job);
+    target[len] = '\0';
+    if (symlinkat(target, dst_dir, dst) != 0) return job_fail(job);
+    copy_metadata_at(dst_dir, dst, st, true);
+    return true;
+}
+
+static bool copy_special_at(CopyJob *job, int dst_dir, const char *dst, const struct stat *st) {
+    if (mknodat(dst_dir, dst, st->st_mode, st->st_rdev) != 0) return job_fail(job);
+    copy_metadata_at(dst_dir, dst, st, false);
+    return true;
+}
+
+static bool copy_entry_at(CopyJob *job, int src_dir, const char *src, int dst_dir,
+                          const char *dst, const struct stat *st);
+
+// The directory is filled while only its owner may write it, then gets its
+// own mode and times (after the entries, whose creation changes them).
+static bool copy_dir_at(CopyJob *job, int src_dir, const char *src, int dst_dir,
+                        const char *dst, const struct stat *st, bool top) {
+    int in = openat(src_dir, src, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (in < 0) return job_fail(job);
+    if (mkdirat(dst_dir, dst, 0700) != 0) {
+        job_fail(job);
+        close(in);
+        return false;
+    }
+    int out = openat(dst_dir, dst, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    DIR *handle = out >= 0 ? fdopendir(in) : NULL;
+    if (!handle) {
+        job_fail(job);
+        if (out >= 0) close(out);
+        close(in);
+        return false;
+    }
+    if (top) {
+        struct stat made;
+        if (fstat(out, &made) == 0) {
+            job->dst_dev = made.st_dev;
+            job->dst_ino = made.st_ino;
+        }
+    }
+
+    bool ok = true;
+    size_t len = job->path_len;
+    struct dirent *entry;
+    errno = 0;
+    while ((entry = readdir(handle)) != NULL) {
+        const char *name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        if (!job_enter(job, name)) {
+            errno = ENAMETOOLONG;
+            ok = job_fail(job);
+            continue;
+        }
+        struct stat child;
+        if (fstatat(dirfd(handle), name, &child, AT_SYMLINK_NOFOLLOW) != 0) {
+            ok = job_fail(job);
+        } else if (child.st_dev == job->dst_dev && child.st_ino == job->dst_ino) {
+            // The copy itself, made inside its source
+        } else if (!copy_entry_at(job, dirfd(handle), name, out, name, &child)) {
+            ok = false;
+        }
+        job_leave(job, len);
+        errno = 0;
+    }
+    if (errno != 0) ok = job_fail(job);
+    copy_metadata(out, st);
+    closedir(handle);
+    close(out);
+    return ok;
+}
+
+static bool copy_entry_at(CopyJob *job, int src_dir, const char *src, int dst_dir,
+                          const char *dst, const struct stat *st) {
+    bool ok;
+    if (S_ISDIR(st->st_mode)) {
+        ok = copy_dir_at(job, src_dir, src, dst_dir, dst, st, false);
+    } else if (S_ISREG(st->st_mode)) {
+        ok = copy_file_at(job, src_dir, src, dst_dir, dst, st);
+    } else if (S_ISLNK(st->st_mode)) {
+        ok = copy_symlink_at(job, src_dir, src, dst_dir, dst, st);
+    } else {
+        ok = copy_special_at(job, dst_dir, dst, st);
+    }
+    job->progress.files++;
+    job_report(job);
+    return ok;
+}
+
+bool file_copy(const char *src, const char *dst, char *err, size_t err_len) {
+    if (!src || !*src || !dst || !*dst) {
+        if (err && err_len) snprintf(err, err_len, "Invalid copy paths");
+        return false;
+    }
+    struct stat st;
+    if (lstat(src, &st) != 0) {
+        if (err && err_len) snprintf(err, err_len, "Copy source missing");
+        return false;
+    }
+
+    CopyJob *job = calloc(1, sizeof(*job));
+    if (!job) {
+        if (err && err_len) snprintf(err, err_len, "Out of memory");
+        return false;
+    }
+    snprintf(job->path, sizeof(job->path), "%s", src);
+    job->path_len = strlen(job->path);
+    job->progress.path = job->path;
+    clock_gettime(CLOCK_MONOTONIC, &job->start);
+
+    bool ok;
+    if (S_ISDIR(st.st_mode)) {
+        ok = copy_dir_at(job, AT_FDCWD, src, AT_FDCWD, dst, &st, true);
+        job->progress.files++;
+        job_report(job);
+    } else {
+        ok = copy_entry_at(job, AT_FDCWD, src, AT_FDCWD, dst, &st);
+    }
+    if (!ok && err && err_len) {
+        snprintf(err, err_len, "Copy failed: %s: %s", job->error_path,
+                 strerror(job->error ? job->error : EIO));
+    }
+    free(job);
+    return ok;
+}
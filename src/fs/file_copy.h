@@ -0,0 +1,35 @@
+#ifndef FILE_COPY_H
+#define FILE_COPY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Copies of files and directory trees, done in-process.
+//
+// A regular file is cloned (FICLONE) where the filesystem shares extents,
+// else copied by the kernel with copy_file_range(), across filesystems with
+// sendfile(), and with read()/write() where neither applies. Directories are
+// walked relative to their parent (openat/mkdirat), symlinks and special
+// files are recreated rather than followed, and owner (where permitted),
+// mode and timestamps are carried over. One bad entry does not stop the
+// rest of a tree.
+
+typedef struct {
+    const char *path; // source being copied
+    long long bytes;  // copied so far by this file_copy() call
+    long files;       // entries finished so far
+    long elapsed_ms;  // since the call started
+} FileCopyProgress;
+
+typedef void (*FileCopyProgressFn)(const FileCopyProgress *progress, void *ctx);
+
+// Called after every file and every few megabytes, on the copying thread;
+// NULL (the default) for none.
+void file_copy_set_progress(FileCopyProgressFn fn, void *ctx);
+
+// Copies `src` (not followed if it is a symlink) to `dst`, which must not
+// exist. On failure, `err` (if given) names the first entry that failed;
+// whatever was copied stays.
+bool file_copy(const char *src, const char *dst, char *err, size_t err_len);
+
+#endif // FILE_COPY_H
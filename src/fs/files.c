@@ -3,16 +3,14 @@
 #ifndef _POSIX_C_SOURCE
 #define _POSIX_C_SOURCE 200809L
 #endif
-#include "../cupidarchive/cupidarchive.h" // For archive reading
 #include "syntax.h"                       // For syntax highlighting
 #include <ctype.h>                        // for toupper
 #include <dirent.h>    // for DIR, struct dirent, opendir, readdir, closedir
 #include <errno.h>     // For permission errors
 #include <fcntl.h>     // For O_RDONLY
 #include <limits.h>    // For PATH_MAX
-#include <magic.h>     // For libmagic
 #include <ncurses.h>   // for WINDOW, mvwprintw
-#include <pthread.h>   // For background directory size worker
+#include <pthread.h>   // For banner_mutex
 #include <stdbool.h>   // for bool, true, false
 #include <stddef.h>    // for NULL
 #include <stdio.h>     // for snprintf
@@ -55,7 +53,9 @@
 // Local includes
 #include "config.h"
 #include "console.h"
+#include "dir_size.h"
 #include "files.h" // for FileAttributes, FileAttr, MAX_PATH_LENGTH
+#include "frame_sched.h"
 #include "globals.h"
 #include "main.h" // for FileAttr, Vector, Vector_add, Vector_len, Vector_set_len
 #include "mime.h" // for MIME types and file emoji
@@ -99,38 +99,6 @@ static void register_ctrl_arrow_keys_once(void) {
 #endif
 }
 
-typedef enum {
-  // Handle Ctrl+Arrow key sequences
-  // This section processes the input for Ctrl+Arrow key combinations
-
-  DIR_SIZE_STATUS_PENDING = 0,
-  DIR_SIZE_STATUS_READY = 1,
-} DirSizeCacheStatus;
-
-typedef struct DirSizeEntry {
-  char path[MAX_PATH_LENGTH];
-  long size;
-  long progress;
-  DirSizeCacheStatus status;
-  bool job_enqueued;
-  struct DirSizeEntry *next;
-} DirSizeEntry;
-
-typedef struct DirSizeJob {
-  char path[MAX_PATH_LENGTH];
-  struct DirSizeJob *next;
-} DirSizeJob;
-
-static DirSizeEntry *dir_size_cache_head = NULL;
-static DirSizeJob *dir_size_job_head = NULL;
-static DirSizeJob *dir_size_job_tail = NULL;
-static pthread_mutex_t dir_size_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t dir_size_cond = PTHREAD_COND_INITIALIZER;
-static bool dir_size_thread_running = false;
-static bool dir_size_thread_initialized = false;
-static pthread_t dir_size_thread;
-static struct timespec dir_size_last_activity = {0};
-static bool dir_size_last_activity_initialized = false;
 static int g_editor_h_scroll = 0;
 static bool g_editor_mouse_dragging = false;
 
@@ -148,213 +116,46 @@ static void editor_disable_mouse_drag_reporting(void) {
   fflush(stdout);
 }
 
-static DirSizeEntry *dir_size_find_entry(const char *path);
-static void dir_size_enqueue_job_locked(const char *path);
-static void dir_size_cache_clear_locked(void);
-static void *dir_size_worker(void *arg);
-static void ensure_dir_size_worker(void);
-static long compute_directory_size_full(const char *dir_path);
-static long compute_directory_size_full_progress(const char *dir_path,
-                                                 const char *job_path);
-static long dir_size_get_result(const char *dir_path, bool allow_enqueue);
-static bool dir_size_user_idle(void);
-
-void dir_size_note_user_activity(void) {
-  clock_gettime(CLOCK_MONOTONIC, &dir_size_last_activity);
-  dir_size_last_activity_initialized = true;
-}
-
-static bool dir_size_user_idle(void) {
-  if (!dir_size_last_activity_initialized) {
-    return true;
-  }
-  struct timespec now;
-  clock_gettime(CLOCK_MONOTONIC, &now);
-  long elapsed_ns = (now.tv_sec - dir_size_last_activity.tv_sec) * 1000000000L +
-                    (now.tv_nsec - dir_size_last_activity.tv_nsec);
-  return elapsed_ns >= DIR_SIZE_REQUEST_DELAY_NS;
-}
-
-bool dir_size_can_enqueue(void) { return dir_size_user_idle(); }
-
-static DirSizeEntry *dir_size_find_entry(const char *path) {
-  for (DirSizeEntry *entry = dir_size_cache_head; entry != NULL;
-       entry = entry->next) {
-    if (strncmp(entry->path, path, MAX_PATH_LENGTH) == 0) {
-      return entry;
-    }
-  }
-  return NULL;
-}
-
-static void dir_size_enqueue_job_locked(const char *path) {
-  DirSizeJob *job = malloc(sizeof(DirSizeJob));
-  if (!job) {
-    return;
-  }
-  strncpy(job->path, path, MAX_PATH_LENGTH - 1);
-  job->path[MAX_PATH_LENGTH - 1] = '\0';
-  job->next = NULL;
-
-  DirSizeEntry *entry = dir_size_find_entry(path);
-  if (entry) {
-    entry->job_enqueued = true;
-  }
-
-  if (dir_size_job_tail) {
-    dir_size_job_tail->next = job;
-  } else {
-    dir_size_job_head = job;
-  }
-  dir_size_job_tail = job;
-  pthread_cond_signal(&dir_size_cond);
-}
-
-static void dir_size_cache_clear_locked(void) {
-  DirSizeEntry *entry = dir_size_cache_head;
-  while (entry) {
-    DirSizeEntry *next = entry->next;
-    free(entry);
-    entry = next;
-  }
-  dir_size_cache_head = NULL;
-
-  DirSizeJob *job = dir_size_job_head;
-  while (job) {
-    DirSizeJob *next = job->next;
-    free(job);
-    job = next;
-  }
-  dir_size_job_head = NULL;
-  dir_size_job_tail = NULL;
-}
-
-static long compute_directory_size_full(const char *dir_path) {
-  if (strncmp(dir_path, "/proc", 5) == 0 || strncmp(dir_path, "/sys", 4) == 0 ||
-      strncmp(dir_path, "/dev", 4) == 0 || strncmp(dir_path, "/run", 4) == 0) {
-    return DIR_SIZE_VIRTUAL_FS;
-  }
-
-  DIR *dir = opendir(dir_path);
-  if (!dir) {
-    if (errno == EACCES) {
-      return DIR_SIZE_PERMISSION_DENIED;
-    }
-    return -1;
-  }
-
-  long total_size = 0;
-  const long MAX_SIZE_THRESHOLD = 1000L * 1024 * 1024 * 1024 * 1024; // 1000 TiB
-  struct dirent *entry;
-  struct stat statbuf;
-
-  while ((entry = readdir(dir)) != NULL) {
-    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-      continue;
-    }
-
-    char path[MAX_PATH_LENGTH];
-    if (strlen(dir_path) + strlen(entry->d_name) + 1 < sizeof(path)) {
-      snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
-    } else {
-      fprintf(stderr, "Path length exceeds buffer size for %s/%s\n", dir_path,
-              entry->d_name);
-      continue;
-    }
-
-    if (lstat(path, &statbuf) == -1) {
-      continue;
-    }
-
-    if (S_ISDIR(statbuf.st_mode)) {
-      long dir_size = compute_directory_size_full(path);
-      if (dir_size == DIR_SIZE_VIRTUAL_FS ||
-          dir_size == DIR_SIZE_PERMISSION_DENIED) {
-        closedir(dir);
-        return dir_size;
-      } else if (dir_size == DIR_SIZE_TOO_LARGE) {
-        closedir(dir);
-        return DIR_SIZE_TOO_LARGE;
-      } else if (dir_size >= 0) {
-        total_size += dir_size;
-      }
-      // If dir_size == -1 (unreadable), skip but keep going
-    } else {
-      total_size += statbuf.st_size;
-    }
-
-    if (total_size > MAX_SIZE_THRESHOLD) {
-      closedir(dir);
-      return DIR_SIZE_TOO_LARGE;
-    }
-  }
-
-  closedir(dir);
-  return total_size;
-}
-
-static void *dir_size_worker(void *arg) {
-  (void)arg;
-  pthread_mutex_lock(&dir_size_mutex);
-  while (dir_size_thread_running) {
-    while (dir_size_job_head == NULL && dir_size_thread_running) {
-      pthread_cond_wait(&dir_size_cond, &dir_size_mutex);
-    }
-    if (!dir_size_thread_running) {
-      break;
-    }
-
-    DirSizeJob *job = dir_size_job_head;
-    dir_size_job_head = job->next;
-    if (!dir_size_job_head) {
-      dir_size_job_tail = NULL;
-    }
-    char path[MAX_PATH_LENGTH];
-    strncpy(path, job->path, MAX_PATH_LENGTH - 1);
-    path[MAX_PATH_LENGTH - 1] = '\0';
-    free(job);
-
-    pthread_mutex_unlock(&dir_size_mutex);
-    // Compute size with periodic progress updates for UI.
-    long size = compute_directory_size_full_progress(path, path);
-    pthread_mutex_lock(&dir_size_mutex);
-
-    DirSizeEntry *entry = dir_size_find_entry(path);
-    if (entry) {
-      entry->size = size;
-      if (size >= 0)
-        entry->progress = size;
-      entry->status = DIR_SIZE_STATUS_READY;
-      entry->job_enqueued = false;
-    }
-  }
-  pthread_mutex_unlock(&dir_size_mutex);
-  return NULL;
-}
-
-static void ensure_dir_size_worker(void) {
-  if (dir_size_thread_initialized) {
-    return;
-  }
-  dir_size_thread_running = true;
-  if (pthread_create(&dir_size_thread, NULL, dir_size_worker, NULL) == 0) {
-    dir_size_thread_initialized = true;
-  } else {
-    dir_size_thread_running = false;
-  }
-}
 
 // FileAttributes structure
 struct FileAttributes {
   char *name;  //
   ino_t inode; // Change from int inode;
   bool is_dir;
+  // lstat metadata, valid once has_stat is set (see FileAttr_load_stat)
+  bool has_stat;
+  bool is_symlink;
+  mode_t mode;
+  off_t size;
+  dev_t dev;
+  struct timespec mtime;
+  char *link_target; // NULL unless is_symlink and the link was readable
+  bool in_arena;     // struct and name live in a listing Arena
 };
+// Highlight spans of one buffer line, lexed the last time it was drawn
+typedef struct {
+  SyntaxSpan *spans;
+  int span_count;
+  const char *text; // line the spans belong to; NULL once the line changed
+  int length;
+  int comment_in;   // block comment state before the line
+  int comment_out;  // and after it
+} LineHighlight;
+
+// Lines holding spans before the ones off screen are dropped
+#define LINE_HIGHLIGHT_KEEP 4096
+
 // TextBuffer structure
 typedef struct {
   char **lines;  // Dynamic array of strings
   int num_lines; // Current number of lines
   int capacity;  // Total capacity of the array
+  SyntaxCheckpoints comment_states; // Block comment state every few lines
+  LineHighlight *highlights;        // highlights[i] belongs to lines[i]
+  int highlight_count;              // entries, a prefix of the lines
+  int highlight_live;               // entries holding spans
+  const SyntaxDef *highlight_syntax; // definition the spans were lexed with
+  SyntaxSpans highlight_scratch;
 } TextBuffer;
 
 // Active editor buffer (only valid while editor is open)
@@ -372,6 +173,85 @@ static bool g_editor_dirty_clear_requested = false;
 static bool g_editor_close_requested = false;
 static bool g_editor_reload_requested = false;
 static bool g_editor_readonly = false;
+
+static void line_highlight_clear(TextBuffer *buffer, LineHighlight *h) {
+  if (h->text)
+    buffer->highlight_live--;
+  free(h->spans);
+  *h = (LineHighlight){0};
+}
+
+// Drops the spans of the `count` lines from `first` on.
+static void text_buffer_clear_highlights(TextBuffer *buffer, int first,
+                                         int count) {
+  int end = MIN(first + count, buffer->highlight_count);
+  for (int i = MAX(first, 0); i < end; i++)
+    line_highlight_clear(buffer, &buffer->highlights[i]);
+}
+
+// `count` lines from `first` on were edited in place.
+static void text_buffer_lines_changed(TextBuffer *buffer, int first,
+                                      int count) {
+  if (!buffer)
+    return;
+  syntax_checkpoints_invalidate(&buffer->comment_states, first);
+  text_buffer_clear_highlights(buffer, first, count);
+}
+
+// `count` new lines were inserted before line `at`.
+static void text_buffer_lines_inserted(TextBuffer *buffer, int at,
+                                       int count) {
+  if (!buffer)
+    return;
+  syntax_checkpoints_invalidate(&buffer->comment_states, at);
+  if (at >= buffer->highlight_count || count <= 0)
+    return;
+  LineHighlight *grown =
+      realloc(buffer->highlights, sizeof(LineHighlight) *
+                                      (size_t)(buffer->highlight_count + count));
+  if (!grown) {
+    // Forget the lines from `at` on rather than misplace them
+    text_buffer_clear_highlights(buffer, at, buffer->highlight_count - at);
+    buffer->highlight_count = at;
+    return;
+  }
+  buffer->highlights = grown;
+  memmove(&grown[at + count], &grown[at],
+          sizeof(LineHighlight) * (size_t)(buffer->highlight_count - at));
+  memset(&grown[at], 0, sizeof(LineHighlight) * (size_t)count);
+  buffer->highlight_count += count;
+}
+
+// The `count` lines from `at` on were removed.
+static void text_buffer_lines_removed(TextBuffer *buffer, int at, int count) {
+  if (!buffer)
+    return;
+  syntax_checkpoints_invalidate(&buffer->comment_states, at);
+  if (at >= buffer->highlight_count || count <= 0)
+    return;
+  count = MIN(count, buffer->highlight_count - at);
+  text_buffer_clear_highlights(buffer, at, count);
+  memmove(&buffer->highlights[at], &buffer->highlights[at + count],
+          sizeof(LineHighlight) *
+              (size_t)(buffer->highlight_count - at - count));
+  buffer->highlight_count -= count;
+}
+
+// All lines were replaced.
+static void text_buffer_reset(TextBuffer *buffer) {
+  if (!buffer)
+    return;
+  syntax_checkpoints_invalidate(&buffer->comment_states, 0);
+  text_buffer_clear_highlights(buffer, 0, buffer->highlight_count);
+  free(buffer->highlights);
+  buffer->highlights = NULL;
+  buffer->highlight_count = 0;
+}
+
+static void text_buffer_free_highlights(TextBuffer *buffer) {
+  text_buffer_reset(buffer);
+  syntax_spans_free(&buffer->highlight_scratch);
+}
 
 static bool editor_block_if_readonly(WINDOW *notification_window,
                                      struct timespec *last_notif_check) {
@@ -395,6 +275,8 @@ static bool editor_load_file_into_buffer(const char *path, TextBuffer *buf) {
   FILE *rf = fopen(path, "r");
   if (!rf)
     return false;
+
+  text_buffer_reset(buf);
 
   // Free existing contents.
   if (buf->lines) {
@@ -576,6 +458,7 @@ static void editor_apply_snapshot(TextBuffer *buf, EditorSnapshot *snap,
   if (!buf || !snap || !snap->lines)
     return;
 
+  text_buffer_reset(buf);
   if (buf->lines) {
     for (int i = 0; i < buf->num_lines; i++)
       free(buf->lines[i]);
@@ -870,6 +753,7 @@ static void delete_selection(TextBuffer *buffer) {
     return;
   if (e_line >= buffer->num_lines)
     e_line = buffer->num_lines - 1;
+  text_buffer_lines_changed(buffer, s_line, 1);
 
   if (s_line == e_line) {
     char *line = buffer->lines[s_line];
@@ -918,6 +802,7 @@ static void delete_selection(TextBuffer *buffer) {
     buffer->lines[i] = buffer->lines[i + remove_count];
   }
   buffer->num_lines -= remove_count;
+  text_buffer_lines_removed(buffer, s_line + 1, remove_count);
 }
 
 // -----------------------
@@ -945,6 +830,7 @@ static void editor_selection_to_uppercase(TextBuffer *buffer) {
     return;
   if (e_line >= buffer->num_lines)
     e_line = buffer->num_lines - 1;
+  text_buffer_lines_changed(buffer, s_line, e_line - s_line + 1);
 
   for (int i = s_line; i <= e_line; i++) {
     char *line = buffer->lines[i];
@@ -980,6 +866,7 @@ static void insert_text_at_cursor(TextBuffer *buffer, int *cursor_line,
                                   int *cursor_col, const char *text) {
   if (!buffer || !buffer->lines || !text || !cursor_line || !cursor_col)
     return;
+  text_buffer_lines_changed(buffer, *cursor_line, 1);
 
   const char *line =
       buffer->lines[*cursor_line] ? buffer->lines[*cursor_line] : "";
@@ -1079,6 +966,7 @@ static void insert_text_at_cursor(TextBuffer *buffer, int *cursor_line,
   buffer->lines[*cursor_line + parts - 1] = last;
 
   buffer->num_lines += (parts - 1);
+  text_buffer_lines_inserted(buffer, *cursor_line + 1, parts - 1);
   *cursor_line = *cursor_line + parts - 1;
   *cursor_col = (int)last_len;
 
@@ -1270,6 +1158,7 @@ bool editor_insert_text(const char *text) {
 
   if (line < 0 || line >= g_editor_buffer->num_lines)
     return false;
+  text_buffer_lines_changed(g_editor_buffer, line, 1);
 
   char *curr_line = g_editor_buffer->lines[line];
   if (!curr_line)
@@ -1323,6 +1212,7 @@ bool editor_insert_text(const char *text) {
               (g_editor_buffer->num_lines - line - 1) * sizeof(char *));
       g_editor_buffer->lines[line + 1] = rest;
       g_editor_buffer->num_lines++;
+      text_buffer_lines_inserted(g_editor_buffer, line + 1, 1);
 
       line++;
       col = 0;
@@ -1374,6 +1264,7 @@ bool editor_replace_text(int start_line, int start_col, int end_line,
     return false;
   if (start_line > end_line || (start_line == end_line && start_col > end_col))
     return false;
+  text_buffer_lines_changed(g_editor_buffer, start_line, 1);
 
   // Delete the range
   if (start_line == end_line) {
@@ -1418,6 +1309,7 @@ bool editor_replace_text(int start_line, int start_col, int end_line,
             &g_editor_buffer->lines[end_line + 1],
             (g_editor_buffer->num_lines - end_line - 1) * sizeof(char *));
     g_editor_buffer->num_lines -= lines_deleted;
+    text_buffer_lines_removed(g_editor_buffer, start_line + 1, lines_deleted);
   }
 
   // Set cursor to start of deleted range
@@ -1451,6 +1343,7 @@ bool editor_delete_range(int start_line, int start_col, int end_line,
     return false;
   if (start_line > end_line || (start_line == end_line && start_col > end_col))
     return false;
+  text_buffer_lines_changed(g_editor_buffer, start_line, 1);
 
   // Delete the range
   if (start_line == end_line) {
@@ -1495,6 +1388,7 @@ bool editor_delete_range(int start_line, int start_col, int end_line,
             &g_editor_buffer->lines[end_line + 1],
             (g_editor_buffer->num_lines - end_line - 1) * sizeof(char *));
     g_editor_buffer->num_lines -= lines_deleted;
+    text_buffer_lines_removed(g_editor_buffer, start_line + 1, lines_deleted);
   }
 
   // Set cursor to start of deleted range
@@ -1669,6 +1563,99 @@ const char *FileAttr_get_name(FileAttr fa) {
  * @return true if the file type is supported, false otherwise
  */
 bool FileAttr_is_dir(FileAttr fa) { return fa != NULL && fa->is_dir; }
+
+/**
+ * Fills the cached lstat metadata of a FileAttr, relative to an open
+ * directory fd so no path has to be resolved again.
+ *
+ * @param fa the entry to fill
+ * @param dir_fd open fd of the directory containing the entry
+ * @return true if the metadata is available
+ */
+bool FileAttr_load_stat(FileAttr fa, int dir_fd) {
+  if (fa == NULL)
+    return false;
+  if (fa->has_stat)
+    return true;
+
+  struct stat st;
+  if (fstatat(dir_fd, fa->name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+    return false;
+  FileAttr_set_stat(fa, &st, dir_fd);
+  return true;
+}
+
+/**
+ * Stores lstat metadata obtained elsewhere (e.g. a batched statx) in a
+ * FileAttr. Symlink targets are read relative to dir_fd.
+ *
+ * @param fa the entry to fill
+ * @param st lstat result for the entry
+ * @param dir_fd open fd of the directory containing the entry
+ */
+void FileAttr_set_stat(FileAttr fa, const struct stat *st, int dir_fd) {
+  if (fa == NULL || st == NULL)
+    return;
+
+  fa->mode = st->st_mode;
+  fa->size = st->st_size;
+  fa->dev = st->st_dev;
+  fa->mtime = st->st_mtim;
+  fa->is_symlink = S_ISLNK(st->st_mode);
+  free(fa->link_target);
+  fa->link_target = NULL;
+  if (fa->is_symlink) {
+    char target[MAX_PATH_LENGTH];
+    ssize_t n = readlinkat(dir_fd, fa->name, target, sizeof(target) - 1);
+    if (n > 0) {
+      target[n] = '\0';
+      fa->link_target = strdup(target);
+    }
+  }
+  fa->has_stat = true;
+}
+
+bool FileAttr_has_stat(FileAttr fa) { return fa != NULL && fa->has_stat; }
+
+bool FileAttr_is_symlink(FileAttr fa) {
+  return fa != NULL && fa->has_stat && fa->is_symlink;
+}
+
+const char *FileAttr_link_target(FileAttr fa) {
+  return (fa != NULL && fa->has_stat) ? fa->link_target : NULL;
+}
+
+off_t FileAttr_size(FileAttr fa) {
+  return (fa != NULL && fa->has_stat) ? fa->size : 0;
+}
+
+mode_t FileAttr_mode(FileAttr fa) {
+  return (fa != NULL && fa->has_stat) ? fa->mode : 0;
+}
+
+struct timespec FileAttr_mtime(FileAttr fa) {
+  if (fa != NULL && fa->has_stat)
+    return fa->mtime;
+  return (struct timespec){0};
+}
+
+/**
+ * Copies the cached metadata into a struct stat. Only st_dev, st_ino,
+ * st_mode, st_size and st_mtim are meaningful.
+ *
+ * @return false if the entry has no metadata yet
+ */
+bool FileAttr_get_stat(FileAttr fa, struct stat *st) {
+  if (fa == NULL || st == NULL || !fa->has_stat)
+    return false;
+  memset(st, 0, sizeof(*st));
+  st->st_dev = fa->dev;
+  st->st_ino = fa->inode;
+  st->st_mode = fa->mode;
+  st->st_size = fa->size;
+  st->st_mtim = fa->mtime;
+  return true;
+}
 /**
  * Function to format a file size in a human-readable format
  *
@@ -1711,15 +1698,74 @@ FileAttr mk_attr(const char *name, bool is_dir, ino_t inode) {
 
     fa->inode = inode;
     fa->is_dir = is_dir;
+    fa->has_stat = false;
+    fa->is_symlink = false;
+    fa->link_target = NULL;
+    fa->in_arena = false;
     return fa;
   } else {
     // Handle memory allocation failure for the FileAttr
     return NULL;
   }
 }
-// Function to free the allocated memory for a FileAttr
+/**
+ * Function to create a new FileAttr inside an Arena. The record and its name
+ * are packed next to each other and released with the arena.
+ *
+ * @param arena the listing arena, or NULL to fall back to mk_attr()
+ * @param name the name of the file
+ * @param is_dir true if the file is a directory, false otherwise
+ * @param inode the inode number of the file
+ * @return a new FileAttr
+ */
+FileAttr mk_attr_in(Arena *arena, const char *name, bool is_dir, ino_t inode) {
+  if (arena == NULL)
+    return mk_attr(name, is_dir, inode);
+
+  FileAttr fa = Arena_alloc(arena, sizeof(struct FileAttributes));
+  if (fa == NULL)
+    return NULL;
+  fa->name = Arena_strdup(arena, name);
+  if (fa->name == NULL)
+    return NULL;
+
+  fa->inode = inode;
+  fa->is_dir = is_dir;
+  fa->has_stat = false;
+  fa->is_symlink = false;
+  fa->link_target = NULL;
+  fa->in_arena = true;
+  return fa;
+}
+/**
+ * Function to move an arena FileAttr into another arena, e.g. to compact a
+ * listing whose arena is mostly filled with entries that are gone. The copy
+ * takes over the cached symlink target, so the original must be dropped
+ * without free_attr().
+ *
+ * @param arena the arena to copy into
+ * @param fa the entry to move
+ * @return the copy, or NULL on allocation failure (fa is left untouched)
+ */
+FileAttr FileAttr_move_to(Arena *arena, FileAttr fa) {
+  FileAttr copy = Arena_alloc(arena, sizeof(struct FileAttributes));
+  if (copy == NULL)
+    return NULL;
+  *copy = *fa;
+  copy->name = Arena_strdup(arena, fa->name);
+  if (copy->name == NULL)
+    return NULL;
+  copy->in_arena = true;
+  fa->link_target = NULL;
+  return copy;
+}
+// Function to free the allocated memory for a FileAttr. Arena entries only
+// drop what lives outside the arena; the arena itself is reset by the owner.
 void free_attr(FileAttr fa) {
   if (fa != NULL) {
+    free(fa->link_target);
+    if (fa->in_arena)
+      return;
     free(fa->name); // Free the allocated memory for the name
     free(fa);
   }
@@ -1745,58 +1791,117 @@ size_t count_directory_files(const char *name) {
   return count;
 }
 
+void dir_cursor_init(DirCursor *cursor) {
+  if (!cursor)
+    return;
+  memset(cursor, 0, sizeof(*cursor));
+}
+
+void dir_cursor_close(DirCursor *cursor) {
+  if (!cursor)
+    return;
+  if (cursor->dir) {
+    closedir(cursor->dir);
+  }
+  dir_cursor_init(cursor);
+}
+
+bool dir_cursor_is_stale(const DirCursor *cursor, const char *path) {
+  if (!cursor || !cursor->dir || !path)
+    return true;
+  struct stat st;
+  if (stat(path, &st) != 0)
+    return true;
+  return st.st_dev != cursor->dev || st.st_ino != cursor->ino ||
+         st.st_mtim.tv_sec != cursor->mtime.tv_sec ||
+         st.st_mtim.tv_nsec != cursor->mtime.tv_nsec;
+}
+
+bool dir_cursor_open(DirCursor *cursor, const char *path) {
+  dir_cursor_close(cursor);
+  cursor->dir = opendir(path);
+  if (!cursor->dir)
+    return false;
+  struct stat st;
+  if (fstat(dirfd(cursor->dir), &st) == 0) {
+    cursor->dev = st.st_dev;
+    cursor->ino = st.st_ino;
+    cursor->mtime = st.st_mtim;
+  }
+  return true;
+}
+
 /**
  * Function to append files in a directory to a Vector (lazy loading version)
- * Loads up to max_files, starting from files_loaded offset
+ * Loads up to max_files, continuing from the cursor's current position
  *
  * @param v the Vector to append the files to
  * @param name the name of the directory
  * @param max_files maximum number of files to load in this batch
  * @param files_loaded pointer to track how many files have been loaded (in/out)
- * @return number of files actually loaded in this batch
+ * @param cursor open readdir position shared between batches (in/out)
+ * @param arena listing arena for the new entries, or NULL for the heap
  */
 void append_files_to_vec_lazy(Vector *v, const char *name, size_t max_files,
-                              size_t *files_loaded) {
-  DIR *dir = opendir(name);
+                              size_t *files_loaded, DirCursor *cursor,
+                              Arena *arena) {
+  if (!cursor)
+    return;
+
   size_t loaded_this_batch = 0;
   size_t skipped = 0;
+  size_t to_skip = 0;
+
+  if (dir_cursor_is_stale(cursor, name)) {
+    // First batch, or the directory changed since the stream was opened:
+    // reopen and fast-forward past what the caller already holds. Readdir
+    // order is stable for an unchanged directory, so this is only paid again
+    // after a modification.
+    if (!dir_cursor_open(cursor, name))
+      return;
+    to_skip = *files_loaded;
+  }
 
-  if (dir != NULL) {
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL && loaded_this_batch < max_files) {
-      if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
-        // Skip files we've already loaded
-        if (skipped < *files_loaded) {
-          skipped++;
-          continue;
-        }
+  if (cursor->exhausted)
+    return;
 
-        // Optimize: Use d_type to avoid expensive stat calls when possible
-        bool is_dir = false;
+  struct dirent *entry;
+  while (loaded_this_batch < max_files) {
+    entry = readdir(cursor->dir);
+    if (entry == NULL) {
+      cursor->exhausted = true;
+      break;
+    }
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      continue;
+    if (skipped < to_skip) {
+      skipped++;
+      continue;
+    }
+
+    // Optimize: Use d_type to avoid expensive stat calls when possible
+    bool is_dir = false;
 #ifdef DT_DIR
-        if (entry->d_type == DT_DIR) {
-          is_dir = true;
-        } else if (entry->d_type == DT_UNKNOWN) {
-          // d_type unavailable, fall back to stat
-          is_dir = is_directory(name, entry->d_name);
-        }
+    if (entry->d_type == DT_DIR) {
+      is_dir = true;
+    } else if (entry->d_type == DT_UNKNOWN) {
+      // d_type unavailable, fall back to stat
+      is_dir = is_directory(name, entry->d_name);
+    }
 // else: d_type indicates regular file or other non-directory
 #else
-        // No d_type support, use stat
-        is_dir = is_directory(name, entry->d_name);
+    // No d_type support, use stat
+    is_dir = is_directory(name, entry->d_name);
 #endif
 
-        FileAttr file_attr = mk_attr(entry->d_name, is_dir, entry->d_ino);
+    FileAttr file_attr = mk_attr_in(arena, entry->d_name, is_dir, entry->d_ino);
 
-        if (file_attr != NULL) { // Only add if not NULL
-          Vector_add(v, 1);
-          v->el[Vector_len(*v)] = file_attr;
-          Vector_set_len(v, Vector_len(*v) + 1);
-          loaded_this_batch++;
-        }
-      }
+    if (file_attr != NULL) { // Only add if not NULL
+      Vector_add(v, 1);
+      v->el[Vector_len(*v)] = file_attr;
+      Vector_set_len(v, Vector_len(*v) + 1);
+      loaded_this_batch++;
     }
-    closedir(dir);
   }
   *files_loaded += loaded_this_batch;
 }
@@ -1806,8 +1911,9 @@ void append_files_to_vec_lazy(Vector *v, const char *name, size_t max_files,
  *
  * @param v the Vector to append the files to
  * @param name the name of the directory
+ * @param arena listing arena for the new entries, or NULL for the heap
  */
-void append_files_to_vec(Vector *v, const char *name) {
+void append_files_to_vec(Vector *v, const char *name, Arena *arena) {
   DIR *dir = opendir(name);
   if (dir != NULL) {
     struct dirent *entry;
@@ -1828,7 +1934,7 @@ void append_files_to_vec(Vector *v, const char *name) {
         is_dir = is_directory(name, entry->d_name);
 #endif
 
-        FileAttr file_attr = mk_attr(entry->d_name, is_dir, entry->d_ino);
+        FileAttr file_attr = mk_attr_in(arena, entry->d_name, is_dir, entry->d_ino);
 
         if (file_attr != NULL) { // Only add if not NULL
           Vector_add(v, 1);
@@ -1841,81 +1947,6 @@ void append_files_to_vec(Vector *v, const char *name) {
   }
 }
 
-static long dir_size_get_result(const char *dir_path, bool allow_enqueue) {
-  dir_size_cache_start();
-
-  pthread_mutex_lock(&dir_size_mutex);
-  DirSizeEntry *entry = dir_size_find_entry(dir_path);
-  if (entry) {
-    long result = entry->size;
-    DirSizeCacheStatus status = entry->status;
-    pthread_mutex_unlock(&dir_size_mutex);
-    return (status == DIR_SIZE_STATUS_READY) ? result : DIR_SIZE_PENDING;
-  }
-
-  if (!allow_enqueue || !dir_size_user_idle()) {
-    pthread_mutex_unlock(&dir_size_mutex);
-    return DIR_SIZE_PENDING;
-  }
-
-  DirSizeEntry *new_entry = malloc(sizeof(DirSizeEntry));
-  if (!new_entry) {
-    pthread_mutex_unlock(&dir_size_mutex);
-    return -1;
-  }
-  strncpy(new_entry->path, dir_path, MAX_PATH_LENGTH - 1);
-  new_entry->path[MAX_PATH_LENGTH - 1] = '\0';
-  new_entry->size = DIR_SIZE_PENDING;
-  new_entry->progress = 0;
-  new_entry->status = DIR_SIZE_STATUS_PENDING;
-  new_entry->job_enqueued = false;
-  new_entry->next = dir_size_cache_head;
-  dir_size_cache_head = new_entry;
-
-  dir_size_enqueue_job_locked(dir_path);
-  pthread_mutex_unlock(&dir_size_mutex);
-  return DIR_SIZE_PENDING;
-}
-
-long dir_size_get_progress(const char *dir_path) {
-  if (!dir_path || !*dir_path)
-    return 0;
-  pthread_mutex_lock(&dir_size_mutex);
-  DirSizeEntry *entry = dir_size_find_entry(dir_path);
-  long p = 0;
-  if (entry && entry->status == DIR_SIZE_STATUS_PENDING) {
-    p = entry->progress;
-    if (p < 0)
-      p = 0;
-  }
-  pthread_mutex_unlock(&dir_size_mutex);
-  return p;
-}
-
-void dir_size_cache_start(void) {
-  pthread_mutex_lock(&dir_size_mutex);
-  ensure_dir_size_worker();
-  pthread_mutex_unlock(&dir_size_mutex);
-}
-
-void dir_size_cache_stop(void) {
-  pthread_mutex_lock(&dir_size_mutex);
-  if (!dir_size_thread_initialized) {
-    dir_size_cache_clear_locked();
-    pthread_mutex_unlock(&dir_size_mutex);
-    return;
-  }
-  dir_size_thread_running = false;
-  pthread_cond_broadcast(&dir_size_cond);
-  pthread_mutex_unlock(&dir_size_mutex);
-  pthread_join(dir_size_thread, NULL);
-
-  pthread_mutex_lock(&dir_size_mutex);
-  dir_size_thread_initialized = false;
-  dir_size_cache_clear_locked();
-  pthread_mutex_unlock(&dir_size_mutex);
-}
-
 void format_dir_size_pending_animation(char *buffer, size_t len, bool reset) {
   if (len == 0 || buffer == NULL) {
     return;
@@ -1936,147 +1967,6 @@ void format_dir_size_pending_animation(char *buffer, size_t len, bool reset) {
   snprintf(buffer, len, "Calculating... %s", formatted);
 }
 
-typedef struct {
-  const char *job_path;
-  long *total;
-  long last_update_ns;
-  int items_since_update;
-} DirSizeProgressCtx;
-
-static void dir_size_progress_maybe_update(DirSizeProgressCtx *ctx) {
-  if (!ctx || !ctx->job_path || !ctx->total)
-    return;
-
-  // Throttle updates: at most ~20Hz or every N entries to keep mutex overhead
-  // low.
-  const long UPDATE_INTERVAL_NS = 50L * 1000 * 1000; // 50ms
-  const int UPDATE_ITEM_BATCH = 128;
-
-  ctx->items_since_update++;
-
-  struct timespec now;
-  clock_gettime(CLOCK_MONOTONIC, &now);
-  long now_ns = now.tv_sec * 1000000000L + now.tv_nsec;
-
-  if (ctx->items_since_update < UPDATE_ITEM_BATCH &&
-      (ctx->last_update_ns != 0) &&
-      (now_ns - ctx->last_update_ns) < UPDATE_INTERVAL_NS) {
-    return;
-  }
-
-  ctx->items_since_update = 0;
-  ctx->last_update_ns = now_ns;
-
-  pthread_mutex_lock(&dir_size_mutex);
-  DirSizeEntry *entry = dir_size_find_entry(ctx->job_path);
-  if (entry && entry->status == DIR_SIZE_STATUS_PENDING) {
-    entry->progress = *ctx->total;
-  }
-  pthread_mutex_unlock(&dir_size_mutex);
-}
-
-static long
-compute_directory_size_full_progress_inner(const char *dir_path,
-                                           DirSizeProgressCtx *ctx) {
-  if (strncmp(dir_path, "/proc", 5) == 0 || strncmp(dir_path, "/sys", 4) == 0 ||
-      strncmp(dir_path, "/dev", 4) == 0 || strncmp(dir_path, "/run", 4) == 0) {
-    return DIR_SIZE_VIRTUAL_FS;
-  }
-
-  DIR *dir = opendir(dir_path);
-  if (!dir) {
-    if (errno == EACCES) {
-      return DIR_SIZE_PERMISSION_DENIED;
-    }
-    return -1;
-  }
-
-  const long MAX_SIZE_THRESHOLD = 1000L * 1024 * 1024 * 1024 * 1024; // 1000 TiB
-  struct dirent *entry;
-  struct stat statbuf;
-
-  while ((entry = readdir(dir)) != NULL) {
-    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-      continue;
-    }
-
-    char path[MAX_PATH_LENGTH];
-    if (strlen(dir_path) + strlen(entry->d_name) + 1 < sizeof(path)) {
-      snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
-    } else {
-      continue;
-    }
-
-    if (lstat(path, &statbuf) == -1) {
-      continue;
-    }
-
-    if (S_ISDIR(statbuf.st_mode)) {
-      long rc = compute_directory_size_full_progress_inner(path, ctx);
-      if (rc == DIR_SIZE_VIRTUAL_FS || rc == DIR_SIZE_PERMISSION_DENIED) {
-        closedir(dir);
-        return rc;
-      } else if (rc == DIR_SIZE_TOO_LARGE) {
-        closedir(dir);
-        return DIR_SIZE_TOO_LARGE;
-      } else if (rc < 0) {
-        // unreadable dir: skip
-      }
-    } else {
-      *ctx->total += statbuf.st_size;
-      if (*ctx->total > MAX_SIZE_THRESHOLD) {
-        closedir(dir);
-        return DIR_SIZE_TOO_LARGE;
-      }
-      dir_size_progress_maybe_update(ctx);
-    }
-  }
-
-  closedir(dir);
-  return 0;
-}
-
-static long compute_directory_size_full_progress(const char *dir_path,
-                                                 const char *job_path) {
-  long total = 0;
-  DirSizeProgressCtx ctx = {
-      .job_path = job_path,
-      .total = &total,
-      .last_update_ns = 0,
-      .items_since_update = 0,
-  };
-
-  // Initialize progress to 0.
-  pthread_mutex_lock(&dir_size_mutex);
-  DirSizeEntry *entry = dir_size_find_entry(job_path);
-  if (entry && entry->status == DIR_SIZE_STATUS_PENDING) {
-    entry->progress = 0;
-  }
-  pthread_mutex_unlock(&dir_size_mutex);
-
-  long rc = compute_directory_size_full_progress_inner(dir_path, &ctx);
-  if (rc < 0)
-    return rc;
-
-  // Final progress push.
-  pthread_mutex_lock(&dir_size_mutex);
-  entry = dir_size_find_entry(job_path);
-  if (entry && entry->status == DIR_SIZE_STATUS_PENDING) {
-    entry->progress = total;
-  }
-  pthread_mutex_unlock(&dir_size_mutex);
-  return total;
-}
-
-// Recursive function to calculate directory size with guard rails to keep UI
-// responsive (legacy fallback)
-long get_directory_size(const char *dir_path) {
-  return dir_size_get_result(dir_path, true);
-}
-
-long get_directory_size_peek(const char *dir_path) {
-  return dir_size_get_result(dir_path, false);
-}
 /**
  * Function to display file information in a window
  *
@@ -2150,7 +2040,8 @@ void display_file_info(WINDOW *window, const char *file_path, int max_x) {
     bool allow_enqueue =
         (elapsed_ns >= DIR_SIZE_REQUEST_DELAY_NS) && dir_size_can_enqueue();
 
-    long dir_size = dir_size_get_result(file_path, allow_enqueue);
+    long dir_size = allow_enqueue ? get_directory_size(file_path)
+                                  : get_directory_size_peek(file_path);
 
     char fileSizeStr[64] = "-";
     if (dir_size == -1) {
@@ -2185,20 +2076,12 @@ void display_file_info(WINDOW *window, const char *file_path, int max_x) {
               "📏 File Size:", fileSizeStr); // Updated with emoji
   }
   // Display MIME type using libmagic
-  magic_t magic_cookie =
-      magic_open(MAGIC_MIME_TYPE | MAGIC_SYMLINK | MAGIC_CHECK);
-  if (magic_cookie == NULL) {
+  if (!mime_init()) {
     mvwprintw(window, 5, 2, "%-*s %s", label_width,
-              "📂 MIME type:", "Error initializing magic library");
+              "📂 MIME type:", mime_error());
     return;
   }
-  if (magic_load(magic_cookie, NULL) != 0) {
-    mvwprintw(window, 5, 2, "%-*s %s", label_width,
-              "📂 MIME type:", magic_error(magic_cookie));
-    magic_close(magic_cookie);
-    return;
-  }
-  const char *mime_type = magic_file(magic_cookie, file_path);
+  const char *mime_type = mime_detect(file_path, true);
   const char *emoji = get_file_emoji(mime_type, file_path);
   if (mime_type == NULL) {
     mvwprintw(window, 5, 2, "%-*s %s", label_width,
@@ -2219,8 +2102,89 @@ void display_file_info(WINDOW *window, const char *file_path, int max_x) {
     mvwprintw(window, 5, 2, "%-*s %s %s", label_width, emoji,
               "MIME type:", display_mime);
   }
-  magic_close(magic_cookie);
 }
+
+/**
+ * Sizes the highlight cache to the buffer before drawing `rows` lines from
+ * `first`. Spans lexed with another syntax definition are dropped, and so
+ * are those of lines off screen once more than LINE_HIGHLIGHT_KEEP lines
+ * hold spans.
+ */
+static void text_buffer_sync_highlights(TextBuffer *buffer,
+                                        const SyntaxDef *syntax, int first,
+                                        int rows) {
+  if (syntax != buffer->highlight_syntax) {
+    text_buffer_clear_highlights(buffer, 0, buffer->highlight_count);
+    buffer->highlight_syntax = syntax;
+  }
+  if (!syntax)
+    return;
+
+  if (buffer->highlight_count > buffer->num_lines) {
+    text_buffer_clear_highlights(buffer, buffer->num_lines,
+                                 buffer->highlight_count - buffer->num_lines);
+    buffer->highlight_count = buffer->num_lines;
+  } else if (buffer->highlight_count < buffer->num_lines) {
+    LineHighlight *grown = realloc(
+        buffer->highlights, sizeof(LineHighlight) * (size_t)buffer->num_lines);
+    if (grown) {
+      memset(&grown[buffer->highlight_count], 0,
+             sizeof(LineHighlight) *
+                 (size_t)(buffer->num_lines - buffer->highlight_count));
+      buffer->highlights = grown;
+      buffer->highlight_count = buffer->num_lines;
+    }
+  }
+
+  if (buffer->highlight_live > LINE_HIGHLIGHT_KEEP) {
+    text_buffer_clear_highlights(buffer, 0, first);
+    text_buffer_clear_highlights(buffer, first + rows,
+                                 buffer->highlight_count - first - rows);
+  }
+}
+
+/**
+ * Returns the cached spans of line `index`, lexing the line again only if
+ * it was edited or the block comment state before it changed.
+ * *in_block_comment is the state before the line on entry and after it on
+ * return. NULL if the line has no spans (out of memory).
+ */
+static const LineHighlight *text_buffer_highlight_line(TextBuffer *buffer,
+                                                       SyntaxDef *syntax,
+                                                       int index,
+                                                       int *in_block_comment) {
+  if (index < 0 || index >= buffer->highlight_count)
+    return NULL;
+  LineHighlight *h = &buffer->highlights[index];
+  const char *line = buffer->lines[index] ? buffer->lines[index] : "";
+  int length = (int)strlen(line);
+
+  if (h->text != line || h->length != length ||
+      h->comment_in != *in_block_comment) {
+    int state = *in_block_comment;
+    SyntaxSpans *scratch = &buffer->highlight_scratch;
+    if (!syntax_line_spans(scratch, line, syntax, &state))
+      return NULL;
+    SyntaxSpan *spans =
+        realloc(h->spans, sizeof(SyntaxSpan) * (size_t)MAX(scratch->count, 1));
+    if (!spans)
+      return NULL;
+    memcpy(spans, scratch->spans, sizeof(SyntaxSpan) * (size_t)scratch->count);
+    if (!h->text)
+      buffer->highlight_live++;
+    *h = (LineHighlight){
+        .spans = spans,
+        .span_count = scratch->count,
+        .text = line,
+        .length = length,
+        .comment_in = *in_block_comment,
+        .comment_out = state,
+    };
+  }
+  *in_block_comment = h->comment_out;
+  return h;
+}
+
 /**
  * Function to render and manage scrolling within the text buffer
  *
@@ -2274,8 +2238,9 @@ void render_text_buffer(WINDOW *window, TextBuffer *buffer, int *start_line,
   // FINAL start_line.
   int in_block_comment = 0;
   if (current_syntax) {
-    in_block_comment = get_initial_block_comment_state(
-        buffer->lines, buffer->num_lines, *start_line, current_syntax);
+    in_block_comment = syntax_checkpoints_state_lines(
+        &buffer->comment_states, current_syntax, buffer->lines,
+        buffer->num_lines, *start_line);
   }
 
   // Draw separator line for line numbers
@@ -2390,6 +2355,8 @@ void render_text_buffer(WINDOW *window, TextBuffer *buffer, int *start_line,
   }
 
   g_editor_h_scroll = h_scroll;
+  text_buffer_sync_highlights(buffer, current_syntax, *start_line,
+                              content_height);
 
   // Display line numbers and content
   for (int i = 0; i < content_height && (*start_line + i) < buffer->num_lines;
@@ -2403,31 +2370,19 @@ void render_text_buffer(WINDOW *window, TextBuffer *buffer, int *start_line,
     int line_length = strlen(line);
     int current_line_index = *start_line + i;
 
-    // Always call syntax_highlight_line to maintain block comment state,
-    // even if the line is shorter than h_scroll (important for /** and */
-    // lines)
-    if (h_scroll < line_length) {
-      // Create a substring for the visible portion
-      char visible_line[4096];
-      int visible_len = MIN(line_length - h_scroll, content_width);
-      if (visible_len > (int)sizeof(visible_line) - 1) {
-        visible_len = sizeof(visible_line) - 1;
-      }
-      strncpy(visible_line, line + h_scroll, visible_len);
-      visible_line[visible_len] = '\0';
-
-      // Use syntax highlighting if available, otherwise plain text
-      syntax_highlight_line(window, visible_line, current_syntax,
-                            &in_block_comment, i + 1, content_start,
-                            content_width, buffer->lines, buffer->num_lines,
-                            current_line_index);
-    } else {
-      // Line is shorter than h_scroll, but we still need to process it for
-      // block comment state Pass empty string but still update state based on
-      // the full line
-      syntax_highlight_line(window, "", current_syntax, &in_block_comment,
-                            i + 1, content_start, content_width, buffer->lines,
-                            buffer->num_lines, current_line_index);
+    // Every visible line goes through the cache, even one shorter than
+    // h_scroll, to carry the block comment state to the next
+    const LineHighlight *highlight =
+        current_syntax
+            ? text_buffer_highlight_line(buffer, current_syntax,
+                                         current_line_index, &in_block_comment)
+            : NULL;
+    if (highlight) {
+      syntax_draw_spans(window, line, highlight->spans, highlight->span_count,
+                        i + 1, content_start, h_scroll, content_width);
+    } else if (h_scroll < line_length) {
+      mvwprintw(window, i + 1, content_start, "%.*s", content_width,
+                line + h_scroll);
     }
 
     // Highlight selection range (if active)
@@ -2763,10 +2718,11 @@ void edit_file_in_terminal(WINDOW *window, const char *file_path,
   box(editor_window, 0, 0);
   pthread_mutex_unlock(&banner_mutex);
 
-  TextBuffer text_buffer;
+  TextBuffer text_buffer = {0};
   text_buffer.capacity = 100;
   text_buffer.num_lines = 0;
   text_buffer.lines = malloc(sizeof(char *) * text_buffer.capacity);
+  syntax_checkpoints_init(&text_buffer.comment_states);
   g_editor_buffer = &text_buffer;
   if (!text_buffer.lines) {
     pthread_mutex_lock(&banner_mutex);
@@ -3507,6 +3463,7 @@ void edit_file_in_terminal(WINDOW *window, const char *file_path,
         if (cursor_line >= 0 && cursor_line < text_buffer.num_lines) {
           editor_undo_record(&um, &text_buffer, cursor_line, cursor_col,
                              start_line);
+          text_buffer_lines_removed(&text_buffer, cursor_line, 1);
           free(text_buffer.lines[cursor_line]);
           for (int i = cursor_line; i < text_buffer.num_lines - 1; i++) {
             text_buffer.lines[i] = text_buffer.lines[i + 1];
@@ -3606,6 +3563,7 @@ void edit_file_in_terminal(WINDOW *window, const char *file_path,
         continue;
       editor_undo_record(&um, &text_buffer, cursor_line, cursor_col,
                          start_line);
+      text_buffer_lines_changed(&text_buffer, cursor_line, 1);
       g_sel_active = false;
       char *current_line = text_buffer.lines[cursor_line];
       // int line_len = (int)strlen(current_line);
@@ -3639,6 +3597,7 @@ void edit_file_in_terminal(WINDOW *window, const char *file_path,
       }
       text_buffer.lines[cursor_line + 1] = new_line;
       text_buffer.num_lines++;
+      text_buffer_lines_inserted(&text_buffer, cursor_line + 1, 1);
 
       // Move cursor to new line
       cursor_line++;
@@ -3657,6 +3616,7 @@ void edit_file_in_terminal(WINDOW *window, const char *file_path,
       if (cursor_col > 0) {
         editor_undo_record(&um, &text_buffer, cursor_line, cursor_col,
                            start_line);
+        text_buffer_lines_changed(&text_buffer, cursor_line, 1);
         char *current_line = text_buffer.lines[cursor_line];
         char deleted_char[2] = {current_line[cursor_col - 1], '\0'};
         memmove(&current_line[cursor_col - 1], &current_line[cursor_col],
@@ -3671,6 +3631,7 @@ void edit_file_in_terminal(WINDOW *window, const char *file_path,
       } else if (cursor_line > 0) {
         editor_undo_record(&um, &text_buffer, cursor_line, cursor_col,
                            start_line);
+        text_buffer_lines_changed(&text_buffer, cursor_line - 1, 1);
         // Merge current line with previous line
         int prev_len = strlen(text_buffer.lines[cursor_line - 1]);
         int curr_len = strlen(text_buffer.lines[cursor_line]);
@@ -3692,6 +3653,7 @@ void edit_file_in_terminal(WINDOW *window, const char *file_path,
           text_buffer.lines[i] = text_buffer.lines[i + 1];
         }
         text_buffer.num_lines--;
+        text_buffer_lines_removed(&text_buffer, cursor_line, 1);
 
         cursor_line--;
         cursor_col = prev_len;
@@ -3713,6 +3675,7 @@ void edit_file_in_terminal(WINDOW *window, const char *file_path,
         continue;
       editor_undo_record(&um, &text_buffer, cursor_line, cursor_col,
                          start_line);
+      text_buffer_lines_changed(&text_buffer, cursor_line, 1);
       g_sel_active = false;
       char *curr_line = text_buffer.lines[cursor_line];
       int line_len = (int)strlen(curr_line);
@@ -3804,6 +3767,8 @@ void edit_file_in_terminal(WINDOW *window, const char *file_path,
     free(text_buffer.lines[i]);
   }
   free(text_buffer.lines);
+  text_buffer_free_highlights(&text_buffer);
+  syntax_checkpoints_free(&text_buffer.comment_states);
 
   editor_stack_clear(um.undo, &um.undo_len);
   editor_stack_clear(um.redo, &um.redo_len);
@@ -3816,30 +3781,12 @@ void edit_file_in_terminal(WINDOW *window, const char *file_path,
  * @return true if the file has a supported MIME type, false otherwise.
  */
 bool is_supported_file_type(const char *filename) {
-  magic_t magic_cookie;
   bool supported = false;
 
-  // Open magic cookie with additional flags for better MIME detection
-  magic_cookie = magic_open(MAGIC_MIME_TYPE | MAGIC_SYMLINK | MAGIC_CHECK);
-  if (magic_cookie == NULL) {
-    fprintf(stderr, "Unable to initialize magic library\n");
-    return false;
-  }
-
-  // Load the default magic database
-  if (magic_load(magic_cookie, NULL) != 0) {
-    fprintf(stderr, "Cannot load magic database: %s\n",
-            magic_error(magic_cookie));
-    magic_close(magic_cookie);
-    return false;
-  }
-
   // Get the MIME type of the file
-  const char *mime_type = magic_file(magic_cookie, filename);
+  const char *mime_type = mime_detect(filename, true);
   if (mime_type == NULL) {
-    fprintf(stderr, "Could not determine file type: %s\n",
-            magic_error(magic_cookie));
-    magic_close(magic_cookie);
+    fprintf(stderr, "Could not determine file type: %s\n", mime_error());
     return false;
   }
 
@@ -3858,156 +3805,5 @@ bool is_supported_file_type(const char *filename) {
     }
   }
 
-  magic_close(magic_cookie);
   return supported;
 }
-
-/**
- * Display archive contents in the preview window.
- *
- * @param window The preview window
- * @param file_path Path to the archive file
- * @param start_line Starting line for scrolling
- * @param max_y Maximum Y coordinate
- * @param max_x Maximum X coordinate
- */
-void display_archive_preview(WINDOW *window, const char *file_path,
-                             int start_line, int max_y, int max_x) {
-  // Check if this is a single compressed file (not a TAR archive)
-  bool is_single_compressed = false;
-  const char *ext = strrchr(file_path, '.');
-  if (ext) {
-    if (strcmp(ext, ".gz") == 0 || strcmp(ext, ".bz2") == 0 ||
-        strcmp(ext, ".xz") == 0) {
-      // Check if it's NOT a .tar.gz, .tar.bz2, etc.
-      const char *tar_pos = strstr(file_path, ".tar");
-      if (!tar_pos || tar_pos >= ext) {
-        is_single_compressed = true;
-      }
-    }
-  }
-
-  ArcReader *reader = arc_open_path(file_path);
-  if (!reader) {
-    // Show more detailed error message
-    char error_msg[256];
-    snprintf(error_msg, sizeof(error_msg),
-             "Unable to open archive: %s (errno: %s)", file_path,
-             strerror(errno));
-    mvwprintw(window, 7, 2, "%.*s", max_x - 4, error_msg);
-    return;
-  }
-
-  // Display archive header (start after MIME type which is on line 5)
-  // For single compressed files, show a different header
-  if (is_single_compressed) {
-    mvwprintw(window, 6, 2, "📦 Compressed File Contents:");
-  } else {
-    mvwprintw(window, 6, 2, "📦 Archive Contents:");
-  }
-  mvwprintw(window, 7, 2, "─────────────────────────────────────");
-
-  ArcEntry entry;
-  int line_num = 8;
-  int current_line = 0;
-  int entry_count = 0;
-  const int max_entries = 1000; // Limit entries to prevent UI overload
-
-  // Skip entries until start_line (accounting for header lines)
-  int header_lines = 2; // "Archive Contents:" and separator line
-  int adjusted_start_line =
-      start_line > header_lines ? start_line - header_lines : 0;
-
-  while (current_line < adjusted_start_line && entry_count < max_entries) {
-    int ret = arc_next(reader, &entry);
-    if (ret != 0) {
-      break; // Done or error
-    }
-    arc_entry_free(&entry);
-    current_line++;
-    entry_count++;
-  }
-
-  // Display entries
-  bool found_any = false;
-  while (line_num < max_y - 1 && entry_count < max_entries) {
-    int ret = arc_next(reader, &entry);
-    if (ret != 0) {
-      if (ret < 0) {
-        // Error reading - for single compressed files, don't show technical
-        // error
-
-        // For compressed files, silently fail (they're not really archives)
-      } else if (ret == 1 && !found_any) {
-        // EOF but no entries found
-        if (!is_single_compressed) {
-          mvwprintw(window, line_num++, 2,
-                    "Archive appears empty (may be corrupted or invalid)");
-        }
-        // For compressed files, silently fail (they're not really archives)
-      }
-      break; // Done
-    }
-
-    found_any = true;
-
-    // Check if entry has a valid path
-    if (!entry.path) {
-      // Skip entries without paths (shouldn't happen, but be safe)
-      arc_entry_free(&entry);
-      entry_count++;
-      continue;
-    }
-
-    // Format entry display
-    char entry_line[256];
-    const char *type_icon = "📄";
-    if (entry.type == ARC_ENTRY_DIR) {
-      type_icon = "📁";
-    } else if (entry.type == ARC_ENTRY_SYMLINK) {
-      type_icon = "🔗";
-    } else if (entry.type == ARC_ENTRY_HARDLINK) {
-      type_icon = "🔗";
-    }
-
-    // Format size
-    char size_str[20];
-    if (entry.type == ARC_ENTRY_DIR) {
-      snprintf(size_str, sizeof(size_str), "<DIR>");
-    } else if (entry.size == 0) {
-      // Unknown size (e.g., compressed single files like .gz, .bz2)
-      // For compressed files, size is unknown until decompressed
-      // (or if ISIZE is available in gzip metadata)
-      snprintf(size_str, sizeof(size_str), "?");
-    } else {
-      format_file_size(size_str, entry.size);
-    }
-
-    // Build display line
-    if (entry.type == ARC_ENTRY_SYMLINK && entry.link_target) {
-      snprintf(entry_line, sizeof(entry_line), "%s %-40s %10s -> %s", type_icon,
-               entry.path ? entry.path : "(null)", size_str, entry.link_target);
-    } else {
-      snprintf(entry_line, sizeof(entry_line), "%s %-40s %10s", type_icon,
-               entry.path ? entry.path : "(null)", size_str);
-    }
-
-    // Truncate if too long
-    int max_display_width = max_x - 4;
-    if ((int)strlen(entry_line) > max_display_width) {
-      entry_line[max_display_width] = '\0';
-    }
-
-    mvwprintw(window, line_num++, 2, "%.*s", max_display_width, entry_line);
-
-    arc_entry_free(&entry);
-    entry_count++;
-  }
-
-  if (entry_count >= max_entries) {
-    mvwprintw(window, line_num++, 2, "... (showing first %d entries)",
-              max_entries);
-  }
-
-  arc_close(reader);
-}
@@ -2,7 +2,11 @@
 #define FILES_H
 
 #include "core/main.h"
+#include "ds/arena.h"
+#include <dirent.h>
 #include <stdbool.h>
+#include <sys/types.h>
+#include <time.h>
 
 // Ctrl+Shift+Letter key codes (defined in files.c)
 #define CTRL_SHIFT_A_CODE 0x2001
@@ -41,30 +45,58 @@ struct PluginManager;
 
 // 256 in most systems
 #define MAX_FILENAME_LEN 512
-#define DIR_SIZE_TOO_LARGE (-2)
-#define DIR_SIZE_VIRTUAL_FS (-3)
-#define DIR_SIZE_PENDING (-4)
-#define DIR_SIZE_PERMISSION_DENIED (-5)
-#define DIR_SIZE_REQUEST_DELAY_NS 200000000L
 
 typedef struct FileAttributes *FileAttr;
 
+// Open readdir position for lazy loading. Each batch continues from where the
+// previous one stopped instead of re-reading the directory from entry zero.
+// The (dev, ino, mtime) snapshot taken at open time lets the next batch notice
+// that the directory changed and reopen the stream.
+typedef struct {
+  DIR *dir;
+  dev_t dev;
+  ino_t ino;
+  struct timespec mtime;
+  bool exhausted;
+} DirCursor;
+
+void dir_cursor_init(DirCursor *cursor);
+void dir_cursor_close(DirCursor *cursor);
+// Opens `path` at its first entry, closing whatever the cursor had open.
+bool dir_cursor_open(DirCursor *cursor, const char *path);
+// Returns true if the cursor is closed or the directory at `path` is no longer
+// the one (or no longer in the state) the cursor was opened on.
+bool dir_cursor_is_stale(const DirCursor *cursor, const char *path);
+
 const char *FileAttr_get_name(FileAttr fa);
 bool FileAttr_is_dir(FileAttr fa);
+FileAttr mk_attr(const char *name, bool is_dir, ino_t inode);
+FileAttr mk_attr_in(Arena *arena, const char *name, bool is_dir, ino_t inode);
+FileAttr FileAttr_move_to(Arena *arena, FileAttr fa);
+
+// Per-entry lstat metadata. Enumeration leaves it empty on the synchronous
+// path (the background loader fills it); renderers fill visible rows on first
+// use, after which redraws need no syscalls.
+struct stat;
+bool FileAttr_load_stat(FileAttr fa, int dir_fd);
+void FileAttr_set_stat(FileAttr fa, const struct stat *st, int dir_fd);
+bool FileAttr_has_stat(FileAttr fa);
+bool FileAttr_is_symlink(FileAttr fa);
+const char *FileAttr_link_target(FileAttr fa);
+off_t FileAttr_size(FileAttr fa);
+mode_t FileAttr_mode(FileAttr fa);
+struct timespec FileAttr_mtime(FileAttr fa);
+bool FileAttr_get_stat(FileAttr fa, struct stat *st);
 void free_attr(FileAttr fa);
-void append_files_to_vec(Vector *v, const char *name);
+void append_files_to_vec(Vector *v, const char *name, Arena *arena);
 void append_files_to_vec_lazy(Vector *v, const char *name, size_t max_files,
-                              size_t *files_loaded);
+                              size_t *files_loaded, DirCursor *cursor,
+                              Arena *arena);
 size_t count_directory_files(const char *name);
 void display_file_info(WINDOW *window, const char *file_path, int max_x);
 bool is_supported_file_type(const char *filename);
 bool is_archive_file(const char *filename);
-void display_archive_preview(WINDOW *window, const char *file_path,
-                             int start_line, int max_y, int max_x);
 void format_dir_size_pending_animation(char *buffer, size_t len, bool reset);
-// Returns the best-known in-progress byte total for a directory size job, or 0
-// if none.
-long dir_size_get_progress(const char *dir_path);
 
 // Returns a newly allocated copy of the current editor buffer, or NULL if not
 // editing. Caller must free the returned string.
@@ -133,11 +165,5 @@ void edit_file_in_terminal(WINDOW *window, const char *file_path,
                            struct PluginManager *pm);
 
 char *format_file_size(char *buffer, size_t size);
-long get_directory_size(const char *dir_path);
-long get_directory_size_peek(const char *dir_path);
-void dir_size_cache_start(void);
-void dir_size_cache_stop(void);
-void dir_size_note_user_activity(void);
-bool dir_size_can_enqueue(void);
 
 #endif // FILES_H
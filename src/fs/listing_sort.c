@@ -0,0 +1,367 @@
+// File: listing_sort.c
+// Directory listing order over a compact key index
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "listing_sort.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "keysort.h"
+#include "stat_batch.h"
+
+#define KEY_MASK56 ((1ULL << 56) - 1)
+#define NAME_PREFIX_LEN 23               // bytes of name carried in key[0..2]
+
+static const char *const sort_mode_names[SORT_BY_COUNT] = {
+    [SORT_BY_NATURAL] = "natural",
+    [SORT_BY_NAME] = "name",
+    [SORT_BY_SIZE] = "size",
+    [SORT_BY_MTIME] = "mtime",
+    [SORT_BY_EXTENSION] = "extension",
+};
+
+static inline size_t size_min(size_t a, size_t b) {
+    return a < b ? a : b;
+}
+
+static inline unsigned char ascii_lower(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c + ('a' - 'A')) : c;
+}
+
+static inline bool ascii_digit(unsigned char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Case-insensitive compare where digit runs compare by numeric value, so
+// "file2" sorts before "file10".
+static int natural_cmp(const char *a, const char *b) {
+    const unsigned char *x = (const unsigned char *)a;
+    const unsigned char *y = (const unsigned char *)b;
+    while (*x || *y) {
+        if (ascii_digit(*x) && ascii_digit(*y)) {
+            while (*x == '0' && ascii_digit(x[1])) x++;
+            while (*y == '0' && ascii_digit(y[1])) y++;
+            size_t nx = 0, ny = 0;
+            while (ascii_digit(x[nx])) nx++;
+            while (ascii_digit(y[ny])) ny++;
+            if (nx != ny) return nx < ny ? -1 : 1;
+            int c = memcmp(x, y, nx);
+            if (c) return c < 0 ? -1 : 1;
+            x += nx;
+            y += ny;
+            continue;
+        }
+        unsigned char cx = ascii_lower(*x), cy = ascii_lower(*y);
+        if (cx != cy) return cx < cy ? -1 : 1;
+        x++;
+        y++;
+    }
+    return 0;
+}
+
+// Extension without the dot; "" for none. A leading dot (".bashrc") does not
+// start an extension.
+static const char *name_extension(const char *name) {
+    const char *dot = strrchr(name, '.');
+    return (dot && dot != name) ? dot + 1 : "";
+}
+
+static int cmp_names(const char *a, const char *b) {
+    int c = KeySort_casecmp(a, b);
+    return c ? c : strcmp(a, b);
+}
+
+// Full ordering for entries whose keys are equal. Must agree with the keys:
+// whenever two keys differ, this has to order the entries the same way.
+static int cmp_entries(SortMode mode, FileAttr a, FileAttr b) {
+    const char *na = FileAttr_get_name(a);
+    const char *nb = FileAttr_get_name(b);
+    switch (mode) {
+    case SORT_BY_NATURAL: {
+        int c = natural_cmp(na, nb);
+        return c ? c : strcmp(na, nb);
+    }
+    case SORT_BY_SIZE: {
+        off_t sa = FileAttr_size(a), sb = FileAttr_size(b);
+        if (sa != sb) return sa > sb ? -1 : 1;
+        break;
+    }
+    case SORT_BY_MTIME: {
+        struct timespec ta = FileAttr_mtime(a), tb = FileAttr_mtime(b);
+        if (ta.tv_sec != tb.tv_sec) return ta.tv_sec > tb.tv_sec ? -1 : 1;
+        if (ta.tv_nsec != tb.tv_nsec) return ta.tv_nsec > tb.tv_nsec ? -1 : 1;
+        break;
+    }
+    case SORT_BY_EXTENSION: {
+        int c = KeySort_casecmp(name_extension(na), name_extension(nb));
+        if (c) return c;
+        break;
+    }
+    default:
+        break;
+    }
+    return cmp_names(na, nb);
+}
+
+static int tie_entries(const void *a, const void *b, void *ctx) {
+    const SortIndex *si = ctx;
+    return cmp_entries(si->mode, (FileAttr)a, (FileAttr)b);
+}
+
+static KeySortOpts sort_opts(SortIndex *si) {
+    return (KeySortOpts){ .tie = tie_entries, .ctx = si };
+}
+
+// Lower-cased leading bytes of `s`, zero padded. In natural mode a digit run
+// becomes '0', its length without leading zeros and then its digits, so runs
+// order by value the same way natural_cmp() orders them ('0' also keeps a run
+// in its place among the surrounding characters).
+static void text_prefix(const char *s, bool natural, unsigned char out[NAME_PREFIX_LEN]) {
+    if (!natural) {
+        size_t i = 0;
+        for (; i < NAME_PREFIX_LEN && s[i]; i++) out[i] = ascii_lower((unsigned char)s[i]);
+        memset(out + i, 0, NAME_PREFIX_LEN - i);
+        return;
+    }
+    memset(out, 0, NAME_PREFIX_LEN);
+    size_t i = 0, o = 0;
+    while (o < NAME_PREFIX_LEN && s[i]) {
+        unsigned char c = (unsigned char)s[i];
+        if (!ascii_digit(c)) {
+            out[o++] = ascii_lower(c);
+            i++;
+            continue;
+        }
+        while (s[i] == '0' && ascii_digit((unsigned char)s[i + 1])) i++;
+        size_t run = 0;
+        while (ascii_digit((unsigned char)s[i + run])) run++;
+        out[o++] = '0';
+        if (o < NAME_PREFIX_LEN) out[o++] = (unsigned char)(run < 255 ? run : 255);
+        size_t copy = size_min(run, NAME_PREFIX_LEN - o);
+        memcpy(out + o, s + i, copy);
+        o += copy;
+        if (copy < run) break; // the rest of the run decides; stop here
+        i += run;
+    }
+}
+
+// First `n` (1..8) bytes at `p` as a big-endian integer, so integer order is
+// byte order. Reads 8 bytes regardless.
+static inline uint64_t pack_be(const unsigned char *p, size_t n) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return n < 8 ? v >> (8 * (8 - n)) : v;
+}
+
+// KeySortKeyFn; only reads the entry, so it runs on several threads at once.
+static void make_key(KeySortRec *rec, void *ctx) {
+    const SortIndex *si = ctx;
+    FileAttr fa = rec->item;
+    const char *name = FileAttr_get_name(fa);
+    uint64_t group = (si->dirs_first && !FileAttr_is_dir(fa)) ? 1 : 0;
+    unsigned char pre[NAME_PREFIX_LEN];
+    uint64_t *key = rec->key;
+
+    switch (si->mode) {
+    case SORT_BY_SIZE: {
+        off_t size = FileAttr_size(fa);
+        uint64_t s = size > 0 ? (uint64_t)size : 0;
+        text_prefix(name, false, pre);
+        key[0] = KEY_MASK56 - (s < KEY_MASK56 ? s : KEY_MASK56);
+        key[1] = pack_be(pre, 8);
+        key[2] = pack_be(pre + 8, 8);
+        break;
+    }
+    case SORT_BY_MTIME: {
+        struct timespec ts = FileAttr_mtime(fa);
+        uint64_t sec = ts.tv_sec > 0 ? (uint64_t)ts.tv_sec : 0;
+        uint64_t nsec = (ts.tv_nsec >= 0 && ts.tv_nsec < 1000000000L) ? (uint64_t)ts.tv_nsec : 0;
+        text_prefix(name, false, pre);
+        key[0] = KEY_MASK56 - (sec < KEY_MASK56 ? sec : KEY_MASK56);
+        key[1] = ((999999999ULL - nsec) << 32) | pack_be(pre, 4);
+        key[2] = pack_be(pre + 4, 8);
+        break;
+    }
+    case SORT_BY_EXTENSION: {
+        const char *ext = name_extension(name);
+        unsigned char ext_pre[NAME_PREFIX_LEN];
+        text_prefix(ext, false, ext_pre);
+        key[0] = pack_be(ext_pre, 7);
+        if (strlen(ext) >= 7) {
+            // The extension does not fit in key[0]; keep going with it so a
+            // longer extension still orders after a 7-character one.
+            key[1] = pack_be(ext_pre + 7, 8);
+            key[2] = pack_be(ext_pre + 15, 8);
+        } else {
+            text_prefix(name, false, pre);
+            key[1] = pack_be(pre, 8);
+            key[2] = pack_be(pre + 8, 8);
+        }
+        break;
+    }
+    default:
+        text_prefix(name, si->mode == SORT_BY_NATURAL, pre);
+        key[0] = pack_be(pre, 7);
+        key[1] = pack_be(pre + 7, 8);
+        key[2] = pack_be(pre + 15, 8);
+        break;
+    }
+    key[0] |= group << 56;
+}
+
+static bool reserve_keys(SortIndex *si, size_t n) {
+    if (n <= si->cap) return true;
+    size_t cap = si->cap ? si->cap : 256;
+    while (cap < n) cap *= 2;
+    KeySortRec *keys = realloc(si->keys, cap * sizeof(*keys));
+    if (!keys) return false;
+    si->keys = keys;
+    KeySortRec *scratch = realloc(si->scratch, cap * sizeof(*scratch));
+    if (!scratch) return false;
+    si->scratch = scratch;
+    si->cap = cap;
+    return true;
+}
+
+// Size and mtime keys need lstat data the synchronous enumeration path does
+// not collect; fetch it for the entries that lack it.
+static void fill_metadata(const SortIndex *si, void **entries, size_t n, const char *dir) {
+    if (si->mode != SORT_BY_SIZE && si->mode != SORT_BY_MTIME) return;
+    if (!dir || n == 0) return;
+
+    size_t missing = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!FileAttr_has_stat((FileAttr)entries[i])) missing++;
+    }
+    if (missing == 0) return;
+
+    int dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0) return;
+    stat_batch_fill((FileAttr *)entries, n, dir_fd);
+    close(dir_fd);
+}
+
+static void write_back(const SortIndex *si, Vector *files, size_t from) {
+    for (size_t i = from; i < si->len; i++) {
+        files->el[i] = si->keys[i].item;
+    }
+}
+
+void sort_index_init(SortIndex *si, SortMode mode, bool dirs_first) {
+    memset(si, 0, sizeof(*si));
+    si->mode = ((unsigned)mode < SORT_BY_COUNT) ? mode : SORT_BY_NATURAL;
+    si->dirs_first = dirs_first;
+}
+
+void sort_index_clear(SortIndex *si) {
+    si->len = 0;
+}
+
+void sort_index_free(SortIndex *si) {
+    free(si->keys);
+    free(si->scratch);
+    si->keys = si->scratch = NULL;
+    si->len = si->cap = 0;
+}
+
+bool sort_index_set_order(SortIndex *si, SortMode mode, bool dirs_first) {
+    if ((unsigned)mode >= SORT_BY_COUNT) return false;
+    if (si->mode == mode && si->dirs_first == dirs_first) return false;
+    si->mode = mode;
+    si->dirs_first = dirs_first;
+    return true;
+}
+
+void sort_index_build(SortIndex *si, Vector *files, const char *dir) {
+    size_t n = Vector_len(*files);
+    si->len = 0;
+    if (n == 0 || !reserve_keys(si, n)) return;
+
+    fill_metadata(si, files->el, n, dir);
+    KeySortOpts opts = sort_opts(si);
+    KeySort_extract(si->keys, files->el, n, make_key, si, &opts);
+    KeySort_sort(si->keys, si->scratch, n, &opts);
+    si->len = n;
+    write_back(si, files, 0);
+}
+
+void sort_index_merge(SortIndex *si, Vector *files, size_t first_new, const char *dir) {
+    size_t n = Vector_len(*files);
+    if (first_new != si->len || first_new > n) {
+        // The index no longer mirrors the listing; start over.
+        sort_index_build(si, files, dir);
+        return;
+    }
+    size_t added = n - first_new;
+    if (added == 0) return;
+    if (!reserve_keys(si, n)) return;
+
+    fill_metadata(si, files->el + first_new, added, dir);
+    KeySortRec *fresh = si->keys + first_new;
+    KeySortOpts opts = sort_opts(si);
+    KeySort_extract(fresh, files->el + first_new, added, make_key, si, &opts);
+    KeySort_sort(fresh, si->scratch, added, &opts);
+
+    // Batches often arrive already in order (e.g. a sorted directory on a
+    // filesystem that returns names in order); then there is nothing to merge.
+    size_t from = first_new;
+    if (first_new > 0 && KeySort_compare(&fresh[0], &si->keys[first_new - 1], &opts) < 0) {
+        KeySort_merge(si->keys, first_new, fresh, added, si->scratch, &opts);
+        KeySortRec *t = si->keys;
+        si->keys = si->scratch;
+        si->scratch = t;
+        from = 0;
+    }
+    si->len = n;
+    write_back(si, files, from);
+}
+
+void sort_index_compact(SortIndex *si, Vector *files) {
+    size_t n = Vector_len(*files);
+    bool keyed = si->len == n;
+    size_t out = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!files->el[i]) continue;
+        files->el[out] = files->el[i];
+        if (keyed) si->keys[out] = si->keys[i];
+        out++;
+    }
+    Vector_set_len_no_free(files, out);
+    // A stale index is dropped so that the next merge rebuilds it.
+    si->len = keyed ? out : 0;
+}
+
+size_t listing_index_of(const Vector *files, FileAttr entry) {
+    if (!entry) return (size_t)-1;
+    size_t n = Vector_len(*files);
+    for (size_t i = 0; i < n; i++) {
+        if (files->el[i] == entry) return i;
+    }
+    return (size_t)-1;
+}
+
+const char *sort_mode_name(SortMode mode) {
+    if ((unsigned)mode >= SORT_BY_COUNT) return sort_mode_names[SORT_BY_NATURAL];
+    return sort_mode_names[mode];
+}
+
+bool sort_mode_parse(const char *name, SortMode *out) {
+    if (!name) return false;
+    for (int m = 0; m < SORT_BY_COUNT; m++) {
+        if (strcasecmp(name, sort_mode_names[m]) == 0) {
+            *out = (SortMode)m;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,72 @@
+#ifndef LISTING_SORT_H
+#define LISTING_SORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "files.h"  // FileAttr
+#include "keysort.h"
+#include "vector.h"
+
+// Directory listing order.
+//
+// Sorting works on a compact index rather than on the FileAttr pointers: every
+// entry gets a fixed-width KeySortRec (group byte, primary key bits, name
+// prefix, entry pointer) computed once, and the key sort engine orders those
+// records. Only entries whose keys tie fall back to comparing the full names.
+// The sorted order is then written back into the listing vector.
+typedef enum {
+    SORT_BY_NATURAL = 0, // case-insensitive name, digit runs compared as numbers
+    SORT_BY_NAME,        // case-insensitive name
+    SORT_BY_SIZE,        // largest first
+    SORT_BY_MTIME,       // newest first
+    SORT_BY_EXTENSION,   // extension, then name
+    SORT_BY_COUNT
+} SortMode;
+
+// Key layout, compared as unsigned integers in order:
+//   key[0]  group byte (directories first) + 56 bits of primary key
+//   key[1]  secondary key and/or name prefix
+//   key[2]  more name prefix
+// Sorted keys of the current listing, parallel to the listing vector.
+typedef struct {
+    SortMode mode;
+    bool dirs_first;
+    KeySortRec *keys;
+    KeySortRec *scratch;
+    size_t len;
+    size_t cap;
+} SortIndex;
+
+void sort_index_init(SortIndex *si, SortMode mode, bool dirs_first);
+// Forgets the listing (its entries are about to be freed); keeps the buffers.
+void sort_index_clear(SortIndex *si);
+void sort_index_free(SortIndex *si);
+
+// Changes the order used by the next build. Returns true if it differs from
+// the current one.
+bool sort_index_set_order(SortIndex *si, SortMode mode, bool dirs_first);
+
+// Re-keys and sorts the whole listing in `files`. `dir` is the directory the
+// entries live in; size and mtime orders use it to fetch missing metadata and
+// it may be NULL when every entry already carries it.
+void sort_index_build(SortIndex *si, Vector *files, const char *dir);
+
+// Sorts the entries appended to `files` from `first_new` on and merges them
+// into the already sorted part, so a listing that grows batch by batch stays
+// ordered without being re-sorted from scratch.
+void sort_index_merge(SortIndex *si, Vector *files, size_t first_new, const char *dir);
+
+// Drops the NULL slots of `files` and their keys in one pass, keeping the
+// order of everything else.
+void sort_index_compact(SortIndex *si, Vector *files);
+
+// Position of `entry` in `files`, or (size_t)-1.
+size_t listing_index_of(const Vector *files, FileAttr entry);
+
+const char *sort_mode_name(SortMode mode);
+// Accepts the names returned by sort_mode_name(). Returns false if unknown.
+bool sort_mode_parse(const char *name, SortMode *out);
+
+#endif // LISTING_SORT_H
@@ -6,8 +6,15 @@
 
 #include "mime.h"
 
+#include <magic.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/stat.h>
+
+#include "frame_sched.h"
+#include "globals.h"
 
 // Supported MIME types
 const char *supported_mime_types[] = {
@@ -249,3 +256,282 @@ bool is_supported_mime_type(const char *mime_type) {
     }
     return false;
 }
+
+// Per-thread libmagic cookies
+static pthread_key_t mime_cookie_key;
+static pthread_once_t mime_key_once = PTHREAD_ONCE_INIT;
+static bool mime_key_ok = false;
+// Stored instead of a cookie when magic_load() failed, so it is not retried.
+static char mime_load_failed;
+static __thread const char *mime_last_error = NULL;
+
+static void mime_cookie_destroy(void *cookie) {
+    if (cookie && cookie != &mime_load_failed) {
+        magic_close((magic_t)cookie);
+    }
+}
+
+static void mime_key_create(void) {
+    mime_key_ok = pthread_key_create(&mime_cookie_key, mime_cookie_destroy) == 0;
+}
+
+static magic_t mime_thread_cookie(void) {
+    pthread_once(&mime_key_once, mime_key_create);
+    if (!mime_key_ok) {
+        mime_last_error = "Error initializing magic library";
+        return NULL;
+    }
+
+    void *cookie = pthread_getspecific(mime_cookie_key);
+    if (cookie == &mime_load_failed) return NULL;
+    if (cookie) return (magic_t)cookie;
+
+    magic_t mc = magic_open(MAGIC_MIME_TYPE);
+    if (!mc) {
+        mime_last_error = "Error initializing magic library";
+        pthread_setspecific(mime_cookie_key, &mime_load_failed);
+        return NULL;
+    }
+    if (magic_load(mc, NULL) != 0) {
+        mime_last_error = "Cannot load magic database";
+        magic_close(mc);
+        pthread_setspecific(mime_cookie_key, &mime_load_failed);
+        return NULL;
+    }
+    pthread_setspecific(mime_cookie_key, mc);
+    return mc;
+}
+
+bool mime_init(void) {
+    return mime_thread_cookie() != NULL;
+}
+
+static void mime_worker_stop(void);
+
+void mime_cleanup(void) {
+    mime_worker_stop();
+    pthread_once(&mime_key_once, mime_key_create);
+    if (!mime_key_ok) return;
+    mime_cookie_destroy(pthread_getspecific(mime_cookie_key));
+    pthread_setspecific(mime_cookie_key, NULL);
+}
+
+const char *mime_detect(const char *path, bool follow_symlinks) {
+    if (!path || !*path) return NULL;
+
+    magic_t mc = mime_thread_cookie();
+    if (!mc) return NULL;
+
+    magic_setflags(mc, MAGIC_MIME_TYPE | (follow_symlinks ? MAGIC_SYMLINK : 0));
+    const char *mime_type = magic_file(mc, path);
+    if (!mime_type) {
+        mime_last_error = magic_error(mc);
+    }
+    return mime_type;
+}
+
+const char *mime_error(void) {
+    return mime_last_error ? mime_last_error : "Unknown error";
+}
+
+// MIME result cache
+#define MIME_CACHE_SLOTS 4096 // power of two
+#define MIME_CACHE_TYPE_MAX 96
+#define MIME_QUEUE_MAX 256
+
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    off_t size;
+} MimeKey;
+
+typedef struct {
+    MimeKey key;
+    bool used;
+    bool pending;     // queued for the worker, no result yet
+    const char *emoji; // static string from get_file_emoji()
+    char mime_type[MIME_CACHE_TYPE_MAX]; // empty if detection failed
+} MimeCacheSlot;
+
+typedef struct {
+    MimeKey key;
+    char path[MAX_PATH_LENGTH];
+} MimeJob;
+
+static pthread_mutex_t mime_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mime_queue_cond = PTHREAD_COND_INITIALIZER;
+static MimeCacheSlot mime_cache[MIME_CACHE_SLOTS];
+static MimeJob mime_queue[MIME_QUEUE_MAX];
+static size_t mime_queue_head = 0;
+static size_t mime_queue_len = 0;
+static pthread_t mime_worker_thread;
+static bool mime_worker_running = false;
+static bool mime_worker_stopping = false;
+
+static MimeKey mime_key_from_stat(const struct stat *st) {
+    MimeKey key;
+    memset(&key, 0, sizeof(key));
+    key.dev = st->st_dev;
+    key.ino = st->st_ino;
+    key.mtime = st->st_mtim;
+    key.size = st->st_size;
+    return key;
+}
+
+static bool mime_key_equal(const MimeKey *a, const MimeKey *b) {
+    return a->dev == b->dev && a->ino == b->ino && a->size == b->size &&
+           a->mtime.tv_sec == b->mtime.tv_sec && a->mtime.tv_nsec == b->mtime.tv_nsec;
+}
+
+// Direct-mapped: a key owns exactly one slot and newer keys evict older ones.
+static MimeCacheSlot *mime_cache_slot(const MimeKey *key) {
+    uint64_t h = (uint64_t)key->ino * 0x9E3779B97F4A7C15ULL;
+    h ^= (uint64_t)key->dev + ((uint64_t)key->mtime.tv_sec << 7) + (uint64_t)key->mtime.tv_nsec;
+    h ^= h >> 29;
+    return &mime_cache[h & (MIME_CACHE_SLOTS - 1)];
+}
+
+// Called with mime_cache_mutex held.
+static void mime_cache_store(const MimeKey *key, const char *mime_type, const char *name) {
+    MimeCacheSlot *slot = mime_cache_slot(key);
+    slot->key = *key;
+    slot->used = true;
+    slot->pending = false;
+    slot->emoji = get_file_emoji(mime_type, name);
+    if (mime_type) {
+        strncpy(slot->mime_type, mime_type, sizeof(slot->mime_type) - 1);
+        slot->mime_type[sizeof(slot->mime_type) - 1] = '\0';
+    } else {
+        slot->mime_type[0] = '\0';
+    }
+}
+
+static const char *mime_basename(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static void *mime_worker(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&mime_cache_mutex);
+    for (;;) {
+        while (mime_queue_len == 0 && !mime_worker_stopping) {
+            pthread_cond_wait(&mime_queue_cond, &mime_cache_mutex);
+        }
+        if (mime_worker_stopping) break;
+
+        MimeJob job = mime_queue[mime_queue_head];
+        mime_queue_head = (mime_queue_head + 1) % MIME_QUEUE_MAX;
+        mime_queue_len--;
+        pthread_mutex_unlock(&mime_cache_mutex);
+
+        const char *mime_type = mime_detect(job.path, false);
+
+        pthread_mutex_lock(&mime_cache_mutex);
+        MimeCacheSlot *slot = mime_cache_slot(&job.key);
+        // Only fill the slot if nothing newer claimed it meanwhile.
+        if (slot->used && slot->pending && mime_key_equal(&slot->key, &job.key)) {
+            mime_cache_store(&job.key, mime_type, mime_basename(job.path));
+            frame_sched_post(FRAME_DIRECTORY); // the row gets its icon
+        }
+    }
+    pthread_mutex_unlock(&mime_cache_mutex);
+    return NULL;
+}
+
+// Called with mime_cache_mutex held. Returns false if the job was dropped.
+static bool mime_enqueue(const MimeKey *key, const char *path) {
+    if (mime_worker_stopping || strlen(path) >= MAX_PATH_LENGTH) return false;
+    if (!mime_worker_running) {
+        if (pthread_create(&mime_worker_thread, NULL, mime_worker, NULL) != 0) {
+            return false;
+        }
+        mime_worker_running = true;
+    }
+    if (mime_queue_len == MIME_QUEUE_MAX) {
+        // Keep the newest requests: they belong to what is on screen now.
+        // The dropped one gives up its slot so the next lookup queues it again.
+        const MimeKey *dropped = &mime_queue[mime_queue_head].key;
+        MimeCacheSlot *slot = mime_cache_slot(dropped);
+        if (slot->used && slot->pending && mime_key_equal(&slot->key, dropped)) {
+            slot->used = false;
+            slot->pending = false;
+        }
+        mime_queue_head = (mime_queue_head + 1) % MIME_QUEUE_MAX;
+        mime_queue_len--;
+    }
+    MimeJob *job = &mime_queue[(mime_queue_head + mime_queue_len) % MIME_QUEUE_MAX];
+    job->key = *key;
+    strcpy(job->path, path);
+    mime_queue_len++;
+    pthread_cond_signal(&mime_queue_cond);
+    return true;
+}
+
+static void mime_worker_stop(void) {
+    pthread_mutex_lock(&mime_cache_mutex);
+    bool running = mime_worker_running;
+    mime_worker_stopping = true;
+    pthread_cond_broadcast(&mime_queue_cond);
+    pthread_mutex_unlock(&mime_cache_mutex);
+
+    if (running) {
+        pthread_join(mime_worker_thread, NULL);
+    }
+
+    pthread_mutex_lock(&mime_cache_mutex);
+    mime_worker_running = false;
+    mime_worker_stopping = false;
+    mime_queue_len = 0;
+    pthread_mutex_unlock(&mime_cache_mutex);
+}
+
+const char *mime_cached_emoji(const char *path, const char *name, const struct stat *st) {
+    if (!path || !st) return get_file_emoji(NULL, name);
+
+    MimeKey key = mime_key_from_stat(st);
+    const char *emoji = NULL;
+
+    pthread_mutex_lock(&mime_cache_mutex);
+    MimeCacheSlot *slot = mime_cache_slot(&key);
+    if (slot->used && mime_key_equal(&slot->key, &key)) {
+        if (!slot->pending) emoji = slot->emoji;
+    } else if (mime_enqueue(&key, path)) {
+        slot->key = key;
+        slot->used = true;
+        slot->pending = true;
+    }
+    pthread_mutex_unlock(&mime_cache_mutex);
+
+    return emoji ? emoji : get_file_emoji(NULL, name);
+}
+
+bool mime_cached_type(const char *path, const struct stat *st, char *buf, size_t len) {
+    if (!path || !buf || len == 0) return false;
+
+    MimeKey key;
+    if (st) {
+        key = mime_key_from_stat(st);
+        pthread_mutex_lock(&mime_cache_mutex);
+        MimeCacheSlot *slot = mime_cache_slot(&key);
+        bool hit = slot->used && !slot->pending && mime_key_equal(&slot->key, &key);
+        if (hit) {
+            strncpy(buf, slot->mime_type, len - 1);
+            buf[len - 1] = '\0';
+        }
+        pthread_mutex_unlock(&mime_cache_mutex);
+        if (hit) return buf[0] != '\0';
+    }
+
+    const char *mime_type = mime_detect(path, false);
+    if (st) {
+        pthread_mutex_lock(&mime_cache_mutex);
+        mime_cache_store(&key, mime_type, mime_basename(path));
+        pthread_mutex_unlock(&mime_cache_mutex);
+    }
+    if (!mime_type) return false;
+    strncpy(buf, mime_type, len - 1);
+    buf[len - 1] = '\0';
+    return true;
+}
@@ -12,4 +12,36 @@ bool is_supported_mime_type(const char *mime_type);
 bool is_archive_file(const char *filename);
 const char *get_file_emoji(const char *mime_type, const char *filename);
 
+// Shared libmagic service. libmagic cookies are not thread-safe, so every
+// thread gets its own cookie, loaded once on first use and reused until the
+// thread exits. Call mime_init() at startup to pay the database load up front.
+bool mime_init(void);
+void mime_cleanup(void);
+
+// Returns the MIME type of `path`, or NULL if it cannot be determined. The
+// string belongs to the calling thread's cookie and stays valid until that
+// thread's next mime_detect() call.
+const char *mime_detect(const char *path, bool follow_symlinks);
+
+// Describes the last failure of mime_detect() on the calling thread.
+const char *mime_error(void);
+
+struct stat;
+
+// Bounded MIME/emoji result cache keyed by (dev, inode, mtime, size) from the
+// entry's lstat data; a changed file simply misses. The table has a fixed
+// number of slots, so browsing huge trees evicts instead of growing.
+//
+// Returns the emoji for `path` without touching libmagic: on a miss the
+// detection is queued for a background worker and an extension-based guess is
+// returned until the next redraw picks up the real result. `st` may be NULL
+// when the entry could not be stat'ed.
+const char *mime_cached_emoji(const char *path, const char *name, const struct stat *st);
+
+// Synchronous variant: copies the MIME type of `path` into `buf`, running
+// libmagic on the calling thread on a miss and caching the result. Symlinks
+// are not followed, matching the lstat key. Returns false if the type could
+// not be determined.
+bool mime_cached_type(const char *path, const struct stat *st, char *buf, size_t len);
+
 #endif // MIME_H
@@ -0,0 +1,369 @@
+// File: stat_batch.c
+// Batched statx over io_uring, with a worker-pool fallback
+#define _GNU_SOURCE
+
+#include "stat_batch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#define STAT_BATCH_RING_DEPTH 64
+#define STAT_BATCH_POOL_THREADS 4
+// Below this many misses the pool wake-up costs more than it saves.
+#define STAT_BATCH_POOL_MIN 8
+
+// ---------------------------------------------------------------------------
+// io_uring (raw syscalls; liburing is not a dependency)
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    int fd;
+    unsigned entries;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr;
+    void *cq_ptr;
+    size_t sq_len;
+    size_t cq_len;
+    size_t sqes_len;
+} StatRing;
+
+typedef enum {
+    RING_UNTRIED = 0,
+    RING_READY,
+    RING_UNAVAILABLE,
+} RingState;
+
+static pthread_mutex_t ring_mutex = PTHREAD_MUTEX_INITIALIZER;
+static StatRing ring;
+static RingState ring_state = RING_UNTRIED;
+
+static void ring_unmap(StatRing *r) {
+    if (r->sqes && r->sqes != MAP_FAILED) munmap(r->sqes, r->sqes_len);
+    if (r->cq_ptr && r->cq_ptr != MAP_FAILED && r->cq_ptr != r->sq_ptr) munmap(r->cq_ptr, r->cq_len);
+    if (r->sq_ptr && r->sq_ptr != MAP_FAILED) munmap(r->sq_ptr, r->sq_len);
+    if (r->fd >= 0) close(r->fd);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+static bool ring_setup(StatRing *r) {
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = (int)syscall(__NR_io_uring_setup, STAT_BATCH_RING_DEPTH, &p);
+    if (fd < 0) return false; // ENOSYS, or blocked by seccomp/sysctl
+    r->fd = fd;
+    r->entries = p.sq_entries;
+
+    r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        if (r->cq_len > r->sq_len) r->sq_len = r->cq_len;
+        r->cq_len = r->sq_len;
+    }
+
+    r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED) goto fail;
+    if (single_mmap) {
+        r->cq_ptr = r->sq_ptr;
+    } else {
+        r->cq_ptr = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         fd, IORING_OFF_CQ_RING);
+        if (r->cq_ptr == MAP_FAILED) goto fail;
+    }
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) goto fail;
+
+    char *sq = r->sq_ptr;
+    char *cq = r->cq_ptr;
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return true;
+
+fail:
+    ring_unmap(r);
+    return false;
+}
+
+static void statx_to_stat(const struct statx *stx, struct stat *st) {
+    memset(st, 0, sizeof(*st));
+    st->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+    st->st_ino = (ino_t)stx->stx_ino;
+    st->st_mode = stx->stx_mode;
+    st->st_nlink = stx->stx_nlink;
+    st->st_size = (off_t)stx->stx_size;
+    st->st_blocks = (blkcnt_t)stx->stx_blocks;
+    st->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+    st->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+}
+
+// Submits up to ring.entries statx requests and reaps them. Called with
+// ring_mutex held. Returns false if the ring turned out to be unusable, in
+// which case it must be torn down (that also drops any SQE still queued).
+static bool ring_stat_chunk(FileAttr *entries, size_t count, int dir_fd) {
+    struct statx results[STAT_BATCH_RING_DEPTH];
+    unsigned tail = *ring.sq_tail;
+    unsigned mask = *ring.sq_mask;
+
+    for (size_t i = 0; i < count; i++) {
+        unsigned idx = tail & mask;
+        struct io_uring_sqe *sqe = &ring.sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = dir_fd;
+        sqe->addr = (uint64_t)(uintptr_t)FileAttr_get_name(entries[i]);
+        sqe->len = STATX_BASIC_STATS;
+        sqe->off = (uint64_t)(uintptr_t)&results[i];
+        sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+        sqe->user_data = i;
+        ring.sq_array[idx] = idx;
+        tail++;
+    }
+    __atomic_store_n(ring.sq_tail, tail, __ATOMIC_RELEASE);
+
+    size_t submitted = 0;
+    bool ok = true;
+    while (submitted < count) {
+        int rc = (int)syscall(__NR_io_uring_enter, ring.fd, (unsigned)(count - submitted),
+                              (unsigned)(count - submitted), IORING_ENTER_GETEVENTS, NULL, 0);
+        if (rc < 0) {
+            if (errno == EINTR) continue;
+            ok = false;
+            break;
+        }
+        submitted += (size_t)rc;
+    }
+
+    size_t reaped = 0;
+    while (reaped < submitted) {
+        unsigned head = *ring.cq_head;
+        unsigned cq_tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        if (head == cq_tail) {
+            int rc = (int)syscall(__NR_io_uring_enter, ring.fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+            if (rc < 0 && errno != EINTR) {
+                ok = false;
+                break;
+            }
+            continue;
+        }
+        for (; head != cq_tail; head++) {
+            struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+            size_t i = (size_t)cqe->user_data;
+            // Failed requests (including -EINVAL from kernels without
+            // IORING_OP_STATX) stay empty for the caller's fallback.
+            if (i < count && cqe->res == 0) {
+                struct stat st;
+                statx_to_stat(&results[i], &st);
+                FileAttr_set_stat(entries[i], &st, dir_fd);
+            }
+            reaped++;
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+    return ok && reaped == count;
+}
+
+// Returns false if io_uring is unavailable; entries may then be partly filled.
+static bool ring_stat_batch(FileAttr *entries, size_t count, int dir_fd) {
+    pthread_mutex_lock(&ring_mutex);
+    if (ring_state == RING_UNTRIED) {
+        ring_state = ring_setup(&ring) ? RING_READY : RING_UNAVAILABLE;
+    }
+    if (ring_state != RING_READY) {
+        pthread_mutex_unlock(&ring_mutex);
+        return false;
+    }
+
+    size_t chunk_max = ring.entries < STAT_BATCH_RING_DEPTH ? ring.entries : STAT_BATCH_RING_DEPTH;
+    for (size_t off = 0; off < count; off += chunk_max) {
+        size_t n = count - off < chunk_max ? count - off : chunk_max;
+        if (!ring_stat_chunk(entries + off, n, dir_fd)) {
+            ring_unmap(&ring);
+            ring_state = RING_UNAVAILABLE;
+            pthread_mutex_unlock(&ring_mutex);
+            return false;
+        }
+    }
+    pthread_mutex_unlock(&ring_mutex);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Worker pool fallback
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    FileAttr *entries;
+    size_t count;
+    int dir_fd;
+    size_t next; // atomic: next index to claim
+} StatJob;
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_idle_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t pool_threads[STAT_BATCH_POOL_THREADS];
+static size_t pool_size = 0;
+static StatJob *pool_job = NULL;
+static unsigned long pool_generation = 0;
+static size_t pool_active = 0;
+static bool pool_stopping = false;
+
+static void stat_job_run(StatJob *job) {
+    for (;;) {
+        size_t i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (i >= job->count) break;
+        FileAttr_load_stat(job->entries[i], job->dir_fd);
+    }
+}
+
+static void *pool_worker(void *arg) {
+    (void)arg;
+    unsigned long seen = 0;
+    pthread_mutex_lock(&pool_mutex);
+    for (;;) {
+        while (!pool_stopping && (pool_job == NULL || pool_generation == seen)) {
+            pthread_cond_wait(&pool_cond, &pool_mutex);
+        }
+        if (pool_stopping) break;
+
+        seen = pool_generation;
+        StatJob *job = pool_job;
+        pool_active++;
+        pthread_mutex_unlock(&pool_mutex);
+
+        stat_job_run(job);
+
+        pthread_mutex_lock(&pool_mutex);
+        pool_active--;
+        pthread_cond_broadcast(&pool_idle_cond);
+    }
+    pthread_mutex_unlock(&pool_mutex);
+    return NULL;
+}
+
+// Called with pool_mutex held.
+static void pool_start_locked(void) {
+    while (pool_size < STAT_BATCH_POOL_THREADS) {
+        if (pthread_create(&pool_threads[pool_size], NULL, pool_worker, NULL) != 0) break;
+        pool_size++;
+    }
+}
+
+static void pool_stat_batch(FileAttr *entries, size_t count, int dir_fd) {
+    StatJob job = {
+        .entries = entries,
+        .count = count,
+        .dir_fd = dir_fd,
+        .next = 0,
+    };
+
+    pthread_mutex_lock(&pool_mutex);
+    pool_start_locked();
+    pool_job = &job;
+    pool_generation++;
+    pthread_cond_broadcast(&pool_cond);
+    pthread_mutex_unlock(&pool_mutex);
+
+    // The caller works too, so a cold pool never makes things slower.
+    stat_job_run(&job);
+
+    pthread_mutex_lock(&pool_mutex);
+    pool_job = NULL;
+    while (pool_active > 0) {
+        pthread_cond_wait(&pool_idle_cond, &pool_mutex);
+    }
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+// ---------------------------------------------------------------------------
+// Public API
+// ---------------------------------------------------------------------------
+
+size_t stat_batch_fill(FileAttr *entries, size_t count, int dir_fd) {
+    if (!entries || count == 0 || dir_fd < 0) return 0;
+
+    FileAttr missing[256];
+    for (size_t base = 0; base < count;) {
+        // Compact this slice's misses into a scratch list.
+        size_t n = 0;
+        for (; base < count && n < sizeof(missing) / sizeof(missing[0]); base++) {
+            if (!FileAttr_has_stat(entries[base])) missing[n++] = entries[base];
+        }
+        if (n == 0) continue;
+
+        bool used_ring = ring_stat_batch(missing, n, dir_fd);
+
+        // Whatever the ring did not resolve: either everything (no io_uring)
+        // or the few requests that failed.
+        size_t left = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (!FileAttr_has_stat(missing[i])) missing[left++] = missing[i];
+        }
+        if (!used_ring && left >= STAT_BATCH_POOL_MIN) {
+            pool_stat_batch(missing, left, dir_fd);
+        } else {
+            for (size_t i = 0; i < left; i++) {
+                FileAttr_load_stat(missing[i], dir_fd);
+            }
+        }
+    }
+
+    size_t filled = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (FileAttr_has_stat(entries[i])) filled++;
+    }
+    return filled;
+}
+
+void stat_batch_shutdown(void) {
+    pthread_mutex_lock(&pool_mutex);
+    pool_stopping = true;
+    pthread_cond_broadcast(&pool_cond);
+    size_t n = pool_size;
+    pthread_mutex_unlock(&pool_mutex);
+
+    for (size_t i = 0; i < n; i++) {
+        pthread_join(pool_threads[i], NULL);
+    }
+
+    pthread_mutex_lock(&pool_mutex);
+    pool_size = 0;
+    pool_stopping = false;
+    pthread_mutex_unlock(&pool_mutex);
+
+    pthread_mutex_lock(&ring_mutex);
+    if (ring_state == RING_READY) ring_unmap(&ring);
+    ring_state = RING_UNTRIED;
+    pthread_mutex_unlock(&ring_mutex);
+}
@@ -0,0 +1,22 @@
+#ifndef STAT_BATCH_H
+#define STAT_BATCH_H
+
+#include <stddef.h>
+
+#include "files.h"  // FileAttr
+
+// Batched metadata fetch for a window of directory entries.
+//
+// All entries of one call live in the directory open as `dir_fd`. Entries that
+// already carry metadata are skipped. Where io_uring is available the statx
+// requests go out as one submission; otherwise they are spread over a small
+// worker pool, so high-latency mounts (NFS, FUSE) are stat'ed in parallel
+// rather than one round trip after another.
+//
+// Returns the number of entries that now have metadata.
+size_t stat_batch_fill(FileAttr *entries, size_t count, int dir_fd);
+
+// Releases the io_uring instance and stops the worker pool.
+void stat_batch_shutdown(void);
+
+#endif // STAT_BATCH_H
@@ -0,0 +1,226 @@
+// File: text_view.c
+// Sparse line index and block-buffered reads for text previews
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "text_view.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TEXT_VIEW_BLOCK 65536
+
+struct TextView {
+    int fd;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+
+    off_t *marks;        // marks[i]: offset of line i * TEXT_VIEW_MARK_EVERY
+    size_t mark_count;
+    size_t mark_cap;
+    off_t scanned;       // the index covers [0, scanned)
+    off_t line_start;    // start of the line that `scanned` is in
+    size_t lines;        // lines ended in [0, scanned)
+    bool complete;       // scanned up to end of file
+
+    char *block;         // bytes [block_off, block_off + block_len)
+    off_t block_off;
+    size_t block_len;
+};
+
+// Returns the bytes from `off` to the end of the block holding it, reading
+// the block if needed. NULL (and *avail = 0) at end of file or on error.
+static const char *block_at(TextView *view, off_t off, size_t *avail) {
+    if (off < view->block_off || off >= view->block_off + (off_t)view->block_len) {
+        ssize_t n;
+        do {
+            n = pread(view->fd, view->block, TEXT_VIEW_BLOCK, off);
+        } while (n < 0 && errno == EINTR);
+        view->block_off = off;
+        view->block_len = n > 0 ? (size_t)n : 0;
+        if (n <= 0) {
+            *avail = 0;
+            return NULL;
+        }
+    }
+    size_t skip = (size_t)(off - view->block_off);
+    *avail = view->block_len - skip;
+    return view->block + skip;
+}
+
+static bool add_mark(TextView *view, off_t offset) {
+    if (view->mark_count == view->mark_cap) {
+        size_t cap = view->mark_cap ? view->mark_cap * 2 : 64;
+        off_t *marks = realloc(view->marks, cap * sizeof(*marks));
+        if (!marks) return false;
+        view->marks = marks;
+        view->mark_cap = cap;
+    }
+    view->marks[view->mark_count++] = offset;
+    return true;
+}
+
+// Of the `n` bytes at `off`, how many can still belong to the line that
+// starts at `start`: its TEXT_VIEW_LINE_MAX bytes and the newline after them.
+// Sets *cut if the line ends within them without a newline.
+static size_t line_window(off_t start, off_t off, size_t n, bool *cut) {
+    off_t left = start + TEXT_VIEW_LINE_MAX + 1 - off;
+    *cut = (off_t)n >= left;
+    return *cut ? (size_t)left : n;
+}
+
+// Extends the index until it has a mark at or before `line`'s group, or the
+// whole file is scanned.
+static void index_until(TextView *view, size_t line) {
+    size_t want = line / TEXT_VIEW_MARK_EVERY;
+    while (view->mark_count <= want && !view->complete) {
+        size_t n;
+        const char *p = block_at(view, view->scanned, &n);
+        if (!p) {
+            view->complete = true;
+            break;
+        }
+        bool cut;
+        size_t look = line_window(view->line_start, view->scanned, n, &cut);
+        const char *nl = memchr(p, '\n', look);
+        if (!nl && !cut) {
+            view->scanned += (off_t)n;
+            continue;
+        }
+        off_t next = nl ? view->scanned + (nl - p) + 1 : view->line_start + TEXT_VIEW_LINE_MAX;
+        view->scanned = next;
+        view->line_start = next;
+        view->lines++;
+        if (view->lines % TEXT_VIEW_MARK_EVERY == 0 && !add_mark(view, next)) {
+            view->complete = true; // out of memory: stop growing
+            return;
+        }
+    }
+}
+
+// Offset where the line after the one at `off` starts, or end of file.
+// Returns -1 if `off` is at end of file.
+static off_t skip_line(TextView *view, off_t off) {
+    off_t start = off;
+    bool any = false;
+    for (;;) {
+        size_t n;
+        const char *p = block_at(view, off, &n);
+        if (!p) return any ? off : -1;
+        any = true;
+        bool cut;
+        size_t look = line_window(start, off, n, &cut);
+        const char *nl = memchr(p, '\n', look);
+        if (nl) return off + (nl - p) + 1;
+        if (cut) return start + TEXT_VIEW_LINE_MAX;
+        off += (off_t)n;
+    }
+}
+
+TextView *text_view_open(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return NULL;
+    }
+
+    TextView *view = calloc(1, sizeof(*view));
+    char *block = malloc(TEXT_VIEW_BLOCK);
+    if (!view || !block) {
+        free(view);
+        free(block);
+        close(fd);
+        return NULL;
+    }
+    view->fd = fd;
+    view->dev = st.st_dev;
+    view->ino = st.st_ino;
+    view->size = st.st_size;
+    view->mtime = st.st_mtim;
+    view->block = block;
+    if (!add_mark(view, 0)) {
+        text_view_close(view);
+        return NULL;
+    }
+    return view;
+}
+
+void text_view_close(TextView *view) {
+    if (!view) return;
+    close(view->fd);
+    free(view->marks);
+    free(view->block);
+    free(view);
+}
+
+bool text_view_matches(const TextView *view, const struct stat *st) {
+    return view && st->st_dev == view->dev && st->st_ino == view->ino &&
+           st->st_size == view->size && st->st_mtim.tv_sec == view->mtime.tv_sec &&
+           st->st_mtim.tv_nsec == view->mtime.tv_nsec;
+}
+
+bool text_view_seek(TextView *view, size_t line, TextViewPos *at) {
+    index_until(view, line);
+    size_t mark = line / TEXT_VIEW_MARK_EVERY;
+    if (mark >= view->mark_count) return false;
+
+    off_t off = view->marks[mark];
+    for (size_t i = mark * TEXT_VIEW_MARK_EVERY; i < line; i++) {
+        off = skip_line(view, off);
+        if (off < 0) return false;
+    }
+    size_t n;
+    if (!block_at(view, off, &n)) return false;
+    at->offset = off;
+    at->line = line;
+    return true;
+}
+
+bool text_view_next(TextView *view, TextViewPos *at, char *out, size_t cap, size_t *len) {
+    size_t copied = 0;
+    off_t start = at->offset;
+    off_t off = start;
+    bool any = false;
+    for (;;) {
+        size_t n;
+        const char *p = block_at(view, off, &n);
+        if (!p) break;
+        any = true;
+        bool cut;
+        size_t look = line_window(start, off, n, &cut);
+        const char *nl = memchr(p, '\n', look);
+        // Cut without a newline: the last byte looked at starts the next line
+        size_t take = nl ? (size_t)(nl - p) : cut ? look - 1 : n;
+        if (cap > 0 && copied < cap - 1) {
+            size_t room = cap - 1 - copied;
+            size_t c = take < room ? take : room;
+            memcpy(out + copied, p, c);
+            copied += c;
+        }
+        if (nl) {
+            off += (off_t)take + 1;
+            break;
+        }
+        off += (off_t)take;
+        if (cut) break;
+    }
+    if (!any) return false;
+    if (cap > 0) out[copied] = '\0';
+    if (len) *len = copied;
+    at->offset = off;
+    at->line++;
+    return true;
+}
+
+bool text_view_has_line(TextView *view, size_t line) {
+    TextViewPos at;
+    return text_view_seek(view, line, &at);
+}
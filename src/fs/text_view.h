@@ -0,0 +1,52 @@
+#ifndef TEXT_VIEW_H
+#define TEXT_VIEW_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// Line-addressed, windowed reads of a text file for the preview pane.
+//
+// Nothing is read up front. A sparse index records the offset of every
+// TEXT_VIEW_MARK_EVERY-th line and is extended only as far as the lines asked
+// for, so jumping to line 1,000,000 of a log scans up to there once and every
+// later scroll step reads just the bytes on screen. Reads go through pread()
+// into a small block buffer rather than through a mapping, so a file that is
+// truncated underneath (log rotation) gives short reads instead of SIGBUS.
+//
+// A line longer than TEXT_VIEW_LINE_MAX bytes is split into lines of that
+// length, so a file that is one huge line (minified JSON, a log without
+// newlines) costs no more per screen than any other.
+typedef struct TextView TextView;
+
+#define TEXT_VIEW_MARK_EVERY 64
+#define TEXT_VIEW_LINE_MAX 4096
+
+// Where a line starts; lets consecutive lines be read without index lookups.
+typedef struct {
+    off_t offset;
+    size_t line;
+} TextViewPos;
+
+// Returns NULL if `path` cannot be opened or is not a regular file.
+TextView *text_view_open(const char *path);
+void text_view_close(TextView *view);
+
+// True while `st` (a fresh stat of the path) still describes the file that
+// was opened: same inode, size and modification time.
+bool text_view_matches(const TextView *view, const struct stat *st);
+
+// Positions *at on line `line` (0-based). Returns false if the file has no
+// such line.
+bool text_view_seek(TextView *view, size_t line, TextViewPos *at);
+
+// Copies the line at *at into `out` without its newline, cut to `cap - 1`
+// bytes and NUL-terminated, stores its copied length in *len (may be NULL)
+// and moves *at to the next line. Returns false at end of file.
+bool text_view_next(TextView *view, TextViewPos *at, char *out, size_t cap, size_t *len);
+
+// True if the file has at least `line + 1` lines.
+bool text_view_has_line(TextView *view, size_t line);
+
+#endif // TEXT_VIEW_H
@@ -7,8 +7,9 @@
 #include "browser_ui.h"
 
 #include <dirent.h>
-#include <magic.h>
+#include <fcntl.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -17,264 +18,141 @@
 #include <unistd.h>
 #include <ctype.h>
 
+#include "dir_size.h"
 #include "files.h"
 #include "globals.h"
 #include "syntax.h"
 #include "mime.h"
+#include "stat_batch.h"
+#include "preview_cache.h"
+#include "preview_worker.h"
+
+// Highlighted windows of recently previewed text files, for the preview pane
+// and for paths shown through fm.preview alike.
+static PreviewCache *preview_frames(void) {
+    static PreviewCache *cache = NULL;
+    if (!cache) cache = preview_cache_new(PREVIEW_CACHE_MAX_ENTRIES, PREVIEW_CACHE_MAX_BYTES);
+    return cache;
+}
 
-#define DIRECTORY_TREE_MAX_DEPTH 4
-#define DIRECTORY_TREE_MAX_TOTAL 1500
-
-static bool tree_limit_hit = false;
-
-static void count_directory_tree_lines(const char *dir_path, int level, int *line_count) {
-    DIR *dir = opendir(dir_path);
-    if (!dir) return;
-
-    struct dirent *entry;
-    struct stat statbuf;
-    char full_path[MAX_PATH_LENGTH];
-    size_t dir_path_len = strlen(dir_path);
-
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
-
-        size_t name_len = strlen(entry->d_name);
-        if (dir_path_len + name_len + 2 > MAX_PATH_LENGTH) continue;
-
-        strcpy(full_path, dir_path);
-        if (full_path[dir_path_len - 1] != '/') {
-            strcat(full_path, "/");
-        }
-        strcat(full_path, entry->d_name);
-
-        if (lstat(full_path, &statbuf) == -1) continue;
-
-        (*line_count)++; // Count this entry
-        if (*line_count >= DIRECTORY_TREE_MAX_TOTAL) {
-            break;
-        }
-
-        if (S_ISDIR(statbuf.st_mode) &&
-            level < DIRECTORY_TREE_MAX_DEPTH) {
-            count_directory_tree_lines(full_path, level + 1, line_count);
-            if (*line_count >= DIRECTORY_TREE_MAX_TOTAL) {
-                break;
-            }
+// Draws up to `rows` lines of a cached frame from row `y` on; returns how
+// many were drawn.
+static int draw_preview_frame(WINDOW *window, const PreviewFrame *frame, int y, int rows) {
+    int count = preview_frame_line_count(frame);
+    if (count > rows) count = rows;
+    for (int i = 0; i < count; i++) {
+        const PreviewRun *runs;
+        size_t run_count;
+        const char *text = preview_frame_line(frame, i, &runs, &run_count);
+        wmove(window, y + i, 2);
+        for (size_t r = 0; r < run_count; r++) {
+            wattrset(window, runs[r].attr);
+            waddnstr(window, text, (int)runs[r].len);
+            text += runs[r].len;
         }
     }
-
-    closedir(dir);
-}
-
-int get_directory_tree_total_lines(const char *dir_path) {
-    int line_count = 0;
-    count_directory_tree_lines(dir_path, 0, &line_count);
-    return line_count;
+    wattrset(window, A_NORMAL);
+    return count;
 }
 
-static void show_directory_tree(WINDOW *window,
-                                const char *dir_path,
-                                int level,
-                                int *line_num,
-                                int max_y,
-                                int max_x,
-                                int start_line,
-                                int *current_count) {
-    if (level == 0) {
-        tree_limit_hit = false;
-    }
-    if (level == 0) {
-        mvwprintw(window, 6, 2, "Directory Tree Preview:");
-        (*line_num)++;
+// Reads rows [y, y + rows) back from the window into a frame for the cache.
+static void remember_preview_frame(WINDOW *window, const char *path, const struct stat *st,
+                                   int start_line, int width, int y, int rows, bool at_end) {
+    if (width <= 0) return;
+    PreviewFrame *frame = preview_frame_new(start_line, width);
+    chtype *cells = malloc(((size_t)width + 1) * sizeof(*cells));
+    bool ok = frame && cells;
+    for (int i = 0; ok && i < rows; i++) {
+        int n = mvwinchnstr(window, y + i, 2, cells, width);
+        ok = n != ERR && preview_frame_add_line(frame, cells, n, getbkgd(window));
     }
-
-    if (*line_num >= max_y - 1) {
+    free(cells);
+    if (!ok) {
+        preview_frame_free(frame);
         return;
     }
+    preview_frame_set_end(frame, at_end);
+    preview_cache_put(preview_frames(), path, st, frame);
+}
 
-    DIR *dir = opendir(dir_path);
-    if (!dir) return;
-
-    struct dirent *entry;
-    struct stat statbuf;
-    char full_path[MAX_PATH_LENGTH];
-    size_t dir_path_len = strlen(dir_path);
-
-    const int WINDOW_SIZE = 50;
-
-    struct {
-        char name[MAX_PATH_LENGTH];
-        bool is_dir;
-        mode_t mode;
-    } entries[WINDOW_SIZE];
-    int entry_count = 0;
-
-    while ((entry = readdir(dir)) != NULL && entry_count < WINDOW_SIZE) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
-
-        size_t name_len = strlen(entry->d_name);
-        if (dir_path_len + name_len + 2 > MAX_PATH_LENGTH) continue;
-
-        strcpy(full_path, dir_path);
-        if (full_path[dir_path_len - 1] != '/') {
-            strcat(full_path, "/");
-        }
-        strcat(full_path, entry->d_name);
-
-        if (lstat(full_path, &statbuf) == -1) continue;
-
-        strncpy(entries[entry_count].name, entry->d_name, MAX_PATH_LENGTH - 1);
-        entries[entry_count].name[MAX_PATH_LENGTH - 1] = '\0';
-        entries[entry_count].is_dir = S_ISDIR(statbuf.st_mode);
-        entries[entry_count].mode = statbuf.st_mode;
-        entry_count++;
-    }
-    closedir(dir);
+// What the directory window shows, row by row, so a redraw only repaints the
+// rows whose entry, icon or highlight changed. A key of 0 means "unknown".
+static struct {
+    WINDOW *window;
+    int rows;
+    int cols;
+    bool empty_message;
+    uint64_t *row_keys;
+    char status[96];    // label in the bottom border
+} dir_render;
 
-    if (entry_count == 0) {
-        if (*current_count >= start_line && *line_num < max_y - 1) {
-            mvwprintw(window, *line_num, 2, "[Empty directory]");
-            (*line_num)++;
-        }
-        (*current_count)++;
-        return;
-    }
+void invalidate_directory_window(void) {
+    dir_render.window = NULL;
+}
 
-    magic_t magic_cookie = magic_open(MAGIC_MIME_TYPE);
-    if (magic_cookie && magic_load(magic_cookie, NULL) != 0) {
-        magic_close(magic_cookie);
-        magic_cookie = NULL;
+static uint64_t row_key_add(uint64_t h, const char *s) {
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 1099511628211ull; // FNV-1a
     }
+    h ^= 0xff; // separator, so "ab"+"c" and "a"+"bc" differ
+    return h * 1099511628211ull;
+}
 
-    for (int i = 0; i < entry_count; i++) {
-        if (*current_count < start_line) {
-            (*current_count)++;
-            if (entries[i].is_dir && level < DIRECTORY_TREE_MAX_DEPTH) {
-                size_t name_len = strlen(entries[i].name);
-                if (dir_path_len + name_len + 2 <= MAX_PATH_LENGTH) {
-                    strcpy(full_path, dir_path);
-                    if (full_path[dir_path_len - 1] != '/') {
-                        strcat(full_path, "/");
-                    }
-                    strcat(full_path, entries[i].name);
-                    show_directory_tree(window, full_path, level + 1, line_num, max_y, max_x, start_line, current_count);
-                }
-            }
-            continue;
-        }
-
-        if (*line_num >= max_y - 1) {
-            break;
-        }
-
-        full_path[0] = '\0';
-        size_t name_len = strlen(entries[i].name);
-        if (dir_path_len + name_len + 2 <= MAX_PATH_LENGTH) {
-            strcpy(full_path, dir_path);
-            if (full_path[dir_path_len - 1] != '/') {
-                strcat(full_path, "/");
-            }
-            strcat(full_path, entries[i].name);
-        }
-
-        struct stat link_statbuf;
-        bool is_symlink = (lstat(full_path, &link_statbuf) == 0 && S_ISLNK(link_statbuf.st_mode));
-        char symlink_target[MAX_PATH_LENGTH] = {0};
-
-        if (is_symlink) {
-            ssize_t target_len = readlink(full_path, symlink_target, sizeof(symlink_target) - 1);
-            if (target_len > 0) {
-                symlink_target[target_len] = '\0';
-            }
-        }
-
-        const char *emoji;
-        if (entries[i].is_dir) {
-            emoji = "📁";
-        } else if (magic_cookie) {
-            if (dir_path_len + name_len + 2 <= MAX_PATH_LENGTH) {
-                const char *mime_type = magic_file(magic_cookie, full_path);
-                emoji = get_file_emoji(mime_type, entries[i].name);
-            } else {
-                emoji = "📄";
-            }
-        } else {
-            emoji = "📄";
-        }
-
-        wmove(window, *line_num, 2 + level * 2);
-        for (int clear_x = 2 + level * 2; clear_x < max_x - 10; clear_x++) {
-            waddch(window, ' ');
-        }
-
-        int available_width = max_x - 4 - level * 2 - 10;
-        int display_len = (int)name_len + (is_symlink ? (4 + (int)strlen(symlink_target)) : 0);
-
-        if (display_len > available_width) {
-            if (is_symlink && strlen(symlink_target) > 0) {
-                int name_part = available_width / 2;
-                int target_part = available_width - name_part - 4;
-                mvwprintw(window, *line_num, 2 + level * 2, "%s %.*s -> %.*s...",
-                          emoji, name_part, entries[i].name, target_part, symlink_target);
-            } else {
-                mvwprintw(window, *line_num, 2 + level * 2, "%s %.*s",
-                          emoji, available_width, entries[i].name);
-            }
-        } else {
-            if (is_symlink && strlen(symlink_target) > 0) {
-                mvwprintw(window, *line_num, 2 + level * 2, "%s %s -> %s",
-                          emoji, entries[i].name, symlink_target);
-            } else {
-                mvwprintw(window, *line_num, 2 + level * 2, "%s %.*s",
-                          emoji, available_width, entries[i].name);
-            }
-        }
-
-        char perm[10];
-        snprintf(perm, sizeof(perm), "%o", entries[i].mode & 0777);
-        mvwprintw(window, *line_num, max_x - 10, "%s", perm);
-        (*line_num)++;
-        (*current_count)++;
-        if (*current_count >= DIRECTORY_TREE_MAX_TOTAL) {
-            tree_limit_hit = true;
-            break;
-        }
+static uint64_t row_key(const char *emoji, const char *name, const char *target,
+                        bool is_cursor, bool select_all) {
+    uint64_t h = 14695981039346656037ull;
+    h = row_key_add(h, emoji);
+    h = row_key_add(h, name);
+    h = row_key_add(h, target);
+    h ^= (uint64_t)is_cursor | ((uint64_t)select_all << 1);
+    h *= 1099511628211ull;
+    return h ? h : 1;
+}
 
-        if (entries[i].is_dir &&
-            *line_num < max_y - 1 &&
-            level < DIRECTORY_TREE_MAX_DEPTH) {
-            if (dir_path_len + name_len + 2 <= MAX_PATH_LENGTH) {
-                show_directory_tree(window, full_path, level + 1, line_num, max_y, max_x, start_line, current_count);
-                if (tree_limit_hit) {
-                    break;
-                }
-            }
-        }
-    }
+// True if the terminal still shows row `y` of `window` as the window holds it.
+// Popups and the editor draw over the pane without telling it; rows they
+// covered are touched so the next refresh sends them again.
+static bool row_on_screen(WINDOW *window, int y, int cols) {
+    cchar_t ours[cols + 1];
+    cchar_t shown[cols + 1];
+    int by, bx, cy, cx;
+    getbegyx(window, by, bx);
+    getyx(curscr, cy, cx);
+    bool same = mvwin_wchnstr(window, y, 0, ours, cols) != ERR &&
+                mvwin_wchnstr(curscr, by + y, bx, shown, cols) != ERR &&
+                memcmp(ours, shown, (size_t)cols * sizeof(cchar_t)) == 0;
+    wmove(curscr, cy, cx);
+    return same;
+}
 
-    if (magic_cookie) {
-        magic_close(magic_cookie);
+// Starts over with a blank, boxed window whenever the window or its size
+// changed; afterwards re-sends rows something else painted over.
+static void dir_render_begin(WINDOW *window, int rows, int cols) {
+    if (dir_render.window != window || dir_render.rows != rows || dir_render.cols != cols) {
+        uint64_t *keys = realloc(dir_render.row_keys, (size_t)MAX(rows, 1) * sizeof(*keys));
+        if (keys) dir_render.row_keys = keys;
+        dir_render.window = keys ? window : NULL;
+        dir_render.rows = rows;
+        dir_render.cols = cols;
+        dir_render.empty_message = false;
+        dir_render.status[0] = '\0';
+        if (keys) memset(keys, 0, (size_t)MAX(rows, 1) * sizeof(*keys));
+        werase(window);
+        box(window, 0, 0);
+        return;
     }
-
-    if (level == 0 && tree_limit_hit && *line_num < max_y - 1) {
-        mvwprintw(window, *line_num, 2, "[Preview truncated]");
-        (*line_num)++;
+    for (int y = 0; y < rows; y++) {
+        if (!row_on_screen(window, y, cols)) touchline(window, y, 1);
     }
 }
 
-int get_total_lines(const char *file_path) {
-    FILE *file = fopen(file_path, "r");
-    if (!file) return 0;
-
-    int total_lines = 0;
-    char line[256];
-    while (fgets(line, sizeof(line), file)) {
-        total_lines++;
-    }
-
-    fclose(file);
-    return total_lines;
+// Stores `key` for window row `y`; returns false if the row already shows it.
+static bool dir_render_row(int y, uint64_t key) {
+    if (!dir_render.window) return true;
+    if (dir_render.row_keys[y] == key) return false;
+    dir_render.row_keys[y] = key;
+    return true;
 }
 
 void draw_directory_window(WINDOW *window,
@@ -298,111 +176,83 @@ void draw_directory_window(WINDOW *window,
         if (cas->cursor >= cas->num_files) cas->cursor = cas->num_files - 1;
     }
 
-    werase(window);
-    box(window, 0, 0);
+    dir_render_begin(window, rows, cols);
 
     if (cas->num_files == 0) {
-        mvwprintw(window, 1, 1, "This directory is empty");
+        if (!dir_render.empty_message) {
+            werase(window);
+            box(window, 0, 0);
+            dir_render.status[0] = '\0';
+            mvwprintw(window, 1, 1, "This directory is empty");
+            dir_render.empty_message = true;
+        }
         wrefresh(window);
         return;
     }
+    if (dir_render.empty_message) {
+        mvwhline(window, 1, 1, ' ', cols - 2);
+        dir_render.empty_message = false;
+        if (dir_render.window) dir_render.row_keys[1] = 0;
+    }
 
     int max_visible_items = rows - 2;
 
-    magic_t magic_cookie = magic_open(MAGIC_MIME_TYPE);
-    if (magic_cookie == NULL || magic_load(magic_cookie, NULL) != 0) {
-        for (int i = 0; i < max_visible_items && (cas->start + i) < cas->num_files; i++) {
-            FileAttr fa = (FileAttr)files_vector->el[cas->start + i];
-            const char *name = FileAttr_get_name(fa);
-
-            char full_path[MAX_PATH_LENGTH];
-            path_join(full_path, directory, name);
-
-            struct stat statbuf;
-            bool is_symlink = (lstat(full_path, &statbuf) == 0 && S_ISLNK(statbuf.st_mode));
-            char symlink_target[MAX_PATH_LENGTH] = {0};
-
-            if (is_symlink) {
-                ssize_t target_len = readlink(full_path, symlink_target, sizeof(symlink_target) - 1);
-                if (target_len > 0) {
-                    symlink_target[target_len] = '\0';
-                }
-            }
-
-            const char *emoji = FileAttr_is_dir(fa) ? "📁" : "📄";
-
-            wmove(window, i + 1, 1);
-            for (int j = 1; j < cols - 1; j++) {
-                waddch(window, ' ');
-            }
+    // Rows enumeration left without metadata are filled once, in one batch
+    // covering the visible window plus a page of margin on each side, so
+    // paging stays syscall-free too. Afterwards redraws of this listing do
+    // no syscalls.
+    SIZE fill_lo = cas->start > max_visible_items ? cas->start - max_visible_items : 0;
+    SIZE fill_hi = MIN(cas->num_files, cas->start + 2 * (SIZE)max_visible_items);
+    bool need_fill = false;
+    for (SIZE i = cas->start; i < fill_hi && i < cas->start + max_visible_items; i++) {
+        if (!FileAttr_has_stat((FileAttr)files_vector->el[i])) {
+            need_fill = true;
+            break;
+        }
+    }
+    if (need_fill) {
+        int dir_fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir_fd >= 0) {
+            stat_batch_fill((FileAttr *)(files_vector->el + fill_lo),
+                            (size_t)(fill_hi - fill_lo), dir_fd);
+            close(dir_fd);
+        }
+    }
 
-            bool is_cursor = ((cas->start + i) == cas->cursor);
-            bool is_selected = g_select_all_highlight || is_cursor;
-            if (is_selected) wattron(window, A_REVERSE);
-            if (g_select_all_highlight && is_cursor) wattron(window, A_BOLD);
-
-            int name_len = (int)strlen(name);
-            int target_len = is_symlink ? (int)strlen(symlink_target) : 0;
-            int total_len = name_len + (is_symlink ? (4 + target_len) : 0);
-            int available_width = cols - 8;
-
-            if (total_len > available_width) {
-                if (is_symlink && target_len > 0) {
-                    int name_part = available_width / 2;
-                    int target_part = available_width - name_part - 4;
-                    mvwprintw(window, i + 1, 1, "%s %.*s -> %.*s...", emoji,
-                              name_part, name, target_part, symlink_target);
-                } else {
-                    mvwprintw(window, i + 1, 1, "%s %.*s", emoji, available_width, name);
-                }
-            } else {
-                if (is_symlink && target_len > 0) {
-                    mvwprintw(window, i + 1, 1, "%s %s -> %s", emoji, name, symlink_target);
-                } else {
-                    mvwprintw(window, i + 1, 1, "%s %s", emoji, name);
-                }
+    for (int i = 0; i < max_visible_items; i++) {
+        if (cas->start + i >= cas->num_files) {
+            if (dir_render_row(i + 1, row_key("", "", "", false, false))) {
+                mvwhline(window, i + 1, 1, ' ', cols - 2);
             }
-
-            if (g_select_all_highlight && is_cursor) wattroff(window, A_BOLD);
-            if (is_selected) wattroff(window, A_REVERSE);
+            continue;
         }
 
-        wrefresh(window);
-        return;
-    }
-
-    for (int i = 0; i < max_visible_items && (cas->start + i) < cas->num_files; i++) {
         FileAttr fa = (FileAttr)files_vector->el[cas->start + i];
         const char *name = FileAttr_get_name(fa);
 
-        char full_path[MAX_PATH_LENGTH];
-        path_join(full_path, directory, name);
-
-        struct stat statbuf;
-        bool is_symlink = (lstat(full_path, &statbuf) == 0 && S_ISLNK(statbuf.st_mode));
-        char symlink_target[MAX_PATH_LENGTH] = {0};
-
-        if (is_symlink) {
-            ssize_t target_len = readlink(full_path, symlink_target, sizeof(symlink_target) - 1);
-            if (target_len > 0) {
-                symlink_target[target_len] = '\0';
-            }
-        }
+        bool is_symlink = FileAttr_is_symlink(fa);
+        const char *symlink_target = FileAttr_link_target(fa);
+        if (!symlink_target) symlink_target = "";
 
         const char *emoji;
         if (FileAttr_is_dir(fa)) {
             emoji = "📁";
         } else {
-            const char *mime_type = magic_file(magic_cookie, full_path);
-            emoji = get_file_emoji(mime_type, name);
+            struct stat statbuf;
+            bool has_stat = FileAttr_get_stat(fa, &statbuf);
+            char full_path[MAX_PATH_LENGTH];
+            path_join(full_path, directory, name);
+            emoji = mime_cached_emoji(full_path, name, has_stat ? &statbuf : NULL);
         }
 
-        wmove(window, i + 1, 1);
-        for (int j = 1; j < cols - 1; j++) {
-            waddch(window, ' ');
+        bool is_cursor = ((cas->start + i) == cas->cursor);
+        if (!dir_render_row(i + 1, row_key(emoji, name, is_symlink ? symlink_target : "",
+                                           is_cursor, g_select_all_highlight))) {
+            continue;
         }
 
-        bool is_cursor = ((cas->start + i) == cas->cursor);
+        mvwhline(window, i + 1, 1, ' ', cols - 2);
+
         bool is_selected = g_select_all_highlight || is_cursor;
         if (is_selected) wattron(window, A_REVERSE);
         if (g_select_all_highlight && is_cursor) wattron(window, A_BOLD);
@@ -433,7 +283,6 @@ void draw_directory_window(WINDOW *window,
         if (is_selected) wattroff(window, A_REVERSE);
     }
 
-    magic_close(magic_cookie);
     wrefresh(window);
 }
 
@@ -447,6 +296,74 @@ static const char *basename_ptr_local(const char *p) {
     return slash ? (slash + 1) : p;
 }
 
+static void draw_preview_text(WINDOW *window, const PreviewContent *content, const char *path,
+                              const struct stat *st) {
+    int max_y, max_x;
+    getmaxyx(window, max_y, max_x);
+    int width = max_x - 4;
+    int rows = max_y - 1 - 7;
+
+    int line_num = 7;
+    bool at_end;
+    const PreviewFrame *frame = preview_cache_get(preview_frames(), path, st,
+                                                  content->start_line, width, rows);
+    if (frame) {
+        // Seen before and unchanged: no highlighting
+        line_num += draw_preview_frame(window, frame, 7, rows);
+        at_end = preview_frame_at_end(frame, rows);
+    } else {
+        SyntaxDef *syntax = syntax_get_for_file(path);
+        int in_block_comment = content->comment_state;
+        for (int i = 0; i < content->line_count && line_num < max_y - 1; i++) {
+            syntax_highlight_line(window, content->lines[i].text, syntax, &in_block_comment,
+                                  line_num++, 2, width, NULL, 0, 0);
+        }
+        at_end = !content->more && content->line_count <= rows;
+        remember_preview_frame(window, path, st, content->start_line, width, 7,
+                               line_num - 7, at_end);
+    }
+
+    if (at_end && line_num < max_y - 1) {
+        mvwprintw(window, line_num++, 2, "--------------------------------");
+        mvwprintw(window, line_num++, 2, "[End of file]");
+    }
+}
+
+static void draw_preview_content(WINDOW *window, const PreviewContent *content,
+                                 const char *path, const struct stat *st) {
+    if (content->kind == PREVIEW_KIND_TEXT) {
+        draw_preview_text(window, content, path, st);
+        return;
+    }
+
+    int max_y, max_x;
+    getmaxyx(window, max_y, max_x);
+    if (content->title) {
+        mvwprintw(window, 6, 2, "%s", content->title);
+    }
+    for (int i = 0; i < content->line_count && 7 + i < max_y - 1; i++) {
+        const PreviewLine *line = &content->lines[i];
+        if (content->kind == PREVIEW_KIND_MESSAGE) {
+            mvwprintw(window, 7 + i, 2, "%.*s", max_x - 4, line->text);
+            continue;
+        }
+        mvwprintw(window, 7 + i, 2 + line->indent, "%s", line->text);
+        if (line->tail[0]) {
+            mvwprintw(window, 7 + i, max_x - 10, "%s", line->tail);
+        }
+    }
+}
+
+bool preview_can_scroll_down(WINDOW *window, const char *path, int start_line) {
+    struct stat st;
+    if (!path || stat(path, &st) != 0) return false;
+    int max_y, max_x;
+    getmaxyx(window, max_y, max_x);
+    const PreviewContent *content = preview_worker_get_wait(path, &st, start_line, max_x - 4,
+                                                            max_y - 1 - 7, FRAME_INTERVAL_MS);
+    return content && content->more;
+}
+
 void draw_preview_window_path(WINDOW *window, const char *full_path, const char *display_name, int start_line) {
     // Clear the window and draw border
     werase(window);
@@ -472,6 +389,7 @@ void draw_preview_window_path(WINDOW *window, const char *full_path, const char
     }
 
     char fileSizeStr[64];
+    dir_size_set_focus(S_ISDIR(file_stat.st_mode) ? full_path : NULL);
     if (S_ISDIR(file_stat.st_mode)) {
         static char last_preview_size_path[MAX_PATH_LENGTH] = "";
         static struct timespec last_preview_size_change = {0};
@@ -514,6 +432,10 @@ void draw_preview_window_path(WINDOW *window, const char *full_path, const char
             }
         } else {
             format_file_size(fileSizeStr, (size_t)dir_size);
+            // From the last run or from before a change: being walked again
+            if (!dir_size_settled(full_path)) {
+                strncat(fileSizeStr, " (updating)", sizeof(fileSizeStr) - strlen(fileSizeStr) - 1);
+            }
         }
         mvwprintw(window, 2, 2, "📁 Directory Size: %s", fileSizeStr);
     } else {
@@ -529,119 +451,54 @@ void draw_preview_window_path(WINDOW *window, const char *full_path, const char
     strftime(modTime, sizeof(modTime), "%c", localtime(&file_stat.st_mtime));
     mvwprintw(window, 4, 2, "🕒 Last Modified: %s", modTime);
 
-    magic_t magic_cookie = magic_open(MAGIC_MIME_TYPE);
-    if (magic_cookie != NULL && magic_load(magic_cookie, NULL) == 0) {
-        const char *mime_type = magic_file(magic_cookie, full_path);
-        mvwprintw(window, 5, 2, "MIME Type: %s", mime_type ? mime_type : "Unknown");
-        magic_close(magic_cookie);
-    } else {
-        if (magic_cookie) {
-            magic_close(magic_cookie);
-        }
-        mvwprintw(window, 5, 2, "MIME Type: Unable to detect");
+    // Everything past the metadata is built by the preview workers. Until
+    // this window is ready, show what the file last showed, if anything.
+    int width = max_x - 4;
+    int rows = max_y - 1 - 7;
+    const PreviewContent *content = preview_worker_get(full_path, &file_stat, start_line, width, rows);
+    if (!content) {
+        preview_worker_request(full_path, &file_stat, start_line, width, rows);
+        content = preview_worker_latest(full_path, &file_stat);
     }
 
-    if (S_ISDIR(file_stat.st_mode)) {
-        int line_num = 7;
-        int current_count = 0;
-        show_directory_tree(window, full_path, 0, &line_num, max_y, max_x, start_line, &current_count);
-    } else if (is_archive_file(full_path)) {
-        display_archive_preview(window, full_path, start_line, max_y, max_x);
-    } else if (is_supported_file_type(full_path)) {
-        FILE *file = fopen(full_path, "r");
-        if (file) {
-            // Read all lines into a buffer first to enable proper block comment state tracking
-            char **all_lines = NULL;
-            int total_lines = 0;
-            int capacity = 100;
-            all_lines = malloc(capacity * sizeof(char*));
-            if (!all_lines) {
-                fclose(file);
-                mvwprintw(window, 7, 2, "Memory allocation failed");
-                wrefresh(window);
-                return;
-            }
-            
-            char line_buffer[256];
-            while (fgets(line_buffer, sizeof(line_buffer), file)) {
-                if (total_lines >= capacity) {
-                    capacity *= 2;
-                    char **new_lines = realloc(all_lines, capacity * sizeof(char*));
-                    if (!new_lines) {
-                        for (int i = 0; i < total_lines; i++) free(all_lines[i]);
-                        free(all_lines);
-                        fclose(file);
-                        mvwprintw(window, 7, 2, "Memory allocation failed");
-                        wrefresh(window);
-                        return;
-                    }
-                    all_lines = new_lines;
-                }
-                line_buffer[strcspn(line_buffer, "\n")] = '\0';
-                all_lines[total_lines] = strdup(line_buffer);
-                if (!all_lines[total_lines]) {
-                    for (int i = 0; i < total_lines; i++) free(all_lines[i]);
-                    free(all_lines);
-                    fclose(file);
-                    mvwprintw(window, 7, 2, "Memory allocation failed");
-                    wrefresh(window);
-                    return;
-                }
-                total_lines++;
-            }
-            fclose(file);
-            
-            // Get syntax definition for this file
-            SyntaxDef *syntax = syntax_get_for_file(full_path);
-            
-            // IMPORTANT: Compute block comment state for the first visible line AFTER determining start_line
-            int in_block_comment = 0;
-            if (syntax && start_line > 0) {
-                in_block_comment = get_initial_block_comment_state(all_lines, total_lines, start_line, syntax);
-            }
-            
-            // Display lines starting from start_line
-            int line_num = 7;
-            for (int i = start_line; i < total_lines && line_num < max_y - 1; i++) {
-                char line[256];
-                strncpy(line, all_lines[i], sizeof(line) - 1);
-                line[sizeof(line) - 1] = '\0';
-                
-                // Clean up non-printable characters
-                for (char *p = line; *p; p++) {
-                    unsigned char c = (unsigned char)*p;
-                    if (c == '\t') {
-                        *p = ' ';
-                    } else if (isspace(c) && c != ' ') {
-                        *p = ' ';
-                    } else if (!isprint(c)) {
-                        *p = ' ';
-                    }
-                }
-
-                // Use syntax highlighting if available, otherwise plain text
-                // Pass full buffer context for proper state tracking
-                syntax_highlight_line(window, line, syntax, &in_block_comment, 
-                                     line_num++, 2, max_x - 4, all_lines, total_lines, i);
-            }
-            
-            // Free all lines
-            for (int i = 0; i < total_lines; i++) {
-                free(all_lines[i]);
-            }
-            free(all_lines);
-
-            if (line_num < max_y - 1) {
-                mvwprintw(window, line_num++, 2, "--------------------------------");
-                mvwprintw(window, line_num++, 2, "[End of file]");
-            }
-        } else {
-            mvwprintw(window, 7, 2, "Unable to open file for preview");
-        }
+    if (content) {
+        mvwprintw(window, 5, 2, "MIME Type: %s", content->mime[0] ? content->mime : "Unknown");
+        draw_preview_content(window, content, full_path, &file_stat);
     } else {
-        mvwprintw(window, 7, 2, "No preview available");
+        mvwprintw(window, 5, 2, "MIME Type: ...");
+        mvwprintw(window, 7, 2, "Loading preview...");
+    }
+
+    wrefresh(window);
+}
+
+void draw_directory_status(WINDOW *window, size_t count, bool loading, const char *order) {
+    int rows, cols;
+    getmaxyx(window, rows, cols);
+
+    char label[96];
+    snprintf(label, sizeof(label), " %zu%s item%s%s%s ", count, loading ? "+" : "",
+             (count == 1 && !loading) ? "" : "s",
+             order ? ", by " : "", order ? order : "");
+    int len = (int)strlen(label);
+    if (rows < 2 || len + 2 > cols) return;
+    if (window == dir_render.window && strcmp(label, dir_render.status) == 0) return;
+
+    mvwhline(window, rows - 1, 1, ACS_HLINE, cols - 2);
+    mvwprintw(window, rows - 1, cols - len - 1, "%s", label);
+    if (window == dir_render.window) {
+        memcpy(dir_render.status, label, (size_t)len + 1);
     }
+    wrefresh(window);
+}
 
+void clear_directory_status(WINDOW *window) {
+    if (window == dir_render.window && !dir_render.status[0]) return;
+    int rows, cols;
+    getmaxyx(window, rows, cols);
+    if (rows < 2) return;
+    mvwhline(window, rows - 1, 1, ACS_HLINE, cols - 2);
+    if (window == dir_render.window) dir_render.status[0] = '\0';
     wrefresh(window);
 }
 
@@ -656,6 +513,12 @@ void draw_preview_window(WINDOW *window, const char *current_directory, const ch
     draw_preview_window_path(window, file_path, selected_entry, start_line);
 }
 
+void move_cursor_with_entry(CursorAndSlice *cas, SIZE new_cursor) {
+    cas->start += new_cursor - cas->cursor;
+    cas->cursor = new_cursor;
+    fix_cursor(cas);
+}
+
 void fix_cursor(CursorAndSlice *cas) {
     cas->cursor = MIN(cas->cursor, cas->num_files - 1);
     cas->cursor = MAX(0, cas->cursor);
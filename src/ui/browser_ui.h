@@ -13,11 +13,25 @@ typedef struct {
     SIZE num_files;
 } CursorAndSlice;
 
+// Repaints only the rows whose entry, icon or highlight changed since the
+// last call (and rows something else drew over), so moving the cursor by one
+// sends two lines to the terminal.
 void draw_directory_window(WINDOW *window,
                            const char *directory,
                            Vector *files_vector,
                            CursorAndSlice *cas);
 
+// Forgets what the directory window shows; the next draw repaints all of it.
+// Needed when the window is recreated.
+void invalidate_directory_window(void);
+
+// Writes the entry count into the bottom border of the directory window.
+// While `loading` the count is still growing and is shown with a '+'. `order`
+// names the sort order; NULL leaves it out.
+void draw_directory_status(WINDOW *window, size_t count, bool loading, const char *order);
+// Restores the plain bottom border (e.g. while a search narrows the listing).
+void clear_directory_status(WINDOW *window);
+
 void draw_preview_window(WINDOW *window,
                          const char *current_directory,
                          const char *selected_entry,
@@ -29,8 +43,13 @@ void draw_preview_window_path(WINDOW *window,
                               int start_line);
 
 void fix_cursor(CursorAndSlice *cas);
-
-int get_total_lines(const char *file_path);
-int get_directory_tree_total_lines(const char *dir_path);
+// Puts the cursor on row `new_cursor` after its entry moved there (listing
+// re-sorted) and scrolls by the same amount, so the entry keeps its screen line.
+void move_cursor_with_entry(CursorAndSlice *cas, SIZE new_cursor);
+
+// True if the preview of `path` drawn in `window` from `start_line` has
+// more below it. Waits at most one frame for that preview to be built and
+// answers false if it is not ready by then.
+bool preview_can_scroll_down(WINDOW *window, const char *path, int start_line);
 
 #endif // BROWSER_UI_H
@@ -0,0 +1,451 @@
+// du_view.c - disk usage breakdown (popup) for CupidFM
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "du_view.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <ncurses.h>
+#include <pthread.h>
+#include <stdbool.h>
+
+#include "dir_size.h"
+#include "files.h" // format_file_size
+#include "frame_sched.h"
+#include "globals.h"
+#include "main.h"  // draw_scrolling_banner + banner globals
+#include "utils.h" // path_join
+
+#define DU_BAR_WIDTH 10
+// Reading a big directory holds up keys for at most this long at a time
+#define DU_LOAD_STEP_NS (8L * 1000 * 1000)
+
+typedef struct {
+    char *name;
+    bool is_dir;
+    long size;      // apparent bytes, or a DIR_SIZE_* code
+    long allocated; // bytes of disk blocks, or a DIR_SIZE_* code
+    bool updating;  // a directory whose size is not settled yet
+} DuEntry;
+
+typedef struct {
+    char path[MAX_PATH_LENGTH];
+    DIR *handle;  // still being read; NULL once every entry is in
+    DuEntry *entries;
+    size_t count;
+    size_t cap;
+    long total;   // of the entries with a size, by the sort key
+    int updating; // entries still being sized
+} DuListing;
+
+// Sort key: disk blocks rather than apparent size. qsort() has no context.
+static bool du_by_disk = false;
+
+static long du_key(const DuEntry *entry) { return du_by_disk ? entry->allocated : entry->size; }
+
+static long du_elapsed_ns(const struct timespec *since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000000000L + (now.tv_nsec - since->tv_nsec);
+}
+
+static void du_listing_free(DuListing *listing) {
+    if (listing->handle) closedir(listing->handle);
+    listing->handle = NULL;
+    for (size_t i = 0; i < listing->count; i++) free(listing->entries[i].name);
+    free(listing->entries);
+    listing->entries = NULL;
+    listing->count = listing->cap = 0;
+}
+
+static bool du_listing_push(DuListing *listing, const char *name, const struct stat *st) {
+    if (listing->count == listing->cap) {
+        size_t cap = listing->cap ? listing->cap * 2 : 64;
+        DuEntry *entries = realloc(listing->entries, cap * sizeof(*entries));
+        if (!entries) return false;
+        listing->entries = entries;
+        listing->cap = cap;
+    }
+    char *copy = strdup(name);
+    if (!copy) return false;
+    DuEntry *entry = &listing->entries[listing->count++];
+    entry->name = copy;
+    entry->is_dir = S_ISDIR(st->st_mode);
+    entry->size = entry->is_dir ? DIR_SIZE_PENDING : (long)st->st_size;
+    entry->allocated = entry->is_dir ? DIR_SIZE_PENDING : (long)st->st_blocks * 512;
+    entry->updating = entry->is_dir;
+    return true;
+}
+
+// Reads further entries of the listing, for up to DU_LOAD_STEP_NS, so that a
+// huge directory fills in between keys. Files are sized here and now;
+// directories come from the size engine in du_listing_update().
+static void du_listing_step(DuListing *listing) {
+    if (!listing->handle) return;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int dfd = dirfd(listing->handle);
+    struct dirent *entry;
+    while ((entry = readdir(listing->handle)) != NULL) {
+        const char *name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        struct stat st;
+        if (fstatat(dfd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+        if (!du_listing_push(listing, name, &st)) break;
+        if (du_elapsed_ns(&start) >= DU_LOAD_STEP_NS) return;
+    }
+    closedir(listing->handle);
+    listing->handle = NULL;
+}
+
+static int du_compare(const void *a, const void *b) {
+    const DuEntry *x = a;
+    const DuEntry *y = b;
+    long kx = du_key(x);
+    long ky = du_key(y);
+    // Unknown sizes last
+    if ((kx < 0) != (ky < 0)) return kx < 0 ? 1 : -1;
+    if (kx != ky && kx >= 0) return kx > ky ? -1 : 1;
+    return strcmp(x->name, y->name);
+}
+
+// Asks the size engine for the listed directory, walked as the focus. Walks
+// are only queued once the user is idle and dropped when nobody asks for a
+// while, so this is repeated while sizes are outstanding.
+static void du_listing_request(const DuListing *listing) {
+    dir_size_set_focus(listing->path);
+    (void)get_directory_size(listing->path);
+}
+
+// Takes the latest directory sizes and sorts. Each subdirectory is recorded
+// as soon as its part of the walk is done.
+static void du_listing_update(DuListing *listing) {
+    du_listing_request(listing);
+    bool walked = dir_size_settled(listing->path);
+
+    listing->total = 0;
+    listing->updating = 0;
+    for (size_t i = 0; i < listing->count; i++) {
+        DuEntry *entry = &listing->entries[i];
+        if (entry->is_dir) {
+            char child[MAX_PATH_LENGTH];
+            path_join(child, listing->path, entry->name);
+            entry->size = dir_size_peek_usage(child, &entry->allocated);
+            entry->updating = !dir_size_settled(child);
+            if (entry->updating && walked) {
+                // The walk is over and did not get to it (gone, or the index
+                // is full)
+                if (entry->size == DIR_SIZE_PENDING) entry->size = entry->allocated = -1;
+                entry->updating = false;
+            }
+            if (entry->updating) listing->updating++;
+        }
+        long key = du_key(entry);
+        if (key > 0) listing->total += key;
+    }
+    qsort(listing->entries, listing->count, sizeof(*listing->entries), du_compare);
+}
+
+// Index of `name`, or listing->count if it is not (yet) listed
+static size_t du_find(const DuListing *listing, const char *name) {
+    for (size_t i = 0; name && i < listing->count; i++) {
+        if (strcmp(listing->entries[i].name, name) == 0) return i;
+    }
+    return listing->count;
+}
+
+// Replaces `listing` with the one of `path`; false (and `listing` as it was)
+// if it cannot be read.
+static bool du_listing_open(DuListing *listing, const char *path) {
+    DIR *handle = opendir(path);
+    if (!handle) return false;
+    du_listing_free(listing);
+    snprintf(listing->path, sizeof(listing->path), "%s", path);
+    listing->handle = handle;
+    du_listing_step(listing);
+    du_listing_update(listing);
+    return true;
+}
+
+static const char *du_size_label(long bytes, char *buf) {
+    switch (bytes) {
+    case DIR_SIZE_PENDING: return "...";
+    case DIR_SIZE_PERMISSION_DENIED: return "denied";
+    case DIR_SIZE_VIRTUAL_FS: return "virtual";
+    case DIR_SIZE_TOO_LARGE: return "too large";
+    default: break;
+    }
+    if (bytes < 0) return "error";
+    return format_file_size(buf, (size_t)bytes);
+}
+
+static void du_draw_entry(WINDOW *win, int y, int width, const DuListing *listing,
+                          const DuEntry *entry, bool selected) {
+    char size_buf[32];
+    char alloc_buf[32];
+    char share[8] = "";
+    char bar[DU_BAR_WIDTH + 1];
+    long key = du_key(entry);
+    int filled = 0;
+    if (key >= 0 && listing->total > 0) {
+        double fraction = (double)key / (double)listing->total;
+        snprintf(share, sizeof(share), "%5.1f%%", fraction * 100.0);
+        filled = (int)(fraction * DU_BAR_WIDTH + 0.5);
+    }
+    for (int i = 0; i < DU_BAR_WIDTH; i++) bar[i] = i < filled ? '#' : ' ';
+    bar[DU_BAR_WIDTH] = '\0';
+
+    char line[MAX_PATH_LENGTH + 64];
+    snprintf(line, sizeof(line), "%c%11s %11s %6s [%s] %s%s", entry->updating ? '~' : ' ',
+             du_size_label(entry->size, size_buf), du_size_label(entry->allocated, alloc_buf),
+             share, bar, entry->name, entry->is_dir ? "/" : "");
+    if (selected) wattron(win, A_REVERSE);
+    mvwprintw(win, y, 2, "%-*.*s", width, width, line);
+    if (selected) wattroff(win, A_REVERSE);
+}
+
+static void du_draw(WINDOW *win, const DuListing *listing, size_t cursor, size_t scroll,
+                    const char *notice) {
+    int popup_height, popup_width;
+    getmaxyx(win, popup_height, popup_width);
+    int content_h = popup_height - 5; // title, column heads, footer, borders
+    if (content_h < 1) content_h = 1;
+    int content_w = popup_width - 4;
+    if (content_w < 1) content_w = 1;
+
+    werase(win);
+    box(win, 0, 0);
+    mvwprintw(win, 0, 2, "[ Disk usage: %.*s ]", popup_width - 20, listing->path);
+    mvwprintw(win, 1, 2, "%-*.*s", content_w, content_w,
+              du_by_disk ? "        Size       *Disk  Share" : "       *Size        Disk  Share");
+    for (int row = 0; row < content_h && scroll + (size_t)row < listing->count; row++) {
+        size_t i = scroll + (size_t)row;
+        du_draw_entry(win, 2 + row, content_w, listing, &listing->entries[i], i == cursor);
+    }
+
+    char total_buf[32];
+    char footer[256];
+    if (notice) {
+        snprintf(footer, sizeof(footer), "%s", notice);
+    } else {
+        int n = snprintf(footer, sizeof(footer), "Total %s",
+                         du_size_label(listing->total, total_buf));
+        if (listing->handle && n > 0 && (size_t)n < sizeof(footer)) {
+            n += snprintf(footer + n, sizeof(footer) - (size_t)n, " (reading, %zu so far)",
+                          listing->count);
+        } else if (listing->updating > 0 && n > 0 && (size_t)n < sizeof(footer)) {
+            n += snprintf(footer + n, sizeof(footer) - (size_t)n, " (%d updating)",
+                          listing->updating);
+        }
+        if (n > 0 && (size_t)n < sizeof(footer)) {
+            snprintf(footer + n, sizeof(footer) - (size_t)n,
+                     " | Enter=open Left=up a=size/disk Esc/q=close");
+        }
+    }
+    mvwprintw(win, popup_height - 2, 2, "%.*s", content_w, footer);
+    wrefresh(win);
+}
+
+// Keep the banner animating while the popup is open; true if it was redrawn
+// (and may have drawn over the popup).
+static bool banner_tick(struct timespec *last_banner_update, int total_scroll_length) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long banner_time_diff = (now.tv_sec - last_banner_update->tv_sec) * 1000000 +
+                            (now.tv_nsec - last_banner_update->tv_nsec) / 1000;
+    if (banner_time_diff >= BANNER_SCROLL_INTERVAL && BANNER_TEXT && bannerwin) {
+        pthread_mutex_lock(&banner_mutex);
+        draw_scrolling_banner(bannerwin, BANNER_TEXT, BUILD_INFO, banner_offset);
+        pthread_mutex_unlock(&banner_mutex);
+        banner_offset = (banner_offset + 1) % total_scroll_length;
+        *last_banner_update = now;
+        return true;
+    }
+    return false;
+}
+
+// Blocks for up to `wait_ms` until a key or a size update from the engine
+// comes in. With a negative `wait_ms` it only checks for a key.
+static int du_next_key(WINDOW *win, long wait_ms) {
+    // Keys ncurses already holds are invisible to poll(): take those first.
+    wtimeout(win, 0);
+    int ch = wgetch(win);
+    wtimeout(win, KEY_READ_TIMEOUT_MS);
+    if (ch != ERR || wait_ms < 0) return ch;
+
+    frame_sched_mark_in(0, wait_ms > 0 ? wait_ms : 1);
+    return frame_sched_wait() ? wgetch(win) : ERR;
+}
+
+void du_view_show(const char *directory) {
+    if (!directory || !*directory) return;
+    DuListing listing = {0};
+    if (!du_listing_open(&listing, directory)) return;
+
+    int max_y, max_x;
+    getmaxyx(stdscr, max_y, max_x);
+
+    // Same placement as the console: clear of the banner and notification bars
+    const int banner_height = 3;
+    const int notif_height = 1;
+    int usable_y = max_y - banner_height - notif_height;
+    if (usable_y < 8) usable_y = max_y;
+
+    int popup_height = usable_y - 2;
+    int popup_width = max_x - 6;
+    if (popup_height < 8) popup_height = 8;
+    if (popup_width < 30) popup_width = 30;
+    if (popup_height > max_y) popup_height = max_y;
+    if (popup_width > max_x) popup_width = max_x;
+
+    int starty = usable_y == max_y ? (max_y - popup_height) / 2
+                                   : banner_height + (usable_y - popup_height) / 2;
+    int startx = (max_x - popup_width) / 2;
+    if (starty < 0) starty = 0;
+    if (startx < 0) startx = 0;
+
+    WINDOW *win = newwin(popup_height, popup_width, starty, startx);
+    if (!win) {
+        du_listing_free(&listing);
+        return;
+    }
+    keypad(win, TRUE);
+
+    int content_h = popup_height - 5; // title, column heads, footer, borders
+    if (content_h < 1) content_h = 1;
+
+    size_t cursor = 0;
+    size_t scroll = 0;
+    const char *notice = NULL;
+    char came_from[MAX_PATH_LENGTH] = ""; // put the cursor here once it is read
+
+    // The main loop's directory watcher is not drained here
+    frame_sched_watch_fd(-1);
+    struct timespec last_banner_update;
+    clock_gettime(CLOCK_MONOTONIC, &last_banner_update);
+    struct timespec last_request = last_banner_update;
+    bool redraw = true;
+    int total_scroll_length = (COLS - 2) + (BANNER_TEXT ? (int)strlen(BANNER_TEXT) : 0) +
+                              (BUILD_INFO ? (int)strlen(BUILD_INFO) : 0) +
+                              BANNER_TIME_PREFIX_LEN + BANNER_TIME_LEN + 4;
+
+    for (;;) {
+        if (cursor >= listing.count) cursor = listing.count ? listing.count - 1 : 0;
+        if (cursor < scroll) scroll = cursor;
+        if (cursor >= scroll + (size_t)content_h) scroll = cursor - (size_t)content_h + 1;
+
+        if (redraw) {
+            du_draw(win, &listing, cursor, scroll, notice);
+            redraw = false;
+        }
+
+        // Wake for the banner, and to ask again for sizes still outstanding;
+        // not at all while the listing is still being read.
+        long wait_ms = BANNER_SCROLL_INTERVAL / 1000 - du_elapsed_ns(&last_banner_update) / 1000000;
+        if (listing.updating > 0) {
+            long ask_ms = (DIR_SIZE_REQUEST_DELAY_NS - du_elapsed_ns(&last_request)) / 1000000;
+            if (ask_ms < wait_ms) wait_ms = ask_ms;
+        }
+        int ch = du_next_key(win, listing.handle ? -1 : wait_ms);
+        if (banner_tick(&last_banner_update, total_scroll_length)) {
+            touchwin(win);
+            wrefresh(win);
+        }
+        if (ch != ERR) {
+            notice = NULL;
+            redraw = true;
+        }
+
+        if (ch == 27 || ch == 'q' || ch == 'Q') break;
+        if (ch == KEY_UP) {
+            if (cursor > 0) cursor--;
+        } else if (ch == KEY_DOWN) {
+            cursor++;
+        } else if (ch == KEY_PPAGE) {
+            cursor = cursor > (size_t)content_h ? cursor - (size_t)content_h : 0;
+        } else if (ch == KEY_NPAGE) {
+            cursor += (size_t)content_h;
+        } else if (ch == KEY_HOME) {
+            cursor = 0;
+        } else if (ch == KEY_END) {
+            cursor = listing.count ? listing.count - 1 : 0;
+        } else if (ch == 'a' || ch == 'A') {
+            du_by_disk = !du_by_disk;
+        } else if (ch == '\n' || ch == KEY_ENTER || ch == KEY_RIGHT) {
+            if (cursor < listing.count && listing.entries[cursor].is_dir) {
+                char child[MAX_PATH_LENGTH];
+                path_join(child, listing.path, listing.entries[cursor].name);
+                if (du_listing_open(&listing, child)) {
+                    cursor = scroll = 0;
+                } else {
+                    notice = "Cannot read that directory";
+                }
+            }
+        } else if (ch == KEY_LEFT || ch == KEY_BACKSPACE || ch == 127 || ch == 8) {
+            if (strcmp(listing.path, "/") != 0) {
+                char parent[MAX_PATH_LENGTH];
+                snprintf(parent, sizeof(parent), "%s", listing.path);
+                char *slash = strrchr(parent, '/');
+                snprintf(came_from, sizeof(came_from), "%s", slash ? slash + 1 : "");
+                if (slash == parent) slash[1] = '\0';
+                else if (slash) *slash = '\0';
+                if (du_listing_open(&listing, parent)) {
+                    cursor = scroll = 0;
+                } else {
+                    came_from[0] = '\0';
+                    notice = "Cannot read the parent directory";
+                }
+            }
+        }
+
+        // Re-sort only when entries or sizes came in (the engine posts its
+        // progress, at most once a frame) or the sort key changed.
+        bool read_more = listing.handle != NULL;
+        du_listing_step(&listing);
+        bool sized = frame_sched_begin() != 0;
+        if (listing.updating > 0 && du_elapsed_ns(&last_request) >= DIR_SIZE_REQUEST_DELAY_NS) {
+            du_listing_request(&listing);
+            clock_gettime(CLOCK_MONOTONIC, &last_request);
+        }
+        if (!read_more && !sized && !came_from[0] && ch != 'a' && ch != 'A') continue;
+        redraw = true;
+
+        // Keep the cursor on its entry as sizes come in and the order changes,
+        // unless it is still at the top
+        if (cursor >= listing.count) cursor = listing.count ? listing.count - 1 : 0;
+        const char *at_cursor = cursor > 0 && cursor < listing.count ? listing.entries[cursor].name
+                                                                     : NULL;
+        du_listing_update(&listing);
+        for (size_t i = 0; at_cursor && i < listing.count; i++) {
+            if (listing.entries[i].name == at_cursor) {
+                cursor = i;
+                break;
+            }
+        }
+        if (came_from[0]) {
+            size_t i = du_find(&listing, came_from);
+            if (i < listing.count) cursor = i;
+            if (i < listing.count || !listing.handle) came_from[0] = '\0';
+        }
+    }
+
+    dir_size_set_focus(NULL);
+    du_listing_free(&listing);
+    wtimeout(win, -1);
+    werase(win);
+    wrefresh(win);
+    delwin(win);
+    touchwin(stdscr);
+    refresh();
+}
@@ -0,0 +1,15 @@
+#ifndef DU_VIEW_H
+#define DU_VIEW_H
+
+// Disk usage breakdown (popup).
+//
+// Lists the entries of a directory by the space they take up, biggest
+// first, with their share of the total. Directories get their size from the
+// background size engine: the viewed directory is walked as the focus and
+// each subdirectory fills in as soon as its part of the walk is done; the
+// popup sleeps until the engine reports progress. A big directory is read
+// a few milliseconds at a time between keys. Keys move into a subdirectory
+// and back up, and toggle between apparent size and disk blocks.
+void du_view_show(const char *directory);
+
+#endif // DU_VIEW_H
@@ -0,0 +1,240 @@
+// File: preview_cache.c
+// LRU of highlighted text preview windows
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "preview_cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    size_t text_off;
+    size_t run_off;
+    size_t run_count;
+} FrameLine;
+
+struct PreviewFrame {
+    int start_line;
+    int width;
+    bool at_end;
+
+    FrameLine *lines;
+    size_t line_count;
+    size_t line_cap;
+    char *text;
+    size_t text_len;
+    size_t text_cap;
+    PreviewRun *runs;
+    size_t run_count;
+    size_t run_cap;
+};
+
+typedef struct {
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    PreviewFrame *frame;
+    size_t bytes;
+} PreviewEntry;
+
+struct PreviewCache {
+    PreviewEntry *entries; // most recently used first
+    size_t count;
+    size_t max_entries;
+    size_t bytes;
+    size_t max_bytes;
+};
+
+// Grows `*buf` to hold at least `need` items of `size` bytes.
+static bool reserve(void **buf, size_t *cap, size_t need, size_t size) {
+    if (need <= *cap) return true;
+    size_t cap_new = *cap ? *cap * 2 : 16;
+    while (cap_new < need) cap_new *= 2;
+    void *grown = realloc(*buf, cap_new * size);
+    if (!grown) return false;
+    *buf = grown;
+    *cap = cap_new;
+    return true;
+}
+
+PreviewFrame *preview_frame_new(int start_line, int width) {
+    PreviewFrame *frame = calloc(1, sizeof(*frame));
+    if (!frame) return NULL;
+    frame->start_line = start_line;
+    frame->width = width;
+    return frame;
+}
+
+void preview_frame_free(PreviewFrame *frame) {
+    if (!frame) return;
+    free(frame->lines);
+    free(frame->text);
+    free(frame->runs);
+    free(frame);
+}
+
+bool preview_frame_add_line(PreviewFrame *frame, const chtype *cells, int count, chtype blank) {
+    while (count > 0 && cells[count - 1] == blank) count--;
+    if (!reserve((void **)&frame->lines, &frame->line_cap, frame->line_count + 1,
+                 sizeof(*frame->lines)) ||
+        !reserve((void **)&frame->text, &frame->text_cap, frame->text_len + (size_t)count,
+                 sizeof(*frame->text))) {
+        return false;
+    }
+
+    FrameLine *line = &frame->lines[frame->line_count];
+    line->text_off = frame->text_len;
+    line->run_off = frame->run_count;
+    line->run_count = 0;
+    for (int i = 0; i < count; i++) {
+        attr_t attr = cells[i] & A_ATTRIBUTES;
+        PreviewRun *last = line->run_count ? &frame->runs[frame->run_count - 1] : NULL;
+        if (last && last->attr == attr) {
+            last->len++;
+        } else {
+            if (!reserve((void **)&frame->runs, &frame->run_cap, frame->run_count + 1,
+                         sizeof(*frame->runs))) {
+                frame->run_count = line->run_off;
+                return false;
+            }
+            frame->runs[frame->run_count++] = (PreviewRun){attr, 1};
+            line->run_count++;
+        }
+        frame->text[frame->text_len + (size_t)i] = (char)(cells[i] & A_CHARTEXT);
+    }
+    frame->text_len += (size_t)count;
+    frame->line_count++;
+    return true;
+}
+
+void preview_frame_set_end(PreviewFrame *frame, bool at_end) {
+    frame->at_end = at_end;
+}
+
+int preview_frame_line_count(const PreviewFrame *frame) {
+    return (int)frame->line_count;
+}
+
+bool preview_frame_at_end(const PreviewFrame *frame, int rows) {
+    return frame->at_end && frame->line_count <= (size_t)rows;
+}
+
+const char *preview_frame_line(const PreviewFrame *frame, int i, const PreviewRun **runs,
+                               size_t *run_count) {
+    const FrameLine *line = &frame->lines[i];
+    *runs = frame->runs + line->run_off;
+    *run_count = line->run_count;
+    return frame->text + line->text_off;
+}
+
+static size_t frame_bytes(const PreviewFrame *frame) {
+    return sizeof(*frame) + frame->line_cap * sizeof(*frame->lines) + frame->text_cap +
+           frame->run_cap * sizeof(*frame->runs);
+}
+
+PreviewCache *preview_cache_new(size_t max_entries, size_t max_bytes) {
+    PreviewCache *cache = calloc(1, sizeof(*cache));
+    if (!cache) return NULL;
+    cache->max_entries = max_entries ? max_entries : 1;
+    cache->entries = calloc(cache->max_entries, sizeof(*cache->entries));
+    if (!cache->entries) {
+        free(cache);
+        return NULL;
+    }
+    cache->max_bytes = max_bytes;
+    return cache;
+}
+
+static void cache_evict(PreviewCache *cache, size_t i) {
+    preview_frame_free(cache->entries[i].frame);
+    free(cache->entries[i].path);
+    cache->bytes -= cache->entries[i].bytes;
+    memmove(&cache->entries[i], &cache->entries[i + 1],
+            (cache->count - i - 1) * sizeof(cache->entries[0]));
+    cache->count--;
+}
+
+void preview_cache_free(PreviewCache *cache) {
+    if (!cache) return;
+    while (cache->count > 0) {
+        cache_evict(cache, cache->count - 1);
+    }
+    free(cache->entries);
+    free(cache);
+}
+
+static size_t cache_find(const PreviewCache *cache, const char *path) {
+    for (size_t i = 0; i < cache->count; i++) {
+        if (strcmp(cache->entries[i].path, path) == 0) return i;
+    }
+    return (size_t)-1;
+}
+
+static bool entry_matches(const PreviewEntry *entry, const struct stat *st) {
+    return st->st_dev == entry->dev && st->st_ino == entry->ino && st->st_size == entry->size &&
+           st->st_mtim.tv_sec == entry->mtime.tv_sec &&
+           st->st_mtim.tv_nsec == entry->mtime.tv_nsec;
+}
+
+const PreviewFrame *preview_cache_get(PreviewCache *cache, const char *path,
+                                      const struct stat *st, int start_line,
+                                      int width, int rows) {
+    if (!cache || !path) return NULL;
+    size_t i = cache_find(cache, path);
+    if (i == (size_t)-1) return NULL;
+    if (!entry_matches(&cache->entries[i], st)) {
+        cache_evict(cache, i); // the file changed: the frame is useless
+        return NULL;
+    }
+
+    const PreviewFrame *frame = cache->entries[i].frame;
+    if (frame->start_line != start_line || frame->width != width ||
+        (frame->line_count < (size_t)rows && !frame->at_end)) {
+        return NULL;
+    }
+
+    // Move to the front
+    PreviewEntry hit = cache->entries[i];
+    memmove(&cache->entries[1], &cache->entries[0], i * sizeof(cache->entries[0]));
+    cache->entries[0] = hit;
+    return frame;
+}
+
+void preview_cache_put(PreviewCache *cache, const char *path, const struct stat *st,
+                       PreviewFrame *frame) {
+    if (!frame) return;
+    PreviewEntry entry = {
+        .path = cache && path ? strdup(path) : NULL,
+        .dev = st->st_dev,
+        .ino = st->st_ino,
+        .size = st->st_size,
+        .mtime = st->st_mtim,
+        .frame = frame,
+    };
+    if (!entry.path) {
+        preview_frame_free(frame);
+        return;
+    }
+    entry.bytes = sizeof(entry) + strlen(path) + 1 + frame_bytes(frame);
+
+    size_t old = cache_find(cache, path);
+    if (old != (size_t)-1) cache_evict(cache, old);
+    if (entry.bytes > cache->max_bytes) {
+        free(entry.path);
+        preview_frame_free(frame);
+        return;
+    }
+    while (cache->count > 0 &&
+           (cache->count >= cache->max_entries || cache->bytes + entry.bytes > cache->max_bytes)) {
+        cache_evict(cache, cache->count - 1);
+    }
+
+    memmove(&cache->entries[1], &cache->entries[0], cache->count * sizeof(cache->entries[0]));
+    cache->entries[0] = entry;
+    cache->count++;
+    cache->bytes += entry.bytes;
+}
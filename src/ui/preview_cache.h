@@ -0,0 +1,66 @@
+#ifndef PREVIEW_CACHE_H
+#define PREVIEW_CACHE_H
+
+#include <ncurses.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+// Already highlighted text preview windows of recently previewed files.
+//
+// A frame is what the text area of the preview pane showed for one file:
+// the lines from `start_line` on, cut to `width` columns, each stored as its
+// characters plus runs of curses attributes. Showing the same window of the
+// same file again draws the frame back without opening, reading or
+// highlighting the file. A frame is tied to the file's device, inode, size
+// and mtime, and dropped as soon as any of them changes.
+//
+// One frame per path; bounded by entry count and by memory, least recently
+// used frames go first.
+typedef struct PreviewCache PreviewCache;
+typedef struct PreviewFrame PreviewFrame;
+
+// `len` characters drawn with `attr` (attributes and color pair).
+typedef struct {
+    attr_t attr;
+    unsigned len;
+} PreviewRun;
+
+PreviewCache *preview_cache_new(size_t max_entries, size_t max_bytes);
+void preview_cache_free(PreviewCache *cache);
+
+// Returns the frame of `path` that starts at `start_line`, is `width`
+// columns wide and can fill `rows` rows, if `st` still describes the file it
+// was built from. The frame stays owned by the cache and valid until the
+// next preview_cache_put().
+const PreviewFrame *preview_cache_get(PreviewCache *cache, const char *path,
+                                      const struct stat *st, int start_line,
+                                      int width, int rows);
+
+// Stores `frame` as the frame of `path` (described by `st`), replacing any
+// older one. Takes ownership; a frame that can never fit is freed.
+void preview_cache_put(PreviewCache *cache, const char *path, const struct stat *st,
+                       PreviewFrame *frame);
+
+PreviewFrame *preview_frame_new(int start_line, int width);
+void preview_frame_free(PreviewFrame *frame);
+
+// Appends a line read back from the screen (e.g. with winchnstr()). Trailing
+// cells equal to `blank`, the window background, are dropped.
+bool preview_frame_add_line(PreviewFrame *frame, const chtype *cells, int count, chtype blank);
+
+// Records whether the file ended right after the frame's last line.
+void preview_frame_set_end(PreviewFrame *frame, bool at_end);
+
+int preview_frame_line_count(const PreviewFrame *frame);
+
+// True if a window of `rows` rows showing this frame reaches the end of
+// the file.
+bool preview_frame_at_end(const PreviewFrame *frame, int rows);
+
+// Characters of line `i`; *runs and *run_count describe their attributes,
+// the run lengths adding up to the number of characters.
+const char *preview_frame_line(const PreviewFrame *frame, int i, const PreviewRun **runs,
+                               size_t *run_count);
+
+#endif // PREVIEW_CACHE_H
@@ -0,0 +1,746 @@
+// File: preview_worker.c
+// Background building of preview contents with cancellation
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "preview_worker.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../cupidarchive/cupidarchive.h"
+#include "files.h"
+#include "frame_sched.h"
+#include "globals.h"
+#include "mime.h"
+#include "syntax.h"
+#include "text_view.h"
+
+#define DIRECTORY_TREE_MAX_DEPTH 4
+#define DIRECTORY_TREE_MAX_TOTAL 1500
+#define ARCHIVE_PREVIEW_MAX_ENTRIES 1000 // Limit entries to prevent UI overload
+// Longest part of a line the text preview reads; the rest is off screen.
+#define PREVIEW_LINE_MAX 4096
+// How long preview_worker_get_wait() stops waiting after a wait ran out.
+#define PREVIEW_WAIT_BACKOFF_MS 500
+
+typedef struct {
+    char path[MAX_PATH_LENGTH];
+    struct stat st;
+    int start_line;
+    int width;
+    int rows;
+} PreviewJob;
+
+// One content being built by a worker.
+typedef struct {
+    PreviewContent *content;
+    unsigned long generation;
+    int line_cap;
+    int tree_count;       // tree entries walked, shown or skipped
+    bool tree_limit_hit;
+} PreviewBuild;
+
+static pthread_mutex_t worker_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t worker_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t current_done_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t workers[PREVIEW_WORKERS];
+static int worker_count = 0;
+static bool workers_stopping = false;
+static unsigned long generation = 0; // bumped by every request; read by jobs
+static PreviewJob current;           // the latest request, until it is finished
+static bool current_active = false;
+static bool current_queued = false;  // not yet taken by a worker
+static PreviewContent **finished = NULL; // built, not yet collected by the UI
+static size_t finished_count = 0;
+static size_t finished_cap = 0;
+
+// The text file being scrolled keeps its line index and block comment
+// checkpoints between jobs. A worker takes them out of the slot while
+// reading, so they are never shared.
+static pthread_mutex_t view_mutex = PTHREAD_MUTEX_INITIALIZER;
+static TextView *kept_view = NULL;
+static SyntaxCheckpoints kept_comments;
+static char kept_view_path[MAX_PATH_LENGTH];
+
+// UI thread only: finished contents, most recently used first.
+static PreviewContent *results[PREVIEW_RESULTS_MAX_ENTRIES];
+static size_t result_count = 0;
+static size_t result_bytes = 0;
+static struct timespec wait_backoff_until;
+
+static void content_free(PreviewContent *content) {
+    if (!content) return;
+    for (int i = 0; i < content->line_count; i++) free(content->lines[i].text);
+    free(content->lines);
+    free(content->path);
+    free(content);
+}
+
+static bool same_identity(const PreviewContent *content, const struct stat *st) {
+    return content->dev == st->st_dev && content->ino == st->st_ino &&
+           content->size == st->st_size && content->mtime.tv_sec == st->st_mtim.tv_sec &&
+           content->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static bool same_job(const PreviewJob *a, const PreviewJob *b) {
+    return strcmp(a->path, b->path) == 0 && a->st.st_dev == b->st.st_dev &&
+           a->st.st_ino == b->st.st_ino && a->st.st_size == b->st.st_size &&
+           a->st.st_mtim.tv_sec == b->st.st_mtim.tv_sec &&
+           a->st.st_mtim.tv_nsec == b->st.st_mtim.tv_nsec && a->start_line == b->start_line &&
+           a->width == b->width && a->rows == b->rows;
+}
+
+static bool build_cancelled(const PreviewBuild *build) {
+    return __atomic_load_n(&generation, __ATOMIC_RELAXED) != build->generation ||
+           __atomic_load_n(&workers_stopping, __ATOMIC_RELAXED);
+}
+
+// Appends a line; returns false once the window is full (noting that more
+// follows) or memory runs out.
+static bool add_line(PreviewBuild *build, int indent, const char *tail, const char *text) {
+    PreviewContent *content = build->content;
+    if (content->line_count >= build->line_cap) {
+        content->more = true;
+        return false;
+    }
+    char *copy = strdup(text);
+    if (!copy) return false;
+    PreviewLine *line = &content->lines[content->line_count++];
+    line->indent = indent;
+    line->text = copy;
+    snprintf(line->tail, sizeof(line->tail), "%s", tail ? tail : "");
+    content->bytes += sizeof(*line) + strlen(copy) + 1;
+    return true;
+}
+
+static bool window_full(const PreviewBuild *build) {
+    return build->content->line_count >= build->line_cap;
+}
+
+// ---------------------------------------------------------------------------
+// Text
+// ---------------------------------------------------------------------------
+
+static TextView *view_checkout(const char *path, const struct stat *st,
+                               SyntaxCheckpoints *comments) {
+    TextView *view = NULL;
+    syntax_checkpoints_init(comments);
+    pthread_mutex_lock(&view_mutex);
+    if (kept_view && strcmp(kept_view_path, path) == 0 && text_view_matches(kept_view, st)) {
+        view = kept_view;
+        kept_view = NULL;
+        *comments = kept_comments;
+        syntax_checkpoints_init(&kept_comments);
+    }
+    pthread_mutex_unlock(&view_mutex);
+    return view ? view : text_view_open(path);
+}
+
+static void view_checkin(const char *path, TextView *view, SyntaxCheckpoints *comments) {
+    pthread_mutex_lock(&view_mutex);
+    TextView *old = kept_view;
+    SyntaxCheckpoints old_comments = kept_comments;
+    kept_view = view;
+    kept_comments = *comments;
+    snprintf(kept_view_path, sizeof(kept_view_path), "%s", path);
+    pthread_mutex_unlock(&view_mutex);
+    text_view_close(old);
+    syntax_checkpoints_free(&old_comments);
+}
+
+// Feeds the lines above the window to the comment checkpoints. They are
+// asked for in order, so each one is a single text_view_next().
+typedef struct {
+    PreviewBuild *build;
+    TextView *view;
+    TextViewPos at;
+    bool positioned;
+    char line[PREVIEW_LINE_MAX];
+} CommentScan;
+
+static const char *comment_scan_line(void *ctx, int index) {
+    CommentScan *scan = ctx;
+    if (build_cancelled(scan->build)) return NULL;
+    if (!scan->positioned || scan->at.line != (size_t)index) {
+        if (!text_view_seek(scan->view, (size_t)index, &scan->at)) return NULL;
+        scan->positioned = true;
+    }
+    if (!text_view_next(scan->view, &scan->at, scan->line, sizeof(scan->line), NULL)) {
+        return NULL;
+    }
+    return scan->line;
+}
+
+static void build_text(PreviewBuild *build, const PreviewJob *job) {
+    PreviewContent *content = build->content;
+    SyntaxCheckpoints comments;
+    TextView *view = view_checkout(job->path, &job->st, &comments);
+    if (!view) {
+        content->kind = PREVIEW_KIND_MESSAGE;
+        add_line(build, 0, NULL, "Unable to open file for preview");
+        return;
+    }
+
+    content->kind = PREVIEW_KIND_TEXT;
+    SyntaxDef *syntax = syntax_get_for_file(job->path);
+    if (syntax && job->start_line > 0) {
+        CommentScan scan = {.build = build, .view = view};
+        content->comment_state = syntax_checkpoints_state(&comments, syntax, job->start_line,
+                                                          comment_scan_line, &scan);
+    }
+
+    // Read only the lines that fit, starting at start_line
+    TextViewPos at;
+    if (text_view_seek(view, (size_t)job->start_line, &at)) {
+        char line[PREVIEW_LINE_MAX];
+        while (!window_full(build) && !build_cancelled(build) &&
+               text_view_next(view, &at, line, sizeof(line), NULL)) {
+            // Clean up non-printable characters
+            for (char *p = line; *p; p++) {
+                unsigned char c = (unsigned char)*p;
+                if (c == '\t') {
+                    *p = ' ';
+                } else if (isspace(c) && c != ' ') {
+                    *p = ' ';
+                } else if (!isprint(c)) {
+                    *p = ' ';
+                }
+            }
+            if (!add_line(build, 0, NULL, line)) break;
+        }
+        content->more = text_view_has_line(view, at.line);
+    }
+    view_checkin(job->path, view, &comments);
+}
+
+// ---------------------------------------------------------------------------
+// Directory tree
+// ---------------------------------------------------------------------------
+
+static bool tree_child_path(char *out, const char *dir_path, const char *name) {
+    size_t len = strlen(dir_path);
+    size_t name_len = strlen(name);
+    if (len + name_len + 2 > MAX_PATH_LENGTH) return false;
+    memcpy(out, dir_path, len);
+    if (len == 0 || out[len - 1] != '/') out[len++] = '/';
+    memcpy(out + len, name, name_len + 1);
+    return true;
+}
+
+static void build_tree(PreviewBuild *build, const char *dir_path, int level, int start_line,
+                       int width) {
+    if (window_full(build) || build_cancelled(build)) return;
+
+    DIR *dir = opendir(dir_path);
+    if (!dir) return;
+
+    struct dirent *entry;
+    struct stat statbuf;
+    char full_path[MAX_PATH_LENGTH];
+
+    const int WINDOW_SIZE = 50;
+
+    struct {
+        char name[MAX_PATH_LENGTH];
+        bool is_dir;
+        mode_t mode;
+    } entries[WINDOW_SIZE];
+    int entry_count = 0;
+
+    while ((entry = readdir(dir)) != NULL && entry_count < WINDOW_SIZE) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        if (!tree_child_path(full_path, dir_path, entry->d_name)) continue;
+        if (lstat(full_path, &statbuf) == -1) continue;
+
+        snprintf(entries[entry_count].name, MAX_PATH_LENGTH, "%s", entry->d_name);
+        entries[entry_count].is_dir = S_ISDIR(statbuf.st_mode);
+        entries[entry_count].mode = statbuf.st_mode;
+        entry_count++;
+    }
+    closedir(dir);
+
+    if (entry_count == 0) {
+        if (build->tree_count >= start_line) {
+            add_line(build, level * 2, NULL, "[Empty directory]");
+        }
+        build->tree_count++;
+        return;
+    }
+
+    for (int i = 0; i < entry_count; i++) {
+        if (build_cancelled(build)) return;
+        bool has_path = tree_child_path(full_path, dir_path, entries[i].name);
+
+        if (build->tree_count < start_line) {
+            build->tree_count++;
+            if (entries[i].is_dir && level < DIRECTORY_TREE_MAX_DEPTH && has_path) {
+                build_tree(build, full_path, level + 1, start_line, width);
+            }
+            continue;
+        }
+
+        if (window_full(build)) {
+            build->content->more = true;
+            break;
+        }
+
+        struct stat link_statbuf;
+        bool has_stat = has_path && lstat(full_path, &link_statbuf) == 0;
+        bool is_symlink = has_stat && S_ISLNK(link_statbuf.st_mode);
+        char symlink_target[MAX_PATH_LENGTH] = {0};
+
+        if (is_symlink) {
+            ssize_t target_len = readlink(full_path, symlink_target, sizeof(symlink_target) - 1);
+            if (target_len > 0) {
+                symlink_target[target_len] = '\0';
+            }
+        }
+
+        // The content is kept, so resolve the real type now rather than
+        // settling for the extension guess.
+        const char *emoji;
+        char mime_type[96];
+        if (entries[i].is_dir) {
+            emoji = "📁";
+        } else if (has_stat && mime_cached_type(full_path, &link_statbuf, mime_type, sizeof(mime_type))) {
+            emoji = get_file_emoji(mime_type, entries[i].name);
+        } else if (has_path) {
+            emoji = get_file_emoji(NULL, entries[i].name);
+        } else {
+            emoji = "📄";
+        }
+
+        int available_width = width - level * 2 - 10;
+        if (available_width < 0) available_width = 0;
+        int name_len = (int)strlen(entries[i].name);
+        int display_len = name_len + (is_symlink ? (4 + (int)strlen(symlink_target)) : 0);
+
+        char text[2 * MAX_PATH_LENGTH + 16];
+        if (display_len > available_width) {
+            if (is_symlink && strlen(symlink_target) > 0) {
+                int name_part = available_width / 2;
+                int target_part = available_width - name_part - 4;
+                if (target_part < 0) target_part = 0;
+                snprintf(text, sizeof(text), "%s %.*s -> %.*s...",
+                         emoji, name_part, entries[i].name, target_part, symlink_target);
+            } else {
+                snprintf(text, sizeof(text), "%s %.*s", emoji, available_width, entries[i].name);
+            }
+        } else {
+            if (is_symlink && strlen(symlink_target) > 0) {
+                snprintf(text, sizeof(text), "%s %s -> %s", emoji, entries[i].name, symlink_target);
+            } else {
+                snprintf(text, sizeof(text), "%s %.*s", emoji, available_width, entries[i].name);
+            }
+        }
+
+        char perm[10];
+        snprintf(perm, sizeof(perm), "%o", entries[i].mode & 0777);
+        if (!add_line(build, level * 2, perm, text)) break;
+        build->tree_count++;
+        if (build->tree_count >= DIRECTORY_TREE_MAX_TOTAL) {
+            build->tree_limit_hit = true;
+            break;
+        }
+
+        if (entries[i].is_dir && !window_full(build) && level < DIRECTORY_TREE_MAX_DEPTH &&
+            has_path) {
+            build_tree(build, full_path, level + 1, start_line, width);
+            if (build->tree_limit_hit) {
+                break;
+            }
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Archives
+// ---------------------------------------------------------------------------
+
+static void build_archive(PreviewBuild *build, const PreviewJob *job) {
+    PreviewContent *content = build->content;
+    const char *file_path = job->path;
+
+    // Check if this is a single compressed file (not a TAR archive)
+    bool is_single_compressed = false;
+    const char *ext = strrchr(file_path, '.');
+    if (ext) {
+        if (strcmp(ext, ".gz") == 0 || strcmp(ext, ".bz2") == 0 || strcmp(ext, ".xz") == 0) {
+            // Check if it's NOT a .tar.gz, .tar.bz2, etc.
+            const char *tar_pos = strstr(file_path, ".tar");
+            if (!tar_pos || tar_pos >= ext) {
+                is_single_compressed = true;
+            }
+        }
+    }
+
+    ArcReader *reader = arc_open_path(file_path);
+    if (!reader) {
+        // Show more detailed error message
+        char error_msg[256];
+        snprintf(error_msg, sizeof(error_msg), "Unable to open archive: %s (errno: %s)",
+                 file_path, strerror(errno));
+        content->kind = PREVIEW_KIND_MESSAGE;
+        add_line(build, 0, NULL, error_msg);
+        return;
+    }
+
+    content->kind = PREVIEW_KIND_ARCHIVE;
+    content->title = is_single_compressed ? "📦 Compressed File Contents:" : "📦 Archive Contents:";
+    add_line(build, 0, NULL, "─────────────────────────────────────");
+
+    ArcEntry entry;
+    int current_line = 0;
+    int entry_count = 0;
+
+    // Skip entries until start_line (accounting for header lines)
+    int header_lines = 2; // "Archive Contents:" and separator line
+    int adjusted_start_line = job->start_line > header_lines ? job->start_line - header_lines : 0;
+
+    while (current_line < adjusted_start_line && entry_count < ARCHIVE_PREVIEW_MAX_ENTRIES &&
+           !build_cancelled(build)) {
+        if (arc_next(reader, &entry) != 0) {
+            break; // Done or error
+        }
+        arc_entry_free(&entry);
+        current_line++;
+        entry_count++;
+    }
+
+    bool found_any = false;
+    while (entry_count < ARCHIVE_PREVIEW_MAX_ENTRIES && !build_cancelled(build)) {
+        int ret = arc_next(reader, &entry);
+        if (ret != 0) {
+            // For compressed files, silently fail (they're not really archives)
+            if (ret == 1 && !found_any && !is_single_compressed) {
+                add_line(build, 0, NULL, "Archive appears empty (may be corrupted or invalid)");
+            }
+            break; // Done
+        }
+        found_any = true;
+
+        // Skip entries without paths (shouldn't happen, but be safe)
+        if (!entry.path) {
+            arc_entry_free(&entry);
+            entry_count++;
+            continue;
+        }
+        if (window_full(build)) {
+            content->more = true;
+            arc_entry_free(&entry);
+            break;
+        }
+
+        const char *type_icon = "📄";
+        if (entry.type == ARC_ENTRY_DIR) {
+            type_icon = "📁";
+        } else if (entry.type == ARC_ENTRY_SYMLINK || entry.type == ARC_ENTRY_HARDLINK) {
+            type_icon = "🔗";
+        }
+
+        char size_str[20];
+        if (entry.type == ARC_ENTRY_DIR) {
+            snprintf(size_str, sizeof(size_str), "<DIR>");
+        } else if (entry.size == 0) {
+            // Unknown size (e.g., compressed single files like .gz, .bz2)
+            snprintf(size_str, sizeof(size_str), "?");
+        } else {
+            format_file_size(size_str, entry.size);
+        }
+
+        char entry_line[256];
+        if (entry.type == ARC_ENTRY_SYMLINK && entry.link_target) {
+            snprintf(entry_line, sizeof(entry_line), "%s %-40s %10s -> %s", type_icon,
+                     entry.path, size_str, entry.link_target);
+        } else {
+            snprintf(entry_line, sizeof(entry_line), "%s %-40s %10s", type_icon, entry.path,
+                     size_str);
+        }
+        if (job->width >= 0 && (int)strlen(entry_line) > job->width) {
+            entry_line[job->width] = '\0';
+        }
+        add_line(build, 0, NULL, entry_line);
+
+        arc_entry_free(&entry);
+        entry_count++;
+    }
+
+    if (entry_count >= ARCHIVE_PREVIEW_MAX_ENTRIES) {
+        char note[64];
+        snprintf(note, sizeof(note), "... (showing first %d entries)", ARCHIVE_PREVIEW_MAX_ENTRIES);
+        add_line(build, 0, NULL, note);
+    }
+
+    arc_close(reader);
+}
+
+// ---------------------------------------------------------------------------
+// Workers
+// ---------------------------------------------------------------------------
+
+static PreviewContent *build_content(const PreviewJob *job, unsigned long gen) {
+    PreviewContent *content = calloc(1, sizeof(*content));
+    int line_cap = job->rows > 0 ? job->rows : 0;
+    if (content) {
+        content->path = strdup(job->path);
+        content->lines = calloc((size_t)line_cap + 1, sizeof(*content->lines));
+    }
+    if (!content || !content->path || !content->lines) {
+        content_free(content);
+        return NULL;
+    }
+    content->dev = job->st.st_dev;
+    content->ino = job->st.st_ino;
+    content->size = job->st.st_size;
+    content->mtime = job->st.st_mtim;
+    content->start_line = job->start_line;
+    content->width = job->width;
+    content->rows = job->rows;
+    content->bytes = sizeof(*content) + strlen(job->path) + 1 +
+                     ((size_t)line_cap + 1) * sizeof(*content->lines);
+
+    PreviewBuild build = {.content = content, .generation = gen, .line_cap = line_cap};
+
+    const char *mime_type = mime_detect(job->path, false);
+    snprintf(content->mime, sizeof(content->mime), "%s", mime_type ? mime_type : "");
+
+    if (S_ISDIR(job->st.st_mode)) {
+        content->kind = PREVIEW_KIND_TREE;
+        content->title = "Directory Tree Preview:";
+        build_tree(&build, job->path, 0, job->start_line, job->width);
+        if (build.tree_limit_hit) {
+            add_line(&build, 0, NULL, "[Preview truncated]");
+        }
+    } else if (is_archive_file(job->path)) {
+        build_archive(&build, job);
+    } else if (is_supported_file_type(job->path)) {
+        build_text(&build, job);
+    } else {
+        content->kind = PREVIEW_KIND_NONE;
+        add_line(&build, 0, NULL, "No preview available");
+    }
+    return content;
+}
+
+static void *preview_worker_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&worker_mutex);
+    for (;;) {
+        while (!workers_stopping && !current_queued) {
+            pthread_cond_wait(&worker_cond, &worker_mutex);
+        }
+        if (workers_stopping) break;
+
+        PreviewJob job = current;
+        unsigned long gen = generation;
+        current_queued = false;
+        pthread_mutex_unlock(&worker_mutex);
+
+        PreviewBuild probe = {.generation = gen};
+        PreviewContent *content = build_content(&job, gen);
+        bool cancelled = build_cancelled(&probe);
+
+        pthread_mutex_lock(&worker_mutex);
+        if (cancelled || gen != generation) {
+            content_free(content);
+            continue;
+        }
+        current_active = false;
+        pthread_cond_broadcast(&current_done_cond);
+        if (content && finished_count == finished_cap) {
+            size_t cap = finished_cap ? finished_cap * 2 : 4;
+            PreviewContent **grown = realloc(finished, cap * sizeof(*grown));
+            if (grown) {
+                finished = grown;
+                finished_cap = cap;
+            }
+        }
+        if (content && finished_count < finished_cap) {
+            finished[finished_count++] = content;
+        } else {
+            content_free(content);
+        }
+        pthread_mutex_unlock(&worker_mutex);
+        frame_sched_post(FRAME_PREVIEW);
+        pthread_mutex_lock(&worker_mutex);
+    }
+    pthread_mutex_unlock(&worker_mutex);
+    return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// UI side
+// ---------------------------------------------------------------------------
+
+static void result_remove(size_t i) {
+    result_bytes -= results[i]->bytes;
+    content_free(results[i]);
+    memmove(&results[i], &results[i + 1], (result_count - i - 1) * sizeof(results[0]));
+    result_count--;
+}
+
+static void result_to_front(size_t i) {
+    PreviewContent *hit = results[i];
+    memmove(&results[1], &results[0], i * sizeof(results[0]));
+    results[0] = hit;
+}
+
+static void result_add(PreviewContent *content) {
+    if (content->bytes > PREVIEW_RESULTS_MAX_BYTES) {
+        content_free(content);
+        return;
+    }
+    while (result_count > 0 && (result_count >= PREVIEW_RESULTS_MAX_ENTRIES ||
+                                result_bytes + content->bytes > PREVIEW_RESULTS_MAX_BYTES)) {
+        result_remove(result_count - 1);
+    }
+    memmove(&results[1], &results[0], result_count * sizeof(results[0]));
+    results[0] = content;
+    result_count++;
+    result_bytes += content->bytes;
+}
+
+// Moves what the workers finished into the results.
+static void collect_finished(void) {
+    pthread_mutex_lock(&worker_mutex);
+    for (size_t i = 0; i < finished_count; i++) {
+        result_add(finished[i]);
+    }
+    finished_count = 0;
+    pthread_mutex_unlock(&worker_mutex);
+}
+
+const PreviewContent *preview_worker_get(const char *path, const struct stat *st,
+                                         int start_line, int width, int rows) {
+    if (!path || !st) return NULL;
+    collect_finished();
+    for (size_t i = 0; i < result_count; i++) {
+        PreviewContent *content = results[i];
+        if (strcmp(content->path, path) != 0) continue;
+        if (!same_identity(content, st)) {
+            result_remove(i--); // the file changed since
+            continue;
+        }
+        if (content->start_line == start_line && content->width == width &&
+            content->rows == rows) {
+            result_to_front(i);
+            return results[0];
+        }
+    }
+    return NULL;
+}
+
+const PreviewContent *preview_worker_latest(const char *path, const struct stat *st) {
+    if (!path || !st) return NULL;
+    collect_finished();
+    for (size_t i = 0; i < result_count; i++) {
+        if (strcmp(results[i]->path, path) == 0 && same_identity(results[i], st)) {
+            return results[i];
+        }
+    }
+    return NULL;
+}
+
+void preview_worker_request(const char *path, const struct stat *st,
+                            int start_line, int width, int rows) {
+    if (!path || !st || strlen(path) >= MAX_PATH_LENGTH) return;
+    PreviewJob job = {.st = *st, .start_line = start_line, .width = width, .rows = rows};
+    memcpy(job.path, path, strlen(path) + 1);
+
+    pthread_mutex_lock(&worker_mutex);
+    if (current_active && same_job(&current, &job)) {
+        pthread_mutex_unlock(&worker_mutex);
+        return;
+    }
+    __atomic_add_fetch(&generation, 1, __ATOMIC_RELAXED);
+    current = job;
+    current_active = true;
+    current_queued = true;
+    while (worker_count < PREVIEW_WORKERS) {
+        if (pthread_create(&workers[worker_count], NULL, preview_worker_main, NULL) != 0) break;
+        worker_count++;
+    }
+    pthread_cond_signal(&worker_cond);
+    pthread_mutex_unlock(&worker_mutex);
+}
+
+void preview_worker_shutdown(void) {
+    pthread_mutex_lock(&worker_mutex);
+    __atomic_store_n(&workers_stopping, true, __ATOMIC_RELAXED);
+    pthread_cond_broadcast(&worker_cond);
+    int count = worker_count;
+    pthread_mutex_unlock(&worker_mutex);
+
+    for (int i = 0; i < count; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    pthread_mutex_lock(&worker_mutex);
+    worker_count = 0;
+    workers_stopping = false;
+    current_active = false;
+    current_queued = false;
+    for (size_t i = 0; i < finished_count; i++) content_free(finished[i]);
+    free(finished);
+    finished = NULL;
+    finished_count = finished_cap = 0;
+    pthread_mutex_unlock(&worker_mutex);
+
+    while (result_count > 0) result_remove(result_count - 1);
+    text_view_close(kept_view);
+    kept_view = NULL;
+    syntax_checkpoints_free(&kept_comments);
+}
+
+const PreviewContent *preview_worker_get_wait(const char *path, const struct stat *st,
+                                              int start_line, int width, int rows,
+                                              long timeout_ms) {
+    const PreviewContent *content = preview_worker_get(path, st, start_line, width, rows);
+    if (content || !path || !st) return content;
+    preview_worker_request(path, st, start_line, width, rows);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (now.tv_sec < wait_backoff_until.tv_sec ||
+        (now.tv_sec == wait_backoff_until.tv_sec && now.tv_nsec < wait_backoff_until.tv_nsec)) {
+        return NULL;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&worker_mutex);
+    int rc = 0;
+    while (current_active && rc != ETIMEDOUT) {
+        rc = pthread_cond_timedwait(&current_done_cond, &worker_mutex, &deadline);
+    }
+    bool done = !current_active;
+    pthread_mutex_unlock(&worker_mutex);
+
+    if (!done) {
+        wait_backoff_until = now;
+        wait_backoff_until.tv_sec += PREVIEW_WAIT_BACKOFF_MS / 1000;
+        wait_backoff_until.tv_nsec += (PREVIEW_WAIT_BACKOFF_MS % 1000) * 1000000L;
+        if (wait_backoff_until.tv_nsec >= 1000000000L) {
+            wait_backoff_until.tv_sec++;
+            wait_backoff_until.tv_nsec -= 1000000000L;
+        }
+        return NULL;
+    }
+    return preview_worker_get(path, st, start_line, width, rows);
+}
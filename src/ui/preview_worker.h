@@ -0,0 +1,81 @@
+#ifndef PREVIEW_WORKER_H
+#define PREVIEW_WORKER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+// Preview contents are built off the UI thread.
+//
+// The preview pane asks for a window of a file or directory with
+// preview_worker_request(). One of PREVIEW_WORKERS threads detects its MIME
+// type and reads what the window shows (text lines, directory tree or
+// archive listing), then posts FRAME_PREVIEW. Every request cancels the
+// ones before it: running jobs check between lines and entries and drop
+// what they built. A job stuck on a slow disk only ties up its own thread,
+// so the next request still gets served.
+//
+// Finished contents are kept on the UI thread, bounded by count and memory
+// and keyed by path, file identity and window, so revisiting a file or
+// scrolling back is served without asking the workers again.
+typedef enum {
+    PREVIEW_KIND_NONE,      // no preview for this type
+    PREVIEW_KIND_TEXT,      // lines to syntax highlight
+    PREVIEW_KIND_TREE,      // directory tree
+    PREVIEW_KIND_ARCHIVE,   // archive listing
+    PREVIEW_KIND_MESSAGE,   // an error or notice, shown as is
+} PreviewKind;
+
+typedef struct {
+    int indent;   // columns right of the content's left edge
+    char *text;
+    char tail[8]; // right-aligned column (tree permissions); may be empty
+} PreviewLine;
+
+typedef struct {
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    int start_line;
+    int width;
+    int rows;
+
+    PreviewKind kind;
+    char mime[96];      // empty if it could not be detected
+    const char *title;  // heading above the lines (static string), or NULL
+    PreviewLine *lines;
+    int line_count;
+    bool more;          // something follows the last line
+    int comment_state;  // text: inside a block comment before the first line
+    size_t bytes;
+} PreviewContent;
+
+// Stops and joins the workers; finished contents are freed.
+void preview_worker_shutdown(void);
+
+// UI thread: the finished content of exactly this window of `path`, whose
+// fresh stat is `st`, or NULL. Valid until the next preview_worker_* call.
+const PreviewContent *preview_worker_get(const char *path, const struct stat *st,
+                                         int start_line, int width, int rows);
+
+// UI thread: the most recent finished content of the same, unchanged file
+// for any window, to show while the requested window is being built.
+const PreviewContent *preview_worker_latest(const char *path, const struct stat *st);
+
+// UI thread: builds this window in the background unless it is already
+// being built. Cancels any other request.
+void preview_worker_request(const char *path, const struct stat *st,
+                            int start_line, int width, int rows);
+
+// UI thread: like preview_worker_get(), but an unfinished window is
+// requested and waited for up to `timeout_ms`. For the few decisions that
+// need the content at once (scroll limits during a burst of keys). After a
+// wait runs out, later calls do not wait for a while, so a slow disk costs
+// one timeout rather than one per key.
+const PreviewContent *preview_worker_get_wait(const char *path, const struct stat *st,
+                                              int start_line, int width, int rows,
+                                              long timeout_ms);
+
+#endif // PREVIEW_WORKER_H
@@ -7,6 +7,8 @@
 
 #include <ctype.h>
 #include <dirent.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,10 +21,51 @@
 #define MAX_SYNTAX_DEFS 50
 #define MAX_LINE_LENGTH 1024
 
+// Character classes: one table lookup per character while highlighting
+enum {
+    CHAR_IDENT    = 1 << 0, // letter, digit or underscore
+    CHAR_DIGIT    = 1 << 1,
+    CHAR_OPERATOR = 1 << 2,
+    CHAR_SPACE    = 1 << 3,
+};
+
+static const unsigned char g_char_class[256] = {
+    ['a' ... 'z'] = CHAR_IDENT,
+    ['A' ... 'Z'] = CHAR_IDENT,
+    ['0' ... '9'] = CHAR_IDENT | CHAR_DIGIT,
+    ['_'] = CHAR_IDENT,
+    ['+'] = CHAR_OPERATOR, ['-'] = CHAR_OPERATOR, ['*'] = CHAR_OPERATOR,
+    ['/'] = CHAR_OPERATOR, ['%'] = CHAR_OPERATOR, ['='] = CHAR_OPERATOR,
+    ['!'] = CHAR_OPERATOR, ['<'] = CHAR_OPERATOR, ['>'] = CHAR_OPERATOR,
+    ['&'] = CHAR_OPERATOR, ['|'] = CHAR_OPERATOR, ['^'] = CHAR_OPERATOR,
+    ['~'] = CHAR_OPERATOR, ['?'] = CHAR_OPERATOR, [':'] = CHAR_OPERATOR,
+    [' '] = CHAR_SPACE, ['\t'] = CHAR_SPACE, ['\n'] = CHAR_SPACE,
+    ['\v'] = CHAR_SPACE, ['\f'] = CHAR_SPACE, ['\r'] = CHAR_SPACE,
+};
+
+#define CHAR_IS(c, cls) ((g_char_class[(unsigned char)(c)] & (cls)) != 0)
+
+// Open addressing table over all word lists of a definition, at most a
+// quarter full so probe sequences stay short. Words point into the lists.
+typedef struct {
+    const char *text; // NULL: empty slot
+    unsigned char len;
+    unsigned char kind;
+} SyntaxWordSlot;
+
+struct SyntaxWords {
+    size_t mask;   // slot count - 1
+    int max_probe; // longest probe sequence any word needed
+    SyntaxWordSlot slots[];
+};
+
 static SyntaxDef g_syntax_defs[MAX_SYNTAX_DEFS];
 static size_t g_syntax_count = 0;
 static bool g_syntax_initialized = false;
 
+// Spans of the line syntax_highlight_line() is drawing (UI thread only)
+static SyntaxSpans g_line_spans;
+
 // Store original color values to restore on exit
 static bool g_colors_changed = false;
 static short g_original_colors[8][3]; // Store RGB for colors 8-15
@@ -135,6 +178,7 @@ static void syntax_def_free(SyntaxDef *def) {
     free(def->line_comment);
     free(def->block_comment_start);
     free(def->block_comment_end);
+    free(def->words);
     
     // Reset color arrays
     for (int i = 0; i < 3; i++) {
@@ -151,6 +195,67 @@ static void syntax_def_free(SyntaxDef *def) {
     memset(def, 0, sizeof(SyntaxDef));
 }
 
+// Helper: FNV-1a hash of a word
+static uint32_t word_hash(const char *word, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)word[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Helper: add a word list to the table; words already present keep their kind
+static void words_insert(struct SyntaxWords *words, char **list, size_t count,
+                         SyntaxWordKind kind) {
+    for (size_t i = 0; i < count; i++) {
+        if (!list[i]) continue;
+        size_t len = strlen(list[i]);
+        if (len == 0 || len > UCHAR_MAX) continue;
+
+        size_t slot = word_hash(list[i], len) & words->mask;
+        int probe = 0;
+        while (words->slots[slot].text &&
+               !(words->slots[slot].len == len && memcmp(words->slots[slot].text, list[i], len) == 0)) {
+            slot = (slot + 1) & words->mask;
+            probe++;
+        }
+        if (words->slots[slot].text) continue;
+        words->slots[slot] = (SyntaxWordSlot){list[i], (unsigned char)len, (unsigned char)kind};
+        if (probe > words->max_probe) words->max_probe = probe;
+    }
+}
+
+// Helper: build the word lookup table of a loaded definition
+static struct SyntaxWords *words_build(const SyntaxDef *def) {
+    size_t total = def->constant_count + def->keyword_count + def->statement_count + def->type_count;
+    size_t slots = 16;
+    while (slots < total * 4) slots *= 2;
+
+    struct SyntaxWords *words = calloc(1, sizeof(*words) + slots * sizeof(SyntaxWordSlot));
+    if (!words) return NULL;
+    words->mask = slots - 1;
+    // Same precedence as the order the highlighter checks the lists in
+    words_insert(words, def->constants, def->constant_count, SYNTAX_WORD_CONSTANT);
+    words_insert(words, def->keywords, def->keyword_count, SYNTAX_WORD_KEYWORD);
+    words_insert(words, def->statements, def->statement_count, SYNTAX_WORD_STATEMENT);
+    words_insert(words, def->types, def->type_count, SYNTAX_WORD_TYPE);
+    return words;
+}
+
+SyntaxWordKind syntax_word_kind(const SyntaxDef *syntax, const char *word, size_t len) {
+    if (!syntax || !syntax->words || len == 0 || len > UCHAR_MAX) return SYNTAX_WORD_NONE;
+    const struct SyntaxWords *words = syntax->words;
+    size_t slot = word_hash(word, len) & words->mask;
+    for (int probe = 0; probe <= words->max_probe; probe++) {
+        const SyntaxWordSlot *s = &words->slots[slot];
+        if (!s->text) break;
+        if (s->len == len && memcmp(s->text, word, len) == 0) return (SyntaxWordKind)s->kind;
+        slot = (slot + 1) & words->mask;
+    }
+    return SYNTAX_WORD_NONE;
+}
+
 // Load a single syntax definition from a cupidconf file
 static bool load_syntax_file(const char *filepath) {
     if (g_syntax_count >= MAX_SYNTAX_DEFS) return false;
@@ -239,6 +344,7 @@ static bool load_syntax_file(const char *filepath) {
     }
     
     fclose(fp);
+    def->words = words_build(def);
     def->loaded = true;
     g_syntax_count++;
     return true;
@@ -289,6 +395,7 @@ void syntax_cleanup(void) {
     }
     g_syntax_count = 0;
     g_syntax_initialized = false;
+    syntax_spans_free(&g_line_spans);
 }
 
 // Get syntax definition for a file based on extension
@@ -390,18 +497,8 @@ void syntax_init_colors(void) {
 }
 
 // Helper: check if a character is part of an identifier
-static bool is_ident_char(char c) {
-    return isalnum((unsigned char)c) || c == '_';
-}
-
-// Helper: check if word matches keyword list
-static bool is_keyword(const char *word, size_t len, char **keywords, size_t count) {
-    for (size_t i = 0; i < count; i++) {
-        if (strlen(keywords[i]) == len && strncmp(word, keywords[i], len) == 0) {
-            return true;
-        }
-    }
-    return false;
+static inline bool is_ident_char(char c) {
+    return CHAR_IS(c, CHAR_IDENT);
 }
 
 // Helper: check if identifier is all uppercase (constant style)
@@ -421,15 +518,13 @@ static bool is_type_suffix(const char *word, size_t len) {
 }
 
 // Helper: check if character is an operator
-static bool is_operator_char(char c) {
-    return (c == '+' || c == '-' || c == '*' || c == '/' || c == '%' ||
-            c == '=' || c == '!' || c == '<' || c == '>' || c == '&' ||
-            c == '|' || c == '^' || c == '~' || c == '?' || c == ':');
+static inline bool is_operator_char(char c) {
+    return CHAR_IS(c, CHAR_OPERATOR);
 }
 
 // Helper: check if next non-whitespace character is '('
 static bool is_followed_by_paren(const char *line, int pos, int len) {
-    while (pos < len && isspace((unsigned char)line[pos])) {
+    while (pos < len && CHAR_IS(line[pos], CHAR_SPACE)) {
         pos++;
     }
     return (pos < len && line[pos] == '(');
@@ -481,8 +576,126 @@ int get_initial_block_comment_state(char **lines, int num_lines, int current_lin
     return 0;
 }
 
-// Helper: parse and highlight a number (supports various formats)
-static int parse_number(WINDOW *win, const char *line, int pos, int len, int y, int *col, int max_x) {
+// Helper: block comment nesting depth after lexing `line` left to right from
+// `depth`. Gives the same answers as the backward scan above: a comment end
+// with no comment open is ignored.
+static int block_comment_depth_after(const SyntaxDef *syntax, const char *line, int depth) {
+    const char *start_delim = syntax->block_comment_start;
+    const char *end_delim   = syntax->block_comment_end;
+    const size_t start_len = strlen(start_delim);
+    const size_t end_len   = strlen(end_delim);
+
+    for (const char *p = line; *p;) {
+        if (*p == end_delim[0] && strncmp(p, end_delim, end_len) == 0) {
+            if (depth > 0) depth--;
+            p += end_len;
+        } else if (*p == start_delim[0] && strncmp(p, start_delim, start_len) == 0) {
+            depth++;
+            p += start_len;
+        } else {
+            p++;
+        }
+    }
+    return depth;
+}
+
+void syntax_checkpoints_init(SyntaxCheckpoints *cp) {
+    *cp = (SyntaxCheckpoints){0};
+}
+
+void syntax_checkpoints_free(SyntaxCheckpoints *cp) {
+    if (!cp) return;
+    free(cp->depths);
+    *cp = (SyntaxCheckpoints){0};
+}
+
+void syntax_checkpoints_invalidate(SyntaxCheckpoints *cp, int line) {
+    if (!cp) return;
+    // The checkpoint at the start of `line` only depends on the lines above
+    int keep = line < 0 ? 0 : line / SYNTAX_CHECKPOINT_INTERVAL + 1;
+    if (cp->count > keep) cp->count = keep;
+}
+
+static void checkpoints_append(SyntaxCheckpoints *cp, int depth) {
+    if (cp->count == cp->capacity) {
+        int new_cap = cp->capacity ? cp->capacity * 2 : 64;
+        int *tmp = realloc(cp->depths, sizeof(int) * (size_t)new_cap);
+        if (!tmp) return;
+        cp->depths = tmp;
+        cp->capacity = new_cap;
+    }
+    cp->depths[cp->count++] = depth;
+}
+
+int syntax_checkpoints_state(SyntaxCheckpoints *cp, SyntaxDef *syntax, int line,
+                             SyntaxLineFn get_line, void *ctx) {
+    if (!cp || !syntax || !get_line || line <= 0) return 0;
+    if (!syntax->block_comment_start || !*syntax->block_comment_start ||
+        !syntax->block_comment_end || !*syntax->block_comment_end) {
+        return 0;
+    }
+
+    if (cp->syntax != syntax) {
+        cp->syntax = syntax;
+        cp->count = 0;
+    }
+    if (cp->count == 0) {
+        checkpoints_append(cp, 0);
+        if (cp->count == 0) return 0;
+    }
+
+    int from = line / SYNTAX_CHECKPOINT_INTERVAL;
+    if (from > cp->count - 1) from = cp->count - 1;
+    int depth = cp->depths[from];
+
+    // Lex forward, recording the checkpoints passed on the way
+    for (int i = from * SYNTAX_CHECKPOINT_INTERVAL; i < line; i++) {
+        const char *text = get_line(ctx, i);
+        if (!text) break;
+        depth = block_comment_depth_after(syntax, text, depth);
+        if ((i + 1) == cp->count * SYNTAX_CHECKPOINT_INTERVAL) {
+            checkpoints_append(cp, depth);
+        }
+    }
+    return depth > 0;
+}
+
+typedef struct {
+    char **lines;
+    int num_lines;
+} LineArray;
+
+static const char *line_array_get(void *ctx, int index) {
+    const LineArray *array = ctx;
+    if (index >= array->num_lines) return NULL;
+    return array->lines[index] ? array->lines[index] : "";
+}
+
+int syntax_checkpoints_state_lines(SyntaxCheckpoints *cp, SyntaxDef *syntax, char **lines,
+                                   int num_lines, int line) {
+    if (!lines) return 0;
+    LineArray array = {lines, num_lines};
+    return syntax_checkpoints_state(cp, syntax, line, line_array_get, &array);
+}
+
+// Helper: append `len` characters drawn with `attr`, merging with the span
+// before when the attributes match. Room for one span per character is
+// reserved up front, so this cannot fail.
+static void spans_add(SyntaxSpans *out, attr_t attr, int len) {
+    if (len <= 0) return;
+    if (out->count > 0 && out->spans[out->count - 1].attr == attr) {
+        out->spans[out->count - 1].len += len;
+        return;
+    }
+    int start = 0;
+    if (out->count > 0) {
+        start = out->spans[out->count - 1].start + out->spans[out->count - 1].len;
+    }
+    out->spans[out->count++] = (SyntaxSpan){start, len, attr};
+}
+
+// Helper: parse a number (supports various formats)
+static int parse_number(SyntaxSpans *out, const char *line, int pos, int len) {
     int start = pos;
     
     // Check for 0x (hex), 0b (binary), or 0 (octal)
@@ -500,7 +713,7 @@ static int parse_number(WINDOW *win, const char *line, int pos, int len, int y,
             while (pos < len && (line[pos] == '0' || line[pos] == '1')) {
                 pos++;
             }
-        } else if (isdigit((unsigned char)line[pos + 1])) {
+        } else if (CHAR_IS(line[pos + 1], CHAR_DIGIT)) {
             // Octal
             pos++;
             while (pos < len && (line[pos] >= '0' && line[pos] <= '7')) {
@@ -511,14 +724,14 @@ static int parse_number(WINDOW *win, const char *line, int pos, int len, int y,
     
     // Decimal or floating point
     if (pos == start) {
-        while (pos < len && isdigit((unsigned char)line[pos])) {
+        while (pos < len && CHAR_IS(line[pos], CHAR_DIGIT)) {
             pos++;
         }
         
         // Check for decimal point
         if (pos < len && line[pos] == '.') {
             pos++;
-            while (pos < len && isdigit((unsigned char)line[pos])) {
+            while (pos < len && CHAR_IS(line[pos], CHAR_DIGIT)) {
                 pos++;
             }
         }
@@ -529,7 +742,7 @@ static int parse_number(WINDOW *win, const char *line, int pos, int len, int y,
             if (pos < len && (line[pos] == '+' || line[pos] == '-')) {
                 pos++;
             }
-            while (pos < len && isdigit((unsigned char)line[pos])) {
+            while (pos < len && CHAR_IS(line[pos], CHAR_DIGIT)) {
                 pos++;
             }
         }
@@ -545,141 +758,109 @@ static int parse_number(WINDOW *win, const char *line, int pos, int len, int y,
         }
     }
     
-    // Print the number
-    wattron(win, COLOR_PAIR(COLOR_SYNTAX_NUMBER));
-    for (int i = start; i < pos && *col < max_x; i++) {
-        mvwaddch(win, y, (*col)++, line[i]);
-    }
-    wattroff(win, COLOR_PAIR(COLOR_SYNTAX_NUMBER));
-    
+    spans_add(out, COLOR_PAIR(COLOR_SYNTAX_NUMBER), pos - start);
     return pos;
 }
 
-// Apply syntax highlighting to a line of text
-void syntax_highlight_line(WINDOW *win, const char *line, SyntaxDef *syntax,
-                          int *in_block_comment, int y, int x, int max_width,
-                          char **lines, int num_lines, int line_index) {
-    if (!win || !line) return;
-    
-    // No syntax highlighting available - just print the line normally
-    if (!syntax) {
-        mvwprintw(win, y, x, "%.*s", max_width, line);
-        return;
-    }
-    
+// Helper: split one line into highlighted spans
+static void lex_line(SyntaxSpans *out, const char *line, int len, SyntaxDef *syntax,
+                     int *in_block_comment) {
     int pos = 0;
-    int col = x;
-    size_t len = strlen(line);
     bool in_string = false;
     bool in_char = false;
     bool in_line_comment = false;
-    int max_x = x + max_width;
     
-    while (pos < (int)len && col < max_x) {
+    // Delimiter lengths and the first non-blank column, worked out once
+    // rather than at every character
+    const int line_comment_len = syntax->line_comment ? (int)strlen(syntax->line_comment) : 0;
+    const int block_start_len =
+        syntax->block_comment_start ? (int)strlen(syntax->block_comment_start) : 0;
+    const int block_end_len = syntax->block_comment_end ? (int)strlen(syntax->block_comment_end) : 0;
+    int first_text = 0;
+    while (first_text < len && CHAR_IS(line[first_text], CHAR_SPACE)) {
+        first_text++;
+    }
+    
+    while (pos < len) {
         // Check for block comment continuation
-        if (in_block_comment && *in_block_comment) {
-            if (syntax->block_comment_end &&
-                strncmp(&line[pos], syntax->block_comment_end, strlen(syntax->block_comment_end)) == 0) {
-                wattron(win, COLOR_PAIR(COLOR_SYNTAX_COMMENT));
-                for (size_t i = 0; i < strlen(syntax->block_comment_end) && col < max_x; i++) {
-                    mvwaddch(win, y, col++, line[pos++]);
-                }
-                wattroff(win, COLOR_PAIR(COLOR_SYNTAX_COMMENT));
+        if (*in_block_comment) {
+            if (block_end_len && line[pos] == syntax->block_comment_end[0] &&
+                strncmp(&line[pos], syntax->block_comment_end, (size_t)block_end_len) == 0) {
+                spans_add(out, COLOR_PAIR(COLOR_SYNTAX_COMMENT), block_end_len);
+                pos += block_end_len;
                 *in_block_comment = 0;
                 continue;
             }
-            wattron(win, COLOR_PAIR(COLOR_SYNTAX_COMMENT));
-            mvwaddch(win, y, col++, line[pos++]);
-            wattroff(win, COLOR_PAIR(COLOR_SYNTAX_COMMENT));
+            spans_add(out, COLOR_PAIR(COLOR_SYNTAX_COMMENT), 1);
+            pos++;
             continue;
         }
         
         // Check for line comment start
-        if (!in_string && !in_char && syntax->line_comment &&
-            strncmp(&line[pos], syntax->line_comment, strlen(syntax->line_comment)) == 0) {
+        if (!in_string && !in_char && line_comment_len && line[pos] == syntax->line_comment[0] &&
+            strncmp(&line[pos], syntax->line_comment, (size_t)line_comment_len) == 0) {
             in_line_comment = true;
         }
         
         // Check for block comment start
-        if (!in_string && !in_char && !in_line_comment && syntax->block_comment_start &&
-            strncmp(&line[pos], syntax->block_comment_start, strlen(syntax->block_comment_start)) == 0) {
+        if (!in_string && !in_char && !in_line_comment && block_start_len &&
+            line[pos] == syntax->block_comment_start[0] &&
+            strncmp(&line[pos], syntax->block_comment_start, (size_t)block_start_len) == 0) {
             *in_block_comment = 1;
-            wattron(win, COLOR_PAIR(COLOR_SYNTAX_COMMENT));
-            for (size_t i = 0; i < strlen(syntax->block_comment_start) && col < max_x; i++) {
-                mvwaddch(win, y, col++, line[pos++]);
-            }
-            wattroff(win, COLOR_PAIR(COLOR_SYNTAX_COMMENT));
+            spans_add(out, COLOR_PAIR(COLOR_SYNTAX_COMMENT), block_start_len);
+            pos += block_start_len;
             continue;
         }
         
         // Line comment - color rest of line
         if (in_line_comment) {
-            wattron(win, COLOR_PAIR(COLOR_SYNTAX_COMMENT));
-            mvwaddch(win, y, col++, line[pos++]);
-            wattroff(win, COLOR_PAIR(COLOR_SYNTAX_COMMENT));
+            spans_add(out, COLOR_PAIR(COLOR_SYNTAX_COMMENT), len - pos);
+            pos = len;
             continue;
         }
         
         // Check for preprocessor (e.g., #include, #define)
         if (!in_string && !in_char && syntax->preprocessor_char) {
-            // Skip leading whitespace to check for preprocessor
-            int check_pos = 0;
-            while (check_pos < pos && isspace((unsigned char)line[check_pos])) {
-                check_pos++;
-            }
-            if (check_pos == pos && line[pos] == syntax->preprocessor_char) {
-                // Highlight the # symbol
-                wattron(win, COLOR_PAIR(COLOR_SYNTAX_PREPROCESSOR));
-                mvwaddch(win, y, col++, line[pos++]);
-                
-                // Skip whitespace after #
-                while (pos < (int)len && isspace((unsigned char)line[pos]) && col < max_x) {
-                    mvwaddch(win, y, col++, line[pos++]);
-                }
-                
-                // Highlight the directive keyword (define, include, ifndef, etc.)
-                int directive_start = pos;
-                while (pos < (int)len && is_ident_char(line[pos])) {
+            // Only the first non-blank character starts a directive
+            if (pos == first_text && line[pos] == syntax->preprocessor_char) {
+                // The # symbol, whitespace after it and the directive keyword
+                // (define, include, ifndef, etc.)
+                int directive_start = pos++;
+                while (pos < len && CHAR_IS(line[pos], CHAR_SPACE)) {
                     pos++;
                 }
-                for (int i = directive_start; i < pos && col < max_x; i++) {
-                    mvwaddch(win, y, col++, line[i]);
+                while (pos < len && is_ident_char(line[pos])) {
+                    pos++;
                 }
-                wattroff(win, COLOR_PAIR(COLOR_SYNTAX_PREPROCESSOR));
+                spans_add(out, COLOR_PAIR(COLOR_SYNTAX_PREPROCESSOR), pos - directive_start);
                 
                 // For simple directives like #define MACRO, #ifndef MACRO, highlight the macro name
                 // Skip whitespace
-                while (pos < (int)len && isspace((unsigned char)line[pos]) && col < max_x) {
-                    mvwaddch(win, y, col++, line[pos++]);
+                int space_start = pos;
+                while (pos < len && CHAR_IS(line[pos], CHAR_SPACE)) {
+                    pos++;
                 }
+                spans_add(out, 0, pos - space_start);
                 
                 // Check if next token is an identifier (macro name)
-                if (pos < (int)len && is_ident_char(line[pos])) {
+                if (pos < len && is_ident_char(line[pos])) {
                     int macro_start = pos;
-                    while (pos < (int)len && is_ident_char(line[pos])) {
+                    while (pos < len && is_ident_char(line[pos])) {
                         pos++;
                     }
                     int macro_len = pos - macro_start;
                     
                     // Highlight macro name as constant if uppercase
                     if (is_uppercase_ident(&line[macro_start], macro_len)) {
-                        wattron(win, COLOR_PAIR(COLOR_SYNTAX_NUMBER) | A_BOLD);
-                        for (int i = macro_start; i < pos && col < max_x; i++) {
-                            mvwaddch(win, y, col++, line[i]);
-                        }
-                        wattroff(win, COLOR_PAIR(COLOR_SYNTAX_NUMBER) | A_BOLD);
+                        spans_add(out, COLOR_PAIR(COLOR_SYNTAX_NUMBER) | A_BOLD, macro_len);
                     } else {
                         // Regular macro name
-                        for (int i = macro_start; i < pos && col < max_x; i++) {
-                            mvwaddch(win, y, col++, line[i]);
-                        }
+                        spans_add(out, 0, macro_len);
                     }
                 }
                 
                 // Rest of the line (macro definition, include path, etc.) - normal color
-                while (pos < (int)len && col < max_x) {
-                    mvwaddch(win, y, col++, line[pos++]);
-                }
+                spans_add(out, 0, len - pos);
                 break;
             }
         }
@@ -691,9 +872,8 @@ void syntax_highlight_line(WINDOW *win, const char *line, SyntaxDef *syntax,
             } else if (pos > 0 && line[pos - 1] != '\\') {
                 in_string = false;
             }
-            wattron(win, COLOR_PAIR(COLOR_SYNTAX_STRING));
-            mvwaddch(win, y, col++, line[pos++]);
-            wattroff(win, COLOR_PAIR(COLOR_SYNTAX_STRING));
+            spans_add(out, COLOR_PAIR(COLOR_SYNTAX_STRING), 1);
+            pos++;
             continue;
         }
         
@@ -704,192 +884,198 @@ void syntax_highlight_line(WINDOW *win, const char *line, SyntaxDef *syntax,
             } else if (pos > 0 && line[pos - 1] != '\\') {
                 in_char = false;
             }
-            wattron(win, COLOR_PAIR(COLOR_SYNTAX_STRING));
-            mvwaddch(win, y, col++, line[pos++]);
-            wattroff(win, COLOR_PAIR(COLOR_SYNTAX_STRING));
+            spans_add(out, COLOR_PAIR(COLOR_SYNTAX_STRING), 1);
+            pos++;
             continue;
         }
         
         // Inside string or char - handle escape sequences
         if (in_string || in_char) {
-            if (line[pos] == '\\' && pos + 1 < (int)len) {
+            if (line[pos] == '\\' && pos + 1 < len) {
                 // Highlight escape sequence
-                wattron(win, COLOR_PAIR(COLOR_SYNTAX_ESCAPE) | A_BOLD);
-                mvwaddch(win, y, col++, line[pos++]);
+                int escape_start = pos++;
                 // Handle different escape types
                 if (line[pos] == 'x' || line[pos] == 'u' || line[pos] == 'U') {
                     // Hex escape \xHH, unicode \uHHHH, \UHHHHHHHH
-                    char esc_type = line[pos];
-                    mvwaddch(win, y, col++, line[pos++]);
+                    char esc_type = line[pos++];
                     int max_digits = (esc_type == 'x') ? 2 : (esc_type == 'u') ? 4 : 8;
-                    for (int i = 0; i < max_digits && pos < (int)len && 
-                         isxdigit((unsigned char)line[pos]) && col < max_x; i++) {
-                        mvwaddch(win, y, col++, line[pos++]);
+                    for (int i = 0; i < max_digits && pos < len && 
+                         isxdigit((unsigned char)line[pos]); i++) {
+                        pos++;
                     }
                 } else if (line[pos] >= '0' && line[pos] <= '7') {
                     // Octal escape \ooo
-                    for (int i = 0; i < 3 && pos < (int)len && 
-                         line[pos] >= '0' && line[pos] <= '7' && col < max_x; i++) {
-                        mvwaddch(win, y, col++, line[pos++]);
+                    for (int i = 0; i < 3 && pos < len && 
+                         line[pos] >= '0' && line[pos] <= '7'; i++) {
+                        pos++;
                     }
                 } else {
                     // Single char escape (\n, \t, etc.)
-                    mvwaddch(win, y, col++, line[pos++]);
+                    pos++;
                 }
-                wattroff(win, COLOR_PAIR(COLOR_SYNTAX_ESCAPE) | A_BOLD);
+                spans_add(out, COLOR_PAIR(COLOR_SYNTAX_ESCAPE) | A_BOLD, pos - escape_start);
             } else {
-                wattron(win, COLOR_PAIR(COLOR_SYNTAX_STRING));
-                mvwaddch(win, y, col++, line[pos++]);
-                wattroff(win, COLOR_PAIR(COLOR_SYNTAX_STRING));
+                spans_add(out, COLOR_PAIR(COLOR_SYNTAX_STRING), 1);
+                pos++;
             }
             continue;
         }
         
         // Check for numbers (improved parsing)
-        if (isdigit((unsigned char)line[pos]) && 
+        if (CHAR_IS(line[pos], CHAR_DIGIT) && 
             (pos == 0 || !is_ident_char(line[pos - 1]))) {
-            pos = parse_number(win, line, pos, len, y, &col, max_x);
+            pos = parse_number(out, line, pos, len);
             continue;
         }
         
         // Check for identifiers (keywords, types, constants, etc.)
         if (is_ident_char(line[pos])) {
             int word_start = pos;
-            while (pos < (int)len && is_ident_char(line[pos])) {
+            while (pos < len && is_ident_char(line[pos])) {
                 pos++;
             }
             int word_len = pos - word_start;
             
             // Check for labels (identifier followed by colon at line start)
-            bool is_label = false;
-            if (pos < (int)len && line[pos] == ':') {
-                // Check if this is at the start of the line (after whitespace)
-                int check = 0;
-                while (check < word_start && isspace((unsigned char)line[check])) {
-                    check++;
-                }
-                if (check == word_start) {
-                    is_label = true;
-                }
-            }
+            bool is_label = pos < len && line[pos] == ':' && word_start == first_text;
             
             // Check for typedef type name (after closing brace and before semicolon)
             bool is_typedef_name = false;
             if (word_start > 0) {
                 int check = word_start - 1;
-                while (check >= 0 && isspace((unsigned char)line[check])) {
+                while (check >= 0 && CHAR_IS(line[check], CHAR_SPACE)) {
                     check--;
                 }
                 if (check >= 0 && line[check] == '}') {
                     // Check if semicolon follows the identifier
                     int after = pos;
-                    while (after < (int)len && isspace((unsigned char)line[after])) {
+                    while (after < len && CHAR_IS(line[after], CHAR_SPACE)) {
                         after++;
                     }
-                    if (after < (int)len && line[after] == ';') {
+                    if (after < len && line[after] == ';') {
                         is_typedef_name = true;
                     }
                 }
             }
             
+            SyntaxWordKind kind = syntax_word_kind(syntax, &line[word_start], (size_t)word_len);
+            attr_t attr = 0;
+            
             // Check if it's a constant (true, false, NULL, etc.)
-            if (syntax->constants && is_keyword(&line[word_start], word_len, 
-                                               syntax->constants, syntax->constant_count)) {
-                wattron(win, COLOR_PAIR(COLOR_SYNTAX_NUMBER) | A_BOLD);
-                for (int i = 0; i < word_len && col < max_x; i++) {
-                    mvwaddch(win, y, col++, line[word_start + i]);
-                }
-                wattroff(win, COLOR_PAIR(COLOR_SYNTAX_NUMBER) | A_BOLD);
+            if (kind == SYNTAX_WORD_CONSTANT) {
+                attr = COLOR_PAIR(COLOR_SYNTAX_NUMBER) | A_BOLD;
             }
             // Check if it's a control flow keyword
-            else if (syntax->keywords && is_keyword(&line[word_start], word_len, 
-                                               syntax->keywords, syntax->keyword_count)) {
-                wattron(win, COLOR_PAIR(COLOR_SYNTAX_KEYWORD) | A_BOLD);
-                for (int i = 0; i < word_len && col < max_x; i++) {
-                    mvwaddch(win, y, col++, line[word_start + i]);
-                }
-                wattroff(win, COLOR_PAIR(COLOR_SYNTAX_KEYWORD) | A_BOLD);
+            else if (kind == SYNTAX_WORD_KEYWORD) {
+                attr = COLOR_PAIR(COLOR_SYNTAX_KEYWORD) | A_BOLD;
             }
             // Check if it's a statement keyword (storage class, qualifiers)
-            else if (syntax->statements && is_keyword(&line[word_start], word_len,
-                                                     syntax->statements, syntax->statement_count)) {
-                wattron(win, COLOR_PAIR(COLOR_SYNTAX_KEYWORD));
-                for (int i = 0; i < word_len && col < max_x; i++) {
-                    mvwaddch(win, y, col++, line[word_start + i]);
-                }
-                wattroff(win, COLOR_PAIR(COLOR_SYNTAX_KEYWORD));
+            else if (kind == SYNTAX_WORD_STATEMENT) {
+                attr = COLOR_PAIR(COLOR_SYNTAX_KEYWORD);
             }
             // Check if it's a type
-            else if (syntax->types && is_keyword(&line[word_start], word_len,
-                                                 syntax->types, syntax->type_count)) {
-                wattron(win, COLOR_PAIR(COLOR_SYNTAX_TYPE));
-                for (int i = 0; i < word_len && col < max_x; i++) {
-                    mvwaddch(win, y, col++, line[word_start + i]);
-                }
-                wattroff(win, COLOR_PAIR(COLOR_SYNTAX_TYPE));
+            else if (kind == SYNTAX_WORD_TYPE) {
+                attr = COLOR_PAIR(COLOR_SYNTAX_TYPE);
             }
             // Check if it's a label
             else if (is_label) {
-                wattron(win, COLOR_PAIR(COLOR_SYNTAX_LABEL) | A_BOLD);
-                for (int i = 0; i < word_len && col < max_x; i++) {
-                    mvwaddch(win, y, col++, line[word_start + i]);
-                }
-                wattroff(win, COLOR_PAIR(COLOR_SYNTAX_LABEL) | A_BOLD);
+                attr = COLOR_PAIR(COLOR_SYNTAX_LABEL) | A_BOLD;
             }
             // Check if it's a typedef type name (after } before ;)
             else if (is_typedef_name) {
-                wattron(win, COLOR_PAIR(COLOR_SYNTAX_TYPE) | A_BOLD);
-                for (int i = 0; i < word_len && col < max_x; i++) {
-                    mvwaddch(win, y, col++, line[word_start + i]);
-                }
-                wattroff(win, COLOR_PAIR(COLOR_SYNTAX_TYPE) | A_BOLD);
+                attr = COLOR_PAIR(COLOR_SYNTAX_TYPE) | A_BOLD;
             }
             // Check if it's a function call (followed by '(')
             else if (is_followed_by_paren(&line[0], pos, len)) {
-                wattron(win, COLOR_PAIR(COLOR_SYNTAX_FUNCTION));
-                for (int i = 0; i < word_len && col < max_x; i++) {
-                    mvwaddch(win, y, col++, line[word_start + i]);
-                }
-                wattroff(win, COLOR_PAIR(COLOR_SYNTAX_FUNCTION));
+                attr = COLOR_PAIR(COLOR_SYNTAX_FUNCTION);
             }
             // Check if it's an uppercase identifier (constant style)
             else if (is_uppercase_ident(&line[word_start], word_len) && word_len >= 2) {
-                wattron(win, COLOR_PAIR(COLOR_SYNTAX_NUMBER));
-                for (int i = 0; i < word_len && col < max_x; i++) {
-                    mvwaddch(win, y, col++, line[word_start + i]);
-                }
-                wattroff(win, COLOR_PAIR(COLOR_SYNTAX_NUMBER));
+                attr = COLOR_PAIR(COLOR_SYNTAX_NUMBER);
             }
             // Check if it has type suffix (_t or _T)
             else if (is_type_suffix(&line[word_start], word_len)) {
-                wattron(win, COLOR_PAIR(COLOR_SYNTAX_TYPE));
-                for (int i = 0; i < word_len && col < max_x; i++) {
-                    mvwaddch(win, y, col++, line[word_start + i]);
-                }
-                wattroff(win, COLOR_PAIR(COLOR_SYNTAX_TYPE));
-            }
-            // Regular identifier
-            else {
-                for (int i = 0; i < word_len && col < max_x; i++) {
-                    mvwaddch(win, y, col++, line[word_start + i]);
-                }
+                attr = COLOR_PAIR(COLOR_SYNTAX_TYPE);
             }
+            // Otherwise a regular identifier
+            spans_add(out, attr, word_len);
             continue;
         }
         
         // Check for operators
         if (is_operator_char(line[pos])) {
-            wattron(win, COLOR_PAIR(COLOR_SYNTAX_OPERATOR));
             // Handle multi-character operators
             int op_start = pos;
-            while (pos < (int)len && is_operator_char(line[pos]) && col < max_x) {
-                mvwaddch(win, y, col++, line[pos++]);
+            while (pos < len && is_operator_char(line[pos])) {
+                pos++;
             }
-            wattroff(win, COLOR_PAIR(COLOR_SYNTAX_OPERATOR));
+            spans_add(out, COLOR_PAIR(COLOR_SYNTAX_OPERATOR), pos - op_start);
             continue;
         }
         
         // Regular character (brackets, semicolons, etc.)
-        mvwaddch(win, y, col++, line[pos++]);
+        spans_add(out, 0, 1);
+        pos++;
+    }
+}
+
+void syntax_spans_free(SyntaxSpans *spans) {
+    if (!spans) return;
+    free(spans->spans);
+    *spans = (SyntaxSpans){0};
+}
+
+bool syntax_line_spans(SyntaxSpans *out, const char *line, SyntaxDef *syntax,
+                       int *in_block_comment) {
+    if (!out || !line || !syntax) return false;
+    int len = (int)strlen(line);
+    int state = in_block_comment ? *in_block_comment : 0;
+
+    // A line never has more spans than characters
+    if (out->cap < len + 1) {
+        SyntaxSpan *grown = realloc(out->spans, sizeof(SyntaxSpan) * (size_t)(len + 1));
+        if (!grown) return false;
+        out->spans = grown;
+        out->cap = len + 1;
+    }
+    out->count = 0;
+    lex_line(out, line, len, syntax, &state);
+
+    if (in_block_comment) *in_block_comment = state;
+    return true;
+}
+
+void syntax_draw_spans(WINDOW *win, const char *line, const SyntaxSpan *spans, int count,
+                       int y, int x, int from, int width) {
+    if (!win || !line || (!spans && count > 0)) return;
+    int end = from + width;
+    for (int i = 0; i < count; i++) {
+        const SyntaxSpan *span = &spans[i];
+        if (span->start >= end) break;
+        int first = span->start > from ? span->start : from;
+        int last = span->start + span->len < end ? span->start + span->len : end;
+        if (first >= last) continue;
+        if (span->attr) wattron(win, span->attr);
+        for (int c = first; c < last; c++) {
+            mvwaddch(win, y, x + (c - from), (unsigned char)line[c]);
+        }
+        if (span->attr) wattroff(win, span->attr);
+    }
+}
+
+// Apply syntax highlighting to a line of text
+void syntax_highlight_line(WINDOW *win, const char *line, SyntaxDef *syntax, 
+                          int *in_block_comment, int y, int x, int max_width,
+                          char **lines, int num_lines, int line_index) {
+    (void)lines;
+    (void)num_lines;
+    (void)line_index;
+    if (!win || !line) return;
+    
+    // No syntax highlighting available - just print the line normally
+    if (!syntax || !syntax_line_spans(&g_line_spans, line, syntax, in_block_comment)) {
+        mvwprintw(win, y, x, "%.*s", max_width, line);
+        return;
     }
+    syntax_draw_spans(win, line, g_line_spans.spans, g_line_spans.count, y, x, 0, max_width);
 }
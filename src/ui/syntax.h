@@ -32,6 +32,18 @@
 #define COLOR_MONOKAI_GRAY 14
 #define COLOR_MONOKAI_WHITE 15
 
+// What a word is in a language. Where a word is listed more than once, the
+// earlier kind wins, the order the highlighter has always checked them in.
+typedef enum {
+    SYNTAX_WORD_NONE,
+    SYNTAX_WORD_CONSTANT,
+    SYNTAX_WORD_KEYWORD,
+    SYNTAX_WORD_STATEMENT,
+    SYNTAX_WORD_TYPE,
+} SyntaxWordKind;
+
+struct SyntaxWords;
+
 // Syntax highlighting rule set for a language
 typedef struct {
     char *language;       // Language name (e.g., "c", "python")
@@ -72,6 +84,8 @@ typedef struct {
     int color_operator[3];     // RGB for operators
     int color_function[3];     // RGB for function calls
     
+    struct SyntaxWords *words; // Hash table over the word lists, built on load
+    
     bool loaded;          // Whether this syntax definition is loaded
 } SyntaxDef;
 
@@ -84,6 +98,10 @@ void syntax_cleanup(void);
 // Get syntax definition for a file based on extension
 SyntaxDef *syntax_get_for_file(const char *filename);
 
+// Look up an identifier in the definition's constants, keywords, statements
+// and types with one hash probe sequence
+SyntaxWordKind syntax_word_kind(const SyntaxDef *syntax, const char *word, size_t len);
+
 // Apply syntax highlighting to a line of text and print it to window
 // lines: array of all lines in the file (can be NULL for single-line mode)
 // num_lines: total number of lines in the file (0 for single-line mode)
@@ -92,9 +110,70 @@ void syntax_highlight_line(WINDOW *win, const char *line, SyntaxDef *syntax,
                           int *in_block_comment, int y, int x, int max_width,
                           char **lines, int num_lines, int line_index);
 
+// `len` characters from column `start` of a line, drawn with `attr`
+// (color pair and attributes; 0 for plain text).
+typedef struct {
+    int start;
+    int len;
+    attr_t attr;
+} SyntaxSpan;
+
+// Spans covering one whole line, left to right and without gaps.
+typedef struct {
+    SyntaxSpan *spans;
+    int count;
+    int cap;
+} SyntaxSpans;
+
+void syntax_spans_free(SyntaxSpans *spans);
+
+// Lexes all of `line` into `out`, reusing its storage. *in_block_comment is
+// the state before the line on entry and after it on return (may be NULL).
+// Returns false without a syntax or on allocation failure.
+bool syntax_line_spans(SyntaxSpans *out, const char *line, SyntaxDef *syntax,
+                       int *in_block_comment);
+
+// Draws columns [from, from + width) of `line`, lexed into the `count`
+// spans at `spans`, at row `y`, column `x` of `win`.
+void syntax_draw_spans(WINDOW *win, const char *line, const SyntaxSpan *spans, int count,
+                       int y, int x, int from, int width);
+
 // Get initial block comment state by scanning backwards from current_line
 int get_initial_block_comment_state(char **lines, int num_lines, int current_line, SyntaxDef *syntax);
 
+// Lines between two block comment checkpoints
+#define SYNTAX_CHECKPOINT_INTERVAL 64
+
+// Block comment nesting depth at the start of every
+// SYNTAX_CHECKPOINT_INTERVAL-th line of one buffer. The state at a line is
+// lexed forward from the checkpoint before it, so once the checkpoints up to
+// there are known it costs at most SYNTAX_CHECKPOINT_INTERVAL lines however
+// far down the line is. An edit drops the checkpoints below the edited line.
+typedef struct {
+    const SyntaxDef *syntax; // definition the depths were lexed with
+    int *depths;             // depths[i]: depth at line i * SYNTAX_CHECKPOINT_INTERVAL
+    int count;               // leading checkpoints that are still valid
+    int capacity;
+} SyntaxCheckpoints;
+
+// Returns line `index` of the buffer, or NULL past its end (or to give up).
+typedef const char *(*SyntaxLineFn)(void *ctx, int index);
+
+void syntax_checkpoints_init(SyntaxCheckpoints *cp);
+void syntax_checkpoints_free(SyntaxCheckpoints *cp);
+
+// Line `line` changed, or lines were inserted or removed there.
+void syntax_checkpoints_invalidate(SyntaxCheckpoints *cp, int line);
+
+// Same result as get_initial_block_comment_state(), for a buffer read
+// through `get_line`. Lines are asked for in increasing order.
+int syntax_checkpoints_state(SyntaxCheckpoints *cp, SyntaxDef *syntax, int line,
+                             SyntaxLineFn get_line, void *ctx);
+
+// syntax_checkpoints_state() for a buffer held as an array of lines.
+int syntax_checkpoints_state_lines(SyntaxCheckpoints *cp, SyntaxDef *syntax, char **lines,
+                                   int num_lines, int line);
+
 // Initialize ncurses color pairs for syntax highlighting
 void syntax_init_colors(void);
 
@@ -324,6 +324,12 @@ static void build_help_lines(StrVec *out, const KeyBindings *kb,
   snprintf(line_buf, sizeof(line_buf), "  %-20s - Console",
            keycode_to_string(kb->key_console));
   strvec_push(out, line_buf);
+  snprintf(line_buf, sizeof(line_buf), "  %-20s - Cycle sort order",
+           keycode_to_string(kb->key_sort));
+  strvec_push(out, line_buf);
+  snprintf(line_buf, sizeof(line_buf), "  %-20s - Disk usage breakdown",
+           keycode_to_string(kb->key_du));
+  strvec_push(out, line_buf);
   snprintf(line_buf, sizeof(line_buf), "  %-20s - Help (this menu)",
            keycode_to_string(kb->key_help));
   strvec_push(out, line_buf);
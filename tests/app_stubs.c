@@ -0,0 +1,9 @@
+// Globals main.c defines, for tests that link the rest of the application.
+#include <ncurses.h>
+#include <signal.h>
+
+volatile sig_atomic_t resized = 0;
+volatile sig_atomic_t is_editing = 0;
+WINDOW *mainwin = NULL;
+WINDOW *dirwin = NULL;
+WINDOW *previewwin = NULL;
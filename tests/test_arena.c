@@ -0,0 +1,142 @@
+#include "test_runner.h"
+#include "arena.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Test Arena_new does not allocate up front
+bool test_arena_new() {
+    Arena arena = Arena_new(1024);
+    ASSERT_NULL(arena.head, "New arena should not own any chunk yet");
+    Arena_bye(&arena);
+    return true;
+}
+
+// Test allocations are aligned and do not overlap
+bool test_arena_alloc_alignment() {
+    Arena arena = Arena_new(1024);
+    char *a = Arena_alloc(&arena, 3);
+    char *b = Arena_alloc(&arena, 5);
+    ASSERT_NOT_NULL(a, "First allocation should succeed");
+    ASSERT_NOT_NULL(b, "Second allocation should succeed");
+    ASSERT_EQ((uintptr_t)a % _Alignof(max_align_t), 0, "Allocation should be max-aligned");
+    ASSERT_EQ((uintptr_t)b % _Alignof(max_align_t), 0, "Allocation should be max-aligned");
+    ASSERT_TRUE(b >= a + 3, "Allocations should not overlap");
+    Arena_bye(&arena);
+    return true;
+}
+
+// Test Arena_strdup copies the string
+bool test_arena_strdup() {
+    Arena arena = Arena_new(1024);
+    char src[] = "file_name.txt";
+    char *copy = Arena_strdup(&arena, src);
+    ASSERT_NOT_NULL(copy, "strdup should succeed");
+    ASSERT_STR_EQ(copy, "file_name.txt", "Copy should match the source");
+    src[0] = 'X';
+    ASSERT_STR_EQ(copy, "file_name.txt", "Copy should not alias the source");
+    ASSERT_NULL(Arena_strdup(&arena, NULL), "strdup(NULL) should return NULL");
+    Arena_bye(&arena);
+    return true;
+}
+
+// Test many small allocations spill into new chunks and stay valid
+bool test_arena_many_allocations() {
+    Arena arena = Arena_new(256);
+    char *ptrs[1000];
+    for (int i = 0; i < 1000; i++) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "entry-%d", i);
+        ptrs[i] = Arena_strdup(&arena, buf);
+        ASSERT_NOT_NULL(ptrs[i], "Allocation should succeed");
+    }
+    for (int i = 0; i < 1000; i++) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "entry-%d", i);
+        ASSERT_STR_EQ(ptrs[i], buf, "Earlier allocations should survive chunk growth");
+    }
+    Arena_bye(&arena);
+    return true;
+}
+
+// Test large allocations get their own chunk without breaking the current one
+bool test_arena_large_allocation() {
+    Arena arena = Arena_new(256);
+    char *small = Arena_alloc(&arena, 16);
+    char *big = Arena_alloc(&arena, 4096);
+    char *small2 = Arena_alloc(&arena, 16);
+    ASSERT_NOT_NULL(big, "Large allocation should succeed");
+    memset(big, 0xAB, 4096);
+    ASSERT_EQ(small2, small + 16, "Small allocations should keep filling the current chunk");
+    Arena_bye(&arena);
+    return true;
+}
+
+// Test Arena_reset reuses the kept chunk
+bool test_arena_reset_reuses_memory() {
+    Arena arena = Arena_new(256);
+    char *first = Arena_alloc(&arena, 32);
+    for (int i = 0; i < 100; i++) {
+        Arena_alloc(&arena, 32);
+    }
+    Arena_alloc(&arena, 4096);
+    Arena_reset(&arena);
+    ASSERT_NOT_NULL(arena.head, "Reset should keep one chunk");
+    char *again = Arena_alloc(&arena, 32);
+    ASSERT_NOT_NULL(again, "Allocation after reset should succeed");
+    ASSERT_EQ(Arena_alloc(&arena, 32), again + 32, "Kept chunk should be filled from the start");
+    (void)first;
+    Arena_bye(&arena);
+    return true;
+}
+
+// Test Arena_adopt moves memory without invalidating pointers
+bool test_arena_adopt() {
+    Arena dst = Arena_new(256);
+    Arena src = Arena_new(256);
+    char *d = Arena_strdup(&dst, "dst");
+    char *s = Arena_strdup(&src, "src");
+    for (int i = 0; i < 50; i++) {
+        Arena_strdup(&src, "filler-filler-filler");
+    }
+    Arena_adopt(&dst, &src);
+    ASSERT_NULL(src.head, "Source arena should be empty after adopt");
+    ASSERT_STR_EQ(d, "dst", "Destination data should survive adopt");
+    ASSERT_STR_EQ(s, "src", "Adopted data should stay valid");
+    char *next = Arena_alloc(&dst, 8);
+    ASSERT_EQ(next, d + _Alignof(max_align_t), "Destination should keep filling its current chunk");
+    ASSERT_NOT_NULL(Arena_strdup(&src, "reuse"), "Source arena should be reusable");
+    Arena_bye(&src);
+    Arena_bye(&dst);
+    return true;
+}
+
+// Test Arena_size counts chunk capacity, including dedicated chunks
+bool test_arena_size() {
+    Arena arena = Arena_new(256);
+    ASSERT_EQ(Arena_size(&arena), 0, "Empty arena should hold no memory");
+    Arena_alloc(&arena, 16);
+    ASSERT_EQ(Arena_size(&arena), 256, "First allocation should take one chunk");
+    Arena_alloc(&arena, 4096);
+    ASSERT_EQ(Arena_size(&arena), 256 + 4096, "Large allocation should add its own chunk");
+    Arena_reset(&arena);
+    ASSERT_EQ(Arena_size(&arena), 256, "Reset should keep one regular chunk");
+    Arena_bye(&arena);
+    ASSERT_EQ(Arena_size(&arena), 0, "Freed arena should hold no memory");
+    return true;
+}
+
+int main() {
+    printf("=== Arena Tests ===\n\n");
+
+    RUN_TEST(test_arena_new);
+    RUN_TEST(test_arena_alloc_alignment);
+    RUN_TEST(test_arena_strdup);
+    RUN_TEST(test_arena_many_allocations);
+    RUN_TEST(test_arena_large_allocation);
+    RUN_TEST(test_arena_reset_reuses_memory);
+    RUN_TEST(test_arena_adopt);
+    RUN_TEST(test_arena_size);
+
+    PRINT_SUMMARY();
+}
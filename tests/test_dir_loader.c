@@ -0,0 +1,137 @@
+#define _DEFAULT_SOURCE
+#include "test_runner.h"
+#include "arena.h"
+#include "dir_loader.h"
+#include "files.h"
+#include "frame_sched.h"
+#include "globals.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Several publishing batches
+#define ENTRY_COUNT 1500
+
+static char root[64];
+
+static void remove_tree(const char *path) {
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", path);
+    if (system(cmd) != 0) fprintf(stderr, "could not remove %s\n", path);
+}
+
+static const char *make_root(void) {
+    strcpy(root, "/tmp/test_dir_loader_XXXXXX");
+    if (!mkdtemp(root)) return NULL;
+    char path[512];
+    for (int i = 0; i < ENTRY_COUNT; i++) {
+        snprintf(path, sizeof(path), "%s/%s%d", root, i % 10 ? "f" : "d", i);
+        if (i % 10) {
+            FILE *fp = fopen(path, "w");
+            if (fp) fclose(fp);
+        } else {
+            mkdir(path, 0755);
+        }
+    }
+    return root;
+}
+
+static void pause_ms(long ms) {
+    struct timespec pause = {ms / 1000, (ms % 1000) * 1000000L};
+    nanosleep(&pause, NULL);
+}
+
+// Regions marked dirty since the last call
+static unsigned dirty_regions(void) {
+    pause_ms(FRAME_INTERVAL_MS + 4);
+    return frame_sched_begin();
+}
+
+// Runs a loader over `root` to the end; returns the entries it listed.
+static size_t load_all(bool background, unsigned *regions) {
+    dirty_regions();
+    DirCursor cursor;
+    dir_cursor_init(&cursor);
+    if (!dir_cursor_open(&cursor, root)) return 0;
+    DirLoader *loader = background ? dir_loader_start_background(root, &cursor)
+                                   : dir_loader_start(root, &cursor);
+    dir_cursor_close(&cursor);
+    if (!loader) return 0;
+
+    Vector files = Vector_new(64);
+    size_t dirs = 0;
+    bool done = false;
+    for (int i = 0; i < 1000 && !done; i++) {
+        dir_loader_wait(loader, 50);
+        dir_loader_drain(loader, &files, &done);
+    }
+    for (size_t i = 0; i < Vector_len(files); i++) {
+        if (FileAttr_is_dir((FileAttr)files.el[i])) dirs++;
+    }
+    size_t count = done && dirs == ENTRY_COUNT / 10 ? Vector_len(files) : 0;
+
+    Arena arena = Arena_new(LISTING_ARENA_CHUNK);
+    dir_loader_finish(loader, &arena);
+    *regions = dirty_regions();
+    // The entries now live in the arena
+    for (size_t i = 0; i < Vector_len(files); i++) {
+        free_attr((FileAttr)files.el[i]);
+    }
+    Vector_set_len_no_free(&files, 0);
+    Vector_bye(&files);
+    Arena_bye(&arena);
+    return count;
+}
+
+bool test_foreground_load_repaints_listing() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    unsigned regions = 0;
+    ASSERT_EQ(load_all(false, &regions), ENTRY_COUNT, "Every entry, kind included");
+    ASSERT_EQ(regions, FRAME_DIRECTORY, "The listing on screen is repainted");
+    remove_tree(root);
+    return true;
+}
+
+// Prefetched listings are off screen: nothing to repaint for them.
+bool test_background_load_posts_nothing() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    unsigned regions = FRAME_ALL;
+    ASSERT_EQ(load_all(true, &regions), ENTRY_COUNT, "Every entry, kind included");
+    ASSERT_EQ(regions, 0, "No region marked");
+    remove_tree(root);
+    return true;
+}
+
+bool test_cancel_mid_load() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    DirCursor cursor;
+    dir_cursor_init(&cursor);
+    ASSERT_TRUE(dir_cursor_open(&cursor, root), "Opened");
+    DirLoader *loader = dir_loader_start_background(root, &cursor);
+    ASSERT_NOT_NULL(loader, "Started");
+    ASSERT_TRUE(cursor.dir == NULL, "The loader owns the stream");
+    dir_loader_cancel(loader); // the thread frees it if still reading
+    pause_ms(50);
+    remove_tree(root);
+    return true;
+}
+
+int main() {
+    printf("=== Directory Loader Tests ===\n\n");
+
+    // A frame is put off while a key is readable; no keys here.
+    int keys[2];
+    if (pipe(keys) != 0 || dup2(keys[0], STDIN_FILENO) < 0) {
+        perror("pipe");
+        return 1;
+    }
+
+    RUN_TEST(test_foreground_load_repaints_listing);
+    RUN_TEST(test_background_load_posts_nothing);
+    RUN_TEST(test_cancel_mid_load);
+
+    PRINT_SUMMARY();
+}
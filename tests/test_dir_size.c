@@ -0,0 +1,399 @@
+#define _DEFAULT_SOURCE
+#include "test_runner.h"
+#include "dir_size.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// dir_size.c wakes the main loop when results come in; nothing to wake here.
+void frame_sched_post(unsigned regions) { (void)regions; }
+
+static char root[64];
+
+static void write_file(const char *path, size_t size) {
+    FILE *fp = fopen(path, "w");
+    for (size_t i = 0; i < size; i++) fputc('x', fp);
+    fclose(fp);
+}
+
+static void remove_tree(const char *path) {
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), "chmod -R u+rwx '%s' 2>/dev/null; rm -rf '%s'", path, path);
+    if (system(cmd) != 0) fprintf(stderr, "could not remove %s\n", path);
+}
+
+// `fanout` subdirectories of `fanout` subdirectories, each holding a 100 byte
+// file; returns the bytes written.
+static long make_tree(const char *base, int fanout) {
+    char path[512];
+    long total = 0;
+    for (int i = 0; i < fanout; i++) {
+        snprintf(path, sizeof(path), "%s/d%d", base, i);
+        mkdir(path, 0755);
+        for (int j = 0; j < fanout; j++) {
+            snprintf(path, sizeof(path), "%s/d%d/e%d", base, i, j);
+            mkdir(path, 0755);
+            snprintf(path, sizeof(path), "%s/d%d/e%d/f", base, i, j);
+            write_file(path, 100);
+            total += 100;
+        }
+    }
+    return total;
+}
+
+static const char *make_root(void) {
+    strcpy(root, "/tmp/test_dir_size_XXXXXX");
+    return mkdtemp(root);
+}
+
+// Asks for the size of `path` and waits for the walk to finish.
+static long size_of(const char *path) {
+    long size = get_directory_size(path);
+    for (int i = 0; size == DIR_SIZE_PENDING && i < 2000; i++) {
+        struct timespec pause = {0, 5 * 1000 * 1000};
+        nanosleep(&pause, NULL);
+        size = get_directory_size_peek(path);
+    }
+    return size;
+}
+
+// Asks again for a size that is about to change from `old`, and waits for it.
+static long size_changed_from(const char *path, long old) {
+    long size = get_directory_size(path);
+    for (int i = 0; size == old && i < 2000; i++) {
+        struct timespec pause = {0, 5 * 1000 * 1000};
+        nanosleep(&pause, NULL);
+        size = get_directory_size_peek(path);
+    }
+    return size;
+}
+
+bool test_sizes_tree() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    long expected = make_tree(root, 12);
+    char path[512];
+    snprintf(path, sizeof(path), "%s/top", root);
+    write_file(path, 1234);
+    expected += 1234;
+
+    for (int workers = 1; workers <= 4; workers += 3) {
+        dir_size_set_workers(workers);
+        dir_size_cache_start();
+        ASSERT_EQ(size_of(root), expected, "Files at every depth add up");
+        dir_size_cache_stop();
+    }
+    remove_tree(root);
+    return true;
+}
+
+bool test_sizes_wide_tree() {
+    // More subdirectories than the deques hold: the rest is walked inline
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    long expected = make_tree(root, 40);
+    dir_size_set_workers(3);
+    dir_size_cache_start();
+    ASSERT_EQ(size_of(root), expected, "Wide tree adds up");
+    dir_size_cache_stop();
+    remove_tree(root);
+    return true;
+}
+
+bool test_sizes_hard_links_once() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    char path[512];
+    char alias[512];
+    snprintf(path, sizeof(path), "%s/a", root);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/b", root);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/a/data", root);
+    write_file(path, 5000);
+    snprintf(alias, sizeof(alias), "%s/b/data", root);
+    ASSERT_EQ(link(path, alias), 0, "Hard link in another directory");
+    snprintf(alias, sizeof(alias), "%s/a/again", root);
+    ASSERT_EQ(link(path, alias), 0, "Hard link in the same directory");
+    snprintf(path, sizeof(path), "%s/b/other", root);
+    write_file(path, 7);
+
+    dir_size_set_workers(2);
+    dir_size_cache_start();
+    ASSERT_EQ(size_of(root), 5007, "A linked file counts once");
+    dir_size_cache_stop();
+    remove_tree(root);
+    return true;
+}
+
+bool test_sizes_symlinks_not_followed() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    char path[512];
+    char target[512];
+    snprintf(target, sizeof(target), "%s/real", root);
+    mkdir(target, 0755);
+    snprintf(path, sizeof(path), "%s/real/f", root);
+    write_file(path, 300);
+    snprintf(path, sizeof(path), "%s/loop", root);
+    ASSERT_EQ(symlink(root, path), 0, "Symlink back to the root");
+
+    dir_size_set_workers(2);
+    dir_size_cache_start();
+    ASSERT_EQ(size_of(root), 300 + (long)strlen(root), "Links count as themselves");
+    dir_size_cache_stop();
+    remove_tree(root);
+    return true;
+}
+
+bool test_sizes_errors() {
+    dir_size_set_workers(2);
+    dir_size_cache_start();
+    ASSERT_EQ(size_of("/tmp/test_dir_size_missing/none"), -1, "Missing directory");
+    ASSERT_EQ(size_of("/proc"), DIR_SIZE_VIRTUAL_FS, "Virtual filesystems are not walked");
+
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    char path[512];
+    snprintf(path, sizeof(path), "%s/a/locked", root);
+    make_tree(root, 2);
+    mkdir(path, 0755);
+    chmod(path, 0);
+    if (geteuid() != 0) {
+        ASSERT_EQ(size_of(root), DIR_SIZE_PERMISSION_DENIED, "Unreadable subdirectory");
+        ASSERT_EQ(get_directory_size_peek(path), DIR_SIZE_PERMISSION_DENIED,
+                  "... recorded as such");
+    }
+    dir_size_cache_stop();
+    remove_tree(root);
+    return true;
+}
+
+static long blocks_of(const char *path) {
+    struct stat st;
+    return lstat(path, &st) == 0 ? (long)st.st_blocks * 512 : -1;
+}
+
+bool test_sizes_disk_usage() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    char dense[512];
+    char sparse[512];
+    char dense_file[512];
+    char sparse_file[512];
+    snprintf(dense, sizeof(dense), "%s/dense", root);
+    snprintf(sparse, sizeof(sparse), "%s/sparse", root);
+    snprintf(dense_file, sizeof(dense_file), "%s/f", dense);
+    snprintf(sparse_file, sizeof(sparse_file), "%s/f", sparse);
+    mkdir(dense, 0755);
+    mkdir(sparse, 0755);
+    write_file(dense_file, 5000);
+    int fd = open(sparse_file, O_WRONLY | O_CREAT, 0644);
+    ASSERT_TRUE(fd >= 0 && ftruncate(fd, 1 << 20) == 0, "Sparse file");
+    close(fd);
+
+    dir_size_set_workers(2);
+    dir_size_cache_start();
+    long allocated;
+    ASSERT_EQ(dir_size_peek_usage(root, &allocated), DIR_SIZE_PENDING, "Unknown until asked");
+    ASSERT_EQ(allocated, DIR_SIZE_PENDING, "... both of them");
+    ASSERT_EQ(size_of(root), 5000 + (1 << 20), "Apparent size");
+
+    ASSERT_EQ(dir_size_peek_usage(root, &allocated), 5000 + (1 << 20), "Same through usage");
+    ASSERT_EQ(allocated,
+              blocks_of(root) + blocks_of(dense) + blocks_of(dense_file) + blocks_of(sparse) +
+                  blocks_of(sparse_file),
+              "Disk blocks, directories included");
+    ASSERT_EQ(dir_size_peek_usage(sparse, &allocated), 1 << 20, "Subdirectory recorded");
+    ASSERT_EQ(allocated, blocks_of(sparse) + blocks_of(sparse_file), "... with its blocks");
+    ASSERT_TRUE(allocated < (1 << 20), "Holes take no blocks");
+    dir_size_cache_stop();
+    remove_tree(root);
+    return true;
+}
+
+bool test_sizes_peek_does_not_queue() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    char path[512];
+    snprintf(path, sizeof(path), "%s/f", root);
+    write_file(path, 10);
+    dir_size_set_workers(1);
+    dir_size_cache_start();
+    ASSERT_EQ(get_directory_size_peek(root), DIR_SIZE_PENDING, "Unknown until asked");
+    struct timespec pause = {0, 50 * 1000 * 1000};
+    nanosleep(&pause, NULL);
+    ASSERT_EQ(get_directory_size_peek(root), DIR_SIZE_PENDING, "Peeking queued nothing");
+    ASSERT_EQ(size_of(root), 10, "Asking does");
+    ASSERT_EQ(dir_size_get_progress(root), 0, "No progress once finished");
+    dir_size_cache_stop();
+    remove_tree(root);
+    return true;
+}
+
+bool test_sizes_stop_mid_walk() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    make_tree(root, 30);
+    dir_size_set_workers(4);
+    dir_size_cache_start();
+    ASSERT_EQ(get_directory_size(root), DIR_SIZE_PENDING, "Walk queued");
+    dir_size_cache_stop(); // must not hang or leak open directories
+    dir_size_cache_start();
+    ASSERT_EQ(get_directory_size_peek(root), DIR_SIZE_PENDING, "Results were dropped");
+    dir_size_cache_stop();
+
+    int fd = open("/dev/null", O_RDONLY);
+    ASSERT_TRUE(fd >= 0 && fd < 16, "No directory left open");
+    close(fd);
+    remove_tree(root);
+    return true;
+}
+
+bool test_sizes_subdirectories_recorded() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    make_tree(root, 5);
+    char path[512];
+    dir_size_set_workers(3);
+    dir_size_cache_start();
+    ASSERT_EQ(size_of(root), 2500, "Whole tree");
+    snprintf(path, sizeof(path), "%s/d3", root);
+    ASSERT_EQ(get_directory_size_peek(path), 500, "Subdirectory sized by the walk above");
+    snprintf(path, sizeof(path), "%s/d3/e1", root);
+    ASSERT_EQ(get_directory_size_peek(path), 100, "Two levels down");
+    dir_size_cache_stop();
+    remove_tree(root);
+    return true;
+}
+
+bool test_sizes_reuse_until_invalidated() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    make_tree(root, 3);
+    char path[512];
+    dir_size_set_workers(2);
+    dir_size_cache_start();
+    ASSERT_EQ(size_of(root), 900, "Whole tree");
+
+    // Nobody reports this one, so the index keeps counting it
+    snprintf(path, sizeof(path), "%s/d1/e1/f", root);
+    unlink(path);
+    // This one is reported
+    snprintf(path, sizeof(path), "%s/d2/e0/new", root);
+    write_file(path, 40);
+    dir_size_invalidate(path);
+
+    ASSERT_EQ(get_directory_size_peek(root), 900, "Old size shown until walked again");
+    ASSERT_EQ(size_changed_from(root, 900), 940, "Only the changed branch was walked again");
+    snprintf(path, sizeof(path), "%s/d2", root);
+    ASSERT_EQ(get_directory_size_peek(path), 340, "Ancestors of the change updated");
+    snprintf(path, sizeof(path), "%s/d1", root);
+    ASSERT_EQ(get_directory_size_peek(path), 300, "Siblings reused");
+
+    // A removed directory takes its subtree along
+    snprintf(path, sizeof(path), "%s/d0", root);
+    dir_size_invalidate(path);
+    ASSERT_EQ(get_directory_size_peek(path), DIR_SIZE_PENDING, "Removed directory forgotten");
+    ASSERT_EQ(size_of(path), 300, "Walked again when asked");
+    dir_size_cache_stop();
+    remove_tree(root);
+    return true;
+}
+
+bool test_sizes_remembered_across_runs() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    make_tree(root, 2);
+    char index[512];
+    char path[512];
+    snprintf(index, sizeof(index), "%s/state/dir_sizes", root);
+    dir_size_set_index_file(index);
+    dir_size_set_workers(2);
+    dir_size_cache_start();
+    ASSERT_EQ(size_of(root), 400, "First run");
+    dir_size_cache_stop();
+
+    snprintf(path, sizeof(path), "%s/d0/e0/f", root);
+    write_file(path, 1000);
+    dir_size_cache_start();
+    ASSERT_EQ(get_directory_size_peek(root), 400, "Last run's size shown at once");
+    snprintf(path, sizeof(path), "%s/d0", root);
+    ASSERT_EQ(get_directory_size_peek(path), DIR_SIZE_PENDING, "Only asked-for sizes are kept");
+    // Walked again rather than trusted; the index file itself counts too
+    struct stat st;
+    ASSERT_EQ(stat(index, &st), 0, "Index file written");
+    ASSERT_EQ(size_changed_from(root, 400), 1300 + (long)st.st_size, "Recomputed");
+    dir_size_cache_stop();
+    dir_size_set_index_file(NULL);
+    remove_tree(root);
+    return true;
+}
+
+bool test_sizes_focus_and_resume() {
+    // Walks are halted and resumed in any order as the focus moves; whatever
+    // ran when, every size comes out right
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    char paths[4][512];
+    for (int i = 0; i < 4; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "%s/t%d", root, i);
+        mkdir(paths[i], 0755);
+        make_tree(paths[i], 12 + 4 * i);
+    }
+    dir_size_set_workers(2);
+    dir_size_cache_start();
+    for (int round = 0; round < 12; round++) {
+        const char *path = paths[round % 4];
+        dir_size_set_focus(path);
+        get_directory_size(path);
+        struct timespec pause = {0, 1000 * 1000};
+        nanosleep(&pause, NULL);
+    }
+    dir_size_set_focus(NULL);
+    for (int i = 0; i < 4; i++) {
+        int fanout = 12 + 4 * i;
+        dir_size_set_focus(paths[i]);
+        ASSERT_EQ(size_of(paths[i]), 100L * fanout * fanout, "Size after being halted");
+        ASSERT_TRUE(dir_size_settled(paths[i]), "Settled");
+    }
+    dir_size_set_focus(NULL);
+    dir_size_cache_stop();
+    remove_tree(root);
+    return true;
+}
+
+bool test_sizes_unwatched_walk_dropped() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    char other[512];
+    snprintf(other, sizeof(other), "%s/other", root);
+    mkdir(other, 0755);
+    make_tree(root, 3);
+    dir_size_set_workers(1);
+    dir_size_cache_start();
+    dir_size_set_focus(other);
+    ASSERT_EQ(size_of(other), 0, "Focus sized");
+    // Queued behind nothing, but nobody asks again until it is overdue:
+    // either it finished in time or it was dropped, never half recorded.
+    get_directory_size(root);
+    struct timespec pause = {1, 300 * 1000 * 1000};
+    nanosleep(&pause, NULL);
+    long size = get_directory_size_peek(root);
+    ASSERT_TRUE(size == 900 || size == DIR_SIZE_PENDING, "Finished or dropped");
+    ASSERT_EQ(size_of(root), 900, "Asked again: walked again");
+    dir_size_cache_stop();
+    remove_tree(root);
+    return true;
+}
+
+int main() {
+    printf("=== Directory Size Tests ===\n\n");
+
+    RUN_TEST(test_sizes_tree);
+    RUN_TEST(test_sizes_wide_tree);
+    RUN_TEST(test_sizes_hard_links_once);
+    RUN_TEST(test_sizes_symlinks_not_followed);
+    RUN_TEST(test_sizes_errors);
+    RUN_TEST(test_sizes_disk_usage);
+    RUN_TEST(test_sizes_peek_does_not_queue);
+    RUN_TEST(test_sizes_stop_mid_walk);
+    RUN_TEST(test_sizes_subdirectories_recorded);
+    RUN_TEST(test_sizes_reuse_until_invalidated);
+    RUN_TEST(test_sizes_remembered_across_runs);
+    RUN_TEST(test_sizes_focus_and_resume);
+    RUN_TEST(test_sizes_unwatched_walk_dropped);
+
+    PRINT_SUMMARY();
+}
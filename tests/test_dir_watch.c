@@ -0,0 +1,275 @@
+#define _DEFAULT_SOURCE
+#include "test_runner.h"
+#include "app_state.h"
+#include "arena.h"
+#include "dir_watch.h"
+#include "listing_sort.h"
+#include "utils.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static char root[64];
+
+static void touch(const char *dir, const char *name) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *fp = fopen(path, "a");
+    if (fp) {
+        fputc('x', fp);
+        fclose(fp);
+    }
+}
+
+static void at_root(char *out, size_t size, const char *name) {
+    snprintf(out, size, "%s/%s", root, name);
+}
+
+static void remove_tree(const char *path) {
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", path);
+    if (system(cmd) != 0) fprintf(stderr, "could not remove %s\n", path);
+}
+
+static const char *make_root(void) {
+    strcpy(root, "/tmp/test_dir_watch_XXXXXX");
+    return mkdtemp(root);
+}
+
+static bool batch_has(const DirWatchBatch *batch, const char *name) {
+    for (size_t i = 0; i < batch->count; i++) {
+        if (strcmp(batch->names[i], name) == 0) return true;
+    }
+    return false;
+}
+
+static void pause_ms(long ms) {
+    struct timespec pause = {ms / 1000, (ms % 1000) * 1000000L};
+    nanosleep(&pause, NULL);
+}
+
+// A listing of `root` as main() keeps it: arena, sort index, watcher.
+static void listing_open(Vector *files, LazyLoadState *lazy_load) {
+    memset(lazy_load, 0, sizeof(*lazy_load));
+    *files = Vector_new(16);
+    dir_cursor_init(&lazy_load->cursor);
+    lazy_load->arena = Arena_new(LISTING_ARENA_CHUNK);
+    sort_index_init(&lazy_load->sort, SORT_BY_NAME, true);
+    lazy_load->watch = dir_watch_open();
+    reload_directory_full(files, root, lazy_load);
+}
+
+static void listing_close(Vector *files, LazyLoadState *lazy_load) {
+    free_listing(files, lazy_load);
+    Vector_bye(files);
+}
+
+static FileAttr listing_find(const Vector *files, const char *name) {
+    for (size_t i = 0; i < Vector_len(*files); i++) {
+        FileAttr fa = (FileAttr)files->el[i];
+        if (strcmp(FileAttr_get_name(fa), name) == 0) return fa;
+    }
+    return NULL;
+}
+
+// True if the listing holds exactly `names`, in this order.
+static bool listing_is(const Vector *files, const char **names, size_t count) {
+    if (Vector_len(*files) != count) return false;
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(FileAttr_get_name((FileAttr)files->el[i]), names[i]) != 0) return false;
+    }
+    return true;
+}
+
+bool test_watch_names_changes() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    touch(root, "old");
+    touch(root, "before");
+    DirWatch *watch = dir_watch_open();
+    ASSERT_NOT_NULL(watch, "inotify available");
+    ASSERT_TRUE(dir_watch_set(watch, root), "Watching");
+
+    DirWatchBatch batch;
+    ASSERT_FALSE(dir_watch_take(watch, &batch), "Nothing yet");
+    touch(root, "new");
+    char from[512];
+    char to[512];
+    at_root(from, sizeof(from), "old");
+    unlink(from);
+    at_root(from, sizeof(from), "before");
+    at_root(to, sizeof(to), "after");
+    rename(from, to);
+
+    ASSERT_TRUE(dir_watch_take(watch, &batch), "Changes reported");
+    ASSERT_FALSE(batch.overflow, "Applicable as deltas");
+    ASSERT_EQ(batch.count, 4, "One name per entry touched");
+    ASSERT_TRUE(batch_has(&batch, "new"), "Created");
+    ASSERT_TRUE(batch_has(&batch, "old"), "Deleted");
+    ASSERT_TRUE(batch_has(&batch, "before") && batch_has(&batch, "after"), "Both rename sides");
+    ASSERT_FALSE(dir_watch_take(watch, &batch), "A batch is handed out once");
+    dir_watch_close(watch);
+    remove_tree(root);
+    return true;
+}
+
+bool test_watch_coalesces_burst() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    DirWatch *watch = dir_watch_open();
+    ASSERT_NOT_NULL(watch, "inotify available");
+    ASSERT_TRUE(dir_watch_set(watch, root), "Watching");
+
+    char path[512];
+    at_root(path, sizeof(path), "log");
+    for (int i = 0; i < 500; i++) {
+        touch(root, "log");
+        if (i % 50 == 49) unlink(path);
+    }
+    DirWatchBatch batch;
+    ASSERT_TRUE(dir_watch_take(watch, &batch), "Changes reported");
+    ASSERT_EQ(batch.count, 1, "A burst on one name is one entry");
+    ASSERT_STR_EQ(batch.names[0], "log", "The name");
+    dir_watch_close(watch);
+    remove_tree(root);
+    return true;
+}
+
+bool test_watch_lost_directory_overflows() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    char sub[512];
+    at_root(sub, sizeof(sub), "sub");
+    mkdir(sub, 0755);
+    DirWatch *watch = dir_watch_open();
+    ASSERT_NOT_NULL(watch, "inotify available");
+    ASSERT_TRUE(dir_watch_set(watch, sub), "Watching");
+    touch(sub, "f");
+    ASSERT_TRUE(dir_watch_poll(watch), "Pending");
+    ASSERT_FALSE(dir_watch_overflowed(watch), "Still deltas");
+
+    ASSERT_TRUE(dir_watch_set(watch, sub), "Watching afresh");
+    ASSERT_FALSE(dir_watch_poll(watch), "Pending names forgotten");
+
+    char f[600];
+    snprintf(f, sizeof(f), "%s/f", sub);
+    unlink(f);
+    rmdir(sub);
+    DirWatchBatch batch;
+    ASSERT_TRUE(dir_watch_take(watch, &batch), "Changes reported");
+    ASSERT_TRUE(batch.overflow, "Only a reload will do");
+    dir_watch_close(watch);
+    remove_tree(root);
+    return true;
+}
+
+bool test_sync_applies_deltas() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    touch(root, "b");
+    touch(root, "d");
+    touch(root, "gone");
+    touch(root, "x");
+    Vector files;
+    LazyLoadState lazy_load;
+    listing_open(&files, &lazy_load);
+    ASSERT_NOT_NULL(lazy_load.watch, "inotify available");
+    FileAttr kept = listing_find(&files, "d");
+    ASSERT_NOT_NULL(kept, "Listed");
+
+    char from[512];
+    char to[512];
+    touch(root, "a");
+    at_root(from, sizeof(from), "gone");
+    unlink(from);
+    at_root(from, sizeof(from), "x");
+    at_root(to, sizeof(to), "c");
+    rename(from, to);
+    char sub[512];
+    at_root(sub, sizeof(sub), "z");
+    mkdir(sub, 0755);
+
+    ASSERT_TRUE(poll_directory_watch(&lazy_load), "Batch due");
+    sync_directory_changes(&files, root, &lazy_load);
+    const char *expect[] = {"z", "a", "b", "c", "d"};
+    ASSERT_TRUE(listing_is(&files, expect, 5), "Listing matches the directory, in order");
+    ASSERT_TRUE(listing_find(&files, "d") == kept, "Untouched entries are not reloaded");
+    ASSERT_TRUE(FileAttr_is_dir(listing_find(&files, "z")), "New directory");
+    listing_close(&files, &lazy_load);
+    remove_tree(root);
+    return true;
+}
+
+bool test_sync_coalesces_batches() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    Vector files;
+    LazyLoadState lazy_load;
+    listing_open(&files, &lazy_load);
+    ASSERT_NOT_NULL(lazy_load.watch, "inotify available");
+
+    touch(root, "one");
+    ASSERT_TRUE(poll_directory_watch(&lazy_load), "First batch due");
+    sync_directory_changes(&files, root, &lazy_load);
+    ASSERT_EQ(Vector_len(files), 1, "Applied");
+
+    touch(root, "two");
+    touch(root, "three");
+    ASSERT_FALSE(poll_directory_watch(&lazy_load), "Held back right after a batch");
+    ASSERT_TRUE(dir_watch_poll(lazy_load.watch), "Still pending");
+    pause_ms(120);
+    ASSERT_TRUE(poll_directory_watch(&lazy_load), "Due after the interval");
+    sync_directory_changes(&files, root, &lazy_load);
+    ASSERT_EQ(Vector_len(files), 3, "Both applied in one batch");
+    listing_close(&files, &lazy_load);
+    remove_tree(root);
+    return true;
+}
+
+bool test_sync_keeps_cursor_entry() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    char name[32];
+    for (int i = 0; i < 40; i++) {
+        snprintf(name, sizeof(name), "m%02d", i);
+        touch(root, name);
+    }
+    Vector files;
+    LazyLoadState lazy_load;
+    listing_open(&files, &lazy_load);
+    ASSERT_NOT_NULL(lazy_load.watch, "inotify available");
+    FileAttr at_cursor = (FileAttr)files.el[20];
+    ASSERT_STR_EQ(FileAttr_get_name(at_cursor), "m20", "Cursor entry");
+
+    // Entries sorting above it come and go; the entry itself is written to
+    for (int i = 0; i < 5; i++) {
+        snprintf(name, sizeof(name), "a%d", i);
+        touch(root, name);
+    }
+    char path[512];
+    at_root(path, sizeof(path), "m03");
+    unlink(path);
+    touch(root, "m20");
+
+    sync_directory_changes(&files, root, &lazy_load);
+    size_t idx = listing_index_of(&files, at_cursor);
+    ASSERT_EQ(idx, 24, "Same entry, moved by the rows above it");
+    struct stat st;
+    at_root(path, sizeof(path), "m20");
+    stat(path, &st);
+    ASSERT_EQ((long)FileAttr_size(at_cursor), (long)st.st_size, "Re-stat'ed in place");
+    listing_close(&files, &lazy_load);
+    remove_tree(root);
+    return true;
+}
+
+int main() {
+    printf("=== Directory Watch Tests ===\n\n");
+
+    RUN_TEST(test_watch_names_changes);
+    RUN_TEST(test_watch_coalesces_burst);
+    RUN_TEST(test_watch_lost_directory_overflows);
+    RUN_TEST(test_sync_applies_deltas);
+    RUN_TEST(test_sync_coalesces_batches);
+    RUN_TEST(test_sync_keeps_cursor_entry);
+
+    PRINT_SUMMARY();
+}
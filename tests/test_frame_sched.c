@@ -0,0 +1,180 @@
+#define _DEFAULT_SOURCE
+#include "test_runner.h"
+#include "frame_sched.h"
+#include "globals.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+// The scheduler polls the terminal on stdin; the tests stand in a pipe for it.
+static int key_pipe[2];
+
+static void pause_ms(long ms) {
+    struct timespec pause = {ms / 1000, (ms % 1000) * 1000000L};
+    nanosleep(&pause, NULL);
+}
+
+static long ms_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+static void press_key(void) {
+    if (write(key_pipe[1], "k", 1) != 1) perror("write");
+}
+
+static void read_key(void) {
+    char c;
+    if (read(STDIN_FILENO, &c, 1) != 1) perror("read");
+}
+
+// Leaves no key queued, nothing dirty and the last frame a full interval ago.
+static void settle(void) {
+    pause_ms(FRAME_INTERVAL_MS + 4);
+    frame_sched_begin();
+    pause_ms(FRAME_INTERVAL_MS + 4);
+}
+
+bool test_marks_coalesce_into_one_frame() {
+    settle();
+    frame_sched_mark(FRAME_DIRECTORY);
+    frame_sched_mark(FRAME_DIRECTORY);
+    frame_sched_mark(FRAME_PREVIEW);
+    ASSERT_EQ(frame_sched_begin(), FRAME_ALL, "One frame for every mark");
+    ASSERT_EQ(frame_sched_begin(), 0, "Nothing left");
+
+    frame_sched_mark(0);
+    pause_ms(FRAME_INTERVAL_MS + 4);
+    ASSERT_EQ(frame_sched_begin(), 0, "Marking nothing paints nothing");
+    return true;
+}
+
+bool test_frames_are_paced() {
+    settle();
+    frame_sched_mark(FRAME_DIRECTORY);
+    ASSERT_EQ(frame_sched_begin(), FRAME_DIRECTORY, "First frame at once");
+    frame_sched_mark(FRAME_PREVIEW);
+    ASSERT_EQ(frame_sched_begin(), 0, "Too soon after the last frame");
+    frame_sched_mark(FRAME_DIRECTORY);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ASSERT_FALSE(frame_sched_wait(), "Woken by the frame, not a key");
+    ASSERT_TRUE(ms_since(&start) < 200, "Wait ends when the frame is due");
+    ASSERT_EQ(frame_sched_begin(), FRAME_ALL, "Both regions in the next frame");
+    return true;
+}
+
+bool test_mark_in_uses_earliest_deadline() {
+    settle();
+    frame_sched_mark_in(FRAME_DIRECTORY, 200);
+    frame_sched_mark_in(FRAME_PREVIEW, 30);
+    ASSERT_EQ(frame_sched_begin(), 0, "Not yet dirty");
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ASSERT_FALSE(frame_sched_wait(), "Woken by the deadline");
+    long waited = ms_since(&start);
+    ASSERT_TRUE(waited >= 25 && waited < 150, "At the earlier deadline");
+    ASSERT_EQ(frame_sched_begin(), FRAME_ALL, "Delayed regions coalesce");
+
+    frame_sched_mark_in(0, 30);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ASSERT_FALSE(frame_sched_wait(), "A bare deadline ends the wait");
+    ASSERT_TRUE(ms_since(&start) < 150, "In time");
+    pause_ms(FRAME_INTERVAL_MS + 4);
+    ASSERT_EQ(frame_sched_begin(), 0, "Without regions nothing is dirty");
+    return true;
+}
+
+static void *post_later(void *arg) {
+    (void)arg;
+    pause_ms(50);
+    frame_sched_post(FRAME_PREVIEW);
+    return NULL;
+}
+
+bool test_post_wakes_wait() {
+    settle();
+    pthread_t worker;
+    ASSERT_EQ(pthread_create(&worker, NULL, post_later, NULL), 0, "Worker started");
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    bool key = frame_sched_wait(); // nothing dirty, no deadline: only the post
+    long waited = ms_since(&start);
+    pthread_join(worker, NULL);
+    ASSERT_FALSE(key, "No key");
+    ASSERT_TRUE(waited >= 40 && waited < 1000, "Woken by the post");
+    ASSERT_EQ(frame_sched_begin(), FRAME_PREVIEW, "Posted regions are dirty");
+
+    // A post that came in before the wait is not lost either
+    settle();
+    frame_sched_post(FRAME_DIRECTORY);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    frame_sched_wait();
+    ASSERT_TRUE(ms_since(&start) < 100, "Returns at once");
+    ASSERT_EQ(frame_sched_begin(), FRAME_DIRECTORY, "Collected");
+    return true;
+}
+
+bool test_queued_keys_defer_frames() {
+    settle();
+    press_key();
+    ASSERT_TRUE(frame_sched_wait(), "A key is readable");
+    frame_sched_mark(FRAME_DIRECTORY);
+    ASSERT_EQ(frame_sched_begin(), 0, "Keys first");
+
+    pause_ms(50);
+    ASSERT_EQ(frame_sched_begin(), 0, "Still deferred under the limit");
+    pause_ms(60);
+    ASSERT_EQ(frame_sched_begin(), FRAME_DIRECTORY, "Painted between keys after 100 ms");
+    read_key();
+
+    frame_sched_mark(FRAME_PREVIEW);
+    pause_ms(FRAME_INTERVAL_MS + 4);
+    ASSERT_EQ(frame_sched_begin(), FRAME_PREVIEW, "No key queued: painted");
+    return true;
+}
+
+bool test_watched_fd_wakes_wait() {
+    settle();
+    int extra[2];
+    ASSERT_EQ(pipe(extra), 0, "Pipe");
+    frame_sched_watch_fd(extra[0]);
+    ASSERT_EQ(write(extra[1], "x", 1), 1, "Readable");
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ASSERT_FALSE(frame_sched_wait(), "Not a key");
+    ASSERT_TRUE(ms_since(&start) < 100, "Woken by the descriptor");
+    frame_sched_watch_fd(-1);
+    close(extra[0]);
+    close(extra[1]);
+    return true;
+}
+
+int main() {
+    printf("=== Frame Scheduler Tests ===\n\n");
+
+    if (pipe(key_pipe) != 0 || dup2(key_pipe[0], STDIN_FILENO) < 0) {
+        perror("pipe");
+        return 1;
+    }
+    if (!frame_sched_init()) {
+        printf("eventfd unavailable\n");
+        return 1;
+    }
+
+    RUN_TEST(test_marks_coalesce_into_one_frame);
+    RUN_TEST(test_frames_are_paced);
+    RUN_TEST(test_mark_in_uses_earliest_deadline);
+    RUN_TEST(test_post_wakes_wait);
+    RUN_TEST(test_queued_keys_defer_frames);
+    RUN_TEST(test_watched_fd_wakes_wait);
+
+    frame_sched_shutdown();
+    PRINT_SUMMARY();
+}
@@ -0,0 +1,191 @@
+#include "test_runner.h"
+#include "keysort.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Items carry a small key (lots of ties) and their input position, so sorted
+// output can be checked for both order and stability.
+typedef struct {
+    uint64_t k;
+    uint64_t tie;
+    size_t pos;
+} Item;
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static void item_key(KeySortRec *rec, void *ctx) {
+    (void)ctx;
+    const Item *it = rec->item;
+    rec->key[0] = it->k >> 8;
+    rec->key[1] = it->k & 0xff;
+    rec->key[2] = 0;
+}
+
+static int item_tie(const void *a, const void *b, void *ctx) {
+    (void)ctx;
+    const Item *x = a;
+    const Item *y = b;
+    return (x->tie > y->tie) - (x->tie < y->tie);
+}
+
+static Item *make_items(size_t n, uint64_t key_range, void ***ptrs) {
+    Item *items = malloc((n ? n : 1) * sizeof(*items));
+    *ptrs = malloc((n ? n : 1) * sizeof(**ptrs));
+    for (size_t i = 0; i < n; i++) {
+        items[i].k = rng_next() % key_range;
+        items[i].tie = rng_next() % 4;
+        items[i].pos = i;
+        (*ptrs)[i] = &items[i];
+    }
+    return items;
+}
+
+// Sorted by key, then tie function (if any), then input position.
+static bool is_sorted_stable(const KeySortRec *recs, size_t n, bool use_tie) {
+    for (size_t i = 1; i < n; i++) {
+        const Item *a = recs[i - 1].item;
+        const Item *b = recs[i].item;
+        if (a->k != b->k) {
+            if (a->k > b->k) return false;
+            continue;
+        }
+        if (use_tie && a->tie != b->tie) {
+            if (a->tie > b->tie) return false;
+            continue;
+        }
+        if (a->pos > b->pos) return false;
+    }
+    return true;
+}
+
+static bool sort_round_trip(size_t n, uint64_t key_range, int threads, bool use_tie) {
+    void **ptrs;
+    Item *items = make_items(n, key_range, &ptrs);
+    KeySortRec *recs = malloc((2 * n + 1) * sizeof(*recs));
+    KeySortOpts opts = { .tie = use_tie ? item_tie : NULL, .threads = threads };
+
+    KeySort_extract(recs, ptrs, n, item_key, NULL, &opts);
+    KeySort_sort(recs, recs + n, n, &opts);
+
+    bool ok = is_sorted_stable(recs, n, use_tie);
+    // Every item must appear exactly once
+    char *seen = calloc(n + 1, 1);
+    for (size_t i = 0; ok && i < n; i++) {
+        const Item *it = recs[i].item;
+        if (seen[it->pos]) ok = false;
+        seen[it->pos] = 1;
+    }
+    free(seen);
+    free(recs);
+    free(ptrs);
+    free(items);
+    return ok;
+}
+
+// Test empty and single-element inputs
+bool test_keysort_trivial() {
+    ASSERT_TRUE(sort_round_trip(0, 10, 1, false), "Empty input should sort");
+    ASSERT_TRUE(sort_round_trip(1, 10, 1, false), "Single record should sort");
+    ASSERT_TRUE(sort_round_trip(2, 10, 1, true), "Two records should sort");
+    return true;
+}
+
+// Test small inputs (insertion sort path) are stable
+bool test_keysort_small_stable() {
+    for (size_t n = 3; n < 200; n += 7) {
+        ASSERT_TRUE(sort_round_trip(n, 5, 1, false), "Small input should sort stably");
+    }
+    return true;
+}
+
+// Test wide keys that spread over many radix buckets
+bool test_keysort_wide_keys() {
+    ASSERT_TRUE(sort_round_trip(5000, UINT64_MAX, 1, false), "Random 64-bit keys should sort");
+    ASSERT_TRUE(sort_round_trip(5000, 1000, 1, false), "Clustered keys should sort");
+    return true;
+}
+
+// Test fully tied keys fall back to the tie function, then input order
+bool test_keysort_tie_function() {
+    ASSERT_TRUE(sort_round_trip(3000, 1, 1, true), "All-equal keys should order by the tie function");
+    ASSERT_TRUE(sort_round_trip(3000, 3, 1, true), "Few distinct keys should order by the tie function");
+    return true;
+}
+
+// Test large inputs with several threads give the same order as one thread
+bool test_keysort_parallel() {
+    ASSERT_TRUE(sort_round_trip(100000, 50000, 4, false), "Parallel sort should be ordered and stable");
+    ASSERT_TRUE(sort_round_trip(100000, 7, 4, true), "Parallel sort should honour the tie function");
+    ASSERT_TRUE(sort_round_trip(100000, UINT64_MAX, 0, false), "Default thread count should sort");
+    return true;
+}
+
+// Test KeySort_merge keeps x ahead of y on equal records
+bool test_keysort_merge() {
+    size_t nx = 40000;
+    size_t ny = 30000;
+    void **ptrs;
+    Item *items = make_items(nx + ny, 100, &ptrs);
+    KeySortRec *recs = malloc(2 * (nx + ny) * sizeof(*recs));
+    KeySortRec *out = recs + nx + ny;
+    KeySortOpts opts = { .threads = 4 };
+
+    KeySort_extract(recs, ptrs, nx + ny, item_key, NULL, &opts);
+    KeySort_sort(recs, out, nx, &opts);
+    KeySort_sort(recs + nx, out, ny, &opts);
+    KeySort_merge(recs, nx, recs + nx, ny, out, &opts);
+
+    bool ok = is_sorted_stable(out, nx + ny, false);
+    free(recs);
+    free(ptrs);
+    free(items);
+    ASSERT_TRUE(ok, "Merged runs should be ordered with x first on ties");
+    return true;
+}
+
+// Test case-folded prefixes order like KeySort_casecmp
+bool test_keysort_casefold_prefix() {
+    const char *names[] = {
+        "", "a", "A", "ab", "B", "readme", "README.md", "Makefile", "makefile2",
+        "_hidden", "zeta", "a-very-long-name-past-the-prefix-x",
+        "a-very-long-name-past-the-prefix-y", "\xc3\xa9t\xc3\xa9",
+    };
+    size_t n = sizeof(names) / sizeof(names[0]);
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < n; j++) {
+            uint64_t a[2];
+            uint64_t b[2];
+            KeySort_casefold_prefix(names[i], a, 2);
+            KeySort_casefold_prefix(names[j], b, 2);
+            int key_cmp = a[0] != b[0] ? (a[0] < b[0] ? -1 : 1)
+                        : a[1] != b[1] ? (a[1] < b[1] ? -1 : 1) : 0;
+            int full = KeySort_casecmp(names[i], names[j]);
+            full = (full > 0) - (full < 0);
+            ASSERT(key_cmp == 0 || key_cmp == full, "Prefix order should agree with KeySort_casecmp");
+        }
+    }
+    ASSERT_EQ(KeySort_casecmp("ReadMe", "readme"), 0, "Comparison should ignore ASCII case");
+    return true;
+}
+
+int main() {
+    printf("=== Key Sort Tests ===\n\n");
+
+    RUN_TEST(test_keysort_trivial);
+    RUN_TEST(test_keysort_small_stable);
+    RUN_TEST(test_keysort_wide_keys);
+    RUN_TEST(test_keysort_tie_function);
+    RUN_TEST(test_keysort_parallel);
+    RUN_TEST(test_keysort_merge);
+    RUN_TEST(test_keysort_casefold_prefix);
+
+    PRINT_SUMMARY();
+}
@@ -0,0 +1,335 @@
+#define _DEFAULT_SOURCE
+#include "test_runner.h"
+#include "app_state.h"
+#include "arena.h"
+#include "dir_watch.h"
+#include "globals.h"
+#include "listing_cache.h"
+#include "listing_sort.h"
+#include "utils.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Large enough that three fit under LISTING_CACHE_MAX_BYTES and four do not
+#define PADDING_BYTES (20 * 1024 * 1024)
+
+static char root[64];
+
+static void touch(const char *dir, const char *name) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *fp = fopen(path, "a");
+    if (fp) {
+        fputc('x', fp);
+        fclose(fp);
+    }
+}
+
+static void at_root(char *out, size_t size, const char *name) {
+    snprintf(out, size, "%s/%s", root, name);
+}
+
+static void remove_tree(const char *path) {
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", path);
+    if (system(cmd) != 0) fprintf(stderr, "could not remove %s\n", path);
+}
+
+static const char *make_root(void) {
+    strcpy(root, "/tmp/test_listing_cache_XXXXXX");
+    return mkdtemp(root);
+}
+
+// Dates the last modification of `path` an hour back, long enough ago for
+// the cache to trust its mtime.
+static void backdate(const char *path) {
+    struct timespec times[2];
+    clock_gettime(CLOCK_REALTIME, &times[0]);
+    times[0].tv_sec -= 3600;
+    times[1] = times[0];
+    utimensat(AT_FDCWD, path, times, 0);
+}
+
+// Makes `root`/`name` holding `count` files, last modified an hour ago.
+static void make_dir(char *out, size_t size, const char *name, int count) {
+    at_root(out, size, name);
+    mkdir(out, 0755);
+    char file[32];
+    for (int i = 0; i < count; i++) {
+        snprintf(file, sizeof(file), "f%02d", i);
+        touch(out, file);
+    }
+    backdate(out);
+}
+
+// An empty live listing as main() keeps it. Without `watched` it has no
+// watcher, like a system without inotify.
+static void listing_init(Vector *files, LazyLoadState *lazy_load, bool watched) {
+    memset(lazy_load, 0, sizeof(*lazy_load));
+    *files = Vector_new(16);
+    dir_cursor_init(&lazy_load->cursor);
+    lazy_load->arena = Arena_new(LISTING_ARENA_CHUNK);
+    sort_index_init(&lazy_load->sort, SORT_BY_NAME, true);
+    lazy_load->watch = watched ? dir_watch_open() : NULL;
+}
+
+static void listing_close(Vector *files, LazyLoadState *lazy_load) {
+    free_listing(files, lazy_load);
+    Vector_bye(files);
+}
+
+// Reads `path` into the live listing and hands it to the cache.
+static void visit(ListingCache *cache, const char *path, Vector *files, LazyLoadState *lazy_load,
+                  const CursorAndSlice *cas) {
+    reload_directory_full(files, path, lazy_load);
+    listing_cache_store(cache, path, files, lazy_load, cas);
+}
+
+static const char *entry_name(const Vector *files, size_t i) {
+    return FileAttr_get_name((FileAttr)files->el[i]);
+}
+
+bool test_store_and_restore_keeps_position() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    char dir[512];
+    make_dir(dir, sizeof(dir), "d", 30);
+    ListingCache *cache = listing_cache_new(LISTING_CACHE_MAX_ENTRIES, LISTING_CACHE_MAX_BYTES);
+    Vector files;
+    LazyLoadState lazy_load;
+    listing_init(&files, &lazy_load, true);
+
+    reload_directory_full(&files, dir, &lazy_load);
+    ASSERT_EQ(Vector_len(files), 30, "Listed");
+    FileAttr at_cursor = (FileAttr)files.el[12];
+    CursorAndSlice cas = {.start = 5, .cursor = 12, .num_lines = 10, .num_files = 30};
+    listing_cache_store(cache, dir, &files, &lazy_load, &cas);
+    ASSERT_TRUE(listing_cache_contains(cache, dir), "Cached");
+    ASSERT_EQ(Vector_len(files), 0, "Live listing left empty");
+    ASSERT_EQ(lazy_load.files_loaded, 0, "Nothing counted as loaded");
+
+    CursorAndSlice back = {.num_lines = 10};
+    ASSERT_TRUE(listing_cache_restore(cache, dir, &files, &lazy_load, &back), "Hit");
+    ASSERT_EQ(Vector_len(files), 30, "Every entry back");
+    ASSERT_TRUE(files.el[12] == at_cursor, "The same entries, not a reload");
+    ASSERT_STR_EQ(entry_name(&files, 0), "f00", "Still sorted");
+    ASSERT_EQ(back.cursor, 12, "Cursor");
+    ASSERT_EQ(back.start, 5, "Scroll");
+    ASSERT_EQ(back.num_files, 30, "Count");
+    ASSERT_EQ(lazy_load.files_loaded, 30, "Complete");
+    ASSERT_FALSE(listing_cache_contains(cache, dir), "Taken out of the cache");
+
+    listing_cache_free(cache);
+    listing_close(&files, &lazy_load);
+    remove_tree(root);
+    return true;
+}
+
+bool test_restore_applies_current_order() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    char dir[512];
+    make_dir(dir, sizeof(dir), "d", 0);
+    touch(dir, "a");
+    char sub[600];
+    snprintf(sub, sizeof(sub), "%s/z", dir);
+    mkdir(sub, 0755);
+    ListingCache *cache = listing_cache_new(LISTING_CACHE_MAX_ENTRIES, LISTING_CACHE_MAX_BYTES);
+    Vector files;
+    LazyLoadState lazy_load;
+    listing_init(&files, &lazy_load, true);
+    CursorAndSlice cas = {0};
+
+    reload_directory_full(&files, dir, &lazy_load);
+    ASSERT_STR_EQ(entry_name(&files, 0), "z", "Directories first");
+    listing_cache_store(cache, dir, &files, &lazy_load, &cas);
+    ASSERT_TRUE(sort_index_set_order(&lazy_load.sort, SORT_BY_NAME, false),
+                "Order changed while cached");
+    ASSERT_TRUE(listing_cache_restore(cache, dir, &files, &lazy_load, &cas), "Hit");
+    ASSERT_FALSE(lazy_load.sort.dirs_first, "Live order kept");
+    ASSERT_STR_EQ(entry_name(&files, 0), "a", "Snapshot re-sorted");
+    ASSERT_STR_EQ(entry_name(&files, 1), "z", "Snapshot re-sorted");
+
+    listing_cache_free(cache);
+    listing_close(&files, &lazy_load);
+    remove_tree(root);
+    return true;
+}
+
+bool test_evicts_least_recently_used() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    char dirs[LISTING_CACHE_MAX_ENTRIES + 1][512];
+    char name[16];
+    for (int i = 0; i <= LISTING_CACHE_MAX_ENTRIES; i++) {
+        snprintf(name, sizeof(name), "d%02d", i);
+        make_dir(dirs[i], sizeof(dirs[i]), name, 2);
+    }
+    ListingCache *cache = listing_cache_new(LISTING_CACHE_MAX_ENTRIES, LISTING_CACHE_MAX_BYTES);
+    Vector files;
+    LazyLoadState lazy_load;
+    listing_init(&files, &lazy_load, false);
+    CursorAndSlice cas = {0};
+
+    for (int i = 0; i < LISTING_CACHE_MAX_ENTRIES; i++) {
+        visit(cache, dirs[i], &files, &lazy_load, &cas);
+    }
+    int cached = 0;
+    for (int i = 0; i < LISTING_CACHE_MAX_ENTRIES; i++) {
+        if (listing_cache_contains(cache, dirs[i])) cached++;
+    }
+    ASSERT_EQ(cached, LISTING_CACHE_MAX_ENTRIES, "All fit");
+
+    // Going back to the oldest makes it the most recently used
+    ASSERT_TRUE(listing_cache_restore(cache, dirs[0], &files, &lazy_load, &cas), "Hit");
+    listing_cache_store(cache, dirs[0], &files, &lazy_load, &cas);
+    visit(cache, dirs[LISTING_CACHE_MAX_ENTRIES], &files, &lazy_load, &cas);
+    ASSERT_TRUE(listing_cache_contains(cache, dirs[LISTING_CACHE_MAX_ENTRIES]), "Newest kept");
+    ASSERT_TRUE(listing_cache_contains(cache, dirs[0]), "Recently used kept");
+    ASSERT_FALSE(listing_cache_contains(cache, dirs[1]), "Least recently used evicted");
+    cached = 0;
+    for (int i = 0; i <= LISTING_CACHE_MAX_ENTRIES; i++) {
+        if (listing_cache_contains(cache, dirs[i])) cached++;
+    }
+    ASSERT_EQ(cached, LISTING_CACHE_MAX_ENTRIES, "Never more than the limit");
+
+    listing_cache_free(cache);
+    listing_close(&files, &lazy_load);
+    remove_tree(root);
+    return true;
+}
+
+// Puts a listing of `path` whose arena holds `padding` bytes.
+static bool put_padded(ListingCache *cache, const char *path, size_t padding) {
+    Vector files = Vector_new(1);
+    Arena arena = Arena_new(LISTING_ARENA_CHUNK);
+    SortIndex sort;
+    sort_index_init(&sort, SORT_BY_NAME, true);
+    Arena_alloc(&arena, padding);
+    bool ok = listing_cache_put(cache, path, &files, &arena, &sort, NULL);
+    free(files.el);
+    Arena_bye(&arena);
+    sort_index_free(&sort);
+    return ok;
+}
+
+bool test_evicts_over_byte_cap() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    char dirs[4][512];
+    char name[16];
+    for (int i = 0; i < 4; i++) {
+        snprintf(name, sizeof(name), "d%d", i);
+        make_dir(dirs[i], sizeof(dirs[i]), name, 0);
+    }
+    ListingCache *cache = listing_cache_new(LISTING_CACHE_MAX_ENTRIES, LISTING_CACHE_MAX_BYTES);
+
+    for (int i = 0; i < 3; i++) {
+        ASSERT_TRUE(put_padded(cache, dirs[i], PADDING_BYTES), "Fits");
+    }
+    for (int i = 0; i < 3; i++) {
+        ASSERT_TRUE(listing_cache_contains(cache, dirs[i]), "Under the cap");
+    }
+    ASSERT_TRUE(put_padded(cache, dirs[3], PADDING_BYTES), "Fits after eviction");
+    ASSERT_FALSE(listing_cache_contains(cache, dirs[0]), "Oldest evicted for memory");
+    ASSERT_TRUE(listing_cache_contains(cache, dirs[1]), "Rest kept");
+    ASSERT_TRUE(listing_cache_contains(cache, dirs[3]), "Newest kept");
+
+    ASSERT_FALSE(put_padded(cache, dirs[0], LISTING_CACHE_MAX_BYTES), "Larger than the cap");
+    ASSERT_FALSE(listing_cache_contains(cache, dirs[0]), "Not cached");
+    ASSERT_TRUE(listing_cache_contains(cache, dirs[1]), "Nothing evicted for it");
+
+    listing_cache_free(cache);
+    remove_tree(root);
+    return true;
+}
+
+bool test_unwatched_snapshot_dropped_on_change() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    char dir[512];
+    make_dir(dir, sizeof(dir), "d", 3);
+    ListingCache *cache = listing_cache_new(LISTING_CACHE_MAX_ENTRIES, LISTING_CACHE_MAX_BYTES);
+    Vector files;
+    LazyLoadState lazy_load;
+    listing_init(&files, &lazy_load, false);
+    CursorAndSlice cas = {0};
+
+    visit(cache, dir, &files, &lazy_load, &cas);
+    ASSERT_TRUE(listing_cache_restore(cache, dir, &files, &lazy_load, &cas), "Unchanged: hit");
+
+    listing_cache_store(cache, dir, &files, &lazy_load, &cas);
+    touch(dir, "new");
+    ASSERT_FALSE(listing_cache_restore(cache, dir, &files, &lazy_load, &cas), "Modified: miss");
+    ASSERT_FALSE(listing_cache_contains(cache, dir), "Stale snapshot dropped");
+
+    // Modified just now: the next change could keep the same mtime
+    visit(cache, dir, &files, &lazy_load, &cas);
+    ASSERT_FALSE(listing_cache_restore(cache, dir, &files, &lazy_load, &cas), "Recent: miss");
+
+    // Another directory under the same name, even with the same mtime
+    backdate(dir);
+    visit(cache, dir, &files, &lazy_load, &cas);
+    struct stat st;
+    ASSERT_EQ(stat(dir, &st), 0, "Stat");
+    char moved[512];
+    at_root(moved, sizeof(moved), "old");
+    ASSERT_EQ(rename(dir, moved), 0, "Moved away");
+    ASSERT_EQ(mkdir(dir, 0755), 0, "Replaced");
+    struct timespec times[2] = {st.st_atim, st.st_mtim};
+    ASSERT_EQ(utimensat(AT_FDCWD, dir, times, 0), 0, "Same mtime");
+    ASSERT_FALSE(listing_cache_restore(cache, dir, &files, &lazy_load, &cas), "Replaced: miss");
+    ASSERT_FALSE(listing_cache_contains(cache, dir), "Dropped");
+
+    listing_cache_free(cache);
+    listing_close(&files, &lazy_load);
+    remove_tree(root);
+    return true;
+}
+
+bool test_watched_snapshot_survives_change() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    char dir[512];
+    make_dir(dir, sizeof(dir), "d", 3);
+    ListingCache *cache = listing_cache_new(LISTING_CACHE_MAX_ENTRIES, LISTING_CACHE_MAX_BYTES);
+    Vector files;
+    LazyLoadState lazy_load;
+    listing_init(&files, &lazy_load, true);
+    ASSERT_NOT_NULL(lazy_load.watch, "inotify available");
+    CursorAndSlice cas = {0};
+
+    visit(cache, dir, &files, &lazy_load, &cas);
+    touch(dir, "new");
+    listing_cache_poll(cache);
+    ASSERT_TRUE(listing_cache_contains(cache, dir), "Kept while the watcher keeps up");
+    ASSERT_TRUE(listing_cache_restore(cache, dir, &files, &lazy_load, &cas), "Hit");
+    ASSERT_EQ(Vector_len(files), 3, "As it was listed");
+    ASSERT_TRUE(poll_directory_watch(&lazy_load), "The change is pending");
+    sync_directory_changes(&files, dir, &lazy_load);
+    ASSERT_EQ(Vector_len(files), 4, "Applied as a delta");
+
+    // A watcher that lost its directory cannot bring the snapshot up to date
+    listing_cache_store(cache, dir, &files, &lazy_load, &cas);
+    ASSERT_TRUE(listing_cache_contains(cache, dir), "Cached again");
+    remove_tree(dir);
+    listing_cache_poll(cache);
+    ASSERT_FALSE(listing_cache_contains(cache, dir), "Evicted");
+
+    listing_cache_free(cache);
+    listing_close(&files, &lazy_load);
+    remove_tree(root);
+    return true;
+}
+
+int main() {
+    printf("=== Listing Cache Tests ===\n\n");
+
+    RUN_TEST(test_store_and_restore_keeps_position);
+    RUN_TEST(test_restore_applies_current_order);
+    RUN_TEST(test_evicts_least_recently_used);
+    RUN_TEST(test_evicts_over_byte_cap);
+    RUN_TEST(test_unwatched_snapshot_dropped_on_change);
+    RUN_TEST(test_watched_snapshot_survives_change);
+
+    PRINT_SUMMARY();
+}
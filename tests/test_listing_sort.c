@@ -0,0 +1,360 @@
+#define _DEFAULT_SOURCE
+#include "test_runner.h"
+#include "files.h"
+#include "listing_sort.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+// Past the key sort's single-threaded limit (1 << 15 records)
+#define LARGE_COUNT 40000
+
+#define LEN(a) (sizeof(a) / sizeof((a)[0]))
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+// An entry carrying its own metadata, so no order has to stat anything.
+static FileAttr entry(const char *name, bool is_dir, off_t size, time_t sec, long nsec) {
+    FileAttr fa = mk_attr(name, is_dir, 0);
+    struct stat st;
+    memset(&st, 0, sizeof(st));
+    st.st_mode = is_dir ? S_IFDIR | 0755 : S_IFREG | 0644;
+    st.st_size = size;
+    st.st_mtim.tv_sec = sec;
+    st.st_mtim.tv_nsec = nsec;
+    FileAttr_set_stat(fa, &st, -1);
+    return fa;
+}
+
+static void push(Vector *files, FileAttr fa) {
+    size_t len = Vector_len(*files);
+    Vector_add(files, 1);
+    files->el[len] = fa;
+    Vector_set_len_no_free(files, len + 1);
+}
+
+static Vector listing_of(const char *const *names, size_t n) {
+    Vector files = Vector_new(n);
+    for (size_t i = 0; i < n; i++) {
+        push(&files, entry(names[i], false, 0, 0, 0));
+    }
+    return files;
+}
+
+static void listing_free(Vector *files) {
+    for (size_t i = 0; i < Vector_len(*files); i++) {
+        free_attr((FileAttr)files->el[i]);
+    }
+    Vector_set_len_no_free(files, 0);
+    Vector_bye(files);
+}
+
+// True if `files` lists exactly `names`, in that order.
+static bool names_are(const Vector *files, const char *const *names, size_t n) {
+    if (Vector_len(*files) != n) return false;
+    for (size_t i = 0; i < n; i++) {
+        if (strcmp(FileAttr_get_name((FileAttr)files->el[i]), names[i]) != 0) {
+            printf("  at %zu: %s, expected %s\n", i, FileAttr_get_name((FileAttr)files->el[i]),
+                   names[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void sort_listing(Vector *files, SortMode mode, bool dirs_first) {
+    SortIndex si;
+    sort_index_init(&si, mode, dirs_first);
+    sort_index_build(&si, files, NULL);
+    sort_index_free(&si);
+}
+
+bool test_natural_order() {
+    const char *input[] = {"file10", "File2", "b", "file1", "a", "file02x",
+                           "shared_prefix_longer_than_a_key_10", "shared_prefix_longer_than_a_key_9"};
+    const char *expect[] = {"a", "b", "file1", "File2", "file02x", "file10",
+                            "shared_prefix_longer_than_a_key_9", "shared_prefix_longer_than_a_key_10"};
+    Vector files = listing_of(input, LEN(input));
+    sort_listing(&files, SORT_BY_NATURAL, true);
+    ASSERT_TRUE(names_are(&files, expect, LEN(expect)), "Digit runs by value, case ignored");
+    listing_free(&files);
+    return true;
+}
+
+bool test_name_order() {
+    const char *input[] = {"file10", "File2", "abc", "file1", "ABC", "Abc",
+                           "shared_prefix_longer_than_a_key_b", "shared_prefix_longer_than_a_key_A"};
+    const char *expect[] = {"ABC", "Abc", "abc", "file1", "file10", "File2",
+                            "shared_prefix_longer_than_a_key_A", "shared_prefix_longer_than_a_key_b"};
+    Vector files = listing_of(input, LEN(input));
+    sort_listing(&files, SORT_BY_NAME, true);
+    ASSERT_TRUE(names_are(&files, expect, LEN(expect)), "Case-insensitive, byte order on ties");
+    listing_free(&files);
+    return true;
+}
+
+bool test_size_order() {
+    Vector files = Vector_new(8);
+    push(&files, entry("small", false, 10, 0, 0));
+    push(&files, entry("huge", false, (off_t)1 << 40, 0, 0));
+    push(&files, entry("b_mid", false, 4096, 0, 0));
+    push(&files, entry("a_mid", false, 4096, 0, 0));
+    push(&files, entry("empty", false, 0, 0, 0));
+    const char *expect[] = {"huge", "a_mid", "b_mid", "small", "empty"};
+    sort_listing(&files, SORT_BY_SIZE, false);
+    ASSERT_TRUE(names_are(&files, expect, LEN(expect)), "Largest first, name on ties");
+    listing_free(&files);
+    return true;
+}
+
+bool test_mtime_order() {
+    Vector files = Vector_new(8);
+    push(&files, entry("old", false, 0, 1000, 0));
+    push(&files, entry("new", false, 0, 2000, 5));
+    push(&files, entry("newer_ns", false, 0, 2000, 900000000));
+    push(&files, entry("b_same", false, 0, 1500, 7));
+    push(&files, entry("a_same", false, 0, 1500, 7));
+    const char *expect[] = {"newer_ns", "new", "a_same", "b_same", "old"};
+    sort_listing(&files, SORT_BY_MTIME, false);
+    ASSERT_TRUE(names_are(&files, expect, LEN(expect)), "Newest first, nanoseconds count");
+    listing_free(&files);
+    return true;
+}
+
+bool test_extension_order() {
+    const char *input[] = {"b.c", "a.txt", "noext", "a.c", ".bashrc", "x.longextension",
+                           "y.longextensio", "z.TXT"};
+    const char *expect[] = {".bashrc", "noext", "a.c", "b.c", "y.longextensio",
+                            "x.longextension", "a.txt", "z.TXT"};
+    Vector files = listing_of(input, LEN(input));
+    sort_listing(&files, SORT_BY_EXTENSION, false);
+    ASSERT_TRUE(names_are(&files, expect, LEN(expect)), "Extension, then name");
+    listing_free(&files);
+    return true;
+}
+
+bool test_dirs_first() {
+    Vector files = Vector_new(8);
+    push(&files, entry("b", false, 1, 0, 0));
+    push(&files, entry("d", true, 4096, 0, 0));
+    push(&files, entry("a", false, 8192, 0, 0));
+    push(&files, entry("c", true, 2, 0, 0));
+
+    const char *grouped[] = {"c", "d", "a", "b"};
+    sort_listing(&files, SORT_BY_NAME, true);
+    ASSERT_TRUE(names_are(&files, grouped, LEN(grouped)), "Directories first");
+
+    const char *mixed[] = {"a", "b", "c", "d"};
+    sort_listing(&files, SORT_BY_NAME, false);
+    ASSERT_TRUE(names_are(&files, mixed, LEN(mixed)), "Interleaved without the group");
+
+    const char *by_size[] = {"d", "c", "a", "b"};
+    sort_listing(&files, SORT_BY_SIZE, true);
+    ASSERT_TRUE(names_are(&files, by_size, LEN(by_size)), "Grouping applies to every order");
+    listing_free(&files);
+    return true;
+}
+
+// Many names sharing prefixes longer than the key, in mixed case.
+static Vector large_listing(void) {
+    static const char *const prefixes[] = {"", "img_", "IMG_", "a_directory_name_that_runs_past_the_key_"};
+    Vector files = Vector_new(LARGE_COUNT);
+    char name[128];
+    for (size_t i = 0; i < LARGE_COUNT; i++) {
+        uint64_t r = rng_next();
+        snprintf(name, sizeof(name), "%s%llu_%zu", prefixes[r % LEN(prefixes)],
+                 (unsigned long long)(r >> 8) % 5000, i);
+        push(&files, entry(name, r % 7 == 0, 0, 0, 0));
+    }
+    return files;
+}
+
+static int name_ref_cmp(FileAttr a, FileAttr b, bool dirs_first) {
+    if (dirs_first && FileAttr_is_dir(a) != FileAttr_is_dir(b)) return FileAttr_is_dir(a) ? -1 : 1;
+    int c = strcasecmp(FileAttr_get_name(a), FileAttr_get_name(b));
+    return c ? c : strcmp(FileAttr_get_name(a), FileAttr_get_name(b));
+}
+
+// Sorting a large listing goes through the radix and threaded paths; merging
+// it in batches has to land on the very same order.
+bool test_large_build_and_merge_agree() {
+    Vector files = large_listing();
+    void **arrival = malloc(LARGE_COUNT * sizeof(*arrival));
+    ASSERT_NOT_NULL(arrival, "Allocated");
+    memcpy(arrival, files.el, LARGE_COUNT * sizeof(*arrival));
+
+    SortIndex si;
+    sort_index_init(&si, SORT_BY_NAME, true);
+    sort_index_build(&si, &files, NULL);
+    size_t misordered = 0;
+    for (size_t i = 1; i < LARGE_COUNT; i++) {
+        if (name_ref_cmp(files.el[i - 1], files.el[i], true) >= 0) misordered++;
+    }
+    ASSERT_EQ(misordered, 0, "Built in order");
+
+    // Grow the copy the way a loader does, one uneven batch at a time
+    Vector batched = Vector_new(64);
+    SortIndex merged;
+    sort_index_init(&merged, SORT_BY_NAME, true);
+    size_t len = 0;
+    size_t batch = 1000;
+    while (len < LARGE_COUNT) {
+        size_t next = len + batch < LARGE_COUNT ? len + batch : LARGE_COUNT;
+        for (size_t i = len; i < next; i++) push(&batched, arrival[i]);
+        sort_index_merge(&merged, &batched, len, NULL);
+        len = next;
+        batch = batch * 3 / 2;
+    }
+    size_t differ = 0;
+    for (size_t i = 0; i < LARGE_COUNT; i++) {
+        if (batched.el[i] != files.el[i]) differ++;
+    }
+    ASSERT_EQ(Vector_len(batched), LARGE_COUNT, "Every batch merged");
+    ASSERT_EQ(differ, 0, "Same order as one build");
+
+    sort_index_free(&si);
+    sort_index_free(&merged);
+    Vector_set_len_no_free(&batched, 0);
+    Vector_bye(&batched);
+    free(arrival);
+    listing_free(&files);
+    return true;
+}
+
+bool test_merge_of_ordered_batches() {
+    const char *first[] = {"a", "c", "e"};
+    const char *later[] = {"f", "g"};
+    const char *between[] = {"b", "d"};
+    const char *expect[] = {"a", "b", "c", "d", "e", "f", "g"};
+    Vector files = listing_of(first, LEN(first));
+    SortIndex si;
+    sort_index_init(&si, SORT_BY_NAME, true);
+    sort_index_build(&si, &files, NULL);
+
+    push(&files, entry(later[0], false, 0, 0, 0));
+    push(&files, entry(later[1], false, 0, 0, 0));
+    sort_index_merge(&si, &files, 3, NULL);
+    push(&files, entry(between[1], false, 0, 0, 0));
+    push(&files, entry(between[0], false, 0, 0, 0));
+    sort_index_merge(&si, &files, 5, NULL);
+    ASSERT_TRUE(names_are(&files, expect, LEN(expect)), "Appended and interleaved batches");
+
+    // A stale index is rebuilt rather than merged into
+    push(&files, entry("0", false, 0, 0, 0));
+    sort_index_merge(&si, &files, 2, NULL);
+    ASSERT_STR_EQ(FileAttr_get_name((FileAttr)files.el[0]), "0", "Rebuilt");
+    ASSERT_EQ(si.len, Vector_len(files), "Index mirrors the listing");
+    sort_index_free(&si);
+    listing_free(&files);
+    return true;
+}
+
+// Entries no key or name tells apart keep the order they came in.
+bool test_equal_entries_are_stable() {
+    Vector files = Vector_new(128);
+    FileAttr dups[100];
+    for (size_t i = 0; i < LEN(dups); i++) {
+        push(&files, entry(i % 2 ? "z" : "a", false, 0, 0, 0));
+        dups[i] = files.el[i];
+    }
+    SortIndex si;
+    sort_index_init(&si, SORT_BY_NATURAL, true);
+    sort_index_build(&si, &files, NULL);
+    bool stable = true;
+    for (size_t i = 0; i < 50; i++) {
+        if (files.el[i] != dups[2 * i] || files.el[50 + i] != dups[2 * i + 1]) stable = false;
+    }
+    ASSERT_TRUE(stable, "Build keeps input order on ties");
+
+    // A merged duplicate goes after the ones already listed
+    FileAttr late = entry("a", false, 0, 0, 0);
+    push(&files, late);
+    sort_index_merge(&si, &files, 100, NULL);
+    ASSERT_TRUE(files.el[50] == late, "Merge keeps listed entries first");
+    ASSERT_TRUE(files.el[49] == dups[98], "Earlier duplicates untouched");
+
+    // Sorting a sorted listing again moves nothing
+    void *before[101];
+    memcpy(before, files.el, sizeof(before));
+    sort_index_build(&si, &files, NULL);
+    ASSERT_TRUE(memcmp(before, files.el, sizeof(before)) == 0, "Re-sort is a no-op");
+    sort_index_free(&si);
+    listing_free(&files);
+    return true;
+}
+
+bool test_compact_and_index_of() {
+    const char *input[] = {"d", "a", "c", "b"};
+    const char *expect[] = {"a", "c", "d"};
+    Vector files = listing_of(input, LEN(input));
+    SortIndex si;
+    sort_index_init(&si, SORT_BY_NAME, true);
+    sort_index_build(&si, &files, NULL);
+
+    FileAttr gone = files.el[1];
+    FileAttr c = files.el[2];
+    ASSERT_EQ(listing_index_of(&files, c), 2, "Found");
+    files.el[1] = NULL;
+    free_attr(gone);
+    sort_index_compact(&si, &files);
+    ASSERT_TRUE(names_are(&files, expect, LEN(expect)), "Holes dropped, order kept");
+    ASSERT_EQ(si.len, 3, "Keys compacted alongside");
+    ASSERT_EQ(listing_index_of(&files, c), 1, "Moved up");
+    ASSERT_EQ(listing_index_of(&files, NULL), (size_t)-1, "No entry");
+    sort_index_free(&si);
+    listing_free(&files);
+    return true;
+}
+
+bool test_mode_names_round_trip() {
+    for (int m = 0; m < SORT_BY_COUNT; m++) {
+        SortMode parsed = SORT_BY_COUNT;
+        ASSERT_TRUE(sort_mode_parse(sort_mode_name((SortMode)m), &parsed), "Own name parses");
+        ASSERT_EQ((int)parsed, m, "Back to the same mode");
+    }
+    SortMode out = SORT_BY_MTIME;
+    ASSERT_TRUE(sort_mode_parse("SIZE", &out), "Case ignored");
+    ASSERT_EQ(out, SORT_BY_SIZE, "Parsed");
+    ASSERT_FALSE(sort_mode_parse("random", &out), "Unknown name");
+    ASSERT_FALSE(sort_mode_parse(NULL, &out), "No name");
+    ASSERT_EQ(out, SORT_BY_SIZE, "Left untouched");
+    ASSERT_STR_EQ(sort_mode_name(SORT_BY_COUNT), "natural", "Out of range falls back");
+
+    SortIndex si;
+    sort_index_init(&si, SORT_BY_COUNT, false);
+    ASSERT_EQ(si.mode, SORT_BY_NATURAL, "Invalid mode starts natural");
+    ASSERT_TRUE(sort_index_set_order(&si, SORT_BY_SIZE, false), "Changed");
+    ASSERT_FALSE(sort_index_set_order(&si, SORT_BY_SIZE, false), "Same order");
+    ASSERT_TRUE(sort_index_set_order(&si, SORT_BY_SIZE, true), "Grouping alone changes it");
+    ASSERT_FALSE(sort_index_set_order(&si, SORT_BY_COUNT, true), "Invalid mode refused");
+    ASSERT_EQ(si.mode, SORT_BY_SIZE, "Kept");
+    sort_index_free(&si);
+    return true;
+}
+
+int main() {
+    printf("=== Listing Sort Tests ===\n\n");
+
+    RUN_TEST(test_natural_order);
+    RUN_TEST(test_name_order);
+    RUN_TEST(test_size_order);
+    RUN_TEST(test_mtime_order);
+    RUN_TEST(test_extension_order);
+    RUN_TEST(test_dirs_first);
+    RUN_TEST(test_large_build_and_merge_agree);
+    RUN_TEST(test_merge_of_ordered_batches);
+    RUN_TEST(test_equal_entries_are_stable);
+    RUN_TEST(test_compact_and_index_of);
+    RUN_TEST(test_mode_names_round_trip);
+
+    PRINT_SUMMARY();
+}
@@ -0,0 +1,106 @@
+#define _DEFAULT_SOURCE
+#include "test_runner.h"
+#include "mime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// mime.c wakes the main loop when results come in; nothing to wake here.
+void frame_sched_post(unsigned regions) { (void)regions; }
+
+// More than the worker's queue (256) holds at once
+#define SCRIPT_COUNT 700
+
+static char root[64];
+
+static void remove_tree(const char *path) {
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", path);
+    if (system(cmd) != 0) fprintf(stderr, "could not remove %s\n", path);
+}
+
+static const char *make_root(void) {
+    strcpy(root, "/tmp/test_mime_XXXXXX");
+    return mkdtemp(root);
+}
+
+// Shell scripts without an extension: only libmagic can tell what they are.
+static void write_script(const char *path, int n) {
+    FILE *fp = fopen(path, "w");
+    fprintf(fp, "#!/bin/sh\necho %d\n", n);
+    fclose(fp);
+}
+
+bool test_emoji_falls_back_without_stat() {
+    ASSERT_STR_EQ(mime_cached_emoji("/nowhere/x.py", "x.py", NULL), "🐍", "Extension guess");
+    ASSERT_STR_EQ(mime_cached_emoji(NULL, "x", NULL), "📄", "Default icon");
+    return true;
+}
+
+bool test_cached_type_detects_and_caches() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    char path[512];
+    snprintf(path, sizeof(path), "%s/script", root);
+    write_script(path, 1);
+    struct stat st;
+    ASSERT_EQ(lstat(path, &st), 0, "Stat");
+
+    char type[64];
+    ASSERT_TRUE(mime_cached_type(path, &st, type, sizeof(type)), "Detected");
+    ASSERT_STR_EQ(type, "text/x-shellscript", "Shell script");
+    ASSERT_STR_EQ(mime_cached_emoji(path, "script", &st), "💻", "Emoji from the cached type");
+    remove_tree(root);
+    return true;
+}
+
+// Asks for the emoji of `path` until the worker has detected it.
+static bool script_resolves(const char *path, const struct stat *st) {
+    const char *name = strrchr(path, '/') + 1;
+    for (int i = 0; i < 400; i++) {
+        if (strcmp(mime_cached_emoji(path, name, st), "💻") == 0) return true;
+        struct timespec pause = {0, 5 * 1000 * 1000};
+        nanosleep(&pause, NULL);
+    }
+    return false;
+}
+
+// Lookups that overflow the worker's queue must still all resolve: a dropped
+// job may not leave its entry marked as queued for good.
+bool test_emoji_queue_overflow_resolves_all() {
+    ASSERT_NOT_NULL(make_root(), "Temporary directory");
+    static char paths[SCRIPT_COUNT][128];
+    static struct stat stats[SCRIPT_COUNT];
+    int made = 0;
+    for (int i = 0; i < SCRIPT_COUNT; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "%s/s%d", root, i);
+        write_script(paths[i], i);
+        if (lstat(paths[i], &stats[i]) == 0) made++;
+    }
+    ASSERT_EQ(made, SCRIPT_COUNT, "Scripts written");
+
+    // One burst, far faster than libmagic: most jobs are dropped
+    for (int i = 0; i < SCRIPT_COUNT; i++) {
+        mime_cached_emoji(paths[i], strrchr(paths[i], '/') + 1, &stats[i]);
+    }
+    int resolved = 0;
+    for (int i = 0; i < SCRIPT_COUNT; i++) {
+        if (script_resolves(paths[i], &stats[i])) resolved++;
+    }
+    ASSERT_EQ(resolved, SCRIPT_COUNT, "Every entry resolved");
+    remove_tree(root);
+    return true;
+}
+
+int main() {
+    printf("=== MIME Cache Tests ===\n\n");
+
+    RUN_TEST(test_emoji_falls_back_without_stat);
+    RUN_TEST(test_cached_type_detects_and_caches);
+    RUN_TEST(test_emoji_queue_overflow_resolves_all);
+
+    mime_cleanup();
+    PRINT_SUMMARY();
+}
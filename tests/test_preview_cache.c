@@ -0,0 +1,194 @@
+#define _POSIX_C_SOURCE 200809L
+#include "test_runner.h"
+#include "preview_cache.h"
+#include <stdio.h>
+#include <string.h>
+
+#define BLANK ((chtype)' ')
+
+// Writes `text` drawn in `attr` into `cells` from `at` on; returns the next cell.
+static int put_cells(chtype *cells, int at, const char *text, attr_t attr) {
+    for (size_t i = 0; text[i]; i++) cells[at++] = (chtype)(unsigned char)text[i] | attr;
+    return at;
+}
+
+static void pad_cells(chtype *cells, int at, int width) {
+    while (at < width) cells[at++] = BLANK;
+}
+
+static struct stat fake_stat(ino_t ino, off_t size, time_t mtime) {
+    struct stat st;
+    memset(&st, 0, sizeof(st));
+    st.st_dev = 1;
+    st.st_ino = ino;
+    st.st_size = size;
+    st.st_mtim.tv_sec = mtime;
+    return st;
+}
+
+// A frame of `lines` one-run lines "line <i>" starting at `start_line`.
+static PreviewFrame *simple_frame(int start_line, int width, int lines, bool at_end) {
+    PreviewFrame *frame = preview_frame_new(start_line, width);
+    chtype cells[64];
+    for (int i = 0; i < lines; i++) {
+        char text[32];
+        snprintf(text, sizeof(text), "line %d", start_line + i);
+        int n = put_cells(cells, 0, text, A_NORMAL);
+        pad_cells(cells, n, width);
+        preview_frame_add_line(frame, cells, width, BLANK);
+    }
+    preview_frame_set_end(frame, at_end);
+    return frame;
+}
+
+bool test_frame_runs() {
+    chtype cells[40];
+    int n = put_cells(cells, 0, "int", A_BOLD | COLOR_PAIR(11));
+    n = put_cells(cells, n, " x = ", A_NORMAL);
+    n = put_cells(cells, n, "42", COLOR_PAIR(14));
+    n = put_cells(cells, n, ";", A_NORMAL);
+    pad_cells(cells, n, 40);
+
+    PreviewFrame *frame = preview_frame_new(0, 40);
+    ASSERT_NOT_NULL(frame, "Frame should be created");
+    ASSERT_TRUE(preview_frame_add_line(frame, cells, 40, BLANK), "Line should be added");
+    ASSERT_EQ(preview_frame_line_count(frame), 1, "Frame should hold one line");
+
+    const PreviewRun *runs;
+    size_t run_count;
+    const char *text = preview_frame_line(frame, 0, &runs, &run_count);
+    ASSERT_EQ(run_count, 4, "Four attribute runs expected");
+    ASSERT_EQ(runs[0].len, 3, "Type run length");
+    ASSERT_EQ(runs[0].attr, (attr_t)(A_BOLD | COLOR_PAIR(11)), "Type run attribute");
+    ASSERT_EQ(runs[1].len, 5, "Plain run length");
+    ASSERT_EQ(runs[2].attr, (attr_t)COLOR_PAIR(14), "Number run attribute");
+    ASSERT_EQ(runs[3].len, 1, "Trailing blanks should be dropped");
+    ASSERT_TRUE(strncmp(text, "int x = 42;", 11) == 0, "Characters should be kept");
+    preview_frame_free(frame);
+    return true;
+}
+
+bool test_frame_blank_line() {
+    chtype cells[10];
+    pad_cells(cells, 0, 10);
+    PreviewFrame *frame = preview_frame_new(0, 10);
+    ASSERT_TRUE(preview_frame_add_line(frame, cells, 10, BLANK), "Blank line should be added");
+    const PreviewRun *runs;
+    size_t run_count;
+    preview_frame_line(frame, 0, &runs, &run_count);
+    ASSERT_EQ(run_count, 0, "Blank line has no runs");
+    preview_frame_free(frame);
+    return true;
+}
+
+bool test_cache_hit_and_window_match() {
+    PreviewCache *cache = preview_cache_new(8, 1 << 20);
+    struct stat st = fake_stat(10, 100, 1000);
+    preview_cache_put(cache, "/a.c", &st, simple_frame(0, 40, 20, false));
+
+    ASSERT_NOT_NULL(preview_cache_get(cache, "/a.c", &st, 0, 40, 20), "Same window should hit");
+    ASSERT_NOT_NULL(preview_cache_get(cache, "/a.c", &st, 0, 40, 10), "Smaller window should hit");
+    ASSERT_NULL(preview_cache_get(cache, "/a.c", &st, 0, 40, 21), "Taller window should miss");
+    ASSERT_NULL(preview_cache_get(cache, "/a.c", &st, 1, 40, 20), "Other start line should miss");
+    ASSERT_NULL(preview_cache_get(cache, "/a.c", &st, 0, 41, 20), "Other width should miss");
+    ASSERT_NULL(preview_cache_get(cache, "/b.c", &st, 0, 40, 20), "Other path should miss");
+    preview_cache_free(cache);
+    return true;
+}
+
+bool test_cache_end_of_file() {
+    PreviewCache *cache = preview_cache_new(8, 1 << 20);
+    struct stat st = fake_stat(10, 100, 1000);
+    preview_cache_put(cache, "/short.txt", &st, simple_frame(0, 40, 3, true));
+
+    const PreviewFrame *frame = preview_cache_get(cache, "/short.txt", &st, 0, 40, 30);
+    ASSERT_NOT_NULL(frame, "A short file's frame fills any taller window");
+    ASSERT_TRUE(preview_frame_at_end(frame, 30), "End of file is reached");
+    ASSERT_TRUE(preview_frame_at_end(frame, 3), "End of file right after the last row");
+    ASSERT_FALSE(preview_frame_at_end(frame, 2), "A cut window does not reach the end");
+    preview_cache_free(cache);
+    return true;
+}
+
+bool test_cache_invalidation() {
+    PreviewCache *cache = preview_cache_new(8, 1 << 20);
+    struct stat st = fake_stat(10, 100, 1000);
+    preview_cache_put(cache, "/a.c", &st, simple_frame(0, 40, 5, true));
+
+    struct stat touched = fake_stat(10, 100, 1001);
+    ASSERT_NULL(preview_cache_get(cache, "/a.c", &touched, 0, 40, 5), "New mtime should miss");
+    ASSERT_NULL(preview_cache_get(cache, "/a.c", &st, 0, 40, 5), "Stale frame should be gone");
+
+    preview_cache_put(cache, "/a.c", &st, simple_frame(0, 40, 5, true));
+    struct stat grown = fake_stat(10, 200, 1000);
+    ASSERT_NULL(preview_cache_get(cache, "/a.c", &grown, 0, 40, 5), "New size should miss");
+
+    preview_cache_put(cache, "/a.c", &st, simple_frame(0, 40, 5, true));
+    struct stat replaced = fake_stat(11, 100, 1000);
+    ASSERT_NULL(preview_cache_get(cache, "/a.c", &replaced, 0, 40, 5), "New inode should miss");
+    preview_cache_free(cache);
+    return true;
+}
+
+bool test_cache_replaces_per_path() {
+    PreviewCache *cache = preview_cache_new(8, 1 << 20);
+    struct stat st = fake_stat(10, 100, 1000);
+    preview_cache_put(cache, "/a.c", &st, simple_frame(0, 40, 5, false));
+    preview_cache_put(cache, "/a.c", &st, simple_frame(5, 40, 5, false));
+    ASSERT_NULL(preview_cache_get(cache, "/a.c", &st, 0, 40, 5), "Old window should be replaced");
+    ASSERT_NOT_NULL(preview_cache_get(cache, "/a.c", &st, 5, 40, 5), "New window should hit");
+    preview_cache_free(cache);
+    return true;
+}
+
+bool test_cache_lru_by_count() {
+    PreviewCache *cache = preview_cache_new(2, 1 << 20);
+    struct stat st = fake_stat(10, 100, 1000);
+    preview_cache_put(cache, "/a", &st, simple_frame(0, 40, 5, true));
+    preview_cache_put(cache, "/b", &st, simple_frame(0, 40, 5, true));
+    ASSERT_NOT_NULL(preview_cache_get(cache, "/a", &st, 0, 40, 5), "Touch /a");
+    preview_cache_put(cache, "/c", &st, simple_frame(0, 40, 5, true));
+
+    ASSERT_NOT_NULL(preview_cache_get(cache, "/a", &st, 0, 40, 5), "Recently used /a stays");
+    ASSERT_NULL(preview_cache_get(cache, "/b", &st, 0, 40, 5), "Least recently used /b goes");
+    ASSERT_NOT_NULL(preview_cache_get(cache, "/c", &st, 0, 40, 5), "New /c is cached");
+    preview_cache_free(cache);
+    return true;
+}
+
+bool test_cache_memory_bound() {
+    PreviewCache *cache = preview_cache_new(100, 4096);
+    struct stat st = fake_stat(10, 100, 1000);
+    char path[16];
+    for (int i = 0; i < 50; i++) {
+        snprintf(path, sizeof(path), "/f%d", i);
+        preview_cache_put(cache, path, &st, simple_frame(0, 60, 10, true));
+    }
+    int kept = 0;
+    for (int i = 0; i < 50; i++) {
+        snprintf(path, sizeof(path), "/f%d", i);
+        if (preview_cache_get(cache, path, &st, 0, 60, 10)) kept++;
+    }
+    ASSERT_TRUE(kept > 0 && kept < 50, "Memory cap should keep only some frames");
+    ASSERT_NOT_NULL(preview_cache_get(cache, "/f49", &st, 0, 60, 10), "Newest frame is kept");
+
+    preview_cache_put(cache, "/huge", &st, simple_frame(0, 60, 400, true));
+    ASSERT_NULL(preview_cache_get(cache, "/huge", &st, 0, 60, 10), "Oversized frame is not kept");
+    preview_cache_free(cache);
+    return true;
+}
+
+int main() {
+    printf("=== Preview Cache Tests ===\n\n");
+
+    RUN_TEST(test_frame_runs);
+    RUN_TEST(test_frame_blank_line);
+    RUN_TEST(test_cache_hit_and_window_match);
+    RUN_TEST(test_cache_end_of_file);
+    RUN_TEST(test_cache_invalidation);
+    RUN_TEST(test_cache_replaces_per_path);
+    RUN_TEST(test_cache_lru_by_count);
+    RUN_TEST(test_cache_memory_bound);
+
+    PRINT_SUMMARY();
+}
@@ -0,0 +1,403 @@
+#define _POSIX_C_SOURCE 200809L
+#include "test_runner.h"
+#include "syntax.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static SyntaxDef c_syntax(void) {
+    SyntaxDef def;
+    memset(&def, 0, sizeof(def));
+    def.block_comment_start = "/*";
+    def.block_comment_end = "*/";
+    return def;
+}
+
+// A line source that counts the lines it hands out and can stop early.
+typedef struct {
+    char **lines;
+    int num_lines;
+    int fetched;
+    int give_up_at; // -1: never
+} CountingLines;
+
+static const char *counting_get(void *ctx, int index) {
+    CountingLines *src = ctx;
+    if (index >= src->num_lines || index == src->give_up_at) return NULL;
+    src->fetched++;
+    return src->lines[index];
+}
+
+// `count` lines of plain code with a comment opened on `open_at` and closed
+// on `close_at` (either may be -1).
+static char **code_lines(int count, int open_at, int close_at) {
+    char **lines = calloc((size_t)count, sizeof(char *));
+    for (int i = 0; i < count; i++) {
+        char text[64];
+        if (i == open_at) {
+            snprintf(text, sizeof(text), "int x%d; /* starts here", i);
+        } else if (i == close_at) {
+            snprintf(text, sizeof(text), "ends here */ int y%d;", i);
+        } else {
+            snprintf(text, sizeof(text), "int v%d = %d; // plain", i, i);
+        }
+        lines[i] = strdup(text);
+    }
+    return lines;
+}
+
+static void free_lines(char **lines, int count) {
+    for (int i = 0; i < count; i++) free(lines[i]);
+    free(lines);
+}
+
+bool test_checkpoints_match_backward_scan() {
+    SyntaxDef def = c_syntax();
+    const char *pieces[] = {"/*", "*/", "x", "a ", "/**/", "*/*/"};
+    char *lines[300];
+    srand(18);
+    for (int round = 0; round < 20; round++) {
+        for (int i = 0; i < 300; i++) {
+            char text[64] = "";
+            int parts = rand() % 5;
+            for (int p = 0; p < parts; p++) strcat(text, pieces[rand() % 6]);
+            lines[i] = strdup(text);
+        }
+        SyntaxCheckpoints cp;
+        syntax_checkpoints_init(&cp);
+        for (int line = 0; line <= 300; line++) {
+            int expect = get_initial_block_comment_state(lines, 300, line, &def);
+            int got = syntax_checkpoints_state_lines(&cp, &def, lines, 300, line);
+            ASSERT_EQ(got, expect, "Forward lexing should agree with the backward scan");
+        }
+        syntax_checkpoints_free(&cp);
+        for (int i = 0; i < 300; i++) free(lines[i]);
+    }
+    return true;
+}
+
+bool test_checkpoints_bound_rescans() {
+    SyntaxDef def = c_syntax();
+    const int count = 100000;
+    char **lines = code_lines(count, 10, -1);
+    CountingLines src = {lines, count, 0, -1};
+    SyntaxCheckpoints cp;
+    syntax_checkpoints_init(&cp);
+
+    ASSERT_EQ(syntax_checkpoints_state(&cp, &def, 99000, counting_get, &src), 1,
+              "Comment opened near the top is still open");
+    ASSERT_EQ(src.fetched, 99000, "First query lexes everything above once");
+
+    for (int line = 98990; line < 99050; line++) {
+        src.fetched = 0;
+        syntax_checkpoints_state(&cp, &def, line, counting_get, &src);
+        ASSERT_TRUE(src.fetched <= SYNTAX_CHECKPOINT_INTERVAL,
+                    "Scrolling line by line lexes at most one interval");
+    }
+    src.fetched = 0;
+    ASSERT_EQ(syntax_checkpoints_state(&cp, &def, 5, counting_get, &src), 0,
+              "Lines above the comment are outside it");
+    ASSERT_TRUE(src.fetched <= 5, "Scrolling back up reuses the first checkpoint");
+
+    syntax_checkpoints_free(&cp);
+    free_lines(lines, count);
+    return true;
+}
+
+bool test_checkpoints_invalidate() {
+    SyntaxDef def = c_syntax();
+    const int count = 5000;
+    char **lines = code_lines(count, -1, -1);
+    SyntaxCheckpoints cp;
+    syntax_checkpoints_init(&cp);
+    ASSERT_EQ(syntax_checkpoints_state_lines(&cp, &def, lines, count, 4000), 0,
+              "No comment anywhere");
+
+    // Open a comment on line 1000
+    free(lines[1000]);
+    lines[1000] = strdup("/* opened by an edit");
+    syntax_checkpoints_invalidate(&cp, 1000);
+    ASSERT_EQ(syntax_checkpoints_state_lines(&cp, &def, lines, count, 4000), 1,
+              "Lines below the edit see the new comment");
+    ASSERT_EQ(syntax_checkpoints_state_lines(&cp, &def, lines, count, 1000), 0,
+              "The edited line itself starts outside it");
+
+    // Close it again on line 2000
+    free(lines[2000]);
+    lines[2000] = strdup("closed again */");
+    syntax_checkpoints_invalidate(&cp, 2000);
+    ASSERT_EQ(syntax_checkpoints_state_lines(&cp, &def, lines, count, 1500), 1,
+              "Lines between the edits are inside");
+    ASSERT_EQ(syntax_checkpoints_state_lines(&cp, &def, lines, count, 4000), 0,
+              "Lines below the closing edit are outside");
+
+    syntax_checkpoints_free(&cp);
+    free_lines(lines, count);
+    return true;
+}
+
+bool test_checkpoints_give_up_keeps_progress() {
+    SyntaxDef def = c_syntax();
+    const int count = 2000;
+    char **lines = code_lines(count, 100, -1);
+    CountingLines src = {lines, count, 0, 1500};
+    SyntaxCheckpoints cp;
+    syntax_checkpoints_init(&cp);
+
+    syntax_checkpoints_state(&cp, &def, 1900, counting_get, &src);
+    src.give_up_at = -1;
+    src.fetched = 0;
+    ASSERT_EQ(syntax_checkpoints_state(&cp, &def, 1900, counting_get, &src), 1,
+              "State is right once all lines are available");
+    ASSERT_TRUE(src.fetched < 1900 - 1500 + SYNTAX_CHECKPOINT_INTERVAL,
+                "Lexing resumes from the checkpoints made before giving up");
+
+    syntax_checkpoints_free(&cp);
+    free_lines(lines, count);
+    return true;
+}
+
+bool test_checkpoints_past_end() {
+    SyntaxDef def = c_syntax();
+    char *lines[] = {"int a;", "/* never closed", "int b;"};
+    SyntaxCheckpoints cp;
+    syntax_checkpoints_init(&cp);
+    ASSERT_EQ(syntax_checkpoints_state_lines(&cp, &def, lines, 3, 0), 0, "First line is outside");
+    ASSERT_EQ(syntax_checkpoints_state_lines(&cp, &def, lines, 3, 2), 1, "Line after the opener is inside");
+    ASSERT_EQ(syntax_checkpoints_state_lines(&cp, &def, lines, 3, 500), 1,
+              "Past the end the state at the end applies");
+    syntax_checkpoints_free(&cp);
+    return true;
+}
+
+bool test_checkpoints_follow_syntax() {
+    SyntaxDef c = c_syntax();
+    SyntaxDef md;
+    memset(&md, 0, sizeof(md));
+    md.block_comment_start = "<!--";
+    md.block_comment_end = "-->";
+    SyntaxDef none;
+    memset(&none, 0, sizeof(none));
+
+    char *lines[] = {"<!-- note", "/* c */", "text", "more"};
+    SyntaxCheckpoints cp;
+    syntax_checkpoints_init(&cp);
+    ASSERT_EQ(syntax_checkpoints_state_lines(&cp, &c, lines, 4, 3), 0, "C sees no open comment");
+    ASSERT_EQ(syntax_checkpoints_state_lines(&cp, &md, lines, 4, 3), 1,
+              "Switching syntax relexes with the new delimiters");
+    ASSERT_EQ(syntax_checkpoints_state_lines(&cp, &none, lines, 4, 3), 0,
+              "No block comments without delimiters");
+    syntax_checkpoints_free(&cp);
+    return true;
+}
+
+bool test_checkpoints_same_delimiters() {
+    SyntaxDef def;
+    memset(&def, 0, sizeof(def));
+    def.block_comment_start = "\"\"\"";
+    def.block_comment_end = "\"\"\"";
+    char *lines[] = {"\"\"\" doc", "still doc", "\"\"\"", "code"};
+    SyntaxCheckpoints cp;
+    syntax_checkpoints_init(&cp);
+    for (int line = 0; line <= 4; line++) {
+        ASSERT_EQ(syntax_checkpoints_state_lines(&cp, &def, lines, 4, line),
+                  get_initial_block_comment_state(lines, 4, line, &def),
+                  "Identical delimiters behave like the backward scan");
+    }
+    syntax_checkpoints_free(&cp);
+    return true;
+}
+
+// Loads `conf` as the only syntax definition, from a temporary HOME.
+static SyntaxDef *load_syntax(const char *conf, const char *filename) {
+    static char home[64];
+    char path[128];
+    strcpy(home, "/tmp/test_syntax_XXXXXX");
+    if (!mkdtemp(home)) return NULL;
+    snprintf(path, sizeof(path), "%s/.cupidfm", home);
+    mkdir(path, 0700);
+    snprintf(path, sizeof(path), "%s/.cupidfm/syntax", home);
+    mkdir(path, 0700);
+    snprintf(path, sizeof(path), "%s/.cupidfm/syntax/test.cupidconf", home);
+    FILE *fp = fopen(path, "w");
+    if (!fp) return NULL;
+    fputs(conf, fp);
+    fclose(fp);
+
+    setenv("HOME", home, 1);
+    syntax_cleanup();
+    syntax_init();
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/.cupidfm/syntax", home);
+    rmdir(path);
+    snprintf(path, sizeof(path), "%s/.cupidfm", home);
+    rmdir(path);
+    rmdir(home);
+    return syntax_get_for_file(filename);
+}
+
+static SyntaxWordKind kind_of(const SyntaxDef *def, const char *word) {
+    return syntax_word_kind(def, word, strlen(word));
+}
+
+bool test_words_lookup() {
+    SyntaxDef *def = load_syntax("extensions = .c\n"
+                                 "keywords = if, else, return,\n"
+                                 "statements = static, const\n"
+                                 "types = int, char, size_t\n"
+                                 "constants = NULL, true\n",
+                                 "main.c");
+    ASSERT_NOT_NULL(def, "Definition should load");
+    ASSERT_EQ(kind_of(def, "return"), SYNTAX_WORD_KEYWORD, "Keyword");
+    ASSERT_EQ(kind_of(def, "static"), SYNTAX_WORD_STATEMENT, "Statement");
+    ASSERT_EQ(kind_of(def, "size_t"), SYNTAX_WORD_TYPE, "Type");
+    ASSERT_EQ(kind_of(def, "NULL"), SYNTAX_WORD_CONSTANT, "Constant");
+    ASSERT_EQ(kind_of(def, "null"), SYNTAX_WORD_NONE, "Lookups are case sensitive");
+    ASSERT_EQ(kind_of(def, "retur"), SYNTAX_WORD_NONE, "Prefixes do not match");
+    ASSERT_EQ(kind_of(def, "returns"), SYNTAX_WORD_NONE, "Longer words do not match");
+    ASSERT_EQ(kind_of(def, ""), SYNTAX_WORD_NONE, "Empty word");
+    ASSERT_EQ(syntax_word_kind(def, "intx", 3), SYNTAX_WORD_TYPE,
+              "Only `len` characters of the word count");
+    syntax_cleanup();
+    return true;
+}
+
+bool test_words_precedence() {
+    SyntaxDef *def = load_syntax("extensions = .x\n"
+                                 "types = bool, thing\n"
+                                 "keywords = thing\n"
+                                 "constants = bool\n",
+                                 "a.x");
+    ASSERT_NOT_NULL(def, "Definition should load");
+    ASSERT_EQ(kind_of(def, "bool"), SYNTAX_WORD_CONSTANT, "Constants win over types");
+    ASSERT_EQ(kind_of(def, "thing"), SYNTAX_WORD_KEYWORD, "Keywords win over types");
+    syntax_cleanup();
+    return true;
+}
+
+// As many words as fit on one line of a syntax file
+#define MANY_WORDS 120
+
+bool test_words_many() {
+    char conf[2048] = "extensions = .big\nkeywords = ";
+    char word[32];
+    for (int i = 0; i < MANY_WORDS; i++) {
+        snprintf(word, sizeof(word), "%sk%d", i ? "," : "", i);
+        strcat(conf, word);
+    }
+    strcat(conf, "\n");
+    SyntaxDef *def = load_syntax(conf, "x.big");
+    ASSERT_NOT_NULL(def, "Definition should load");
+    for (int i = 0; i < MANY_WORDS; i++) {
+        snprintf(word, sizeof(word), "k%d", i);
+        ASSERT_EQ(kind_of(def, word), SYNTAX_WORD_KEYWORD, "Every listed word is found");
+        snprintf(word, sizeof(word), "k%d_", i);
+        ASSERT_EQ(kind_of(def, word), SYNTAX_WORD_NONE, "Unlisted words are not");
+    }
+    syntax_cleanup();
+
+    SyntaxDef bare;
+    memset(&bare, 0, sizeof(bare));
+    ASSERT_EQ(kind_of(&bare, "if"), SYNTAX_WORD_NONE, "A definition without words knows none");
+    return true;
+}
+
+// The spans of a line are contiguous, cover all of it and never repeat an
+// attribute twice in a row.
+static bool spans_well_formed(const SyntaxSpans *spans, const char *line) {
+    int at = 0;
+    for (int i = 0; i < spans->count; i++) {
+        if (spans->spans[i].start != at || spans->spans[i].len <= 0) return false;
+        if (i > 0 && spans->spans[i].attr == spans->spans[i - 1].attr) return false;
+        at += spans->spans[i].len;
+    }
+    return at == (int)strlen(line);
+}
+
+// Attribute the spans give column `col`.
+static attr_t attr_at(const SyntaxSpans *spans, int col) {
+    for (int i = 0; i < spans->count; i++) {
+        if (col >= spans->spans[i].start && col < spans->spans[i].start + spans->spans[i].len) {
+            return spans->spans[i].attr;
+        }
+    }
+    return (attr_t)-1;
+}
+
+bool test_spans_cover_line() {
+    SyntaxDef *def = load_syntax("extensions = .c\n"
+                                 "keywords = return\n"
+                                 "types = int\n"
+                                 "line_comment = //\n"
+                                 "string_delim = \"\n",
+                                 "main.c");
+    ASSERT_NOT_NULL(def, "Definition should load");
+    SyntaxSpans spans = {0};
+    const char *line = "int f(void) { return g(\"a\\n\") + 42; } // done";
+    ASSERT_TRUE(syntax_line_spans(&spans, line, def, NULL), "Line should lex");
+    ASSERT_TRUE(spans_well_formed(&spans, line), "Spans cover the line");
+    ASSERT_EQ(attr_at(&spans, 0), COLOR_PAIR(COLOR_SYNTAX_TYPE), "Type");
+    ASSERT_EQ(attr_at(&spans, 4), COLOR_PAIR(COLOR_SYNTAX_FUNCTION), "Function call");
+    ASSERT_EQ(attr_at(&spans, 14), COLOR_PAIR(COLOR_SYNTAX_KEYWORD) | A_BOLD, "Keyword");
+    ASSERT_EQ(attr_at(&spans, 24), COLOR_PAIR(COLOR_SYNTAX_STRING), "String");
+    ASSERT_EQ(attr_at(&spans, 26), COLOR_PAIR(COLOR_SYNTAX_ESCAPE) | A_BOLD, "Escape");
+    ASSERT_EQ(attr_at(&spans, 32), COLOR_PAIR(COLOR_SYNTAX_NUMBER), "Number");
+    ASSERT_EQ(attr_at(&spans, (int)strlen(line) - 1), COLOR_PAIR(COLOR_SYNTAX_COMMENT),
+              "Line comment runs to the end");
+
+    // Storage is reused for a shorter line, and an empty line has no spans
+    ASSERT_TRUE(syntax_line_spans(&spans, "x;", def, NULL), "Short line should lex");
+    ASSERT_TRUE(spans_well_formed(&spans, "x;"), "Spans cover the short line");
+    ASSERT_TRUE(syntax_line_spans(&spans, "", def, NULL), "Empty line should lex");
+    ASSERT_EQ(spans.count, 0, "Empty line has no spans");
+    syntax_spans_free(&spans);
+    syntax_cleanup();
+    return true;
+}
+
+bool test_spans_comment_state() {
+    SyntaxDef *def = load_syntax("extensions = .c\n"
+                                 "block_comment_start = /*\n"
+                                 "block_comment_end = */\n",
+                                 "main.c");
+    ASSERT_NOT_NULL(def, "Definition should load");
+    SyntaxSpans spans = {0};
+    int state = 0;
+    ASSERT_TRUE(syntax_line_spans(&spans, "a; /* opens", def, &state), "Line should lex");
+    ASSERT_EQ(state, 1, "Comment is still open after the line");
+    ASSERT_EQ(attr_at(&spans, 0), (attr_t)0, "Code before the comment is plain");
+    ASSERT_EQ(attr_at(&spans, 3), COLOR_PAIR(COLOR_SYNTAX_COMMENT), "Comment");
+
+    const char *next = "still */ b;";
+    ASSERT_TRUE(syntax_line_spans(&spans, next, def, &state), "Next line should lex");
+    ASSERT_EQ(state, 0, "Comment closed on the next line");
+    ASSERT_TRUE(spans_well_formed(&spans, next), "Spans cover the next line");
+    ASSERT_EQ(spans.spans[0].len, 8, "Comment runs up to its end delimiter");
+    ASSERT_EQ(attr_at(&spans, 9), (attr_t)0, "Code after the comment is plain");
+
+    ASSERT_FALSE(syntax_line_spans(&spans, next, NULL, &state), "No syntax, no spans");
+    syntax_spans_free(&spans);
+    syntax_cleanup();
+    return true;
+}
+
+int main() {
+    printf("=== Syntax Tests ===\n\n");
+
+    RUN_TEST(test_checkpoints_match_backward_scan);
+    RUN_TEST(test_checkpoints_bound_rescans);
+    RUN_TEST(test_checkpoints_invalidate);
+    RUN_TEST(test_checkpoints_give_up_keeps_progress);
+    RUN_TEST(test_checkpoints_past_end);
+    RUN_TEST(test_checkpoints_follow_syntax);
+    RUN_TEST(test_checkpoints_same_delimiters);
+    RUN_TEST(test_words_lookup);
+    RUN_TEST(test_words_precedence);
+    RUN_TEST(test_words_many);
+    RUN_TEST(test_spans_cover_line);
+    RUN_TEST(test_spans_comment_state);
+
+    PRINT_SUMMARY();
+}
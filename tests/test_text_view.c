@@ -0,0 +1,245 @@
+#define _DEFAULT_SOURCE
+#include "test_runner.h"
+#include "text_view.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Writes `len` bytes to a fresh temp file; the path goes to `path`.
+static bool write_temp(char path[64], const char *data, size_t len) {
+    strcpy(path, "/tmp/test_text_view_XXXXXX");
+    int fd = mkstemp(path);
+    if (fd < 0) return false;
+    bool ok = write(fd, data, len) == (ssize_t)len;
+    close(fd);
+    return ok;
+}
+
+// "line <n>\n" for n in [0, count)
+static char *numbered_lines(size_t count, size_t *len) {
+    char *buf = malloc(count * 16 + 1);
+    size_t off = 0;
+    for (size_t i = 0; i < count; i++) {
+        off += (size_t)sprintf(buf + off, "line %zu\n", i);
+    }
+    *len = off;
+    return buf;
+}
+
+bool test_text_view_empty_file() {
+    char path[64];
+    ASSERT_TRUE(write_temp(path, "", 0), "Temp file should be written");
+    TextView *view = text_view_open(path);
+    ASSERT_NOT_NULL(view, "Empty file should open");
+    ASSERT_FALSE(text_view_has_line(view, 0), "Empty file has no lines");
+    TextViewPos at;
+    ASSERT_FALSE(text_view_seek(view, 0, &at), "Seek into empty file should fail");
+    text_view_close(view);
+    unlink(path);
+    return true;
+}
+
+bool test_text_view_small_file() {
+    char path[64];
+    const char *text = "alpha\nbeta\n\ngamma\n";
+    ASSERT_TRUE(write_temp(path, text, strlen(text)), "Temp file should be written");
+    TextView *view = text_view_open(path);
+    ASSERT_NOT_NULL(view, "File should open");
+
+    const char *expect[] = {"alpha", "beta", "", "gamma"};
+    TextViewPos at;
+    ASSERT_TRUE(text_view_seek(view, 0, &at), "Seek to first line should work");
+    char line[64];
+    size_t len;
+    for (size_t i = 0; i < 4; i++) {
+        ASSERT_TRUE(text_view_next(view, &at, line, sizeof(line), &len), "Line should be read");
+        ASSERT_STR_EQ(line, expect[i], "Line content should match");
+        ASSERT_EQ(len, strlen(expect[i]), "Length should exclude the newline");
+    }
+    ASSERT_FALSE(text_view_next(view, &at, line, sizeof(line), &len), "Trailing newline adds no line");
+    ASSERT_TRUE(text_view_has_line(view, 3), "Fourth line exists");
+    ASSERT_FALSE(text_view_has_line(view, 4), "Fifth line does not");
+    text_view_close(view);
+    unlink(path);
+    return true;
+}
+
+bool test_text_view_no_trailing_newline() {
+    char path[64];
+    const char *text = "one\ntwo";
+    ASSERT_TRUE(write_temp(path, text, strlen(text)), "Temp file should be written");
+    TextView *view = text_view_open(path);
+    ASSERT_NOT_NULL(view, "File should open");
+
+    TextViewPos at;
+    char line[64];
+    ASSERT_TRUE(text_view_seek(view, 1, &at), "Unterminated last line is a line");
+    ASSERT_TRUE(text_view_next(view, &at, line, sizeof(line), NULL), "Last line should be read");
+    ASSERT_STR_EQ(line, "two", "Last line content should match");
+    ASSERT_FALSE(text_view_has_line(view, 2), "Nothing after the last line");
+    text_view_close(view);
+    unlink(path);
+    return true;
+}
+
+bool test_text_view_seek_across_marks() {
+    char path[64];
+    size_t len;
+    const size_t count = 200000; // spans many index marks and read blocks
+    char *text = numbered_lines(count, &len);
+    ASSERT_TRUE(write_temp(path, text, len), "Temp file should be written");
+    free(text);
+    TextView *view = text_view_open(path);
+    ASSERT_NOT_NULL(view, "File should open");
+
+    const size_t probes[] = {count - 1, 0, TEXT_VIEW_MARK_EVERY - 1, TEXT_VIEW_MARK_EVERY,
+                             TEXT_VIEW_MARK_EVERY + 1, 123457, 99999, 5};
+    char line[64];
+    char expect[64];
+    for (size_t i = 0; i < sizeof(probes) / sizeof(probes[0]); i++) {
+        TextViewPos at;
+        ASSERT_TRUE(text_view_seek(view, probes[i], &at), "Seek to an existing line should work");
+        ASSERT_EQ(at.line, probes[i], "Position should name the line");
+        ASSERT_TRUE(text_view_next(view, &at, line, sizeof(line), NULL), "Line should be read");
+        snprintf(expect, sizeof(expect), "line %zu", probes[i]);
+        ASSERT_STR_EQ(line, expect, "Seek should land on the requested line");
+    }
+    ASSERT_TRUE(text_view_has_line(view, count - 1), "Last line exists");
+    ASSERT_FALSE(text_view_has_line(view, count), "No line past the end");
+    text_view_close(view);
+    unlink(path);
+    return true;
+}
+
+bool test_text_view_long_line() {
+    char path[64];
+    const size_t long_len = 300000; // longer than a read block
+    char *text = malloc(long_len + 16);
+    memset(text, 'x', long_len);
+    memcpy(text + long_len, "\nafter\n", 7);
+    ASSERT_TRUE(write_temp(path, text, long_len + 7), "Temp file should be written");
+    free(text);
+    TextView *view = text_view_open(path);
+    ASSERT_NOT_NULL(view, "File should open");
+
+    TextViewPos at;
+    char line[32];
+    size_t len;
+    ASSERT_TRUE(text_view_seek(view, 0, &at), "Seek should work");
+    ASSERT_TRUE(text_view_next(view, &at, line, sizeof(line), &len), "Long line should be read");
+    ASSERT_EQ(len, sizeof(line) - 1, "Long line should be cut to the buffer");
+    ASSERT_EQ((long)at.offset, (long)TEXT_VIEW_LINE_MAX, "Its rest should be the next line");
+
+    size_t pieces = (long_len + TEXT_VIEW_LINE_MAX - 1) / TEXT_VIEW_LINE_MAX;
+    char piece[TEXT_VIEW_LINE_MAX + 1];
+    ASSERT_TRUE(text_view_seek(view, pieces - 1, &at), "Seek to the last piece should work");
+    ASSERT_TRUE(text_view_next(view, &at, piece, sizeof(piece), &len), "Last piece should be read");
+    ASSERT_EQ(len, long_len - (pieces - 1) * TEXT_VIEW_LINE_MAX, "Last piece holds the remainder");
+    ASSERT_TRUE(text_view_next(view, &at, line, sizeof(line), NULL), "Next line should follow it");
+    ASSERT_STR_EQ(line, "after", "Reading should resume after the long line");
+    ASSERT_TRUE(text_view_seek(view, pieces, &at), "Seek past the long line should work");
+    text_view_close(view);
+    unlink(path);
+    return true;
+}
+
+// Bytes this process has read so far, from /proc/self/io.
+static long long bytes_read(void) {
+    FILE *fp = fopen("/proc/self/io", "r");
+    if (!fp) return -1;
+    long long rchar = -1;
+    char key[32];
+    long long value;
+    while (fscanf(fp, "%31[^:]: %lld\n", key, &value) == 2) {
+        if (strcmp(key, "rchar") == 0) rchar = value;
+    }
+    fclose(fp);
+    return rchar;
+}
+
+bool test_text_view_huge_line_reads_little() {
+    char path[64];
+    strcpy(path, "/tmp/test_text_view_XXXXXX");
+    int fd = mkstemp(path);
+    ASSERT_TRUE(fd >= 0, "Temp file should be created");
+    // 32 MiB without a newline
+    char chunk[65536];
+    memset(chunk, 'j', sizeof(chunk));
+    bool written = true;
+    for (int i = 0; i < 512; i++) {
+        written = written && write(fd, chunk, sizeof(chunk)) == (ssize_t)sizeof(chunk);
+    }
+    close(fd);
+    ASSERT_TRUE(written, "Temp file should be written");
+    if (bytes_read() < 0) {
+        unlink(path);
+        return true; // no /proc to count with
+    }
+
+    TextView *view = text_view_open(path);
+    ASSERT_NOT_NULL(view, "File should open");
+    long long before = bytes_read();
+    // A screenful, redrawn a few times
+    for (int redraw = 0; redraw < 5; redraw++) {
+        TextViewPos at;
+        char line[TEXT_VIEW_LINE_MAX];
+        ASSERT_TRUE(text_view_seek(view, 10, &at), "Seek should work");
+        for (int i = 0; i < 40; i++) {
+            ASSERT_TRUE(text_view_next(view, &at, line, sizeof(line), NULL), "Line should be read");
+        }
+    }
+    // Each redraw reads the 50 lines up to the bottom of the screen, give or
+    // take a read block at either end, out of 32 MiB
+    long long read = bytes_read() - before;
+    ASSERT_TRUE(read <= 5 * (50 * TEXT_VIEW_LINE_MAX + 2 * 65536),
+                "Only the bytes on screen should be read");
+    text_view_close(view);
+    unlink(path);
+    return true;
+}
+
+bool test_text_view_change_detection() {
+    char path[64];
+    size_t len;
+    char *text = numbered_lines(1000, &len);
+    ASSERT_TRUE(write_temp(path, text, len), "Temp file should be written");
+    free(text);
+    TextView *view = text_view_open(path);
+    ASSERT_NOT_NULL(view, "File should open");
+
+    struct stat st;
+    ASSERT_EQ(stat(path, &st), 0, "stat should work");
+    ASSERT_TRUE(text_view_matches(view, &st), "Unchanged file should match");
+
+    ASSERT_EQ(truncate(path, 10), 0, "Truncate should work");
+    ASSERT_EQ(stat(path, &st), 0, "stat should work");
+    ASSERT_FALSE(text_view_matches(view, &st), "Truncated file should not match");
+    // Reading the stale view past the new end must fail cleanly.
+    ASSERT_FALSE(text_view_has_line(view, 900), "Lines past the truncation are gone");
+    text_view_close(view);
+    unlink(path);
+    return true;
+}
+
+bool test_text_view_rejects_non_regular() {
+    ASSERT_NULL(text_view_open("/tmp"), "Directories should not open");
+    ASSERT_NULL(text_view_open("/nonexistent/text_view"), "Missing files should not open");
+    return true;
+}
+
+int main() {
+    printf("=== Text View Tests ===\n\n");
+
+    RUN_TEST(test_text_view_empty_file);
+    RUN_TEST(test_text_view_small_file);
+    RUN_TEST(test_text_view_no_trailing_newline);
+    RUN_TEST(test_text_view_seek_across_marks);
+    RUN_TEST(test_text_view_long_line);
+    RUN_TEST(test_text_view_huge_line_reads_little);
+    RUN_TEST(test_text_view_change_detection);
+    RUN_TEST(test_text_view_rejects_non_regular);
+
+    PRINT_SUMMARY();
+}